@@ -0,0 +1,58 @@
+// Global operator new/delete replacements that count heap allocations and
+// bytes, so benchmarks can report allocations/op and bytes/element.
+// Include from exactly one translation unit per benchmark binary.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+
+struct AllocCounters {
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> frees{0};
+    std::atomic<int64_t> live_bytes{0};
+};
+
+inline AllocCounters alloc_counters;
+
+struct AllocSnapshot {
+    uint64_t allocations;
+    int64_t live_bytes;
+
+    static AllocSnapshot take() {
+        return {alloc_counters.allocations.load(std::memory_order_relaxed),
+                alloc_counters.live_bytes.load(std::memory_order_relaxed)};
+    }
+};
+
+// Bytes are what the allocator actually reserved (malloc_usable_size), so
+// size-class rounding shows up in the numbers
+inline void* counted_alloc(std::size_t size) {
+    void* ptr = std::malloc(size == 0 ? 1 : size);
+    if (!ptr) throw std::bad_alloc();
+    alloc_counters.allocations.fetch_add(1, std::memory_order_relaxed);
+    alloc_counters.live_bytes.fetch_add(static_cast<int64_t>(malloc_usable_size(ptr)), std::memory_order_relaxed);
+    return ptr;
+}
+
+inline void counted_free(void* ptr) {
+    if (!ptr) return;
+    alloc_counters.frees.fetch_add(1, std::memory_order_relaxed);
+    alloc_counters.live_bytes.fetch_sub(static_cast<int64_t>(malloc_usable_size(ptr)), std::memory_order_relaxed);
+    std::free(ptr);
+}
+
+void* operator new(std::size_t size) { return counted_alloc(size); }
+void* operator new[](std::size_t size) { return counted_alloc(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try { return counted_alloc(size); } catch (...) { return nullptr; }
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    try { return counted_alloc(size); } catch (...) { return nullptr; }
+}
+void operator delete(void* ptr) noexcept { counted_free(ptr); }
+void operator delete[](void* ptr) noexcept { counted_free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { counted_free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { counted_free(ptr); }
@@ -0,0 +1,237 @@
+// Shared helpers for the BlinkDB benchmark tools: clocks, latency
+// histograms, key distributions and a RESP reply scanner.
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+inline uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Log-linear latency histogram in the spirit of HdrHistogram: values below
+// 2 * SUB_BUCKETS are exact, larger values keep 7 significant bits (< 1% error).
+// Values are recorded in nanoseconds.
+class LatencyHistogram {
+private:
+    static constexpr int SUB_BUCKET_BITS = 7;
+    static constexpr uint64_t SUB_BUCKETS = 1ULL << SUB_BUCKET_BITS;
+    static constexpr int MAX_EXPONENT = 64 - SUB_BUCKET_BITS;
+
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+    uint64_t min_value = UINT64_MAX;
+    uint64_t max_value = 0;
+    long double sum = 0;
+
+    static size_t index_of(uint64_t value) {
+        if (value < SUB_BUCKETS) return static_cast<size_t>(value);
+        int exponent = 63 - __builtin_clzll(value) - (SUB_BUCKET_BITS - 1);
+        uint64_t sub = value >> exponent; // in [SUB_BUCKETS / 2, SUB_BUCKETS)
+        return static_cast<size_t>(exponent) * (SUB_BUCKETS / 2) + sub;
+    }
+
+    // Highest value that maps to the given index
+    static uint64_t value_of(size_t index) {
+        if (index < SUB_BUCKETS) return index;
+        size_t exponent = (index - SUB_BUCKETS / 2) / (SUB_BUCKETS / 2);
+        uint64_t sub = index - exponent * (SUB_BUCKETS / 2);
+        return ((sub + 1) << exponent) - 1;
+    }
+
+public:
+    LatencyHistogram() : counts((MAX_EXPONENT + 1) * (SUB_BUCKETS / 2) + SUB_BUCKETS, 0) {}
+
+    void record(uint64_t value) {
+        counts[index_of(value)]++;
+        total++;
+        sum += value;
+        min_value = std::min(min_value, value);
+        max_value = std::max(max_value, value);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < counts.size(); ++i) counts[i] += other.counts[i];
+        total += other.total;
+        sum += other.sum;
+        min_value = std::min(min_value, other.min_value);
+        max_value = std::max(max_value, other.max_value);
+    }
+
+    uint64_t count() const { return total; }
+    uint64_t min() const { return total ? min_value : 0; }
+    uint64_t max() const { return max_value; }
+    double mean() const { return total ? static_cast<double>(sum / total) : 0.0; }
+
+    // Value at the given percentile (0-100)
+    uint64_t percentile(double pct) const {
+        if (total == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(std::ceil(pct / 100.0 * total));
+        rank = std::max<uint64_t>(rank, 1);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            seen += counts[i];
+            if (seen >= rank) return std::min(value_of(i), max_value);
+        }
+        return max_value;
+    }
+};
+
+// Zipfian rank generator over [0, items) following Gray et al., as used by YCSB.
+// Construction is O(items) to compute the zeta constant.
+class ZipfianGenerator {
+private:
+    uint64_t items;
+    double theta;
+    double zeta_n;
+    double alpha;
+    double eta;
+    std::uniform_real_distribution<double> uniform{0.0, 1.0};
+
+    static double zeta(uint64_t n, double theta) {
+        double sum = 0;
+        for (uint64_t i = 1; i <= n; ++i) sum += 1.0 / std::pow(static_cast<double>(i), theta);
+        return sum;
+    }
+
+public:
+    explicit ZipfianGenerator(uint64_t count, double skew = 0.99)
+        : items(std::max<uint64_t>(count, 1)), theta(skew) {
+        zeta_n = zeta(items, theta);
+        double zeta_2 = zeta(2, theta);
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1 - std::pow(2.0 / items, 1 - theta)) / (1 - zeta_2 / zeta_n);
+    }
+
+    template <typename Rng>
+    uint64_t next(Rng& rng) {
+        double u = uniform(rng);
+        double uz = u * zeta_n;
+        if (uz < 1.0) return 0;
+        if (uz < 1.0 + std::pow(0.5, theta)) return std::min<uint64_t>(1, items - 1);
+        uint64_t rank = static_cast<uint64_t>(items * std::pow(eta * u - eta + 1, alpha));
+        return std::min(rank, items - 1);
+    }
+};
+
+inline uint64_t fnv1a_64(uint64_t value) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < 8; ++i) {
+        hash ^= value & 0xff;
+        hash *= 0x100000001b3ULL;
+        value >>= 8;
+    }
+    return hash;
+}
+
+enum class KeyDistribution {
+    UNIFORM,
+    ZIPFIAN
+};
+
+// Picks key indexes in [0, keyspace). Zipfian ranks are scrambled with FNV so
+// the hot keys are spread over the keyspace instead of being the lowest ids.
+class KeyChooser {
+private:
+    uint64_t keyspace;
+    KeyDistribution distribution;
+    ZipfianGenerator zipf;
+
+public:
+    KeyChooser(uint64_t count, KeyDistribution dist, double theta = 0.99)
+        : keyspace(std::max<uint64_t>(count, 1)), distribution(dist),
+          zipf(dist == KeyDistribution::ZIPFIAN ? count : 1, theta) {}
+
+    template <typename Rng>
+    uint64_t next(Rng& rng) {
+        if (distribution == KeyDistribution::UNIFORM) return rng() % keyspace;
+        return fnv1a_64(zipf.next(rng)) % keyspace;
+    }
+};
+
+// Returns the length of the first complete RESP reply in buf[pos..], or 0 if
+// the buffer does not hold a complete reply yet. Sets is_error for '-' replies.
+inline size_t resp_reply_length(const std::string& buf, size_t pos, bool& is_error) {
+    if (pos >= buf.size()) return 0;
+    size_t line_end = buf.find("\r\n", pos);
+    if (line_end == std::string::npos) return 0;
+    char type = buf[pos];
+    size_t header = line_end + 2 - pos;
+
+    if (type == '+' || type == ':' || type == '-') {
+        is_error = type == '-';
+        return header;
+    }
+    long long count = std::atoll(buf.c_str() + pos + 1);
+    is_error = false;
+    if (type == '$') {
+        if (count < 0) return header;
+        size_t total = header + static_cast<size_t>(count) + 2;
+        return pos + total <= buf.size() ? total : 0;
+    }
+    if (type == '*') {
+        size_t total = header;
+        for (long long i = 0; i < count; ++i) {
+            bool nested_error = false;
+            size_t len = resp_reply_length(buf, pos + total, nested_error);
+            if (len == 0) return 0;
+            total += len;
+        }
+        return total;
+    }
+    // Not RESP: treat the line as a complete reply
+    return header;
+}
+
+// Opens a blocking TCP connection with Nagle disabled; returns -1 on failure
+inline int connect_to(const std::string& host, int port) {
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0) return -1;
+
+    int fd = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+    if (fd != -1 && connect(fd, result->ai_addr, result->ai_addrlen) == -1) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+    if (fd != -1) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+// Writes the whole buffer to a blocking socket; returns false on error
+inline bool write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(fd, data, len);
+        if (written <= 0) return false;
+        data += written;
+        len -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+inline std::string json_escape(const std::string& value) {
+    std::string result;
+    for (char c : value) {
+        if (c == '"' || c == '\\') result += '\\';
+        result += c;
+    }
+    return result;
+}
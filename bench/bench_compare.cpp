@@ -0,0 +1,310 @@
+// blinkdb-bench-compare: performance regression gate.
+//
+//   run      runs the microbenchmarks and a network benchmark against a
+//            freshly started server several times and writes one JSON line
+//            per metric with all samples, tagged with the git revision.
+//   compare  compares two result files. A metric regresses when it is worse
+//            by more than --threshold percent and the 95% confidence interval
+//            of the difference (Welch) excludes zero; the exit status is 1
+//            if any metric regressed.
+#include "bench_common.h"
+
+#include <csignal>
+#include <fcntl.h>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <sys/wait.h>
+
+struct Metric {
+    std::string name;
+    bool higher_is_better = false;
+    std::vector<double> samples;
+};
+
+using MetricSet = std::map<std::string, Metric>;
+
+// Returns the raw text of the first "key": value in a JSON line, or "" if absent
+static std::string json_field(const std::string& line, const std::string& key) {
+    size_t pos = line.find("\"" + key + "\":");
+    if (pos == std::string::npos) return "";
+    pos += key.size() + 3;
+    if (line[pos] == '"') {
+        size_t end = line.find('"', pos + 1);
+        return line.substr(pos + 1, end - pos - 1);
+    }
+    size_t end = line.find_first_of(",}]", pos);
+    return line.substr(pos, end - pos);
+}
+
+static void add_sample(MetricSet& metrics, const std::string& name, double value, bool higher_is_better) {
+    Metric& metric = metrics[name];
+    metric.name = name;
+    metric.higher_is_better = higher_is_better;
+    metric.samples.push_back(value);
+}
+
+static bool run_micro(const std::string& bin_dir, const std::string& args, MetricSet& metrics) {
+    std::string command = bin_dir + "/blinkdb-microbench --json " + args;
+    FILE* pipe = popen(command.c_str(), "r");
+    if (!pipe) return false;
+    char buffer[4096];
+    while (fgets(buffer, sizeof(buffer), pipe)) {
+        std::string line = buffer;
+        std::string benchmark = json_field(line, "benchmark");
+        std::string ns = json_field(line, "ns_per_op");
+        if (benchmark.empty() || ns.empty()) continue;
+        std::string name = "micro/" + benchmark + "/" + json_field(line, "size");
+        add_sample(metrics, name + "/ns_per_op", std::stod(ns), false);
+        std::string bytes = json_field(line, "bytes_per_element");
+        if (!bytes.empty()) add_sample(metrics, name + "/bytes_per_element", std::stod(bytes), false);
+    }
+    return pclose(pipe) == 0;
+}
+
+// Starts a server in a scratch directory, drives it with blinkdb-benchmark and stops it
+static bool run_macro(const std::string& bin_dir, const std::string& args, MetricSet& metrics) {
+    int probe = connect_to("127.0.0.1", 9001);
+    if (probe != -1) {
+        close(probe);
+        std::cerr << "Port 9001 is already in use; stop the running server or pass --no-macro" << std::endl;
+        return false;
+    }
+
+    char scratch[] = "/tmp/blinkdb-bench-XXXXXX";
+    if (!mkdtemp(scratch)) return false;
+    char cwd[4096];
+    std::string server = (bin_dir[0] == '/' || !getcwd(cwd, sizeof(cwd)) ? bin_dir : std::string(cwd) + "/" + bin_dir)
+                       + "/blinkdb";
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (chdir(scratch) != 0 || null_fd == -1) _exit(1);
+        dup2(null_fd, STDOUT_FILENO);
+        execl(server.c_str(), "blinkdb", nullptr);
+        _exit(1);
+    }
+
+    bool ready = false;
+    for (int i = 0; i < 100 && !ready; ++i) {
+        usleep(20000);
+        int fd = connect_to("127.0.0.1", 9001);
+        if (fd != -1) {
+            close(fd);
+            ready = true;
+        }
+    }
+
+    bool ok = false;
+    if (ready) {
+        FILE* pipe = popen((bin_dir + "/blinkdb-benchmark --json " + args).c_str(), "r");
+        std::string output;
+        char buffer[4096];
+        while (pipe && fgets(buffer, sizeof(buffer), pipe)) output += buffer;
+        ok = pipe && pclose(pipe) == 0;
+        std::string ops = json_field(output, "ops_per_sec");
+        if (ok && !ops.empty()) {
+            // The first latency block in the output is the all-commands summary
+            add_sample(metrics, "macro/ops_per_sec", std::stod(ops), true);
+            add_sample(metrics, "macro/p50_us", std::stod(json_field(output, "p50")), false);
+            add_sample(metrics, "macro/p99_us", std::stod(json_field(output, "p99")), false);
+        }
+    }
+
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    std::remove((std::string(scratch) + "/blinkdb_data.txt").c_str());
+    rmdir(scratch);
+    return ok;
+}
+
+static bool write_results(const std::string& path, const std::string& revision, const MetricSet& metrics) {
+    std::ofstream file(path);
+    if (!file.is_open()) return false;
+    for (const auto& [name, metric] : metrics) {
+        file << "{\"revision\":\"" << json_escape(revision) << "\",\"metric\":\"" << json_escape(name)
+             << "\",\"higher_is_better\":" << (metric.higher_is_better ? "true" : "false") << ",\"samples\":[";
+        for (size_t i = 0; i < metric.samples.size(); ++i) {
+            file << (i ? "," : "") << std::setprecision(10) << metric.samples[i];
+        }
+        file << "]}\n";
+    }
+    return true;
+}
+
+static bool read_results(const std::string& path, MetricSet& metrics, std::string& revision) {
+    std::ifstream file(path);
+    if (!file.is_open()) return false;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::string name = json_field(line, "metric");
+        if (name.empty()) continue;
+        revision = json_field(line, "revision");
+        Metric& metric = metrics[name];
+        metric.name = name;
+        metric.higher_is_better = json_field(line, "higher_is_better") == "true";
+        size_t open = line.find('[', line.find("\"samples\""));
+        std::istringstream samples(line.substr(open + 1, line.find(']', open) - open - 1));
+        std::string value;
+        while (std::getline(samples, value, ',')) metric.samples.push_back(std::stod(value));
+    }
+    return true;
+}
+
+static double mean(const std::vector<double>& values) {
+    double sum = 0;
+    for (double value : values) sum += value;
+    return values.empty() ? 0 : sum / values.size();
+}
+
+static double variance(const std::vector<double>& values) {
+    if (values.size() < 2) return 0;
+    double m = mean(values);
+    double sum = 0;
+    for (double value : values) sum += (value - m) * (value - m);
+    return sum / (values.size() - 1);
+}
+
+// Two-sided 95% Student t critical value
+static double t_critical(double degrees_of_freedom) {
+    static const double table[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                   2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                   2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    if (degrees_of_freedom < 1) return table[0];
+    if (degrees_of_freedom > 30) return 1.96;
+    return table[static_cast<int>(degrees_of_freedom) - 1];
+}
+
+static int compare(const std::string& baseline_path, const std::string& current_path, double threshold) {
+    MetricSet baseline, current;
+    std::string baseline_revision, current_revision;
+    if (!read_results(baseline_path, baseline, baseline_revision) || !read_results(current_path, current, current_revision)) {
+        std::cerr << "Failed to read results" << std::endl;
+        return 2;
+    }
+
+    std::cout << "baseline " << baseline_revision << " vs current " << current_revision
+              << " (threshold " << threshold << "%, 95% CI)\n"
+              << std::left << std::setw(48) << "metric" << std::right << std::setw(14) << "baseline"
+              << std::setw(14) << "current" << std::setw(10) << "change%" << std::setw(18) << "95% CI%" << "  verdict\n";
+
+    int regressions = 0;
+    for (const auto& [name, base] : baseline) {
+        auto it = current.find(name);
+        if (it == current.end()) continue;
+        const Metric& now = it->second;
+
+        double base_mean = mean(base.samples);
+        double now_mean = mean(now.samples);
+        if (base_mean == 0) continue;
+        // Welch: standard error and Welch-Satterthwaite degrees of freedom
+        double base_se = variance(base.samples) / base.samples.size();
+        double now_se = variance(now.samples) / now.samples.size();
+        double se = std::sqrt(base_se + now_se);
+        double df_denominator = (base.samples.size() > 1 ? base_se * base_se / (base.samples.size() - 1) : 0) +
+                                (now.samples.size() > 1 ? now_se * now_se / (now.samples.size() - 1) : 0);
+        double df = df_denominator > 0 ? std::pow(base_se + now_se, 2) / df_denominator : 0;
+        double margin = t_critical(df) * se;
+
+        // Express everything as percent change where positive means worse
+        double sign = base.higher_is_better ? -1 : 1;
+        double change = sign * 100.0 * (now_mean - base_mean) / base_mean;
+        double ci_low = change - 100.0 * margin / base_mean;
+        double ci_high = change + 100.0 * margin / base_mean;
+
+        std::string verdict = "ok";
+        if (ci_low > 0 && change > threshold) {
+            verdict = "REGRESSION";
+            regressions++;
+        } else if (ci_high < 0 && -change > threshold) {
+            verdict = "improved";
+        } else if (ci_low <= 0 && ci_high >= 0) {
+            verdict = "~";
+        }
+
+        std::ostringstream ci;
+        ci << std::fixed << std::setprecision(1) << "[" << ci_low << ", " << ci_high << "]";
+        std::cout << std::left << std::setw(48) << name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(14) << base_mean << std::setw(14) << now_mean << std::setprecision(1)
+                  << std::setw(10) << change << std::setw(18) << ci.str() << "  " << verdict << "\n";
+    }
+
+    std::cout << (regressions ? std::to_string(regressions) + " regression(s) above threshold" : "no regressions")
+              << std::endl;
+    return regressions ? 1 : 0;
+}
+
+static void usage() {
+    std::cerr <<
+        "Usage: blinkdb-bench-compare run [--runs N] [--revision REV] [--out FILE] [--bin-dir DIR]\n"
+        "                                 [--micro-args ARGS] [--macro-args ARGS] [--no-macro]\n"
+        "       blinkdb-bench-compare compare BASELINE CURRENT [--threshold PCT]\n";
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        usage();
+        return 2;
+    }
+    std::string mode = argv[1];
+
+    if (mode == "compare") {
+        if (argc < 4) {
+            usage();
+            return 2;
+        }
+        double threshold = 5;
+        for (int i = 4; i + 1 < argc; i += 2) {
+            if (std::string(argv[i]) == "--threshold") threshold = std::stod(argv[i + 1]);
+        }
+        return compare(argv[2], argv[3], threshold);
+    }
+    if (mode != "run") {
+        usage();
+        return 2;
+    }
+
+    int runs = 5;
+    std::string revision = "unknown";
+    std::string out = "bench-results.jsonl";
+    std::string bin_dir = ".";
+    std::string micro_args = "--min-time 50 --max-size 10000";
+    std::string macro_args = "--requests 200000 --connections 8 --threads 2 --pipeline 16";
+    bool macro = true;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--no-macro") { macro = false; continue; }
+        if (i + 1 >= argc) { usage(); return 2; }
+        std::string value = argv[++i];
+        if (arg == "--runs") runs = std::max(1, std::stoi(value));
+        else if (arg == "--revision") revision = value;
+        else if (arg == "--out") out = value;
+        else if (arg == "--bin-dir") bin_dir = value;
+        else if (arg == "--micro-args") micro_args = value;
+        else if (arg == "--macro-args") macro_args = value;
+        else { usage(); return 2; }
+    }
+
+    MetricSet metrics;
+    for (int run = 1; run <= runs; ++run) {
+        std::cerr << "run " << run << "/" << runs << std::endl;
+        if (!run_micro(bin_dir, micro_args, metrics)) {
+            std::cerr << "Microbenchmarks failed" << std::endl;
+            return 2;
+        }
+        if (macro && !run_macro(bin_dir, macro_args, metrics)) {
+            std::cerr << "Network benchmark failed" << std::endl;
+            return 2;
+        }
+    }
+
+    if (!write_results(out, revision, metrics)) {
+        std::cerr << "Failed to write " << out << std::endl;
+        return 2;
+    }
+    std::cerr << "wrote " << metrics.size() << " metrics for " << revision << " to " << out << std::endl;
+    return 0;
+}
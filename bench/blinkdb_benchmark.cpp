@@ -0,0 +1,425 @@
+// blinkdb-benchmark: multi-threaded load generator for a BlinkDB server.
+//
+// Each worker thread drives its share of the connections with poll(). In the
+// default closed-loop mode every connection keeps `pipeline` requests in
+// flight. With --rate the load is open-loop: requests are scheduled at fixed
+// intervals and latency is measured from the scheduled send time, so queueing
+// behind a slow reply is counted (no coordinated omission).
+#include "bench_common.h"
+
+#include <atomic>
+#include <deque>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <poll.h>
+#include <sstream>
+#include <thread>
+
+// Commands the generator knows how to build
+enum class BenchCommand {
+    SET, GET, LPUSH, RPUSH, LPOP, RPOP, LRANGE, SADD, SISMEMBER, HSET, HGET, PING, COUNT
+};
+
+static const char* command_names[] = {
+    "set", "get", "lpush", "rpush", "lpop", "rpop", "lrange", "sadd", "sismember", "hset", "hget", "ping"
+};
+
+struct BenchConfig {
+    std::string host = "127.0.0.1";
+    int port = 9001;
+    int connections = 50;
+    int threads = 4;
+    uint64_t requests = 100000;
+    double duration_sec = 0;
+    int pipeline = 1;
+    uint64_t keyspace = 100000;
+    size_t value_size = 3;
+    KeyDistribution distribution = KeyDistribution::UNIFORM;
+    double zipf_theta = 0.99;
+    double rate = 0; // total requests per second, 0 = closed loop
+    bool json = false;
+    std::vector<std::pair<BenchCommand, double>> mix = {{BenchCommand::SET, 1}, {BenchCommand::GET, 1}};
+};
+
+struct CommandStats {
+    LatencyHistogram latency;
+    uint64_t errors = 0;
+};
+
+struct ThreadResult {
+    CommandStats commands[static_cast<int>(BenchCommand::COUNT)];
+};
+
+struct Pending {
+    BenchCommand command;
+    uint64_t start_ns;
+};
+
+struct Connection {
+    int fd = -1;
+    std::string input;
+    std::string output;
+    std::deque<Pending> in_flight;
+    uint64_t next_send_ns = 0;
+};
+
+static void usage() {
+    std::cerr <<
+        "Usage: blinkdb-benchmark [options]\n"
+        "  --host HOST            server host (default 127.0.0.1)\n"
+        "  --port PORT            server port (default 9001)\n"
+        "  --connections N        total connections (default 50)\n"
+        "  --threads N            worker threads (default 4)\n"
+        "  --requests N           total requests (default 100000)\n"
+        "  --duration SEC         run for a fixed time instead of a request count\n"
+        "  --pipeline N           requests in flight per connection (default 1)\n"
+        "  --keyspace N           number of distinct keys (default 100000)\n"
+        "  --value-size N         value size in bytes (default 3)\n"
+        "  --distribution D       uniform or zipfian (default uniform)\n"
+        "  --zipf-theta T         zipfian skew (default 0.99)\n"
+        "  --rate N               open-loop pacing at N requests/sec in total\n"
+        "  --mix CMD:W,...        command mix weights (default set:1,get:1)\n"
+        "                         commands: set get lpush rpush lpop rpop lrange\n"
+        "                                   sadd sismember hset hget ping\n"
+        "  --json                 print results as JSON\n";
+}
+
+static bool parse_mix(const std::string& spec, std::vector<std::pair<BenchCommand, double>>& mix) {
+    mix.clear();
+    std::istringstream iss(spec);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        size_t colon = item.find(':');
+        std::string name = item.substr(0, colon);
+        double weight = colon == std::string::npos ? 1.0 : std::stod(item.substr(colon + 1));
+        auto it = std::find_if(std::begin(command_names), std::end(command_names),
+                               [&name](const char* candidate) { return name == candidate; });
+        if (it == std::end(command_names)) {
+            std::cerr << "Unknown command in mix: " << name << std::endl;
+            return false;
+        }
+        mix.emplace_back(static_cast<BenchCommand>(it - std::begin(command_names)), weight);
+    }
+    return !mix.empty();
+}
+
+static bool parse_args(int argc, char** argv, BenchConfig& config) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--json") {
+            config.json = true;
+            continue;
+        }
+        if (arg == "--help" || i + 1 >= argc) return false;
+        std::string value = argv[++i];
+        if (arg == "--host") config.host = value;
+        else if (arg == "--port") config.port = std::stoi(value);
+        else if (arg == "--connections") config.connections = std::stoi(value);
+        else if (arg == "--threads") config.threads = std::stoi(value);
+        else if (arg == "--requests") config.requests = std::stoull(value);
+        else if (arg == "--duration") config.duration_sec = std::stod(value);
+        else if (arg == "--pipeline") config.pipeline = std::stoi(value);
+        else if (arg == "--keyspace") config.keyspace = std::stoull(value);
+        else if (arg == "--value-size") config.value_size = std::stoul(value);
+        else if (arg == "--zipf-theta") config.zipf_theta = std::stod(value);
+        else if (arg == "--rate") config.rate = std::stod(value);
+        else if (arg == "--mix") {
+            if (!parse_mix(value, config.mix)) return false;
+        } else if (arg == "--distribution") {
+            if (value == "uniform") config.distribution = KeyDistribution::UNIFORM;
+            else if (value == "zipfian") config.distribution = KeyDistribution::ZIPFIAN;
+            else return false;
+        } else {
+            return false;
+        }
+    }
+    config.threads = std::max(1, std::min(config.threads, config.connections));
+    config.pipeline = std::max(1, config.pipeline);
+    return config.connections > 0;
+}
+
+static std::string build_command(BenchCommand command, uint64_t key, const std::string& value, std::mt19937_64& rng) {
+    std::string id = std::to_string(key);
+    switch (command) {
+        case BenchCommand::SET: return "SET bench:str:" + id + " " + value + "\r\n";
+        case BenchCommand::GET: return "GET bench:str:" + id + "\r\n";
+        case BenchCommand::LPUSH: return "LPUSH bench:list:" + id + " " + value + "\r\n";
+        case BenchCommand::RPUSH: return "RPUSH bench:list:" + id + " " + value + "\r\n";
+        case BenchCommand::LPOP: return "LPOP bench:list:" + id + "\r\n";
+        case BenchCommand::RPOP: return "RPOP bench:list:" + id + "\r\n";
+        case BenchCommand::LRANGE: return "LRANGE bench:list:" + id + " 0 9\r\n";
+        case BenchCommand::SADD: return "SADD bench:set:" + id + " m" + std::to_string(rng() % 1000) + "\r\n";
+        case BenchCommand::SISMEMBER: return "SISMEMBER bench:set:" + id + " m" + std::to_string(rng() % 1000) + "\r\n";
+        case BenchCommand::HSET: return "HSET bench:hash:" + id + " f" + std::to_string(rng() % 16) + " " + value + "\r\n";
+        case BenchCommand::HGET: return "HGET bench:hash:" + id + " f" + std::to_string(rng() % 16) + "\r\n";
+        default: return "PING\r\n";
+    }
+}
+
+class Worker {
+private:
+    const BenchConfig& config;
+    std::vector<Connection> connections;
+    std::atomic<uint64_t>& issued;
+    uint64_t deadline_ns;
+    uint64_t interval_ns;
+    std::mt19937_64 rng;
+    KeyChooser keys;
+    std::discrete_distribution<int> mix;
+    std::string value;
+
+    // Claims one request from the global budget
+    bool claim_request() {
+        if (deadline_ns != 0) return now_ns() < deadline_ns;
+        return issued.fetch_add(1, std::memory_order_relaxed) < config.requests;
+    }
+
+    void queue_request(Connection& conn, uint64_t start_ns) {
+        BenchCommand command = config.mix[mix(rng)].first;
+        conn.output += build_command(command, keys.next(rng), value, rng);
+        conn.in_flight.push_back({command, start_ns});
+    }
+
+    bool flush(Connection& conn) {
+        while (!conn.output.empty()) {
+            ssize_t written = write(conn.fd, conn.output.data(), conn.output.size());
+            if (written < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+            conn.output.erase(0, static_cast<size_t>(written));
+        }
+        return true;
+    }
+
+    bool read_replies(Connection& conn, ThreadResult& result) {
+        char buffer[16384];
+        ssize_t bytes;
+        while ((bytes = read(conn.fd, buffer, sizeof(buffer))) > 0) {
+            conn.input.append(buffer, static_cast<size_t>(bytes));
+        }
+        if (bytes == 0 || (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) return false;
+
+        size_t pos = 0;
+        uint64_t now = now_ns();
+        while (!conn.in_flight.empty()) {
+            bool is_error = false;
+            size_t len = resp_reply_length(conn.input, pos, is_error);
+            if (len == 0) break;
+            pos += len;
+            Pending pending = conn.in_flight.front();
+            conn.in_flight.pop_front();
+            CommandStats& stats = result.commands[static_cast<int>(pending.command)];
+            stats.latency.record(now - pending.start_ns);
+            if (is_error) stats.errors++;
+        }
+        conn.input.erase(0, pos);
+        return true;
+    }
+
+public:
+    Worker(const BenchConfig& cfg, int connection_count, std::atomic<uint64_t>& issued_count, uint64_t seed)
+        : config(cfg), connections(connection_count), issued(issued_count), deadline_ns(0),
+          interval_ns(0), rng(seed), keys(cfg.keyspace, cfg.distribution, cfg.zipf_theta),
+          value(cfg.value_size, 'x') {
+        std::vector<double> weights;
+        for (const auto& entry : cfg.mix) weights.push_back(entry.second);
+        mix = std::discrete_distribution<int>(weights.begin(), weights.end());
+        if (cfg.rate > 0) {
+            interval_ns = static_cast<uint64_t>(1e9 * cfg.connections / cfg.rate);
+        }
+    }
+
+    // With a deadline the run is time based and the request budget is ignored
+    void set_deadline(uint64_t deadline) {
+        deadline_ns = deadline;
+    }
+
+    bool connect_all() {
+        uint64_t start = now_ns();
+        for (size_t i = 0; i < connections.size(); ++i) {
+            Connection& conn = connections[i];
+            conn.fd = connect_to(config.host, config.port);
+            if (conn.fd == -1) return false;
+            fcntl(conn.fd, F_SETFL, fcntl(conn.fd, F_GETFL, 0) | O_NONBLOCK);
+            // Stagger open-loop schedules so connections do not fire in lockstep
+            conn.next_send_ns = start + (interval_ns * i) / std::max<size_t>(connections.size(), 1);
+        }
+        return true;
+    }
+
+    void run(ThreadResult& result) {
+        std::vector<pollfd> fds(connections.size());
+        bool generating = true;
+
+        while (true) {
+            uint64_t now = now_ns();
+            size_t outstanding = 0;
+            uint64_t next_wakeup = now + 100000000;
+
+            for (size_t i = 0; i < connections.size(); ++i) {
+                Connection& conn = connections[i];
+                if (generating && interval_ns == 0) {
+                    while (conn.in_flight.size() < static_cast<size_t>(config.pipeline)) {
+                        if (!claim_request()) { generating = false; break; }
+                        queue_request(conn, now);
+                    }
+                } else if (generating) {
+                    // Open loop: issue every request whose scheduled time has passed
+                    while (conn.next_send_ns <= now) {
+                        if (!claim_request()) { generating = false; break; }
+                        queue_request(conn, conn.next_send_ns);
+                        conn.next_send_ns += interval_ns;
+                    }
+                    next_wakeup = std::min(next_wakeup, conn.next_send_ns);
+                }
+                if (!flush(conn)) return;
+                outstanding += conn.in_flight.size();
+                fds[i] = {conn.fd, static_cast<short>(POLLIN | (conn.output.empty() ? 0 : POLLOUT)), 0};
+            }
+
+            if (!generating && outstanding == 0) return;
+
+            // ppoll gives the open-loop schedule sub-millisecond wakeups without spinning
+            uint64_t wait_ns = next_wakeup - std::min(next_wakeup, now_ns());
+            timespec timeout{static_cast<time_t>(wait_ns / 1000000000), static_cast<long>(wait_ns % 1000000000)};
+            ppoll(fds.data(), fds.size(), &timeout, nullptr);
+            for (size_t i = 0; i < connections.size(); ++i) {
+                if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) && !read_replies(connections[i], result)) {
+                    std::cerr << "Connection closed by server" << std::endl;
+                    return;
+                }
+            }
+        }
+    }
+
+    ~Worker() {
+        for (auto& conn : connections) {
+            if (conn.fd != -1) close(conn.fd);
+        }
+    }
+};
+
+static void print_text(const BenchConfig& config, const ThreadResult& totals, double elapsed_sec) {
+    LatencyHistogram all;
+    uint64_t errors = 0;
+    for (const auto& stats : totals.commands) {
+        all.merge(stats.latency);
+        errors += stats.errors;
+    }
+
+    std::cout << "connections: " << config.connections << ", threads: " << config.threads
+              << ", pipeline: " << config.pipeline << ", keyspace: " << config.keyspace
+              << ", value size: " << config.value_size
+              << ", mode: " << (config.rate > 0 ? "open-loop" : "closed-loop") << "\n";
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "total: " << all.count() << " requests in " << elapsed_sec << " s, "
+              << all.count() / elapsed_sec << " ops/sec, " << errors << " errors\n\n";
+
+    auto row = [](const std::string& name, const LatencyHistogram& h, uint64_t errs, double secs) {
+        std::cout << std::left << std::setw(10) << name << std::right
+                  << std::setw(12) << h.count() << std::setw(14) << h.count() / secs
+                  << std::setw(8) << errs;
+        for (double pct : {50.0, 90.0, 99.0, 99.9, 99.99}) {
+            std::cout << std::setw(11) << h.percentile(pct) / 1000.0;
+        }
+        std::cout << std::setw(11) << h.max() / 1000.0 << "\n";
+    };
+
+    std::cout << std::left << std::setw(10) << "command" << std::right << std::setw(12) << "requests"
+              << std::setw(14) << "ops/sec" << std::setw(8) << "errors"
+              << std::setw(11) << "p50 us" << std::setw(11) << "p90 us" << std::setw(11) << "p99 us"
+              << std::setw(11) << "p99.9 us" << std::setw(11) << "p99.99 us" << std::setw(11) << "max us" << "\n";
+    for (int i = 0; i < static_cast<int>(BenchCommand::COUNT); ++i) {
+        if (totals.commands[i].latency.count() == 0) continue;
+        row(command_names[i], totals.commands[i].latency, totals.commands[i].errors, elapsed_sec);
+    }
+    row("all", all, errors, elapsed_sec);
+}
+
+static void print_json(const BenchConfig& config, const ThreadResult& totals, double elapsed_sec) {
+    auto latency_json = [](const LatencyHistogram& h) {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(3)
+            << "{\"min\":" << h.min() / 1000.0 << ",\"mean\":" << h.mean() / 1000.0
+            << ",\"p50\":" << h.percentile(50) / 1000.0 << ",\"p90\":" << h.percentile(90) / 1000.0
+            << ",\"p99\":" << h.percentile(99) / 1000.0 << ",\"p99_9\":" << h.percentile(99.9) / 1000.0
+            << ",\"p99_99\":" << h.percentile(99.99) / 1000.0 << ",\"max\":" << h.max() / 1000.0 << "}";
+        return out.str();
+    };
+
+    LatencyHistogram all;
+    uint64_t errors = 0;
+    std::ostringstream commands;
+    bool first = true;
+    for (int i = 0; i < static_cast<int>(BenchCommand::COUNT); ++i) {
+        const CommandStats& stats = totals.commands[i];
+        all.merge(stats.latency);
+        errors += stats.errors;
+        if (stats.latency.count() == 0) continue;
+        commands << (first ? "" : ",") << "\"" << command_names[i] << "\":{\"requests\":" << stats.latency.count()
+                 << ",\"errors\":" << stats.errors << ",\"ops_per_sec\":" << std::fixed << std::setprecision(2)
+                 << stats.latency.count() / elapsed_sec << ",\"latency_us\":" << latency_json(stats.latency) << "}";
+        first = false;
+    }
+
+    std::cout << std::fixed << std::setprecision(2)
+              << "{\"config\":{\"host\":\"" << json_escape(config.host) << "\",\"port\":" << config.port
+              << ",\"connections\":" << config.connections << ",\"threads\":" << config.threads
+              << ",\"pipeline\":" << config.pipeline << ",\"keyspace\":" << config.keyspace
+              << ",\"value_size\":" << config.value_size
+              << ",\"distribution\":\"" << (config.distribution == KeyDistribution::UNIFORM ? "uniform" : "zipfian")
+              << "\",\"rate\":" << config.rate << "},"
+              << "\"elapsed_sec\":" << elapsed_sec << ",\"requests\":" << all.count() << ",\"errors\":" << errors
+              << ",\"ops_per_sec\":" << all.count() / elapsed_sec << ",\"latency_us\":" << latency_json(all)
+              << ",\"commands\":{" << commands.str() << "}}" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    if (!parse_args(argc, argv, config)) {
+        usage();
+        return 1;
+    }
+
+    std::atomic<uint64_t> issued{0};
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<ThreadResult> results(config.threads);
+
+    for (int t = 0; t < config.threads; ++t) {
+        int count = config.connections / config.threads + (t < config.connections % config.threads ? 1 : 0);
+        workers.push_back(std::make_unique<Worker>(config, count, issued, 0x9e3779b97f4a7c15ULL * (t + 1)));
+        if (!workers.back()->connect_all()) {
+            std::cerr << "Failed to connect to " << config.host << ":" << config.port << std::endl;
+            return 1;
+        }
+    }
+
+    uint64_t start = now_ns();
+    if (config.duration_sec > 0) {
+        uint64_t deadline = start + static_cast<uint64_t>(config.duration_sec * 1e9);
+        for (auto& worker : workers) {
+            worker->set_deadline(deadline);
+        }
+    }
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < config.threads; ++t) {
+        threads.emplace_back([&, t] { workers[t]->run(results[t]); });
+    }
+    for (auto& thread : threads) thread.join();
+    double elapsed_sec = (now_ns() - start) / 1e9;
+
+    ThreadResult totals;
+    for (const auto& result : results) {
+        for (int i = 0; i < static_cast<int>(BenchCommand::COUNT); ++i) {
+            totals.commands[i].latency.merge(result.commands[i].latency);
+            totals.commands[i].errors += result.commands[i].errors;
+        }
+    }
+
+    if (config.json) {
+        print_json(config, totals, elapsed_sec);
+    } else {
+        print_text(config, totals, elapsed_sec);
+    }
+    return 0;
+}
@@ -0,0 +1,175 @@
+// Memory-efficiency benchmark: fills an engine with N keys of one type and
+// element count, then reports allocator-measured bytes per key and per
+// element and the overhead ratio against the raw payload (key and element
+// bytes). The total is broken down into the keyspace table and values
+// (`store`), LRUCache bookkeeping and the BloomFilter.
+#include "../lib/blinkdb_internal.h"
+
+#include "alloc_counter.h"
+#include "bench_common.h"
+
+#include <iomanip>
+
+struct MemoryConfig {
+    uint64_t keys = 100000;
+    size_t value_size = 16;
+    std::string type_filter;
+    bool json = false;
+};
+
+struct Shape {
+    ValueType type;
+    size_t elements;
+};
+
+static const Shape shapes[] = {
+    {ValueType::STRING, 1},
+    {ValueType::LIST, 1}, {ValueType::LIST, 16}, {ValueType::LIST, 256},
+    {ValueType::SET, 1}, {ValueType::SET, 16}, {ValueType::SET, 256},
+    {ValueType::HASH, 1}, {ValueType::HASH, 16}, {ValueType::HASH, 256},
+};
+
+struct MemoryResult {
+    uint64_t payload_bytes = 0;
+    int64_t engine_bytes = 0;
+    int64_t store_bytes = 0;
+    int64_t lru_bytes = 0;
+};
+
+static std::string element(const std::string& prefix, size_t index, size_t size) {
+    std::string value = prefix + std::to_string(index);
+    value.resize(std::max(size, value.size()), 'v');
+    return value;
+}
+
+// Applies one key's elements through `insert(member, value)` and returns the payload bytes
+template <typename Insert>
+static uint64_t fill_key(const Shape& shape, size_t value_size, Insert insert) {
+    uint64_t payload = 0;
+    for (size_t e = 0; e < shape.elements; ++e) {
+        std::string member = element("m", e, value_size);
+        std::string value = shape.type == ValueType::HASH ? element("v", e, value_size) : "";
+        insert(member, value);
+        payload += member.size() + value.size();
+    }
+    return payload;
+}
+
+static MemoryResult measure(const Shape& shape, const MemoryConfig& config) {
+    MemoryResult result;
+    std::vector<std::string> keys;
+    keys.reserve(config.keys);
+    for (uint64_t i = 0; i < config.keys; ++i) keys.push_back("key:" + std::to_string(i));
+
+    // Whole engine: everything a running server would hold for this keyspace
+    {
+        AllocSnapshot before = AllocSnapshot::take();
+        auto db = std::make_unique<BlinkDBEngine>("");
+        for (const auto& key : keys) {
+            result.payload_bytes += key.size();
+            result.payload_bytes += fill_key(shape, config.value_size, [&](const std::string& member, const std::string& value) {
+                switch (shape.type) {
+                    case ValueType::STRING: db->set(key, member); break;
+                    case ValueType::LIST: db->rpush(key, member); break;
+                    case ValueType::SET: db->sadd(key, member); break;
+                    case ValueType::HASH: db->hset(key, member, value); break;
+                }
+            });
+        }
+        result.engine_bytes = AllocSnapshot::take().live_bytes - before.live_bytes + sizeof(BlinkDBEngine);
+    }
+
+    // The keyspace table and values on their own, built the way BlinkDB builds them
+    {
+        AllocSnapshot before = AllocSnapshot::take();
+        std::unordered_map<std::string, std::unique_ptr<DataType>> store;
+        for (const auto& key : keys) {
+            std::unique_ptr<DataType> entry;
+            switch (shape.type) {
+                case ValueType::STRING: break;
+                case ValueType::LIST: entry = std::make_unique<ListType>(); break;
+                case ValueType::SET: entry = std::make_unique<SetType>(); break;
+                case ValueType::HASH: entry = std::make_unique<HashType>(); break;
+            }
+            fill_key(shape, config.value_size, [&](const std::string& member, const std::string& value) {
+                switch (shape.type) {
+                    // SET replaces the whole value, which keeps the string's capacity exact
+                    case ValueType::STRING: entry = std::make_unique<StringType>(member); break;
+                    case ValueType::LIST: static_cast<ListType*>(entry.get())->rpush(member); break;
+                    case ValueType::SET: static_cast<SetType*>(entry.get())->sadd(member); break;
+                    case ValueType::HASH: static_cast<HashType*>(entry.get())->hset(member, value); break;
+                }
+            });
+            store[key] = std::move(entry);
+        }
+        result.store_bytes = AllocSnapshot::take().live_bytes - before.live_bytes;
+    }
+
+    // LRU bookkeeping is capped at CACHE_SIZE tracked keys
+    {
+        AllocSnapshot before = AllocSnapshot::take();
+        LRUCache cache(blinkdb_config::CACHE_SIZE);
+        for (const auto& key : keys) cache.access(key);
+        result.lru_bytes = AllocSnapshot::take().live_bytes - before.live_bytes;
+    }
+    return result;
+}
+
+int main(int argc, char** argv) {
+    MemoryConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--json") config.json = true;
+        else if (arg == "--keys" && i + 1 < argc) config.keys = std::max<uint64_t>(1, std::stoull(argv[++i]));
+        else if (arg == "--value-size" && i + 1 < argc) config.value_size = std::stoul(argv[++i]);
+        else if (arg == "--type" && i + 1 < argc) config.type_filter = argv[++i];
+        else {
+            std::cerr << "Usage: blinkdb-memory-bench [--keys N] [--value-size N] [--type string|list|set|hash] [--json]"
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    // The Bloom filter is a fixed bitset inside BlinkDB, so its cost does not grow with keys
+    size_t bloom_bytes = sizeof(BloomFilter);
+
+    if (!config.json) {
+        std::cout << "keys: " << config.keys << ", element size: " << config.value_size
+                  << ", bloom filter: " << bloom_bytes << " bytes fixed\n"
+                  << std::left << std::setw(8) << "type" << std::right << std::setw(10) << "elements"
+                  << std::setw(14) << "bytes/key" << std::setw(14) << "bytes/elem" << std::setw(14) << "payload/key"
+                  << std::setw(12) << "overhead" << std::setw(14) << "store/key" << std::setw(12) << "lru/key"
+                  << std::setw(14) << "other/key" << std::endl;
+    }
+
+    for (const Shape& shape : shapes) {
+        std::string type = value_type_name(shape.type);
+        if (!config.type_filter.empty() && config.type_filter != type) continue;
+        MemoryResult result = measure(shape, config);
+
+        double keys = static_cast<double>(config.keys);
+        double per_key = result.engine_bytes / keys;
+        double per_element = result.engine_bytes / (keys * shape.elements);
+        double payload_per_key = result.payload_bytes / keys;
+        double overhead = result.payload_bytes ? static_cast<double>(result.engine_bytes) / result.payload_bytes : 0;
+        // Hot key tracking, lock statistics and the engine object itself
+        double other = (result.engine_bytes - result.store_bytes - result.lru_bytes) / keys;
+
+        if (config.json) {
+            std::cout << std::fixed << std::setprecision(2)
+                      << "{\"type\":\"" << type << "\",\"elements\":" << shape.elements
+                      << ",\"keys\":" << config.keys << ",\"element_size\":" << config.value_size
+                      << ",\"bytes_per_key\":" << per_key << ",\"bytes_per_element\":" << per_element
+                      << ",\"payload_per_key\":" << payload_per_key << ",\"overhead_ratio\":" << overhead
+                      << ",\"store_bytes\":" << result.store_bytes << ",\"lru_bytes\":" << result.lru_bytes
+                      << ",\"bloom_bytes\":" << bloom_bytes << ",\"other_per_key\":" << other << "}" << std::endl;
+        } else {
+            std::cout << std::fixed << std::setprecision(1) << std::left << std::setw(8) << type << std::right
+                      << std::setw(10) << shape.elements << std::setw(14) << per_key << std::setw(14) << per_element
+                      << std::setw(14) << payload_per_key << std::setprecision(2) << std::setw(11) << overhead << "x"
+                      << std::setprecision(1) << std::setw(14) << result.store_bytes / keys
+                      << std::setw(12) << result.lru_bytes / keys << std::setw(14) << other << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,284 @@
+// In-process microbenchmarks for the BlinkDB data types, LRUCache,
+// BloomFilter and the BlinkDB engine API. No sockets are involved, so
+// engine-level regressions show up separately from network noise.
+//
+// Every benchmark reports ns/op and allocations/op; footprint benchmarks
+// also report the allocator-measured bytes per element.
+#include "../lib/blinkdb_internal.h"
+
+#include "alloc_counter.h"
+#include "bench_common.h"
+
+#include <iomanip>
+
+struct MicroResult {
+    std::string name;
+    uint64_t size;
+    uint64_t iterations;
+    double ns_per_op;
+    double allocs_per_op;
+    double bytes_per_element; // negative when not measured
+};
+
+template <typename T>
+inline void do_not_optimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+class MicroBench {
+private:
+    double min_time_ns;
+    std::string filter;
+    bool json;
+
+    void report(const MicroResult& result) {
+        if (json) {
+            std::cout << "{\"benchmark\":\"" << json_escape(result.name) << "\",\"size\":" << result.size
+                      << ",\"iterations\":" << result.iterations << std::fixed << std::setprecision(2)
+                      << ",\"ns_per_op\":" << result.ns_per_op << ",\"allocs_per_op\":" << result.allocs_per_op;
+            if (result.bytes_per_element >= 0) std::cout << ",\"bytes_per_element\":" << result.bytes_per_element;
+            std::cout << "}" << std::endl;
+            return;
+        }
+        std::cout << std::left << std::setw(28) << result.name << std::right << std::setw(10) << result.size
+                  << std::setw(12) << result.iterations << std::fixed << std::setprecision(1)
+                  << std::setw(14) << result.ns_per_op << std::setprecision(2) << std::setw(12) << result.allocs_per_op;
+        if (result.bytes_per_element >= 0) {
+            std::cout << std::setprecision(1) << std::setw(14) << result.bytes_per_element;
+        }
+        std::cout << std::endl;
+    }
+
+public:
+    MicroBench(double min_time_ms, const std::string& name_filter, bool json_output)
+        : min_time_ns(min_time_ms * 1e6), filter(name_filter), json(json_output) {
+        if (!json) {
+            std::cout << std::left << std::setw(28) << "benchmark" << std::right << std::setw(10) << "size"
+                      << std::setw(12) << "iterations" << std::setw(14) << "ns/op" << std::setw(12) << "allocs/op"
+                      << std::setw(14) << "bytes/elem" << std::endl;
+        }
+    }
+
+    bool enabled(const std::string& name) const {
+        return filter.empty() || name.find(filter) != std::string::npos;
+    }
+
+    // Runs op(i) in growing batches until the minimum time or max_iterations is reached
+    template <typename Op>
+    void run(const std::string& name, uint64_t size, uint64_t max_iterations, Op op) {
+        if (!enabled(name)) return;
+        uint64_t done = 0;
+        uint64_t batch = 1;
+        uint64_t elapsed = 0;
+        AllocSnapshot before = AllocSnapshot::take();
+        while (done < max_iterations && elapsed < min_time_ns) {
+            batch = std::min(batch, max_iterations - done);
+            uint64_t start = now_ns();
+            for (uint64_t i = 0; i < batch; ++i) op(done + i);
+            elapsed += now_ns() - start;
+            done += batch;
+            batch *= 2;
+        }
+        AllocSnapshot after = AllocSnapshot::take();
+        report({name, size, done, static_cast<double>(elapsed) / done,
+                static_cast<double>(after.allocations - before.allocations) / done, -1});
+    }
+
+    // Times build(), which must create `elements` elements in an object it
+    // keeps alive, and reports ns and live heap bytes per element
+    template <typename Build>
+    void footprint(const std::string& name, uint64_t elements, Build build) {
+        if (!enabled(name)) return;
+        AllocSnapshot before = AllocSnapshot::take();
+        uint64_t start = now_ns();
+        auto keep_alive = build();
+        uint64_t elapsed = now_ns() - start;
+        AllocSnapshot after = AllocSnapshot::take();
+        do_not_optimize(keep_alive);
+        report({name, elements, elements, static_cast<double>(elapsed) / elements,
+                static_cast<double>(after.allocations - before.allocations) / elements,
+                static_cast<double>(after.live_bytes - before.live_bytes) / elements});
+    }
+
+    // Reports a single named metric that is not a timing
+    void metric(const std::string& name, uint64_t size, const std::string& metric_name, double value) {
+        if (!enabled(name)) return;
+        if (json) {
+            std::cout << "{\"benchmark\":\"" << json_escape(name) << "\",\"size\":" << size << std::fixed
+                      << std::setprecision(4) << ",\"" << metric_name << "\":" << value << "}" << std::endl;
+        } else {
+            std::cout << std::left << std::setw(28) << name << std::right << std::setw(10) << size << "  "
+                      << metric_name << " = " << std::fixed << std::setprecision(4) << value << std::endl;
+        }
+    }
+};
+
+static std::vector<std::string> make_keys(const std::string& prefix, uint64_t count) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    for (uint64_t i = 0; i < count; ++i) keys.push_back(prefix + std::to_string(i));
+    return keys;
+}
+
+static void bench_strings(MicroBench& bench) {
+    for (size_t value_size : {16, 1024}) {
+        std::string value(value_size, 'v');
+        StringType string_value;
+        bench.run("string/set", value_size, UINT64_MAX, [&](uint64_t) { string_value.set(value); });
+        bench.run("string/get", value_size, UINT64_MAX, [&](uint64_t) { do_not_optimize(string_value.get()); });
+    }
+}
+
+static void bench_lists(MicroBench& bench, uint64_t max_size) {
+    std::string value(16, 'v');
+    for (uint64_t size = 10; size <= max_size; size *= 100) {
+        if (!bench.enabled("list/lpush+rpop") && !bench.enabled("list/rpush+lpop")
+            && !bench.enabled("list/lindex") && !bench.enabled("list/lrange_10")) break;
+        ListType list;
+        for (uint64_t i = 0; i < size; ++i) list.rpush(value);
+        // lpush followed by rpop keeps the list at `size` elements
+        bench.run("list/lpush+rpop", size, UINT64_MAX, [&](uint64_t) {
+            list.lpush(value);
+            do_not_optimize(list.rpop());
+        });
+        bench.run("list/rpush+lpop", size, UINT64_MAX, [&](uint64_t) {
+            list.rpush(value);
+            do_not_optimize(list.lpop());
+        });
+        bench.run("list/lindex", size, UINT64_MAX, [&](uint64_t i) {
+            do_not_optimize(list.lindex(static_cast<int>(i % size)));
+        });
+        bench.run("list/lrange_10", size, UINT64_MAX, [&](uint64_t) { do_not_optimize(list.lrange(0, 9)); });
+    }
+    for (uint64_t size : {1000ULL, 1000000ULL}) {
+        if (size > max_size) break;
+        bench.footprint("list/footprint", size, [&] {
+            auto list = std::make_unique<ListType>();
+            for (uint64_t i = 0; i < size; ++i) list->rpush(value);
+            return list;
+        });
+    }
+}
+
+static void bench_sets(MicroBench& bench, uint64_t max_size) {
+    for (uint64_t size : {100ULL, 100000ULL, 1000000ULL}) {
+        if (size > max_size) break;
+        std::vector<std::string> members = make_keys("member:", size);
+        std::vector<std::string> misses = make_keys("absent:", 1024);
+        SetType set;
+        for (const auto& member : members) set.sadd(member);
+        bench.run("set/sismember_hit", size, UINT64_MAX, [&](uint64_t i) {
+            do_not_optimize(set.sismember(members[i % size]));
+        });
+        bench.run("set/sismember_miss", size, UINT64_MAX, [&](uint64_t i) {
+            do_not_optimize(set.sismember(misses[i % misses.size()]));
+        });
+        bench.footprint("set/footprint", size, [&] {
+            auto built = std::make_unique<SetType>();
+            for (const auto& member : members) built->sadd(member);
+            return built;
+        });
+    }
+}
+
+static void bench_hashes(MicroBench& bench, uint64_t max_size) {
+    std::string value(16, 'v');
+    for (uint64_t size : {100ULL, 100000ULL}) {
+        if (size > max_size) break;
+        std::vector<std::string> fields = make_keys("field:", size);
+        HashType hash;
+        for (const auto& field : fields) hash.hset(field, value);
+        bench.run("hash/hset_existing", size, UINT64_MAX, [&](uint64_t i) { hash.hset(fields[i % size], value); });
+        bench.run("hash/hget", size, UINT64_MAX, [&](uint64_t i) { do_not_optimize(hash.hget(fields[i % size])); });
+        bench.footprint("hash/footprint", size, [&] {
+            auto built = std::make_unique<HashType>();
+            for (const auto& field : fields) built->hset(field, value);
+            return built;
+        });
+    }
+}
+
+static void bench_lru(MicroBench& bench) {
+    std::vector<std::string> keys = make_keys("key:", 100000);
+    LRUCache cache(blinkdb_config::CACHE_SIZE);
+    for (size_t i = 0; i < blinkdb_config::CACHE_SIZE; ++i) cache.access(keys[i]);
+    bench.run("lru/access_hit", blinkdb_config::CACHE_SIZE, UINT64_MAX, [&](uint64_t i) { cache.access(keys[i % blinkdb_config::CACHE_SIZE]); });
+    bench.run("lru/access_evict", blinkdb_config::CACHE_SIZE, UINT64_MAX, [&](uint64_t i) { cache.access(keys[i % keys.size()]); });
+    bench.footprint("lru/footprint", blinkdb_config::CACHE_SIZE, [&] {
+        auto built = std::make_unique<LRUCache>(blinkdb_config::CACHE_SIZE);
+        for (size_t i = 0; i < blinkdb_config::CACHE_SIZE; ++i) built->access(keys[i]);
+        return built;
+    });
+}
+
+static void bench_bloom(MicroBench& bench) {
+    std::vector<std::string> keys = make_keys("key:", 100000);
+    std::vector<std::string> absent = make_keys("absent:", 100000);
+    BloomFilter filter;
+    bench.run("bloom/add", 0, UINT64_MAX, [&](uint64_t i) { filter.add(keys[i % keys.size()]); });
+    bench.run("bloom/contains", 0, UINT64_MAX, [&](uint64_t i) { do_not_optimize(filter.contains(absent[i % absent.size()])); });
+
+    // False positive rate as the number of inserted keys grows
+    for (uint64_t count : {100ULL, 1000ULL, 10000ULL, 100000ULL}) {
+        BloomFilter fresh;
+        for (uint64_t i = 0; i < count; ++i) fresh.add(keys[i]);
+        uint64_t false_positives = 0;
+        for (const auto& key : absent) false_positives += fresh.contains(key) ? 1 : 0;
+        bench.metric("bloom/fpr", count, "false_positive_rate", static_cast<double>(false_positives) / absent.size());
+    }
+}
+
+static void bench_engine(MicroBench& bench, uint64_t max_size) {
+    uint64_t size = std::min<uint64_t>(100000, max_size);
+    std::vector<std::string> keys = make_keys("key:", size);
+    std::vector<std::string> misses = make_keys("absent:", 1024);
+    std::string value(16, 'v');
+    BlinkDBEngine db("");
+    bench.run("engine/set", size, UINT64_MAX, [&](uint64_t i) { db.set(keys[i % size], value); });
+    bench.run("engine/get_hit", size, UINT64_MAX, [&](uint64_t i) { do_not_optimize(db.get(keys[i % size])); });
+    bench.run("engine/get_miss", size, UINT64_MAX, [&](uint64_t i) { do_not_optimize(db.get(misses[i % misses.size()])); });
+    bench.run("engine/hset", size, UINT64_MAX, [&](uint64_t i) { db.hset("hash:" + std::to_string(i % 1000), keys[i % size], value); });
+    bench.run("engine/lpush+rpop", 1, UINT64_MAX, [&](uint64_t) {
+        db.lpush("list", value);
+        do_not_optimize(db.rpop("list"));
+    });
+    bench.footprint("engine/footprint", size, [&] {
+        auto built = std::make_unique<BlinkDBEngine>("");
+        for (const auto& key : keys) built->set(key, value);
+        return built;
+    });
+}
+
+int main(int argc, char** argv) {
+    double min_time_ms = 200;
+    uint64_t max_size = 10000000;
+    std::string filter;
+    bool json = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--json") json = true;
+        else if (arg == "--min-time" && i + 1 < argc) min_time_ms = std::stod(argv[++i]);
+        else if (arg == "--max-size" && i + 1 < argc) max_size = std::stoull(argv[++i]);
+        else if (arg == "--filter" && i + 1 < argc) filter = argv[++i];
+        else if (arg == "--huge-pages" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            HugePageArena::set_mode(mode == "thp" ? HugePageArena::Mode::THP
+                                    : mode == "hugetlb" ? HugePageArena::Mode::HUGETLB : HugePageArena::Mode::OFF);
+        } else {
+            std::cerr << "Usage: blinkdb-microbench [--filter NAME] [--min-time MS] [--max-size N]"
+                      << " [--huge-pages off|thp|hugetlb] [--json]" << std::endl;
+            return 1;
+        }
+    }
+
+    MicroBench bench(min_time_ms, filter, json);
+    bench_strings(bench);
+    bench_lists(bench, max_size);
+    bench_sets(bench, max_size);
+    bench_hashes(bench, max_size);
+    bench_lru(bench);
+    bench_bloom(bench);
+    bench_engine(bench, max_size);
+    return 0;
+}
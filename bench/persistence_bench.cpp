@@ -0,0 +1,219 @@
+// Persistence benchmark: generates a synthetic keyspace, then times snapshot
+// save and load and reports MB/s, keys/s, file size and peak RSS.
+//
+// Each phase runs in a forked child so the peak RSS reported for a load is
+// the memory needed to rebuild the dataset, not what the generator held.
+#include "../lib/blinkdb.h"
+
+#include "bench_common.h"
+
+#include <iomanip>
+#include <iostream>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+struct DatasetConfig {
+    uint64_t keys = 1000000;
+    size_t value_size = 32;
+    // Relative weights of the value types
+    double string_weight = 70;
+    double hash_weight = 20;
+    double list_weight = 5;
+    double set_weight = 5;
+    size_t small_elements = 4;
+    size_t large_elements = 1000;
+    double large_fraction = 0.001;
+    std::string file = "persistence_bench.dat";
+    bool json = false;
+};
+
+struct PhaseResult {
+    double seconds = 0;
+    uint64_t keys = 0;
+    long peak_rss_kb = 0;
+    bool ok = false;
+};
+
+// A snapshot format under test. New persistence paths are added here; `open`
+// is what a restart does: build an engine from the snapshot at `file`.
+struct PersistencePath {
+    const char* name;
+    void (*save)(BlinkDB& db);
+    std::unique_ptr<BlinkDB> (*open)(const std::string& file);
+};
+
+static const PersistencePath persistence_paths[] = {
+    {"text",
+     [](BlinkDB& db) { db.save_to_disk(); },
+     [](const std::string& file) { return std::make_unique<BlinkDB>(file); }},
+};
+
+static void populate(BlinkDB& db, const DatasetConfig& config) {
+    std::mt19937_64 rng(42);
+    std::discrete_distribution<int> type_choice({config.string_weight, config.hash_weight,
+                                                 config.list_weight, config.set_weight});
+    std::bernoulli_distribution large(config.large_fraction);
+    std::string value(config.value_size, 'v');
+
+    for (uint64_t i = 0; i < config.keys; ++i) {
+        std::string key = "key:" + std::to_string(i);
+        size_t elements = large(rng) ? config.large_elements : config.small_elements;
+        switch (type_choice(rng)) {
+            case 0:
+                db.set(key, value);
+                break;
+            case 1:
+                for (size_t e = 0; e < elements; ++e) db.hset(key, "field" + std::to_string(e), value);
+                break;
+            case 2:
+                for (size_t e = 0; e < elements; ++e) db.rpush(key, value);
+                break;
+            default:
+                for (size_t e = 0; e < elements; ++e) db.sadd(key, "member" + std::to_string(e));
+                break;
+        }
+    }
+}
+
+// Runs phase() in a child process and collects its timing and peak RSS
+template <typename Phase>
+static PhaseResult run_in_child(Phase phase) {
+    int fds[2];
+    if (pipe(fds) == -1) return {};
+    // Otherwise the child may flush a copy of pending output
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        PhaseResult result = phase();
+        result.ok = true;
+        write_all(fds[1], reinterpret_cast<const char*>(&result), sizeof(result));
+        // Skip destructors: BlinkDB would save the snapshot again on exit
+        _exit(0);
+    }
+    close(fds[1]);
+    PhaseResult result;
+    ssize_t bytes = read(fds[0], &result, sizeof(result));
+    close(fds[0]);
+
+    int status = 0;
+    struct rusage usage {};
+    wait4(pid, &status, 0, &usage);
+    if (bytes != sizeof(result)) return {};
+    result.peak_rss_kb = usage.ru_maxrss;
+    return result;
+}
+
+static bool parse_args(int argc, char** argv, DatasetConfig& config) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--json") {
+            config.json = true;
+            continue;
+        }
+        if (i + 1 >= argc) return false;
+        std::string value = argv[++i];
+        if (arg == "--keys") config.keys = std::stoull(value);
+        else if (arg == "--value-size") config.value_size = std::stoul(value);
+        else if (arg == "--small-elements") config.small_elements = std::stoul(value);
+        else if (arg == "--large-elements") config.large_elements = std::stoul(value);
+        else if (arg == "--large-fraction") config.large_fraction = std::stod(value);
+        else if (arg == "--file") config.file = value;
+        else if (arg == "--mix") {
+            // string:W,hash:W,list:W,set:W
+            config.string_weight = config.hash_weight = config.list_weight = config.set_weight = 0;
+            std::istringstream iss(value);
+            std::string item;
+            while (std::getline(iss, item, ',')) {
+                size_t colon = item.find(':');
+                if (colon == std::string::npos) return false;
+                std::string type = item.substr(0, colon);
+                double weight = std::stod(item.substr(colon + 1));
+                if (type == "string") config.string_weight = weight;
+                else if (type == "hash") config.hash_weight = weight;
+                else if (type == "list") config.list_weight = weight;
+                else if (type == "set") config.set_weight = weight;
+                else return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    DatasetConfig config;
+    if (!parse_args(argc, argv, config)) {
+        std::cerr << "Usage: blinkdb-persistence-bench [--keys N] [--value-size N]\n"
+                     "         [--mix string:W,hash:W,list:W,set:W] [--small-elements N]\n"
+                     "         [--large-elements N] [--large-fraction F] [--file PATH] [--json]" << std::endl;
+        return 1;
+    }
+
+    if (!config.json) {
+        std::cout << "keys: " << config.keys << ", value size: " << config.value_size
+                  << ", mix string/hash/list/set: " << config.string_weight << "/" << config.hash_weight
+                  << "/" << config.list_weight << "/" << config.set_weight
+                  << ", elements small/large: " << config.small_elements << "/" << config.large_elements
+                  << " (" << config.large_fraction * 100 << "% large)" << std::endl;
+    }
+
+    bool first = true;
+    if (config.json) std::cout << "[";
+    for (const PersistencePath& path : persistence_paths) {
+        std::remove(config.file.c_str());
+
+        PhaseResult save = run_in_child([&] {
+            BlinkDB db(config.file);
+            populate(db, config);
+            uint64_t start = now_ns();
+            path.save(db);
+            return PhaseResult{(now_ns() - start) / 1e9, config.keys, 0, true};
+        });
+
+        struct stat file_stat {};
+        stat(config.file.c_str(), &file_stat);
+        double file_mb = file_stat.st_size / (1024.0 * 1024.0);
+
+        PhaseResult load = run_in_child([&] {
+            uint64_t start = now_ns();
+            std::unique_ptr<BlinkDB> db = path.open(config.file);
+            double seconds = (now_ns() - start) / 1e9;
+            return PhaseResult{seconds, db->dbsize(), 0, true};
+        });
+
+        if (!save.ok || !load.ok) {
+            std::cerr << "Benchmark phase failed for " << path.name << std::endl;
+            return 1;
+        }
+
+        if (config.json) {
+            std::cout << (first ? "" : ",") << std::fixed << std::setprecision(3)
+                      << "{\"path\":\"" << path.name << "\",\"keys\":" << config.keys
+                      << ",\"file_mb\":" << file_mb
+                      << ",\"save_sec\":" << save.seconds << ",\"save_mb_per_sec\":" << file_mb / save.seconds
+                      << ",\"save_keys_per_sec\":" << config.keys / save.seconds
+                      << ",\"load_sec\":" << load.seconds << ",\"load_mb_per_sec\":" << file_mb / load.seconds
+                      << ",\"load_keys_per_sec\":" << load.keys / load.seconds
+                      << ",\"loaded_keys\":" << load.keys
+                      << ",\"save_peak_rss_mb\":" << save.peak_rss_kb / 1024.0
+                      << ",\"load_peak_rss_mb\":" << load.peak_rss_kb / 1024.0 << "}";
+        } else {
+            std::cout << std::fixed << std::setprecision(2)
+                      << "[" << path.name << "] file: " << file_mb << " MB\n"
+                      << "  save: " << save.seconds << " s, " << file_mb / save.seconds << " MB/s, "
+                      << config.keys / save.seconds << " keys/s\n"
+                      << "  load: " << load.seconds << " s, " << file_mb / load.seconds << " MB/s, "
+                      << load.keys / load.seconds << " keys/s, " << load.keys << " keys loaded\n"
+                      << "  peak RSS: " << save.peak_rss_kb / 1024.0 << " MB while saving, "
+                      << load.peak_rss_kb / 1024.0 << " MB while loading" << std::endl;
+        }
+        first = false;
+    }
+    if (config.json) std::cout << "]" << std::endl;
+
+    std::remove(config.file.c_str());
+    return 0;
+}
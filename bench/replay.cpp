@@ -0,0 +1,321 @@
+// blinkdb-replay: re-drives a server with traffic recorded by CAPTURE START.
+//
+// Every captured connection gets its own socket. Commands that arrived in one
+// read on the original connection are sent as one pipelined write; the next
+// batch goes out at its recorded time (scaled by --speed) but never before
+// the previous batch's replies are in, so per-connection ordering and the
+// client's request/reply dependencies are preserved. With --compare the same
+// capture is replayed against a second server and latencies are diffed.
+#include "bench_common.h"
+
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <poll.h>
+#include <sstream>
+#include <fcntl.h>
+
+// Must match the server's TrafficCapture format
+#define CAPTURE_MAGIC "BLINKCAP"
+#define CAPTURE_VERSION 1
+
+struct CaptureRecord {
+    uint64_t time_us;
+    uint64_t connection;
+    bool pipelined;
+    std::string command;
+};
+
+struct Batch {
+    uint64_t time_us;
+    std::vector<std::string> commands;
+};
+
+struct Pending {
+    std::string name;
+    uint64_t start_ns;
+};
+
+struct ReplayConnection {
+    int fd = -1;
+    std::vector<Batch> batches;
+    size_t next = 0;
+    std::string input;
+    std::string output;
+    std::deque<Pending> in_flight;
+};
+
+struct ReplayResult {
+    std::map<std::string, LatencyHistogram> commands;
+    LatencyHistogram all;
+    uint64_t errors = 0;
+    double elapsed_sec = 0;
+};
+
+static bool read_varint(const std::string& data, size_t& pos, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; pos < data.size() && shift < 64; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(data[pos++]);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+static bool load_capture(const std::string& path, std::vector<CaptureRecord>& records) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    size_t pos = strlen(CAPTURE_MAGIC);
+    uint64_t version = 0;
+    if (data.compare(0, pos, CAPTURE_MAGIC) != 0 || !read_varint(data, pos, version) || version != CAPTURE_VERSION) {
+        return false;
+    }
+
+    uint64_t time_us = 0;
+    while (pos < data.size()) {
+        uint64_t delta, tagged_connection, length;
+        if (!read_varint(data, pos, delta) || !read_varint(data, pos, tagged_connection) ||
+            !read_varint(data, pos, length) || pos + length > data.size()) {
+            return false;
+        }
+        time_us += delta;
+        records.push_back({time_us, tagged_connection >> 1, (tagged_connection & 1) != 0, data.substr(pos, length)});
+        pos += length;
+    }
+    return true;
+}
+
+static std::string command_name(const std::string& command) {
+    std::string name = command.substr(0, command.find(' '));
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    return name;
+}
+
+// Groups records into per-connection batches, dropping the CAPTURE commands themselves
+static std::map<uint64_t, std::vector<Batch>> build_batches(const std::vector<CaptureRecord>& records) {
+    std::map<uint64_t, std::vector<Batch>> connections;
+    for (const CaptureRecord& record : records) {
+        if (command_name(record.command) == "capture") continue;
+        std::vector<Batch>& batches = connections[record.connection];
+        if (!record.pipelined || batches.empty()) batches.push_back({record.time_us, {}});
+        batches.back().commands.push_back(record.command);
+    }
+    return connections;
+}
+
+static bool replay(const std::map<uint64_t, std::vector<Batch>>& captured, const std::string& host, int port,
+                   double speed, ReplayResult& result) {
+    std::vector<ReplayConnection> connections;
+    for (const auto& [id, batches] : captured) {
+        ReplayConnection conn;
+        conn.fd = connect_to(host, port);
+        if (conn.fd == -1) {
+            std::cerr << "Failed to connect to " << host << ":" << port << std::endl;
+            for (auto& open : connections) close(open.fd);
+            return false;
+        }
+        fcntl(conn.fd, F_SETFL, fcntl(conn.fd, F_GETFL, 0) | O_NONBLOCK);
+        conn.batches = batches;
+        connections.push_back(std::move(conn));
+    }
+
+    std::vector<pollfd> fds(connections.size());
+    uint64_t start = now_ns();
+    bool ok = true;
+    while (ok) {
+        uint64_t now = now_ns();
+        uint64_t next_wakeup = now + 100000000;
+        bool busy = false;
+
+        for (size_t i = 0; i < connections.size(); ++i) {
+            ReplayConnection& conn = connections[i];
+            if (conn.in_flight.empty() && conn.next < conn.batches.size()) {
+                const Batch& batch = conn.batches[conn.next];
+                uint64_t due = speed > 0 ? start + static_cast<uint64_t>(batch.time_us * 1000 / speed) : now;
+                if (due <= now) {
+                    for (const std::string& command : batch.commands) {
+                        conn.output += command + "\r\n";
+                        conn.in_flight.push_back({command_name(command), now});
+                    }
+                    conn.next++;
+                } else {
+                    next_wakeup = std::min(next_wakeup, due);
+                }
+            }
+            while (!conn.output.empty()) {
+                ssize_t written = write(conn.fd, conn.output.data(), conn.output.size());
+                if (written < 0) {
+                    ok = errno == EAGAIN || errno == EWOULDBLOCK;
+                    break;
+                }
+                conn.output.erase(0, static_cast<size_t>(written));
+            }
+            busy = busy || !conn.in_flight.empty() || conn.next < conn.batches.size();
+            fds[i] = {conn.fd, static_cast<short>(POLLIN | (conn.output.empty() ? 0 : POLLOUT)), 0};
+        }
+        if (!busy) break;
+
+        uint64_t wait_ns = next_wakeup - std::min(next_wakeup, now_ns());
+        timespec timeout{static_cast<time_t>(wait_ns / 1000000000), static_cast<long>(wait_ns % 1000000000)};
+        ppoll(fds.data(), fds.size(), &timeout, nullptr);
+
+        for (size_t i = 0; i < connections.size() && ok; ++i) {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            ReplayConnection& conn = connections[i];
+            char buffer[16384];
+            ssize_t bytes;
+            while ((bytes = read(conn.fd, buffer, sizeof(buffer))) > 0) conn.input.append(buffer, bytes);
+            if (bytes == 0 || (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                std::cerr << "Connection closed by server" << std::endl;
+                ok = false;
+                break;
+            }
+
+            size_t pos = 0;
+            uint64_t received = now_ns();
+            while (!conn.in_flight.empty()) {
+                bool is_error = false;
+                size_t len = resp_reply_length(conn.input, pos, is_error);
+                if (len == 0) break;
+                pos += len;
+                const Pending& pending = conn.in_flight.front();
+                result.commands[pending.name].record(received - pending.start_ns);
+                result.all.record(received - pending.start_ns);
+                if (is_error) result.errors++;
+                conn.in_flight.pop_front();
+            }
+            conn.input.erase(0, pos);
+        }
+    }
+    result.elapsed_sec = (now_ns() - start) / 1e9;
+
+    for (auto& conn : connections) close(conn.fd);
+    return ok;
+}
+
+static void print_result(const std::string& target, const ReplayResult& result) {
+    std::cout << std::fixed << std::setprecision(2)
+              << "[" << target << "] " << result.all.count() << " commands in " << result.elapsed_sec << " s, "
+              << result.all.count() / result.elapsed_sec << " ops/sec, " << result.errors << " errors\n"
+              << std::left << std::setw(12) << "command" << std::right << std::setw(10) << "count"
+              << std::setw(11) << "p50 us" << std::setw(11) << "p99 us" << std::setw(11) << "p99.9 us"
+              << std::setw(11) << "max us" << "\n";
+    auto row = [](const std::string& name, const LatencyHistogram& h) {
+        std::cout << std::left << std::setw(12) << name << std::right << std::setw(10) << h.count()
+                  << std::setw(11) << h.percentile(50) / 1000.0 << std::setw(11) << h.percentile(99) / 1000.0
+                  << std::setw(11) << h.percentile(99.9) / 1000.0 << std::setw(11) << h.max() / 1000.0 << "\n";
+    };
+    for (const auto& [name, histogram] : result.commands) row(name, histogram);
+    row("all", result.all);
+}
+
+static void print_comparison(const ReplayResult& base, const ReplayResult& other) {
+    auto delta = [](uint64_t before, uint64_t after) {
+        return before ? 100.0 * (static_cast<double>(after) - before) / before : 0.0;
+    };
+    std::cout << "\n" << std::left << std::setw(12) << "command" << std::right
+              << std::setw(11) << "p50 base" << std::setw(11) << "p50 cmp" << std::setw(10) << "delta%"
+              << std::setw(11) << "p99 base" << std::setw(11) << "p99 cmp" << std::setw(10) << "delta%" << "\n";
+    auto row = [&](const std::string& name, const LatencyHistogram& a, const LatencyHistogram& b) {
+        std::cout << std::left << std::setw(12) << name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(11) << a.percentile(50) / 1000.0 << std::setw(11) << b.percentile(50) / 1000.0
+                  << std::setw(10) << delta(a.percentile(50), b.percentile(50))
+                  << std::setw(11) << a.percentile(99) / 1000.0 << std::setw(11) << b.percentile(99) / 1000.0
+                  << std::setw(10) << delta(a.percentile(99), b.percentile(99)) << "\n";
+    };
+    for (const auto& [name, histogram] : base.commands) {
+        auto it = other.commands.find(name);
+        if (it != other.commands.end()) row(name, histogram, it->second);
+    }
+    row("all", base.all, other.all);
+}
+
+static void print_json(const std::string& target, const ReplayResult& result, bool first) {
+    auto latency_json = [](const LatencyHistogram& h) {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(3) << "{\"count\":" << h.count()
+            << ",\"p50\":" << h.percentile(50) / 1000.0 << ",\"p99\":" << h.percentile(99) / 1000.0
+            << ",\"p99_9\":" << h.percentile(99.9) / 1000.0 << ",\"max\":" << h.max() / 1000.0 << "}";
+        return out.str();
+    };
+    std::cout << (first ? "" : ",") << std::fixed << std::setprecision(2)
+              << "{\"target\":\"" << json_escape(target) << "\",\"elapsed_sec\":" << result.elapsed_sec
+              << ",\"errors\":" << result.errors << ",\"latency_us\":" << latency_json(result.all) << ",\"commands\":{";
+    bool first_command = true;
+    for (const auto& [name, histogram] : result.commands) {
+        std::cout << (first_command ? "" : ",") << "\"" << json_escape(name) << "\":" << latency_json(histogram);
+        first_command = false;
+    }
+    std::cout << "}}";
+}
+
+static bool parse_target(const std::string& spec, std::string& host, int& port) {
+    size_t colon = spec.rfind(':');
+    if (colon == std::string::npos) return false;
+    host = spec.substr(0, colon);
+    port = std::stoi(spec.substr(colon + 1));
+    return true;
+}
+
+int main(int argc, char** argv) {
+    std::string file;
+    std::string host = "127.0.0.1";
+    int port = 9001;
+    std::string compare_host;
+    int compare_port = 0;
+    double speed = 1.0;
+    bool json = false;
+    bool valid = true;
+
+    for (int i = 1; i < argc && valid; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--json") json = true;
+        else if (arg == "--host" && i + 1 < argc) host = argv[++i];
+        else if (arg == "--port" && i + 1 < argc) port = std::stoi(argv[++i]);
+        else if (arg == "--speed" && i + 1 < argc) speed = std::stod(argv[++i]);
+        else if (arg == "--compare" && i + 1 < argc) valid = parse_target(argv[++i], compare_host, compare_port);
+        else if (arg[0] != '-' && file.empty()) file = arg;
+        else valid = false;
+    }
+    if (!valid || file.empty()) {
+        std::cerr << "Usage: blinkdb-replay FILE [--host HOST] [--port PORT] [--compare HOST:PORT]\n"
+                     "         [--speed X] [--json]\n"
+                     "  --speed X   replay X times faster than recorded; 0 sends as fast as replies allow\n";
+        return 1;
+    }
+
+    std::vector<CaptureRecord> records;
+    if (!load_capture(file, records)) {
+        std::cerr << "Failed to read capture file " << file << std::endl;
+        return 1;
+    }
+    auto batches = build_batches(records);
+
+    std::string base_target = host + ":" + std::to_string(port);
+    ReplayResult base;
+    if (!replay(batches, host, port, speed, base)) return 1;
+
+    ReplayResult other;
+    bool comparing = !compare_host.empty();
+    std::string compare_target = compare_host + ":" + std::to_string(compare_port);
+    if (comparing && !replay(batches, compare_host, compare_port, speed, other)) return 1;
+
+    if (json) {
+        std::cout << "[";
+        print_json(base_target, base, true);
+        if (comparing) print_json(compare_target, other, false);
+        std::cout << "]" << std::endl;
+    } else {
+        std::cout << records.size() << " captured commands on " << batches.size() << " connections\n";
+        print_result(base_target, base);
+        if (comparing) {
+            print_result(compare_target, other);
+            print_comparison(base, other);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,155 @@
+// Engine scaling benchmark: 1..N threads hammer one in-process BlinkDB with
+// a configurable read/write ratio and key overlap, reporting throughput,
+// scaling efficiency and keyspace lock wait time per thread count.
+//
+// Build the -tsan variant (make blinkdb-scaling-bench-tsan) to run the same
+// workload under ThreadSanitizer and flag data races in the engine.
+#include "../lib/blinkdb_internal.h"
+
+#include "bench_common.h"
+
+#include <iomanip>
+
+struct ScalingConfig {
+    int max_threads = 8;
+    double read_ratio = 0.9;
+    // Fraction of operations on the shared key range; the rest use keys private to the thread
+    double overlap = 1.0;
+    uint64_t keys = 100000;
+    size_t value_size = 16;
+    double seconds = 1.0;
+    bool json = false;
+};
+
+struct StepResult {
+    int threads;
+    uint64_t ops;
+    double seconds;
+    uint64_t shared_wait_ns;
+    uint64_t exclusive_wait_ns;
+    uint64_t contended;
+    uint64_t acquisitions;
+};
+
+static StepResult run_step(const ScalingConfig& config, int thread_count) {
+    BlinkDBEngine db("");
+    std::string value(config.value_size, 'v');
+
+    // Shared keys plus one private range per thread
+    for (uint64_t i = 0; i < config.keys; ++i) db.set("shared:" + std::to_string(i), value);
+    for (int t = 0; t < thread_count; ++t) {
+        for (uint64_t i = 0; i < config.keys / thread_count; ++i) {
+            db.set("t" + std::to_string(t) + ":" + std::to_string(i), value);
+        }
+    }
+    db.reset_lockstats();
+
+    std::atomic<int> ready{0};
+    std::atomic<bool> go{false};
+    std::atomic<bool> stop{false};
+    std::vector<uint64_t> ops(thread_count, 0);
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&, t] {
+            std::mt19937_64 rng(t + 1);
+            std::bernoulli_distribution is_read(config.read_ratio);
+            std::bernoulli_distribution is_shared(config.overlap);
+            uint64_t private_keys = std::max<uint64_t>(config.keys / thread_count, 1);
+            std::string private_prefix = "t" + std::to_string(t) + ":";
+            uint64_t count = 0;
+
+            ready++;
+            while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+            while (!stop.load(std::memory_order_relaxed)) {
+                std::string key = is_shared(rng) ? "shared:" + std::to_string(rng() % config.keys)
+                                                 : private_prefix + std::to_string(rng() % private_keys);
+                if (is_read(rng)) {
+                    db.get(key);
+                } else {
+                    db.set(key, value);
+                }
+                ++count;
+            }
+            ops[t] = count;
+        });
+    }
+
+    while (ready.load() < thread_count) std::this_thread::yield();
+    uint64_t start = now_ns();
+    go.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(std::chrono::duration<double>(config.seconds));
+    stop = true;
+    for (auto& thread : threads) thread.join();
+    double elapsed = (now_ns() - start) / 1e9;
+
+    const LockModeStats& shared = db.lock_stats(InstrumentedSharedMutex::SHARED);
+    const LockModeStats& exclusive = db.lock_stats(InstrumentedSharedMutex::EXCLUSIVE);
+    StepResult result{thread_count, 0, elapsed, shared.wait_ns.load(), exclusive.wait_ns.load(),
+                      shared.contended.load() + exclusive.contended.load(),
+                      shared.acquisitions.load() + exclusive.acquisitions.load()};
+    for (uint64_t count : ops) result.ops += count;
+    return result;
+}
+
+int main(int argc, char** argv) {
+    ScalingConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--json") config.json = true;
+        else if (arg == "--max-threads" && i + 1 < argc) config.max_threads = std::stoi(argv[++i]);
+        else if (arg == "--read-ratio" && i + 1 < argc) config.read_ratio = std::stod(argv[++i]);
+        else if (arg == "--overlap" && i + 1 < argc) config.overlap = std::stod(argv[++i]);
+        else if (arg == "--keys" && i + 1 < argc) config.keys = std::stoull(argv[++i]);
+        else if (arg == "--value-size" && i + 1 < argc) config.value_size = std::stoul(argv[++i]);
+        else if (arg == "--seconds" && i + 1 < argc) config.seconds = std::stod(argv[++i]);
+        else if (arg == "--huge-pages" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            HugePageArena::set_mode(mode == "thp" ? HugePageArena::Mode::THP
+                                    : mode == "hugetlb" ? HugePageArena::Mode::HUGETLB : HugePageArena::Mode::OFF);
+        }
+        else {
+            std::cerr << "Usage: blinkdb-scaling-bench [--max-threads N] [--read-ratio R] [--overlap F]\n"
+                         "         [--keys N] [--value-size N] [--seconds S] [--huge-pages off|thp|hugetlb] [--json]"
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    if (!config.json) {
+        std::cout << "read ratio: " << config.read_ratio << ", overlap: " << config.overlap
+                  << ", keys: " << config.keys << ", hardware threads: " << std::thread::hardware_concurrency()
+                  << "\n" << std::left << std::setw(8) << "threads" << std::right << std::setw(14) << "ops/sec"
+                  << std::setw(12) << "speedup" << std::setw(12) << "efficiency" << std::setw(14) << "contended%"
+                  << std::setw(16) << "wait ns/op" << std::endl;
+    } else {
+        std::cout << "[";
+    }
+
+    double base_throughput = 0;
+    for (int threads = 1; threads <= config.max_threads; threads *= 2) {
+        StepResult step = run_step(config, threads);
+        double throughput = step.ops / step.seconds;
+        if (threads == 1) base_throughput = throughput;
+        double speedup = base_throughput > 0 ? throughput / base_throughput : 0;
+        double contended = step.acquisitions ? 100.0 * step.contended / step.acquisitions : 0;
+        double wait_per_op = step.ops ? static_cast<double>(step.shared_wait_ns + step.exclusive_wait_ns) / step.ops : 0;
+
+        if (config.json) {
+            std::cout << (threads == 1 ? "" : ",") << std::fixed << std::setprecision(2)
+                      << "{\"threads\":" << threads << ",\"ops_per_sec\":" << throughput
+                      << ",\"speedup\":" << speedup << ",\"efficiency\":" << speedup / threads
+                      << ",\"contended_percent\":" << contended
+                      << ",\"shared_wait_ms\":" << step.shared_wait_ns / 1e6
+                      << ",\"exclusive_wait_ms\":" << step.exclusive_wait_ns / 1e6
+                      << ",\"wait_ns_per_op\":" << wait_per_op << "}";
+        } else {
+            std::cout << std::fixed << std::setprecision(2) << std::left << std::setw(8) << threads << std::right
+                      << std::setw(14) << throughput << std::setw(12) << speedup
+                      << std::setw(12) << speedup / threads << std::setw(14) << contended
+                      << std::setw(16) << wait_per_op << std::endl;
+        }
+    }
+    if (config.json) std::cout << "]" << std::endl;
+    return 0;
+}
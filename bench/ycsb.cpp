@@ -0,0 +1,385 @@
+// blinkdb-ycsb: YCSB core workloads A-F against a BlinkDB server.
+//
+// Records follow the YCSB layout: key "user<hashed id>" holding a HASH with
+// field0..fieldN-1. Reads are HGETALL, updates HSET one field, inserts HSET
+// every field. BlinkDB has no ordered scan, so every insert also appends the
+// key to the list ycsb:index and a scan is an LRANGE over that list followed
+// by an HGETALL per returned key. Output uses the YCSB summary format.
+#include "bench_common.h"
+
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#define YCSB_INDEX_KEY "ycsb:index"
+
+enum class Operation { INSERT, READ, UPDATE, SCAN, READ_MODIFY_WRITE, COUNT };
+
+static const char* operation_names[] = {"INSERT", "READ", "UPDATE", "SCAN", "READ-MODIFY-WRITE"};
+
+enum class RequestDistribution { UNIFORM, ZIPFIAN, LATEST };
+
+struct Workload {
+    char name;
+    double read;
+    double update;
+    double insert;
+    double scan;
+    double read_modify_write;
+    RequestDistribution distribution;
+};
+
+// Proportions from the YCSB core workload files
+static const Workload workloads[] = {
+    {'a', 0.50, 0.50, 0,    0,    0,    RequestDistribution::ZIPFIAN},
+    {'b', 0.95, 0.05, 0,    0,    0,    RequestDistribution::ZIPFIAN},
+    {'c', 1.00, 0,    0,    0,    0,    RequestDistribution::ZIPFIAN},
+    {'d', 0.95, 0,    0.05, 0,    0,    RequestDistribution::LATEST},
+    {'e', 0,    0,    0.05, 0.95, 0,    RequestDistribution::ZIPFIAN},
+    {'f', 0.50, 0,    0,    0,    0.50, RequestDistribution::ZIPFIAN},
+};
+
+struct YcsbConfig {
+    std::string host = "127.0.0.1";
+    int port = 9001;
+    Workload workload = workloads[0];
+    bool load = true;
+    bool run = true;
+    int threads = 4;
+    uint64_t record_count = 100000;
+    uint64_t operation_count = 100000;
+    int field_count = 10;
+    size_t field_length = 100;
+    int max_scan_length = 100;
+    double zipf_theta = 0.99;
+};
+
+struct OperationStats {
+    LatencyHistogram latency;
+    uint64_t ok = 0;
+    uint64_t errors = 0;
+
+    void merge(const OperationStats& other) {
+        latency.merge(other.latency);
+        ok += other.ok;
+        errors += other.errors;
+    }
+};
+
+struct PhaseStats {
+    OperationStats operations[static_cast<int>(Operation::COUNT)];
+};
+
+static std::string record_key(uint64_t id) {
+    return "user" + std::to_string(fnv1a_64(id));
+}
+
+// A blocking connection that sends a batch of commands and waits for all replies
+class Client {
+private:
+    int fd;
+    std::string input;
+
+public:
+    explicit Client(int socket_fd) : fd(socket_fd) {}
+    ~Client() {
+        if (fd != -1) close(fd);
+    }
+
+    bool connected() const { return fd != -1; }
+
+    // Appends each reply to replies; returns false if any reply is an error
+    bool call(const std::string& commands, size_t reply_count, std::vector<std::string>* replies = nullptr) {
+        if (!write_all(fd, commands.data(), commands.size())) return false;
+        bool ok = true;
+        size_t pos = 0;
+        char buffer[16384];
+        while (reply_count > 0) {
+            bool is_error = false;
+            size_t len = resp_reply_length(input, pos, is_error);
+            if (len == 0) {
+                ssize_t bytes = read(fd, buffer, sizeof(buffer));
+                if (bytes <= 0) return false;
+                input.append(buffer, static_cast<size_t>(bytes));
+                continue;
+            }
+            if (replies) replies->push_back(input.substr(pos, len));
+            ok = ok && !is_error;
+            pos += len;
+            reply_count--;
+        }
+        input.erase(0, pos);
+        return ok;
+    }
+};
+
+// Returns the bulk strings of a RESP array reply
+static std::vector<std::string> array_items(const std::string& reply) {
+    std::vector<std::string> items;
+    size_t pos = reply.find("\r\n");
+    while (pos != std::string::npos && pos + 2 < reply.size() && reply[pos + 2] == '$') {
+        size_t header_end = reply.find("\r\n", pos + 2);
+        size_t len = std::stoul(reply.substr(pos + 3, header_end - pos - 3));
+        items.push_back(reply.substr(header_end + 2, len));
+        pos = header_end + 2 + len;
+    }
+    return items;
+}
+
+class YcsbWorker {
+private:
+    const YcsbConfig& config;
+    Client client;
+    std::mt19937_64 rng;
+    KeyChooser chooser;
+    ZipfianGenerator latest;
+    std::atomic<uint64_t>& inserted;
+    std::discrete_distribution<int> mix;
+    std::string field_value;
+
+    std::string insert_commands(const std::string& key) {
+        std::string commands;
+        for (int f = 0; f < config.field_count; ++f) {
+            commands += "HSET " + key + " field" + std::to_string(f) + " " + field_value + "\r\n";
+        }
+        commands += "RPUSH " YCSB_INDEX_KEY " " + key + "\r\n";
+        return commands;
+    }
+
+    // Picks an existing record according to the workload's request distribution
+    uint64_t next_record() {
+        uint64_t count = inserted.load(std::memory_order_relaxed);
+        if (config.workload.distribution == RequestDistribution::LATEST) {
+            uint64_t offset = latest.next(rng) % count;
+            return count - 1 - offset;
+        }
+        return chooser.next(rng) % count;
+    }
+
+    std::string random_field() {
+        return "field" + std::to_string(rng() % config.field_count);
+    }
+
+public:
+    YcsbWorker(const YcsbConfig& cfg, std::atomic<uint64_t>& inserted_count, uint64_t seed)
+        : config(cfg), client(connect_to(cfg.host, cfg.port)), rng(seed),
+          chooser(cfg.record_count,
+                  cfg.workload.distribution == RequestDistribution::UNIFORM ? KeyDistribution::UNIFORM
+                                                                              : KeyDistribution::ZIPFIAN,
+                  cfg.zipf_theta),
+          latest(cfg.workload.distribution == RequestDistribution::LATEST ? cfg.record_count : 1, cfg.zipf_theta),
+          inserted(inserted_count),
+          mix({cfg.workload.read, cfg.workload.update, cfg.workload.insert, cfg.workload.scan,
+               cfg.workload.read_modify_write}),
+          field_value(cfg.field_length, 'x') {}
+
+    bool connected() const { return client.connected(); }
+
+    Operation next_operation() {
+        static const Operation operations[] = {Operation::READ, Operation::UPDATE, Operation::INSERT,
+                                               Operation::SCAN, Operation::READ_MODIFY_WRITE};
+        return operations[mix(rng)];
+    }
+
+    bool insert(uint64_t id) {
+        return client.call(insert_commands(record_key(id)), config.field_count + 1);
+    }
+
+    bool execute(Operation operation) {
+        switch (operation) {
+            case Operation::INSERT: {
+                // Claim the id first so concurrent inserts never collide
+                uint64_t id = inserted.fetch_add(1, std::memory_order_relaxed);
+                return insert(id);
+            }
+            case Operation::READ:
+                return client.call("HGETALL " + record_key(next_record()) + "\r\n", 1);
+            case Operation::UPDATE:
+                return client.call("HSET " + record_key(next_record()) + " " + random_field() + " " +
+                                   field_value + "\r\n", 1);
+            case Operation::SCAN: {
+                uint64_t start = next_record();
+                uint64_t length = 1 + rng() % config.max_scan_length;
+                std::vector<std::string> replies;
+                if (!client.call("LRANGE " YCSB_INDEX_KEY " " + std::to_string(start) + " " +
+                                 std::to_string(start + length - 1) + "\r\n", 1, &replies)) {
+                    return false;
+                }
+                std::vector<std::string> keys = array_items(replies[0]);
+                std::string commands;
+                for (const std::string& key : keys) commands += "HGETALL " + key + "\r\n";
+                return keys.empty() || client.call(commands, keys.size());
+            }
+            case Operation::READ_MODIFY_WRITE: {
+                std::string key = record_key(next_record());
+                return client.call("HGETALL " + key + "\r\n", 1) &&
+                       client.call("HSET " + key + " " + random_field() + " " + field_value + "\r\n", 1);
+            }
+            default:
+                return false;
+        }
+    }
+};
+
+static void record(OperationStats& stats, uint64_t start_ns, bool ok) {
+    stats.latency.record(now_ns() - start_ns);
+    if (ok) stats.ok++;
+    else stats.errors++;
+}
+
+// Runs body(worker, stats) on every thread until the shared budget is spent
+template <typename Body>
+static bool run_phase(const YcsbConfig& config, std::atomic<uint64_t>& inserted, uint64_t budget,
+                      Body body, PhaseStats& totals, double& elapsed_sec) {
+    std::vector<std::unique_ptr<YcsbWorker>> workers;
+    for (int t = 0; t < config.threads; ++t) {
+        workers.push_back(std::make_unique<YcsbWorker>(config, inserted, 0x9e3779b97f4a7c15ULL * (t + 1)));
+        if (!workers.back()->connected()) {
+            std::cerr << "Failed to connect to " << config.host << ":" << config.port << std::endl;
+            return false;
+        }
+    }
+
+    std::atomic<uint64_t> claimed{0};
+    std::vector<PhaseStats> results(config.threads);
+    std::vector<std::thread> threads;
+    uint64_t start = now_ns();
+    for (int t = 0; t < config.threads; ++t) {
+        threads.emplace_back([&, t] {
+            uint64_t index;
+            while ((index = claimed.fetch_add(1, std::memory_order_relaxed)) < budget) {
+                body(*workers[t], index, results[t]);
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    elapsed_sec = (now_ns() - start) / 1e9;
+
+    for (const auto& result : results) {
+        for (int i = 0; i < static_cast<int>(Operation::COUNT); ++i) {
+            totals.operations[i].merge(result.operations[i]);
+        }
+    }
+    return true;
+}
+
+static void print_summary(const PhaseStats& stats, double elapsed_sec) {
+    uint64_t total = 0;
+    for (const auto& op : stats.operations) total += op.latency.count();
+
+    std::cout << std::fixed << std::setprecision(1)
+              << "[OVERALL], RunTime(ms), " << elapsed_sec * 1000 << "\n"
+              << "[OVERALL], Throughput(ops/sec), " << total / elapsed_sec << "\n";
+    for (int i = 0; i < static_cast<int>(Operation::COUNT); ++i) {
+        const OperationStats& op = stats.operations[i];
+        if (op.latency.count() == 0) continue;
+        std::string tag = std::string("[") + operation_names[i] + "], ";
+        std::cout << tag << "Operations, " << op.latency.count() << "\n"
+                  << tag << "AverageLatency(us), " << op.latency.mean() / 1000.0 << "\n"
+                  << tag << "MinLatency(us), " << op.latency.min() / 1000 << "\n"
+                  << tag << "MaxLatency(us), " << op.latency.max() / 1000 << "\n"
+                  << tag << "95thPercentileLatency(us), " << op.latency.percentile(95) / 1000 << "\n"
+                  << tag << "99thPercentileLatency(us), " << op.latency.percentile(99) / 1000 << "\n"
+                  << tag << "Return=OK, " << op.ok << "\n";
+        if (op.errors) std::cout << tag << "Return=ERROR, " << op.errors << "\n";
+    }
+    std::cout.flush();
+}
+
+static void usage() {
+    std::cerr <<
+        "Usage: blinkdb-ycsb [load|run|both] [options]\n"
+        "  --workload a-f         YCSB core workload (default a)\n"
+        "  --host HOST            server host (default 127.0.0.1)\n"
+        "  --port PORT            server port (default 9001)\n"
+        "  --threads N            client threads, one connection each (default 4)\n"
+        "  --recordcount N        records loaded (default 100000)\n"
+        "  --operationcount N     operations in the run phase (default 100000)\n"
+        "  --fieldcount N         fields per record (default 10)\n"
+        "  --fieldlength N        bytes per field value (default 100)\n"
+        "  --maxscanlength N      longest scan in workload e (default 100)\n"
+        "  --requestdistribution  uniform, zipfian or latest (default per workload)\n"
+        "  --zipf-theta T         zipfian skew (default 0.99)\n";
+}
+
+static bool parse_args(int argc, char** argv, YcsbConfig& config) {
+    std::string distribution;
+    int i = 1;
+    if (i < argc && argv[i][0] != '-') {
+        std::string phase = argv[i++];
+        if (phase == "load") config.run = false;
+        else if (phase == "run") config.load = false;
+        else if (phase != "both") return false;
+    }
+    for (; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || i + 1 >= argc) return false;
+        std::string value = argv[++i];
+        if (arg == "--workload") {
+            auto it = std::find_if(std::begin(workloads), std::end(workloads),
+                                   [&value](const Workload& w) { return value.size() == 1 && std::tolower(value[0]) == w.name; });
+            if (it == std::end(workloads)) return false;
+            config.workload = *it;
+        }
+        else if (arg == "--host") config.host = value;
+        else if (arg == "--port") config.port = std::stoi(value);
+        else if (arg == "--threads") config.threads = std::max(1, std::stoi(value));
+        else if (arg == "--recordcount") config.record_count = std::max<uint64_t>(1, std::stoull(value));
+        else if (arg == "--operationcount") config.operation_count = std::stoull(value);
+        else if (arg == "--fieldcount") config.field_count = std::max(1, std::stoi(value));
+        else if (arg == "--fieldlength") config.field_length = std::max<size_t>(1, std::stoul(value));
+        else if (arg == "--maxscanlength") config.max_scan_length = std::max(1, std::stoi(value));
+        else if (arg == "--zipf-theta") config.zipf_theta = std::stod(value);
+        else if (arg == "--requestdistribution") distribution = value;
+        else return false;
+    }
+
+    // Applied last so it overrides the workload default regardless of option order
+    if (distribution == "uniform") config.workload.distribution = RequestDistribution::UNIFORM;
+    else if (distribution == "zipfian") config.workload.distribution = RequestDistribution::ZIPFIAN;
+    else if (distribution == "latest") config.workload.distribution = RequestDistribution::LATEST;
+    else if (!distribution.empty()) return false;
+    return true;
+}
+
+int main(int argc, char** argv) {
+    YcsbConfig config;
+    if (!parse_args(argc, argv, config)) {
+        usage();
+        return 1;
+    }
+
+    // Records 0..inserted-1 exist; the run phase assumes the load phase already ran
+    std::atomic<uint64_t> inserted{config.record_count};
+
+    if (config.load) {
+        PhaseStats stats;
+        double elapsed = 0;
+        bool ok = run_phase(config, inserted, config.record_count,
+                            [](YcsbWorker& worker, uint64_t index, PhaseStats& result) {
+                                uint64_t start = now_ns();
+                                bool done = worker.insert(index);
+                                record(result.operations[static_cast<int>(Operation::INSERT)], start, done);
+                            }, stats, elapsed);
+        if (!ok) return 1;
+        std::cout << "# load: " << config.record_count << " records\n";
+        print_summary(stats, elapsed);
+    }
+
+    if (config.run) {
+        PhaseStats stats;
+        double elapsed = 0;
+        bool ok = run_phase(config, inserted, config.operation_count,
+                            [](YcsbWorker& worker, uint64_t, PhaseStats& result) {
+                                Operation operation = worker.next_operation();
+                                uint64_t start = now_ns();
+                                bool done = worker.execute(operation);
+                                record(result.operations[static_cast<int>(operation)], start, done);
+                            }, stats, elapsed);
+        if (!ok) return 1;
+        std::cout << "# run: workload " << config.workload.name << ", " << config.operation_count << " operations\n";
+        print_summary(stats, elapsed);
+    }
+    return 0;
+}
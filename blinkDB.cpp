@@ -1,1034 +1,1278 @@
-#include <iostream>
-#include <unordered_map>
-#include <unordered_set>
-#include <vector>
-#include <list>
-#include <sstream>
+// BlinkDB server: RESP protocol handling and the epoll event loop over the
+// engine in lib/blinkdb_internal.h, plus the server-side tooling (keyspace
+// analyzer, event loop watchdog, traffic capture).
+#include "lib/blinkdb_internal.h"
+
 #include <sys/epoll.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <fstream>
-#include <bitset>
-#include <shared_mutex>
-#include <mutex>
-#include <algorithm>
-#include <memory>
-
+#include <condition_variable>
+#include <csignal>
+#include <execinfo.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <cstring>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <linux/errqueue.h>
+#include <deque>
+#include <map>
+#include <coroutine>
+#include <cmath>
+#include <numeric>
+#include <utility>
 
 #define PORT 9001
 #define MAX_EVENTS 10
 #define BUFFER_SIZE 1024
-#define CACHE_SIZE 1000
-#define BLOOM_FILTER_SIZE 10000
-
-// Forward declarations
-class DataType;
-class StringType;
-class ListType;
-class SetType;
-class HashType;
-
-// Value types enum
-enum class ValueType {
-    STRING,
-    LIST,
-    SET,
-    HASH
-};
-
-// Base abstract class for all data types
-class DataType {
+#define ANALYZER_BATCH 256
+#define ANALYZER_DEFAULT_TOP_N 10
+#define ANALYZER_DEFAULT_CPU_PERCENT 10
+#define ANALYZER_HISTOGRAM_BUCKETS 32
+#define WATCHDOG_PERIOD_MS 1000
+#define WATCHDOG_MAX_FRAMES 64
+#define WATCHDOG_SIGNAL_OFFSET 3
+#define CAPTURE_MAGIC "BLINKCAP"
+#define CAPTURE_VERSION 1
+#define CAPTURE_BUFFER_SIZE 65536
+#define SHARD_MAX 64
+#define SHARD_QUEUE_CAPACITY 4096
+#define NUMA_SAMPLE_PAGES 1024
+#define OUTPUT_IOV_MAX 64
+
+// CPU affinity and NUMA memory placement for the server's threads. Event
+// loops and background threads (keyspace analyzer, watchdog, command
+// scheduler worker) take their CPUs from --loop-cpus and --background-cpus.
+// A pinned thread also switches to the local allocation policy, so the
+// malloc arena it fills is backed by memory on its own node. On single-node
+// machines only the affinity is applied.
+class ThreadPlacement {
 public:
-    virtual ~DataType() = default;
-    virtual ValueType get_type() const = 0;
-    virtual std::string serialize() const = 0;
-    virtual void deserialize(const std::string& data) = 0;
-    virtual std::string to_string() const = 0;
-};
+    enum class Role { LOOP, BACKGROUND };
 
-// String data type
-class StringType : public DataType {
 private:
-    std::string value;
-
-public:
-    explicit StringType(const std::string& val = "") : value(val) {}
-
-    ValueType get_type() const override {
-        return ValueType::STRING;
-    }
-
-    std::string serialize() const override {
-        return value;
-    }
-
-    void deserialize(const std::string& data) override {
-        value = data;
-    }
-
-    std::string to_string() const override {
-        return value;
-    }
-
-    void set(const std::string& val) {
-        value = val;
+    std::vector<int> loop_cpus;
+    std::vector<int> background_cpus;
+    std::string loop_spec = "any";
+    std::string background_spec = "any";
+    cpu_set_t startup_mask;
+    size_t nodes = 1;
+
+    // Parses a kernel-style CPU or node list such as "0-3,8,10-11"
+    static std::optional<std::vector<int>> parse_list(const std::string& spec) {
+        std::vector<int> ids;
+        std::istringstream iss(spec);
+        std::string range;
+        while (std::getline(iss, range, ',')) {
+            size_t dash = range.find('-');
+            try {
+                int first = std::stoi(range.substr(0, dash));
+                int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                if (first < 0 || last < first || last >= CPU_SETSIZE) return std::nullopt;
+                for (int id = first; id <= last; ++id) ids.push_back(id);
+            } catch (const std::exception&) {
+                return std::nullopt;
+            }
+        }
+        if (ids.empty()) return std::nullopt;
+        return ids;
     }
 
-    std::string get() const {
-        return value;
+    static int current_node() {
+        unsigned cpu = 0, node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) == -1) return 0;
+        return static_cast<int>(node);
     }
-};
-
-// List data type
-class ListType : public DataType {
-private:
-    std::vector<std::string> elements;
 
 public:
-    ValueType get_type() const override {
-        return ValueType::LIST;
+    ThreadPlacement() {
+        CPU_ZERO(&startup_mask);
+        sched_getaffinity(0, sizeof(startup_mask), &startup_mask);
+        std::ifstream online("/sys/devices/system/node/online");
+        std::string spec;
+        if (online >> spec) {
+            auto ids = parse_list(spec);
+            if (ids) nodes = ids->size();
+        }
+    }
+
+    bool configure(Role role, const std::string& spec) {
+        auto cpus = parse_list(spec);
+        if (!cpus) return false;
+        (role == Role::LOOP ? loop_cpus : background_cpus) = std::move(*cpus);
+        (role == Role::LOOP ? loop_spec : background_spec) = spec;
+        return true;
     }
 
-    // Serializes list to string format for storage
-    std::string serialize() const override {
-        std::string result = "L";
-        for (const auto& element : elements) {
-            result += std::to_string(element.size()) + ":" + element + ",";
+    // Pins the calling thread. `slot` picks one CPU of the role's set for
+    // thread-per-core shards; otherwise the thread may run on any of them.
+    // Unconfigured background threads go back to the startup mask rather
+    // than inheriting a pinned event loop's.
+    void pin(Role role, std::optional<size_t> slot = std::nullopt) const {
+        const std::vector<int>& cpus = role == Role::LOOP ? loop_cpus : background_cpus;
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        if (cpus.empty()) {
+            if (role == Role::LOOP) return;
+            mask = startup_mask;
+        } else if (slot) {
+            CPU_SET(cpus[*slot % cpus.size()], &mask);
+        } else {
+            for (int cpu : cpus) CPU_SET(cpu, &mask);
+        }
+        int error = pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+        if (error != 0) {
+            std::cerr << "Failed to set CPU affinity: " << strerror(error) << std::endl;
+            return;
         }
-        return result;
-    }
-
-    // Deserializes string to list
-    void deserialize(const std::string& data) override {
-        elements.clear();
-        if (data.empty() || data[0] != 'L') return;
-        
-        size_t pos = 1;
-        while (pos < data.size()) {
-            size_t colon_pos = data.find(':', pos);
-            if (colon_pos == std::string::npos) break;
-            
-            int len = std::stoi(data.substr(pos, colon_pos - pos));
-            std::string element = data.substr(colon_pos + 1, len);
-            elements.push_back(element);
-            
-            pos = colon_pos + len + 2; // Skip past element and comma
+        if (nodes > 1 && syscall(SYS_set_mempolicy, MPOL_LOCAL, nullptr, 0) == -1) {
+            std::cerr << "Failed to set local NUMA memory policy: " << strerror(errno) << std::endl;
         }
     }
 
-    std::string to_string() const override {
-        std::string result = "[";
-        for (size_t i = 0; i < elements.size(); ++i) {
-            if (i > 0) result += ", ";
-            result += elements[i];
+    // INFO numa: placement settings plus the share of sampled value pages
+    // that live on another node than the CPU serving this request. Values
+    // are taken from the start of the keyspace walk, NUMA_SAMPLE_PAGES at most.
+    std::string report(BlinkDBEngine& db) const {
+        uintptr_t page_mask = ~static_cast<uintptr_t>(sysconf(_SC_PAGESIZE) - 1);
+        std::vector<void*> pages;
+        size_t cursor = 0;
+        do {
+            cursor = db.scan_buckets(cursor, ANALYZER_BATCH, [&](const std::string&, const DataType& value) {
+                if (pages.size() < NUMA_SAMPLE_PAGES) {
+                    pages.push_back(reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(&value) & page_mask));
+                }
+            });
+        } while (cursor != 0 && pages.size() < NUMA_SAMPLE_PAGES);
+        std::sort(pages.begin(), pages.end());
+        pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+
+        // move_pages with no target nodes only reports where each page is
+        int local = current_node();
+        size_t resident = 0, remote = 0;
+        std::vector<int> status(pages.size());
+        if (!pages.empty() && syscall(SYS_move_pages, 0, pages.size(), pages.data(), nullptr, status.data(), 0) == 0) {
+            for (int node : status) {
+                if (node < 0) continue;
+                resident++;
+                if (node != local) remote++;
+            }
         }
-        result += "]";
+
+        std::string result = "# Numa\r\n";
+        result += "numa_nodes:" + std::to_string(nodes) + "\r\n";
+        bool pinned = !loop_cpus.empty() || !background_cpus.empty();
+        result += "numa_policy:" + std::string(nodes > 1 && pinned ? "local" : "default") + "\r\n";
+        result += "loop_cpus:" + loop_spec + "\r\n";
+        result += "background_cpus:" + background_spec + "\r\n";
+        result += "current_node:" + std::to_string(local) + "\r\n";
+        result += "numa_sampled_pages:" + std::to_string(resident) + "\r\n";
+        result += "numa_remote_pages:" + std::to_string(remote) + "\r\n";
+        result += "numa_cross_node_ratio:" + std::to_string(resident ? static_cast<double>(remote) / resident : 0.0) + "\r\n";
         return result;
     }
+};
 
-    // List operations
-    void lpush(const std::string& value) {
-        elements.insert(elements.begin(), value);
-    }
+static ThreadPlacement thread_placement;
 
-    void rpush(const std::string& value) {
-        elements.push_back(value);
+// Background big-key and keyspace-shape analyzer.
+// A worker thread walks the keyspace ANALYZER_BATCH buckets at a time and
+// sleeps between batches so it stays within the configured CPU budget. The
+// report keeps the largest keys per type plus element-count, size and TTL
+// distributions, and can be read while the walk is still in progress: a
+// batch is measured without the analyzer's lock and only merged under it.
+class KeyspaceAnalyzer {
+private:
+    struct KeyInfo {
+        size_t bytes;
+        size_t elements;
+        std::string key;
+    };
+
+    struct ScannedKey {
+        ValueType type;
+        KeyInfo info;
+    };
+
+    struct TypeReport {
+        size_t keys = 0;
+        size_t bytes = 0;
+        size_t elements = 0;
+        std::vector<KeyInfo> largest; // min-heap on bytes
+        size_t element_histogram[ANALYZER_HISTOGRAM_BUCKETS] = {};
+        size_t size_histogram[ANALYZER_HISTOGRAM_BUCKETS] = {};
+    };
+
+    BlinkDBEngine& db;
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable stop_signal;
+    bool stop_requested = false;
+    bool running = false;
+    size_t top_n = ANALYZER_DEFAULT_TOP_N;
+    int cpu_percent = ANALYZER_DEFAULT_CPU_PERCENT;
+    TypeReport reports[4];
+    size_t keys_scanned = 0;
+    size_t buckets_scanned = 0;
+    size_t buckets_total = 0;
+    std::chrono::steady_clock::time_point started_at;
+    std::chrono::steady_clock::duration elapsed{};
+
+    static bool smaller(const KeyInfo& a, const KeyInfo& b) {
+        return a.bytes > b.bytes;
+    }
+
+    // Bucket i holds values in [2^(i-1), 2^i); bucket 0 holds zero
+    static size_t log2_bucket(size_t value) {
+        size_t bucket = 0;
+        while (value > 0 && bucket < ANALYZER_HISTOGRAM_BUCKETS - 1) {
+            value >>= 1;
+            ++bucket;
+        }
+        return bucket;
+    }
+
+    void add_key(ValueType type, KeyInfo info) {
+        TypeReport& report = reports[static_cast<size_t>(type)];
+        report.keys++;
+        report.bytes += info.bytes;
+        report.elements += info.elements;
+        report.element_histogram[log2_bucket(info.elements)]++;
+        report.size_histogram[log2_bucket(info.bytes)]++;
+        
+        if (report.largest.size() < top_n) {
+            report.largest.push_back(std::move(info));
+            std::push_heap(report.largest.begin(), report.largest.end(), smaller);
+        } else if (!report.largest.empty() && info.bytes > report.largest.front().bytes) {
+            std::pop_heap(report.largest.begin(), report.largest.end(), smaller);
+            report.largest.back() = std::move(info);
+            std::push_heap(report.largest.begin(), report.largest.end(), smaller);
+        }
+        keys_scanned++;
+    }
+
+    void run() {
+        thread_placement.pin(ThreadPlacement::Role::BACKGROUND);
+        size_t cursor = 0;
+        std::vector<ScannedKey> batch;
+        do {
+            auto batch_start = std::chrono::steady_clock::now();
+            batch.clear();
+            cursor = db.scan_buckets(cursor, ANALYZER_BATCH, [&batch](const std::string& key, const DataType& value) {
+                batch.push_back({value.get_type(),
+                                 {BlinkDBEngine::key_overhead(key) + value.memory_usage(blinkdb_config::MEMORY_USAGE_SAMPLES),
+                                  value.element_count(), key}});
+            });
+            size_t total = db.keyspace_buckets();
+            
+            std::unique_lock<std::mutex> guard(lock);
+            for (auto& scanned : batch) {
+                add_key(scanned.type, std::move(scanned.info));
+            }
+            buckets_total = total;
+            buckets_scanned = cursor == 0 ? total : cursor;
+            auto busy = std::chrono::steady_clock::now() - batch_start;
+            auto idle = busy * (100 - cpu_percent) / cpu_percent;
+            elapsed = std::chrono::steady_clock::now() - started_at;
+            if (stop_signal.wait_for(guard, idle, [this] { return stop_requested; })) {
+                break;
+            }
+        } while (cursor != 0);
+        
+        std::lock_guard<std::mutex> guard(lock);
+        elapsed = std::chrono::steady_clock::now() - started_at;
+        running = false;
     }
 
-    std::string lpop() {
-        if (elements.empty()) return "";
-        std::string value = elements.front();
-        elements.erase(elements.begin());
-        return value;
+    static std::string format_histogram(const size_t* histogram) {
+        std::string result;
+        for (size_t i = 0; i < ANALYZER_HISTOGRAM_BUCKETS; ++i) {
+            if (histogram[i] == 0) continue;
+            if (!result.empty()) result += ",";
+            std::string bound = (i == ANALYZER_HISTOGRAM_BUCKETS - 1) ? "inf" : std::to_string(1ULL << i);
+            result += "lt_" + bound + "=" + std::to_string(histogram[i]);
+        }
+        return result;
     }
 
-    std::string rpop() {
-        if (elements.empty()) return "";
-        std::string value = elements.back();
-        elements.pop_back();
-        return value;
+public:
+    explicit KeyspaceAnalyzer(BlinkDBEngine& database) : db(database) {}
+
+    ~KeyspaceAnalyzer() { stop(); }
+
+    // Returns false when an analysis is already running
+    bool start(size_t top, int percent) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (running) return false;
+        if (worker.joinable()) worker.join();
+        
+        top_n = top;
+        cpu_percent = std::clamp(percent, 1, 100);
+        for (auto& report : reports) report = TypeReport();
+        keys_scanned = 0;
+        buckets_scanned = 0;
+        buckets_total = 0;
+        stop_requested = false;
+        running = true;
+        started_at = std::chrono::steady_clock::now();
+        worker = std::thread(&KeyspaceAnalyzer::run, this);
+        return true;
     }
 
-    std::string lindex(int index) const {
-        if (index < 0) index = elements.size() + index;
-        if (index < 0 || index >= static_cast<int>(elements.size())) return "";
-        return elements[index];
+    void stop() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stop_requested = true;
+        }
+        stop_signal.notify_all();
+        if (worker.joinable()) worker.join();
     }
 
-    int llen() const {
-        return static_cast<int>(elements.size());
+    std::string status() {
+        std::lock_guard<std::mutex> guard(lock);
+        double progress = buckets_total > 0 ? 100.0 * buckets_scanned / buckets_total : 0.0;
+        std::string result;
+        result += "analyzer_running:" + std::to_string(running ? 1 : 0) + "\r\n";
+        result += "analyzer_keys_scanned:" + std::to_string(keys_scanned) + "\r\n";
+        result += "analyzer_progress_percent:" + std::to_string(progress) + "\r\n";
+        result += "analyzer_cpu_budget_percent:" + std::to_string(cpu_percent) + "\r\n";
+        result += "analyzer_elapsed_ms:"
+                + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()) + "\r\n";
+        return result;
     }
 
-    std::vector<std::string> lrange(int start, int end) const {
-        if (elements.empty()) return {};
-        
-        if (start < 0) start = elements.size() + start;
-        if (end < 0) end = elements.size() + end;
+    std::string report() {
+        std::string result = "# Analyzer\r\n" + status();
+        std::lock_guard<std::mutex> guard(lock);
         
-        start = std::max(0, start);
-        end = std::min(static_cast<int>(elements.size()) - 1, end);
-        
-        if (start > end) return {};
+        for (ValueType type : {ValueType::STRING, ValueType::LIST, ValueType::SET, ValueType::HASH}) {
+            const TypeReport& report = reports[static_cast<size_t>(type)];
+            std::string name = value_type_name(type);
+            result += "# " + name + "\r\n";
+            result += name + "_keys:" + std::to_string(report.keys) + "\r\n";
+            result += name + "_bytes:" + std::to_string(report.bytes) + "\r\n";
+            result += name + "_elements:" + std::to_string(report.elements) + "\r\n";
+            result += name + "_element_distribution:" + format_histogram(report.element_histogram) + "\r\n";
+            result += name + "_size_distribution:" + format_histogram(report.size_histogram) + "\r\n";
+            
+            std::vector<KeyInfo> largest(report.largest);
+            std::sort(largest.begin(), largest.end(), smaller);
+            for (size_t i = 0; i < largest.size(); ++i) {
+                result += name + "_largest_" + std::to_string(i) + ":key=" + largest[i].key
+                        + ",bytes=" + std::to_string(largest[i].bytes)
+                        + ",elements=" + std::to_string(largest[i].elements) + "\r\n";
+            }
+        }
         
-        return std::vector<std::string>(elements.begin() + start, elements.begin() + end + 1);
+        // Keys have no expiry support yet, so every scanned key is persistent
+        result += "# TTL\r\n";
+        result += "ttl_distribution:no_expiry=" + std::to_string(keys_scanned) + "\r\n";
+        return result;
     }
 };
 
-// Set data type
-class SetType : public DataType {
-private:
-    std::unordered_set<std::string> elements;
+// Stack frames captured by the watchdog signal handler on the stalled thread
+static void* watchdog_frames[WATCHDOG_MAX_FRAMES];
+static volatile sig_atomic_t watchdog_frame_count = 0;
+static std::atomic<bool> watchdog_capture_done{false};
 
-public:
-    ValueType get_type() const override {
-        return ValueType::SET;
-    }
+static void watchdog_signal_handler(int) {
+    watchdog_frame_count = backtrace(watchdog_frames, WATCHDOG_MAX_FRAMES);
+    watchdog_capture_done.store(true, std::memory_order_release);
+}
 
-    std::string serialize() const override {
-        std::string result = "S";
-        for (const auto& element : elements) {
-            result += std::to_string(element.size()) + ":" + element + ",";
+// Detects event loop stalls. The loop marks the start and end of every
+// iteration; when an iteration runs longer than the watchdog period, the
+// watchdog thread signals the loop thread, which captures its own stack in
+// the signal handler. The symbolized trace is logged and kept for LATENCY STACK.
+// The signal is the real-time signal SIGRTMIN + WATCHDOG_SIGNAL_OFFSET, so
+// the watchdog leaves SIGUSR1/SIGUSR2 to the embedding process; whatever
+// handler it replaces is restored when the watchdog stops.
+class EventLoopWatchdog {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    pthread_t loop_thread;
+    int signal_number;
+    struct sigaction previous_action {};
+    std::atomic<int64_t> iteration_start_ns{0};
+    std::atomic<uint64_t> period_ms{WATCHDOG_PERIOD_MS};
+    std::atomic<uint64_t> stalls{0};
+    std::atomic<bool> stop_requested{false};
+    std::thread worker;
+    std::mutex trace_lock;
+    std::string last_trace;
+
+    static int64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+    }
+
+    void capture(uint64_t stalled_ms) {
+        watchdog_capture_done = false;
+        pthread_kill(loop_thread, signal_number);
+        for (int i = 0; i < 100 && !watchdog_capture_done.load(std::memory_order_acquire); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (!watchdog_capture_done) return;
+        
+        std::string trace = "--- WATCHDOG: event loop stalled for " + std::to_string(stalled_ms) + " ms ---\n";
+        char** symbols = backtrace_symbols(watchdog_frames, watchdog_frame_count);
+        for (int i = 0; symbols && i < watchdog_frame_count; ++i) {
+            trace += std::string(symbols[i]) + "\n";
+        }
+        free(symbols);
+        std::cerr << trace;
+        
+        std::lock_guard<std::mutex> guard(trace_lock);
+        last_trace = trace;
+    }
+
+    void run() {
+        thread_placement.pin(ThreadPlacement::Role::BACKGROUND);
+        int64_t reported_iteration = 0;
+        while (!stop_requested) {
+            uint64_t period = period_ms.load();
+            std::this_thread::sleep_for(std::chrono::milliseconds(period == 0 ? 100 : std::max<uint64_t>(period / 2, 1)));
+            if (period == 0) continue;
+            
+            int64_t started = iteration_start_ns.load();
+            if (started == 0 || started == reported_iteration) continue;
+            uint64_t stalled_ms = (now_ns() - started) / 1000000;
+            if (stalled_ms >= period) {
+                reported_iteration = started;
+                stalls++;
+                capture(stalled_ms);
+            }
         }
-        return result;
     }
 
-    void deserialize(const std::string& data) override {
-        elements.clear();
-        if (data.empty() || data[0] != 'S') return;
+public:
+    // Must be constructed on the event loop thread
+    EventLoopWatchdog() : loop_thread(pthread_self()), signal_number(SIGRTMIN + WATCHDOG_SIGNAL_OFFSET) {
+        struct sigaction action {};
+        action.sa_handler = watchdog_signal_handler;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(signal_number, &action, &previous_action);
         
-        size_t pos = 1;
-        while (pos < data.size()) {
-            size_t colon_pos = data.find(':', pos);
-            if (colon_pos == std::string::npos) break;
-            
-            int len = std::stoi(data.substr(pos, colon_pos - pos));
-            std::string element = data.substr(colon_pos + 1, len);
-            elements.insert(element);
-            
-            pos = colon_pos + len + 2; // Skip past element and comma
-        }
+        // backtrace() loads libgcc lazily; do it now rather than inside the signal handler
+        void* warmup[1];
+        backtrace(warmup, 1);
+        
+        worker = std::thread(&EventLoopWatchdog::run, this);
     }
 
-    std::string to_string() const override {
-        std::string result = "{";
-        bool first = true;
-        for (const auto& element : elements) {
-            if (!first) result += ", ";
-            result += element;
-            first = false;
-        }
-        result += "}";
-        return result;
+    ~EventLoopWatchdog() {
+        stop_requested = true;
+        if (worker.joinable()) worker.join();
+        sigaction(signal_number, &previous_action, nullptr);
+    }
+
+    void begin_iteration() {
+        iteration_start_ns.store(now_ns(), std::memory_order_relaxed);
     }
 
-    // Set operations
-    bool sadd(const std::string& value) {
-        auto [_, inserted] = elements.insert(value);
-        return inserted;
+    void end_iteration() {
+        iteration_start_ns.store(0, std::memory_order_relaxed);
     }
 
-    bool sismember(const std::string& value) const {
-        return elements.find(value) != elements.end();
+    // A period of 0 disables stall detection
+    void set_period(uint64_t ms) {
+        period_ms = ms;
     }
 
-    bool srem(const std::string& value) {
-        return elements.erase(value) > 0;
+    uint64_t period() const {
+        return period_ms;
     }
 
-    int scard() const {
-        return static_cast<int>(elements.size());
+    uint64_t stall_count() const {
+        return stalls;
     }
 
-    std::vector<std::string> smembers() const {
-        return std::vector<std::string>(elements.begin(), elements.end());
+    std::string stack() {
+        std::lock_guard<std::mutex> guard(trace_lock);
+        return last_trace;
     }
 };
 
-// Hash data type (similar to Redis hashes)
-class HashType : public DataType {
+// Records incoming commands for later replay (CAPTURE START/STOP). The file
+// is CAPTURE_MAGIC, a varint version, then one record per command:
+//   varint microseconds since the previous record
+//   varint (connection id << 1) | pipelined
+//   varint length, command bytes
+// `pipelined` marks a command that arrived in the same read as the previous
+// command on its connection. Records are buffered and written in
+// CAPTURE_BUFFER_SIZE chunks, so a capturing event loop only pays for an
+// append; when capture is off the cost is one atomic load.
+class TrafficCapture {
 private:
-    std::unordered_map<std::string, std::string> fields;
+    using Clock = std::chrono::steady_clock;
 
-public:
-    ValueType get_type() const override {
-        return ValueType::HASH;
-    }
+    std::atomic<bool> active{false};
+    std::mutex lock;
+    std::ofstream file;
+    std::string path;
+    std::string buffer;
+    Clock::time_point last_record;
+    uint64_t records = 0;
+    uint64_t bytes = 0;
 
-    std::string serialize() const override {
-        std::string result = "H";
-        for (const auto& [field, value] : fields) {
-            result += std::to_string(field.size()) + ":" + field + ":" + 
-                      std::to_string(value.size()) + ":" + value + ",";
+    static void append_varint(std::string& out, uint64_t value) {
+        while (value >= 0x80) {
+            out += static_cast<char>((value & 0x7f) | 0x80);
+            value >>= 7;
         }
-        return result;
+        out += static_cast<char>(value);
     }
 
-    void deserialize(const std::string& data) override {
-        fields.clear();
-        if (data.empty() || data[0] != 'H') return;
-        
-        size_t pos = 1;
-        while (pos < data.size()) {
-            // Parse field
-            size_t colon_pos1 = data.find(':', pos);
-            if (colon_pos1 == std::string::npos) break;
-            
-            int field_len = std::stoi(data.substr(pos, colon_pos1 - pos));
-            std::string field = data.substr(colon_pos1 + 1, field_len);
-            
-            // Parse value
-            size_t colon_pos2 = data.find(':', colon_pos1 + field_len + 1);
-            if (colon_pos2 == std::string::npos) break;
-            
-            int value_len = std::stoi(data.substr(colon_pos1 + field_len + 1, 
-                                     colon_pos2 - (colon_pos1 + field_len + 1)));
-            std::string value = data.substr(colon_pos2 + 1, value_len);
-            
-            fields[field] = value;
-            pos = colon_pos2 + value_len + 2; // Skip past value and comma
-        }
+    void flush() {
+        file.write(buffer.data(), buffer.size());
+        bytes += buffer.size();
+        buffer.clear();
     }
 
-    std::string to_string() const override {
-        std::string result = "{";
-        bool first = true;
-        for (const auto& [field, value] : fields) {
-            if (!first) result += ", ";
-            result += field + ": " + value;
-            first = false;
-        }
-        result += "}";
-        return result;
+public:
+    ~TrafficCapture() {
+        stop();
+    }
+
+    bool start(const std::string& file_path) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (active) return false;
+        file.open(file_path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) return false;
+        path = file_path;
+        records = 0;
+        bytes = 0;
+        buffer = CAPTURE_MAGIC;
+        append_varint(buffer, CAPTURE_VERSION);
+        last_record = Clock::now();
+        active = true;
+        return true;
     }
 
-    // Hash operations
-    bool hset(const std::string& field, const std::string& value) {
-        bool is_new = fields.find(field) == fields.end();
-        fields[field] = value;
-        return is_new;
+    void stop() {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!active) return;
+        active = false;
+        flush();
+        file.close();
     }
 
-    std::string hget(const std::string& field) const {
-        auto it = fields.find(field);
-        return (it != fields.end()) ? it->second : "";
+    void record(uint64_t connection, const std::string& command, bool pipelined) {
+        if (!active.load(std::memory_order_relaxed)) return;
+        std::lock_guard<std::mutex> guard(lock);
+        if (!active) return;
+        auto now = Clock::now();
+        append_varint(buffer, std::chrono::duration_cast<std::chrono::microseconds>(now - last_record).count());
+        append_varint(buffer, connection << 1 | (pipelined ? 1 : 0));
+        append_varint(buffer, command.size());
+        buffer += command;
+        last_record = now;
+        records++;
+        if (buffer.size() >= CAPTURE_BUFFER_SIZE) flush();
     }
 
-    bool hexists(const std::string& field) const {
-        return fields.find(field) != fields.end();
+    std::string status() {
+        std::lock_guard<std::mutex> guard(lock);
+        return "capturing:" + std::string(active ? "1" : "0") + "\r\n"
+             + "file:" + path + "\r\n"
+             + "records:" + std::to_string(records) + "\r\n"
+             + "bytes:" + std::to_string(bytes + buffer.size()) + "\r\n";
     }
+};
 
-    bool hdel(const std::string& field) {
-        return fields.erase(field) > 0;
+// Counters for the MSG_ZEROCOPY send path (INFO zerocopy)
+struct ZeroCopyStats {
+    std::atomic<uint64_t> sends{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> completions{0};
+    std::atomic<uint64_t> copied{0};
+    std::atomic<uint64_t> fallbacks{0};
+
+    std::string report() const {
+        std::string result = "# Zerocopy\r\n";
+        result += "zerocopy_sends:" + std::to_string(sends.load()) + "\r\n";
+        result += "zerocopy_bytes:" + std::to_string(bytes.load()) + "\r\n";
+        result += "zerocopy_completions:" + std::to_string(completions.load()) + "\r\n";
+        result += "zerocopy_copied:" + std::to_string(copied.load()) + "\r\n";
+        result += "zerocopy_fallbacks:" + std::to_string(fallbacks.load()) + "\r\n";
+        return result;
     }
+};
 
-    int hlen() const {
-        return static_cast<int>(fields.size());
-    }
+static ZeroCopyStats zerocopy_stats;
 
-    std::vector<std::string> hkeys() const {
-        std::vector<std::string> keys;
-        keys.reserve(fields.size());
-        for (const auto& [field, _] : fields) {
-            keys.push_back(field);
+// A reply ready for the socket: encoded text, or a string value's shared
+// pre-encoded buffer that is written straight from the keyspace's copy
+struct Reply {
+    std::string text;
+    std::shared_ptr<const BulkString> bulk;
+
+    std::string_view data() const { return bulk ? bulk->resp() : std::string_view(text); }
+};
+
+// A command running as a C++20 coroutine. It starts eagerly and usually
+// finishes without suspending; a blocking command suspends on an awaitable
+// from CommandScheduler and is resumed later by the event loop. Plain
+// commands are wrapped without allocating a coroutine frame.
+class CommandTask {
+public:
+    struct promise_type {
+        std::string reply;
+
+        CommandTask get_return_object() {
+            return CommandTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_value(std::string value) { reply = std::move(value); }
+
+        // Errors become replies, as in CommandHandler::execute_command
+        void unhandled_exception() {
+            try {
+                throw;
+            } catch (const WrongTypeError& e) {
+                reply = "-" + std::string(e.what()) + "\r\n";
+            } catch (const std::exception& e) {
+                reply = "-ERR " + std::string(e.what()) + "\r\n";
+            }
         }
-        return keys;
-    }
+    };
 
-    std::vector<std::string> hvals() const {
-        std::vector<std::string> values;
-        values.reserve(fields.size());
-        for (const auto& [_, value] : fields) {
-            values.push_back(value);
+    explicit CommandTask(Reply ready_reply) : ready(std::move(ready_reply)) {}
+    explicit CommandTask(std::string ready_reply) : ready{std::move(ready_reply), nullptr} {}
+    CommandTask(CommandTask&& other) noexcept
+        : handle(std::exchange(other.handle, nullptr)), ready(std::move(other.ready)) {}
+    CommandTask& operator=(CommandTask&& other) noexcept {
+        if (this != &other) {
+            if (handle) handle.destroy();
+            handle = std::exchange(other.handle, nullptr);
+            ready = std::move(other.ready);
         }
-        return values;
+        return *this;
     }
-
-    std::unordered_map<std::string, std::string> hgetall() const {
-        return fields;
+    ~CommandTask() {
+        if (handle) handle.destroy();
     }
-};
 
-// LRU Cache for key management
-class LRUCache {
+    bool done() const { return !handle || handle.done(); }
+    Reply take_reply() { return handle ? Reply{std::move(handle.promise().reply), nullptr} : std::move(ready); }
+    std::coroutine_handle<> coroutine() const { return handle; }
+
 private:
-    std::list<std::string> cache;
-    std::unordered_map<std::string, std::list<std::string>::iterator> map;
-    size_t max_size;
+    explicit CommandTask(std::coroutine_handle<promise_type> h) : handle(h) {}
 
+    std::coroutine_handle<promise_type> handle;
+    Reply ready;
+};
+
+// Owns suspended commands for one event loop and the events that resume
+// them: pushes to watched keys, deadlines and work finished on the
+// background thread. Everything except the background worker and
+// notify_push runs on the loop thread; resumptions are queued and run from
+// run_ready() so a command never resumes inside another one.
+class CommandScheduler {
 public:
-    explicit LRUCache(size_t size) : max_size(size) {}
+    using Clock = std::chrono::steady_clock;
 
-    void access(const std::string& key) {
-        if (map.find(key) != map.end()) {
-            cache.erase(map[key]);
-        }
-        cache.push_front(key);
-        map[key] = cache.begin();
+    // Suspends until one of `keys` is pushed to or the deadline passes;
+    // resumes with false on timeout
+    class KeyWait {
+    private:
+        friend class CommandScheduler;
+
+        CommandScheduler& scheduler;
+        std::vector<std::string> keys;
+        Clock::time_point deadline;
+        uint64_t ticket;
+        uint64_t pushes_seen;
+        std::coroutine_handle<> handle;
+        bool registered = false;
+        bool timed_out = false;
+
+    public:
+        KeyWait(CommandScheduler& s, std::vector<std::string> watched, Clock::time_point until,
+                uint64_t place, uint64_t pushes)
+            : scheduler(s), keys(std::move(watched)), deadline(until), ticket(place), pushes_seen(pushes) {}
+        KeyWait(const KeyWait&) = delete;
+        KeyWait& operator=(const KeyWait&) = delete;
+        // Unregisters when the waiting command is destroyed (client disconnect)
+        ~KeyWait() { scheduler.unregister(this); }
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) {
+            handle = h;
+            scheduler.register_wait(this);
+        }
+        bool await_resume() { return !timed_out; }
+    };
+
+    // Runs `work` on the background thread and resumes with its result
+    class Offload {
+    private:
+        friend class CommandScheduler;
+
+        struct State {
+            std::function<std::string()> work;
+            std::string result;
+            std::coroutine_handle<> handle;
+            bool abandoned = false;  // loop thread only
+        };
+
+        CommandScheduler& scheduler;
+        std::shared_ptr<State> state;
+
+    public:
+        Offload(CommandScheduler& s, std::function<std::string()> work)
+            : scheduler(s), state(std::make_shared<State>()) {
+            state->work = std::move(work);
+        }
+        Offload(const Offload&) = delete;
+        Offload& operator=(const Offload&) = delete;
+        // The work cannot be interrupted, but its completion must not resume a destroyed command
+        ~Offload() { state->abandoned = true; }
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) {
+            state->handle = h;
+            scheduler.submit(state);
+        }
+        std::string await_resume() { return std::move(state->result); }
+    };
 
-        if (cache.size() > max_size) {
-            auto oldest = cache.back();
-            map.erase(oldest);
-            cache.pop_back();
+private:
+    struct Suspended {
+        CommandTask task;
+        int owner;
+        std::function<void(Reply)> complete;
+    };
+
+    std::unordered_map<void*, Suspended> suspended;
+    std::unordered_map<int, void*> owners;
+    std::unordered_map<std::string, std::deque<KeyWait*>> key_waits;
+    std::multimap<Clock::time_point, KeyWait*> deadlines;
+    std::deque<std::coroutine_handle<>> ready;
+    uint64_t next_ticket = 0;
+
+    // Keys pushed to off the loop thread, handed over through `wakeup`.
+    // `pushes_elsewhere` counts every such push, so a command that checked
+    // its keys before one landed notices when it registers.
+    std::thread::id loop_thread = std::this_thread::get_id();
+    std::mutex pushed_lock;
+    std::vector<std::string> pushed;
+    uint64_t pushes_elsewhere = 0;
+    size_t registered_waits = 0;
+
+    // Background worker and the completions it hands back through `wakeup`
+    int wakeup = -1;
+    std::mutex worker_lock;
+    std::condition_variable worker_cv;
+    std::deque<std::shared_ptr<Offload::State>> work_queue;
+    std::vector<std::shared_ptr<Offload::State>> finished;
+    bool stopping = false;
+    std::thread worker;
+
+    void register_wait(KeyWait* wait) {
+        wait->registered = true;
+        for (const auto& key : wait->keys) {
+            auto& queue = key_waits[key];
+            queue.insert(std::upper_bound(queue.begin(), queue.end(), wait->ticket,
+                                          [](uint64_t ticket, KeyWait* other) { return ticket < other->ticket; }),
+                         wait);
+        }
+        if (wait->deadline != Clock::time_point::max()) {
+            deadlines.emplace(wait->deadline, wait);
+        }
+        bool missed;
+        {
+            std::lock_guard<std::mutex> guard(pushed_lock);
+            registered_waits++;
+            missed = pushes_elsewhere != wait->pushes_seen;
+        }
+        // A push from another thread may have landed after the keys were checked
+        if (missed) wake(wait, false);
+    }
+
+    void unregister(KeyWait* wait) {
+        if (!wait->registered) return;
+        wait->registered = false;
+        {
+            std::lock_guard<std::mutex> guard(pushed_lock);
+            registered_waits--;
+        }
+        for (const auto& key : wait->keys) {
+            auto it = key_waits.find(key);
+            if (it == key_waits.end()) continue;
+            auto& queue = it->second;
+            queue.erase(std::remove(queue.begin(), queue.end(), wait), queue.end());
+            if (queue.empty()) key_waits.erase(it);
+        }
+        auto range = deadlines.equal_range(wait->deadline);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == wait) {
+                deadlines.erase(it);
+                break;
+            }
         }
     }
 
-    bool contains(const std::string& key) const {
-        return map.find(key) != map.end();
+    void wake(KeyWait* wait, bool timed_out) {
+        unregister(wait);
+        wait->timed_out = timed_out;
+        ready.push_back(wait->handle);
     }
 
-    void remove(const std::string& key) {
-        if (map.find(key) != map.end()) {
-            cache.erase(map[key]);
-            map.erase(key);
+    void submit(std::shared_ptr<Offload::State> state) {
+        {
+            std::lock_guard<std::mutex> guard(worker_lock);
+            work_queue.push_back(std::move(state));
         }
+        worker_cv.notify_one();
     }
 
-    std::string get_oldest() const {
-        if (cache.empty()) {
-            throw std::runtime_error("Cache is empty");
+    void worker_loop() {
+        thread_placement.pin(ThreadPlacement::Role::BACKGROUND);
+        while (true) {
+            std::shared_ptr<Offload::State> state;
+            {
+                std::unique_lock<std::mutex> guard(worker_lock);
+                worker_cv.wait(guard, [this] { return stopping || !work_queue.empty(); });
+                if (stopping) return;
+                state = std::move(work_queue.front());
+                work_queue.pop_front();
+            }
+            try {
+                state->result = state->work();
+            } catch (const std::exception& e) {
+                state->result = "-ERR " + std::string(e.what()) + "\r\n";
+            }
+            {
+                std::lock_guard<std::mutex> guard(worker_lock);
+                finished.push_back(std::move(state));
+            }
+            uint64_t one = 1;
+            ssize_t written = write(wakeup, &one, sizeof(one));
+            (void)written;
         }
-        return cache.back();
-    }
-
-    size_t size() const {
-        return cache.size();
-    }
-};
-
-// Bloom Filter for probabilistic key existence checking
-class BloomFilter {
-private:
-    std::bitset<BLOOM_FILTER_SIZE> filter;
-    
-    size_t hash(const std::string& key) const {
-        std::hash<std::string> hasher;
-        return hasher(key) % BLOOM_FILTER_SIZE;
     }
 
 public:
-    void add(const std::string& key) {
-        filter.set(hash(key));
-    }
-
-    bool contains(const std::string& key) const {
-        return filter.test(hash(key));
-    }
-};
+    CommandScheduler() : wakeup(eventfd(0, EFD_NONBLOCK)), worker([this] { worker_loop(); }) {}
+    CommandScheduler(const CommandScheduler&) = delete;
+    CommandScheduler& operator=(const CommandScheduler&) = delete;
 
-// Main database class supporting multiple data types
-class BlinkDB {
-private:
-    std::unordered_map<std::string, std::unique_ptr<DataType>> store;
-    LRUCache cache;
-    BloomFilter bloom_filter;
-    std::shared_mutex rw_lock;
-    std::string persistence_file = "blinkdb_data.txt";
-    
-    void evict_if_needed() {
-        if (cache.size() > CACHE_SIZE) {
-            std::string oldest_key = cache.get_oldest();
-            cache.remove(oldest_key);
-            store.erase(oldest_key);
+    ~CommandScheduler() {
+        {
+            std::lock_guard<std::mutex> guard(worker_lock);
+            stopping = true;
         }
+        worker_cv.notify_one();
+        worker.join();
+        suspended.clear();
+        if (wakeup != -1) close(wakeup);
     }
 
-public:
-    explicit BlinkDB() : cache(CACHE_SIZE) { load_from_disk(); }
-
-    ~BlinkDB() { save_to_disk(); }
+    // Readable when background work has finished or another thread pushed
+    // to a list; add it to the loop's epoll set and drain it when it fires
+    int wakeup_fd() const { return wakeup; }
 
-    // Basic operations
-    void set(const std::string& key, const std::string& value) {
-        std::unique_lock lock(rw_lock);
-        auto string_value = std::make_unique<StringType>(value);
-        store[key] = std::move(string_value);
-        cache.access(key);
-        evict_if_needed();
-        bloom_filter.add(key);
+    // Read before run_ready, so a wakeup written after run_ready collected
+    // its work only costs one more pass instead of leaving the fd readable
+    void drain_wakeup() {
+        uint64_t count;
+        ssize_t drained = read(wakeup, &count, sizeof(count));
+        (void)drained;
     }
 
-    std::string get(const std::string& key) {
-        std::shared_lock lock(rw_lock);
-        if (!bloom_filter.contains(key) || store.find(key) == store.end()) {
-            return "NULL";
-        }
-        
-        cache.access(key);
-        
-        // Check if the value is a string
-        if (store[key]->get_type() == ValueType::STRING) {
-            auto* string_value = dynamic_cast<StringType*>(store[key].get());
-            return string_value->get();
-        }
-        
-        return "WRONGTYPE Operation against a key holding the wrong kind of value";
+    // A place behind every command already waiting. Waiters on a key are
+    // woken in ticket order, and a command that lost the pushed element to
+    // another client waits again with the same ticket to keep its place.
+    uint64_t take_ticket() { return next_ticket++; }
+
+    // How many pushes have been made off the loop thread; read it before
+    // checking the keys and pass it to wait_for_keys, so a push that lands
+    // in between is not missed
+    uint64_t pushes_seen() {
+        std::lock_guard<std::mutex> guard(pushed_lock);
+        return pushes_elsewhere;
     }
 
-    void del(const std::string& key) {
-        std::unique_lock lock(rw_lock);
-        store.erase(key);
-        cache.remove(key);
+    KeyWait wait_for_keys(std::vector<std::string> keys, Clock::time_point deadline, uint64_t ticket, uint64_t pushes) {
+        return KeyWait(*this, std::move(keys), deadline, ticket, pushes);
     }
 
-    // Get type of a key
-    std::string type(const std::string& key) {
-        std::shared_lock lock(rw_lock);
-        if (!bloom_filter.contains(key) || store.find(key) == store.end()) {
-            return "none";
-        }
-        
-        switch (store[key]->get_type()) {
-            case ValueType::STRING: return "string";
-            case ValueType::LIST: return "list";
-            case ValueType::SET: return "set";
-            case ValueType::HASH: return "hash";
-            default: return "unknown";
-        }
-    }
-
-    // List operations
-    bool create_list_if_needed(const std::string& key) {
-        if (store.find(key) == store.end()) {
-            auto list_value = std::make_unique<ListType>();
-            store[key] = std::move(list_value);
-            bloom_filter.add(key);
-            return true;
-        } else if (store[key]->get_type() != ValueType::LIST) {
-            return false;
-        }
-        return true;
+    Offload offload(std::function<std::string()> work) {
+        return Offload(*this, std::move(work));
     }
 
-    std::string lpush(const std::string& key, const std::string& value) {
-        std::unique_lock lock(rw_lock);
-        
-        if (!create_list_if_needed(key)) {
-            return "WRONGTYPE Operation against a key holding the wrong kind of value";
+    // Returns the reply of a command that finished right away; otherwise
+    // keeps it and calls `complete` with the reply once it finishes
+    std::optional<Reply> start(int owner, CommandTask task, std::function<void(Reply)> complete) {
+        if (task.done()) {
+            return task.take_reply();
         }
-        
-        auto* list = dynamic_cast<ListType*>(store[key].get());
-        list->lpush(value);
-        cache.access(key);
-        evict_if_needed();
-        
-        return std::to_string(list->llen());
+        void* frame = task.coroutine().address();
+        owners[owner] = frame;
+        suspended.emplace(frame, Suspended{std::move(task), owner, std::move(complete)});
+        return std::nullopt;
     }
 
-    std::string rpush(const std::string& key, const std::string& value) {
-        std::unique_lock lock(rw_lock);
-        
-        if (!create_list_if_needed(key)) {
-            return "WRONGTYPE Operation against a key holding the wrong kind of value";
-        }
-        
-        auto* list = dynamic_cast<ListType*>(store[key].get());
-        list->rpush(value);
-        cache.access(key);
-        evict_if_needed();
-        
-        return std::to_string(list->llen());
+    // Drops the suspended command of a client that disconnected
+    void cancel(int owner) {
+        auto it = owners.find(owner);
+        if (it == owners.end()) return;
+        void* frame = it->second;
+        owners.erase(it);
+        ready.erase(std::remove_if(ready.begin(), ready.end(),
+                                   [frame](std::coroutine_handle<> h) { return h.address() == frame; }),
+                    ready.end());
+        suspended.erase(frame);
     }
 
-    std::string lpop(const std::string& key) {
-        std::unique_lock lock(rw_lock);
-        
-        if (store.find(key) == store.end()) {
-            return "NULL";
-        }
-        
-        if (store[key]->get_type() != ValueType::LIST) {
-            return "WRONGTYPE Operation against a key holding the wrong kind of value";
-        }
-        
-        auto* list = dynamic_cast<ListType*>(store[key].get());
-        std::string result = list->lpop();
-        cache.access(key);
-        
-        if (list->llen() == 0) {
-            store.erase(key);
-            cache.remove(key);
+    // Wakes the longest waiting command blocked on `key`
+    void signal_key(const std::string& key) {
+        auto it = key_waits.find(key);
+        if (it != key_waits.end()) {
+            wake(it->second.front(), false);
         }
-        
-        return result.empty() ? "NULL" : result;
     }
 
-    std::string rpop(const std::string& key) {
-        std::unique_lock lock(rw_lock);
-        
-        if (store.find(key) == store.end()) {
-            return "NULL";
-        }
-        
-        if (store[key]->get_type() != ValueType::LIST) {
-            return "WRONGTYPE Operation against a key holding the wrong kind of value";
+    // signal_key for a list push made on any thread. Pushes from other
+    // threads (an offloaded DEBUG POPULATE) are queued for run_ready, and
+    // only while some command waits.
+    void notify_push(const std::string& key) {
+        if (std::this_thread::get_id() == loop_thread) {
+            signal_key(key);
+            return;
         }
-        
-        auto* list = dynamic_cast<ListType*>(store[key].get());
-        std::string result = list->rpop();
-        cache.access(key);
-        
-        if (list->llen() == 0) {
-            store.erase(key);
-            cache.remove(key);
+        {
+            std::lock_guard<std::mutex> guard(pushed_lock);
+            pushes_elsewhere++;
+            if (registered_waits == 0) return;
+            pushed.push_back(key);
         }
-        
-        return result.empty() ? "NULL" : result;
+        uint64_t one = 1;
+        ssize_t written = write(wakeup, &one, sizeof(one));
+        (void)written;
     }
 
-    std::string lindex(const std::string& key, int index) {
-        std::shared_lock lock(rw_lock);
-        
-        if (store.find(key) == store.end()) {
-            return "NULL";
-        }
-        
-        if (store[key]->get_type() != ValueType::LIST) {
-            return "WRONGTYPE Operation against a key holding the wrong kind of value";
-        }
-        
-        auto* list = dynamic_cast<ListType*>(store[key].get());
-        std::string result = list->lindex(index);
-        cache.access(key);
-        
-        return result.empty() ? "NULL" : result;
+    // Milliseconds until the next deadline for epoll_wait (-1 when none, 0 when work is ready)
+    int timeout_ms() const {
+        if (!ready.empty()) return 0;
+        if (deadlines.empty()) return -1;
+        auto wait = std::chrono::ceil<std::chrono::milliseconds>(deadlines.begin()->first - Clock::now());
+        return static_cast<int>(std::max<int64_t>(0, wait.count()));
     }
 
-    std::string llen(const std::string& key) {
-        std::shared_lock lock(rw_lock);
-        
-        if (store.find(key) == store.end()) {
-            return "0";
+    // Collects expired deadlines, pushes from other threads and finished
+    // background work, then resumes every ready command, completing those
+    // that run to the end
+    void run_ready() {
+        auto now = Clock::now();
+        while (!deadlines.empty() && deadlines.begin()->first <= now) {
+            wake(deadlines.begin()->second, true);
         }
-        
-        if (store[key]->get_type() != ValueType::LIST) {
-            return "WRONGTYPE Operation against a key holding the wrong kind of value";
+
+        std::vector<std::string> keys;
+        {
+            std::lock_guard<std::mutex> guard(pushed_lock);
+            keys.swap(pushed);
         }
-        
-        auto* list = dynamic_cast<ListType*>(store[key].get());
-        cache.access(key);
-        
-        return std::to_string(list->llen());
-    }
+        for (const auto& key : keys) signal_key(key);
 
-    std::string lrange(const std::string& key, int start, int end) {
-        std::shared_lock lock(rw_lock);
-        
-        if (store.find(key) == store.end()) {
-            return "*0\r\n";
+        std::vector<std::shared_ptr<Offload::State>> completed;
+        {
+            std::lock_guard<std::mutex> guard(worker_lock);
+            completed.swap(finished);
         }
-        
-        if (store[key]->get_type() != ValueType::LIST) {
-            return "WRONGTYPE Operation against a key holding the wrong kind of value";
+        for (const auto& state : completed) {
+            if (!state->abandoned) ready.push_back(state->handle);
         }
-        
-        auto* list = dynamic_cast<ListType*>(store[key].get());
-        std::vector<std::string> results = list->lrange(start, end);
-        cache.access(key);
-        
-        std::string response = "*" + std::to_string(results.size()) + "\r\n";
-        for (const auto& item : results) {
-            response += "$" + std::to_string(item.size()) + "\r\n" + item + "\r\n";
+
+        while (!ready.empty()) {
+            std::coroutine_handle<> handle = ready.front();
+            ready.pop_front();
+            handle.resume();
+            if (!handle.done()) continue;
+            
+            auto it = suspended.find(handle.address());
+            if (it == suspended.end()) continue;
+            Reply reply = it->second.task.take_reply();
+            auto complete = std::move(it->second.complete);
+            owners.erase(it->second.owner);
+            suspended.erase(it);
+            complete(std::move(reply));
         }
-        
-        return response;
     }
+};
 
-    // Set operations
-    bool create_set_if_needed(const std::string& key) {
-        if (store.find(key) == store.end()) {
-            auto set_value = std::make_unique<SetType>();
-            store[key] = std::move(set_value);
-            bloom_filter.add(key);
-            return true;
-        } else if (store[key]->get_type() != ValueType::SET) {
-            return false;
-        }
-        return true;
+// Protocol handler for parsing and processing Redis-like commands
+class CommandHandler {
+private:
+    BlinkDBEngine& db;
+    KeyspaceAnalyzer analyzer;
+    EventLoopWatchdog* watchdog = nullptr;
+    TrafficCapture* capture = nullptr;
+    CommandScheduler* scheduler = nullptr;
+    // Keys this handler's engine owns when the keyspace is partitioned across shards
+    std::function<bool(const std::string&)> key_filter;
+
+    // RESP encoders for the engine's typed results
+    static std::string bulk_reply(const std::optional<std::string>& value) {
+        if (!value) return "$-1\r\n";
+        return "$" + std::to_string(value->size()) + "\r\n" + *value + "\r\n";
     }
 
-    std::string sadd(const std::string& key, const std::string& value) {
-        std::unique_lock lock(rw_lock);
-        
-        if (!create_set_if_needed(key)) {
-            return "WRONGTYPE Operation against a key holding the wrong kind of value";
-        }
-        
-        auto* set = dynamic_cast<SetType*>(store[key].get());
-        bool added = set->sadd(value);
-        cache.access(key);
-        evict_if_needed();
-        
-        return added ? "1" : "0";
+    static std::string integer_reply(long long value) {
+        return ":" + std::to_string(value) + "\r\n";
     }
 
-    std::string sismember(const std::string& key, const std::string& value) {
-        std::shared_lock lock(rw_lock);
-        
-        if (store.find(key) == store.end()) {
-            return "0";
-        }
-        
-        if (store[key]->get_type() != ValueType::SET) {
-            return "WRONGTYPE Operation against a key holding the wrong kind of value";
+    static std::string array_reply(const std::vector<std::string>& items) {
+        std::string response = "*" + std::to_string(items.size()) + "\r\n";
+        for (const auto& item : items) {
+            response += bulk_reply(item);
         }
-        
-        auto* set = dynamic_cast<SetType*>(store[key].get());
-        bool is_member = set->sismember(value);
-        cache.access(key);
-        
-        return is_member ? "1" : "0";
+        return response;
     }
 
-    std::string srem(const std::string& key, const std::string& value) {
-        std::unique_lock lock(rw_lock);
-        
-        if (store.find(key) == store.end()) {
-            return "0";
-        }
-        
-        if (store[key]->get_type() != ValueType::SET) {
-            return "WRONGTYPE Operation against a key holding the wrong kind of value";
-        }
-        
-        auto* set = dynamic_cast<SetType*>(store[key].get());
-        bool removed = set->srem(value);
-        cache.access(key);
-        
-        if (set->scard() == 0) {
-            store.erase(key);
-            cache.remove(key);
+    // Parses a non-negative integer argument
+    static size_t count_arg(const std::string& text) {
+        if (text.empty() || text.size() > 18 || text.find_first_not_of("0123456789") != std::string::npos) {
+            throw std::invalid_argument("value is not an integer");
         }
-        
-        return removed ? "1" : "0";
+        return std::stoull(text);
     }
 
-    std::string scard(const std::string& key) {
-        std::shared_lock lock(rw_lock);
-        
-        if (store.find(key) == store.end()) {
-            return "0";
+    // Parses a BLPOP/BRPOP timeout in seconds, rejecting junk and negatives
+    static double timeout_arg(const std::string& text) {
+        char* end = nullptr;
+        double timeout = std::strtod(text.c_str(), &end);
+        if (text.empty() || end != text.c_str() + text.size() || !std::isfinite(timeout)) {
+            throw std::invalid_argument("timeout is not a float or out of range");
         }
-        
-        if (store[key]->get_type() != ValueType::SET) {
-            return "WRONGTYPE Operation against a key holding the wrong kind of value";
-        }
-        
-        auto* set = dynamic_cast<SetType*>(store[key].get());
-        cache.access(key);
-        
-        return std::to_string(set->scard());
+        if (timeout < 0) throw std::invalid_argument("timeout is negative");
+        return timeout;
     }
 
-    std::string smembers(const std::string& key) {
-        std::shared_lock lock(rw_lock);
-        
-        if (store.find(key) == store.end()) {
-            return "*0\r\n";
-        }
-        
-        if (store[key]->get_type() != ValueType::SET) {
-            return "WRONGTYPE Operation against a key holding the wrong kind of value";
-        }
-        
-        auto* set = dynamic_cast<SetType*>(store[key].get());
-        std::vector<std::string> members = set->smembers();
-        cache.access(key);
-        
-        std::string response = "*" + std::to_string(members.size()) + "\r\n";
-        for (const auto& member : members) {
-            response += "$" + std::to_string(member.size()) + "\r\n" + member + "\r\n";
+    static std::string hotkeys_reply(const std::vector<std::pair<std::string, uint64_t>>& top) {
+        std::string response = "*" + std::to_string(top.size() * 2) + "\r\n";
+        for (const auto& [key, hits] : top) {
+            response += bulk_reply(key) + bulk_reply(std::to_string(hits));
         }
-        
         return response;
     }
 
-    // Hash operations
-    bool create_hash_if_needed(const std::string& key) {
-        if (store.find(key) == store.end()) {
-            auto hash_value = std::make_unique<HashType>();
-            store[key] = std::move(hash_value);
-            bloom_filter.add(key);
-            return true;
-        } else if (store[key]->get_type() != ValueType::HASH) {
-            return false;
+    // Pops from the first of `keys` holding an element, returning the key and value
+    std::optional<std::pair<std::string, std::string>> pop_first(const std::vector<std::string>& keys, bool left) {
+        for (const auto& key : keys) {
+            auto value = left ? db.lpop(key) : db.rpop(key);
+            if (value) return std::make_pair(key, std::move(*value));
         }
-        return true;
+        return std::nullopt;
     }
 
-    std::string hset(const std::string& key, const std::string& field, const std::string& value) {
-        std::unique_lock lock(rw_lock);
-        
-        if (!create_hash_if_needed(key)) {
-            return "WRONGTYPE Operation against a key holding the wrong kind of value";
-        }
-        
-        auto* hash = dynamic_cast<HashType*>(store[key].get());
-        bool added = hash->hset(field, value);
-        cache.access(key);
-        evict_if_needed();
-        
-        return added ? "1" : "0";
+    static std::string pop_reply(const std::optional<std::pair<std::string, std::string>>& popped) {
+        if (!popped) return "*-1\r\n";
+        return "*2\r\n" + bulk_reply(popped->first) + bulk_reply(popped->second);
     }
 
-    std::string hget(const std::string& key, const std::string& field) {
-        std::shared_lock lock(rw_lock);
-        
-        if (store.find(key) == store.end()) {
-            return "NULL";
-        }
-        
-        if (store[key]->get_type() != ValueType::HASH) {
-            return "WRONGTYPE Operation against a key holding the wrong kind of value";
-        }
-        
-        auto* hash = dynamic_cast<HashType*>(store[key].get());
-        std::string result = hash->hget(field);
-        cache.access(key);
-        
-        return result.empty() ? "NULL" : result;
+    // BLPOP/BRPOP key [key ...] timeout: suspends until a push to one of the
+    // keys or the timeout in seconds (0 waits forever)
+    CommandTask blocking_pop(std::vector<std::string> command_parts, bool left) {
+        std::vector<std::string> keys(command_parts.begin() + 1, command_parts.end() - 1);
+        double timeout = timeout_arg(command_parts.back());
+        auto deadline = timeout == 0 ? CommandScheduler::Clock::time_point::max()
+            : CommandScheduler::Clock::now()
+                + std::chrono::duration_cast<CommandScheduler::Clock::duration>(std::chrono::duration<double>(timeout));
+
+        // Another client may take the pushed element before this one resumes
+        uint64_t ticket = scheduler->take_ticket();
+        while (true) {
+            uint64_t pushes = scheduler->pushes_seen();
+            std::optional<std::pair<std::string, std::string>> popped;
+            {
+                // Not held across the suspension: other commands run on this thread meanwhile
+                InstrumentedSharedMutex::CommandScope command_scope(left ? "blpop" : "brpop");
+                popped = pop_first(keys, left);
+            }
+            if (popped) co_return pop_reply(popped);
+            if (!co_await scheduler->wait_for_keys(keys, deadline, ticket, pushes)) co_return pop_reply(std::nullopt);
+        }
+    }
+
+    // MEMORY STATS walks every key; build it on the background thread
+    CommandTask offloaded_memory_stats() {
+        // The walk runs on the worker thread, which needs its own attribution
+        std::string result = co_await scheduler->offload([this] {
+            InstrumentedSharedMutex::CommandScope command_scope("memory");
+            return db.memory_stats();
+        });
+        co_return "$" + std::to_string(result.size()) + "\r\n" + result + "\r\n";
+    }
+
+    // DEBUG POPULATE releases the keyspace lock between batches; run on the
+    // background thread, it leaves the loop free to serve other clients
+    CommandTask offloaded_populate(std::string command_str) {
+        // Built outside the co_await: GCC destroys a capturing lambda
+        // temporary in the awaited expression twice
+        CommandScheduler::Offload populate = scheduler->offload([this, command_str] {
+            return process_command(command_str);
+        });
+        co_return co_await populate;
+    }
+
+    std::string latency_command(const std::vector<std::string>& command_parts) {
+        std::string sub = command_parts[1];
+        std::transform(sub.begin(), sub.end(), sub.begin(), ::tolower);
+        LatencyMonitor& monitor = db.latency();
+        
+        if (sub == "latest") {
+            auto events = monitor.latest();
+            std::string response = "*" + std::to_string(events.size()) + "\r\n";
+            for (const auto& [name, event] : events) {
+                response += "*4\r\n$" + std::to_string(name.size()) + "\r\n" + name + "\r\n"
+                         +  ":" + std::to_string(event.latest.time) + "\r\n"
+                         +  ":" + std::to_string(event.latest.latency_ms) + "\r\n"
+                         +  ":" + std::to_string(event.max_ms) + "\r\n";
+            }
+            return response;
+        } else if (sub == "history" && command_parts.size() >= 3) {
+            auto samples = monitor.history(command_parts[2]);
+            std::string response = "*" + std::to_string(samples.size()) + "\r\n";
+            for (const auto& sample : samples) {
+                response += "*2\r\n:" + std::to_string(sample.time) + "\r\n"
+                         +  ":" + std::to_string(sample.latency_ms) + "\r\n";
+            }
+            return response;
+        } else if (sub == "reset") {
+            size_t count = monitor.reset(std::vector<std::string>(command_parts.begin() + 2, command_parts.end()));
+            return ":" + std::to_string(count) + "\r\n";
+        } else if (sub == "threshold" && command_parts.size() >= 3) {
+            monitor.set_threshold(count_arg(command_parts[2]));
+            return "+OK\r\n";
+        } else if (sub == "watchdog" && command_parts.size() >= 3 && watchdog) {
+            watchdog->set_period(count_arg(command_parts[2]));
+            return "+OK\r\n";
+        } else if (sub == "stack" && watchdog) {
+            std::string trace = watchdog->stack();
+            if (trace.empty()) return "$-1\r\n";
+            return "$" + std::to_string(trace.size()) + "\r\n" + trace + "\r\n";
+        }
+        return "-ERR unknown LATENCY subcommand '" + sub + "'\r\n";
+    }
+
+    // A RANGE bound: a number, -inf/+inf, or "(" before the number to exclude it
+    static double range_bound(const std::string& text, bool is_min) {
+        bool exclusive = !text.empty() && text[0] == '(';
+        std::string number = exclusive ? text.substr(1) : text;
+        char* end = nullptr;
+        double value = std::strtod(number.c_str(), &end);
+        if (number.empty() || end != number.c_str() + number.size() || std::isnan(value)) {
+            throw std::invalid_argument("min or max is not a float");
+        }
+        if (!exclusive) return value;
+        return std::nextafter(value, is_min ? HUGE_VAL : -HUGE_VAL);
     }
 
-    std::string hexists(const std::string& key, const std::string& field) {
-        std::shared_lock lock(rw_lock);
-        
-        if (store.find(key) == store.end()) {
-            return "0";
-        }
-        
-        if (store[key]->get_type() != ValueType::HASH) {
-            return "WRONGTYPE Operation against a key holding the wrong kind of value";
+public:
+    // The predicates and LIMIT (0 when absent) of INDEX QUERY; false on a syntax error
+    static bool parse_index_query(const std::vector<std::string>& command_parts,
+                                  std::vector<FieldPredicate>& predicates, size_t& limit) {
+        size_t i = 2;
+        while (i < command_parts.size()) {
+            std::string word = command_parts[i];
+            std::transform(word.begin(), word.end(), word.begin(), ::tolower);
+            if (word == "limit" && i + 1 < command_parts.size()) {
+                limit = count_arg(command_parts[i + 1]);
+                i += 2;
+                continue;
+            }
+            if (i + 2 >= command_parts.size()) return false;
+            std::string op = command_parts[i + 1];
+            std::transform(op.begin(), op.end(), op.begin(), ::tolower);
+            FieldPredicate predicate;
+            predicate.index = command_parts[i];
+            if (op == "eq") {
+                predicate.value = command_parts[i + 2];
+                i += 3;
+            } else if (op == "range" && i + 3 < command_parts.size()) {
+                predicate.range = true;
+                predicate.min = range_bound(command_parts[i + 2], true);
+                predicate.max = range_bound(command_parts[i + 3], false);
+                i += 4;
+            } else {
+                return false;
+            }
+            predicates.push_back(std::move(predicate));
         }
-        
-        auto* hash = dynamic_cast<HashType*>(store[key].get());
-        bool exists = hash->hexists(field);
-        cache.access(key);
-        
-        return exists ? "1" : "0";
+        return !predicates.empty();
     }
 
-    std::string hdel(const std::string& key, const std::string& field) {
-        std::unique_lock lock(rw_lock);
-        
-        if (store.find(key) == store.end()) {
-            return "0";
-        }
-        
-        if (store[key]->get_type() != ValueType::HASH) {
-            return "WRONGTYPE Operation against a key holding the wrong kind of value";
-        }
-        
-        auto* hash = dynamic_cast<HashType*>(store[key].get());
-        bool removed = hash->hdel(field);
-        cache.access(key);
-        
-        if (hash->hlen() == 0) {
-            store.erase(key);
-            cache.remove(key);
+private:
+    // INDEX CREATE name prefix field [EQUALITY|NUMERIC] | DROP name | LIST
+    // INDEX QUERY name EQ value [name RANGE min max ...] [LIMIT count]
+    std::string index_command(const std::vector<std::string>& command_parts) {
+        std::string sub = command_parts[1];
+        std::transform(sub.begin(), sub.end(), sub.begin(), ::tolower);
+        
+        if (sub == "create" && command_parts.size() >= 5) {
+            FieldIndexType type = FieldIndexType::EQUALITY;
+            if (command_parts.size() >= 6) {
+                std::string type_name = command_parts[5];
+                std::transform(type_name.begin(), type_name.end(), type_name.begin(), ::tolower);
+                if (type_name == "numeric") type = FieldIndexType::NUMERIC;
+                else if (type_name != "equality") return "-ERR unknown index type '" + type_name + "'\r\n";
+            }
+            if (!db.create_index(command_parts[2], command_parts[3], command_parts[4], type)) {
+                return "-ERR index '" + command_parts[2] + "' already exists\r\n";
+            }
+            return "+OK\r\n";
+        } else if (sub == "drop" && command_parts.size() >= 3) {
+            return integer_reply(db.drop_index(command_parts[2]));
+        } else if (sub == "list") {
+            auto indexes = db.list_indexes();
+            std::string response = "*" + std::to_string(indexes.size()) + "\r\n";
+            for (const auto& index : indexes) {
+                response += "*5\r\n" + bulk_reply(index.name) + bulk_reply(index.prefix) + bulk_reply(index.field)
+                          + bulk_reply(index.type == FieldIndexType::NUMERIC ? "numeric" : "equality")
+                          + integer_reply(index.keys);
+            }
+            return response;
+        } else if (sub == "query" && command_parts.size() >= 5) {
+            std::vector<FieldPredicate> predicates;
+            size_t limit = 0;
+            if (!parse_index_query(command_parts, predicates, limit)) return "-ERR syntax error\r\n";
+            return array_reply(db.query_index(predicates, limit));
         }
-        
-        return removed ? "1" : "0";
+        return "-ERR unknown INDEX subcommand '" + sub + "'\r\n";
     }
 
-    std::string hlen(const std::string& key) {
-        std::shared_lock lock(rw_lock);
+    std::string execute_command(const std::string& command_str) {
+        std::vector<std::string> command_parts;
+        std::istringstream iss(command_str);
+        std::string part;
         
-        if (store.find(key) == store.end()) {
-            return "0";
+        while (iss >> part) {
+            command_parts.push_back(part);
         }
         
-        if (store[key]->get_type() != ValueType::HASH) {
-            return "WRONGTYPE Operation against a key holding the wrong kind of value";
+        if (command_parts.empty()) {
+            return "-ERR empty command\r\n";
         }
         
-        auto* hash = dynamic_cast<HashType*>(store[key].get());
-        cache.access(key);
+        std::string cmd = command_parts[0];
+        std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::tolower);
         
-        return std::to_string(hash->hlen());
-    }
-
-    std::string hkeys(const std::string& key) {
-        std::shared_lock lock(rw_lock);
-        
-        if (store.find(key) == store.end()) {
-            return "*0\r\n";
-        }
-        
-        if (store[key]->get_type() != ValueType::HASH) {
-            return "WRONGTYPE Operation against a key holding the wrong kind of value";
-        }
-        
-        auto* hash = dynamic_cast<HashType*>(store[key].get());
-        std::vector<std::string> keys = hash->hkeys();
-        cache.access(key);
-        
-        std::string response = "*" + std::to_string(keys.size()) + "\r\n";
-        for (const auto& k : keys) {
-            response += "$" + std::to_string(k.size()) + "\r\n" + k + "\r\n";
-        }
-        
-        return response;
-    }
-
-    std::string hvals(const std::string& key) {
-        std::shared_lock lock(rw_lock);
-        
-        if (store.find(key) == store.end()) {
-            return "*0\r\n";
-        }
-        
-        if (store[key]->get_type() != ValueType::HASH) {
-            return "WRONGTYPE Operation against a key holding the wrong kind of value";
-        }
-        
-        auto* hash = dynamic_cast<HashType*>(store[key].get());
-        std::vector<std::string> values = hash->hvals();
-        cache.access(key);
-        
-        std::string response = "*" + std::to_string(values.size()) + "\r\n";
-        for (const auto& v : values) {
-            response += "$" + std::to_string(v.size()) + "\r\n" + v + "\r\n";
-        }
-        
-        return response;
-    }
-
-std::string hgetall(const std::string& key) {
-        std::shared_lock lock(rw_lock);
-        
-        if (store.find(key) == store.end()) {
-            return "*0\r\n";
-        }
-        
-        if (store[key]->get_type() != ValueType::HASH) {
-            return "WRONGTYPE Operation against a key holding the wrong kind of value";
-        }
-        
-        auto* hash = dynamic_cast<HashType*>(store[key].get());
-        auto fields = hash->hgetall();
-        cache.access(key);
-        
-        std::string response = "*" + std::to_string(fields.size() * 2) + "\r\n";
-        for (const auto& [field, value] : fields) {
-            response += "$" + std::to_string(field.size()) + "\r\n" + field + "\r\n"
-                     +  "$" + std::to_string(value.size()) + "\r\n" + value + "\r\n";
-        }
-        
-        return response;
-    }
-
-    // Persistence operations
-    void save_to_disk() {
-        std::shared_lock lock(rw_lock);
-        std::ofstream file(persistence_file);
-        
-        if (!file) {
-            std::cerr << "Failed to open file for writing: " << persistence_file << std::endl;
-            return;
-        }
-        
-        for (const auto& [key, value] : store) {
-            char type_char;
-            switch (value->get_type()) {
-                case ValueType::STRING: type_char = 'S'; break;
-                case ValueType::LIST: type_char = 'L'; break;
-                case ValueType::SET: type_char = 'E'; break;
-                case ValueType::HASH: type_char = 'H'; break;
-                default: continue;
-            }
-            
-            file << type_char << " " << key << " " << value->serialize() << std::endl;
-        }
-        
-        file.close();
-    }
-
-    void load_from_disk() {
-        std::unique_lock lock(rw_lock);
-        std::ifstream file(persistence_file);
-        
-        if (!file) {
-            std::cerr << "No persistence file found or unable to open: " << persistence_file << std::endl;
-            return;
-        }
-        
-        std::string line;
-        while (std::getline(file, line)) {
-            if (line.empty() || line.size() < 3) continue;
-            
-            char type_char = line[0];
-            size_t first_space = line.find(' ');
-            size_t second_space = line.find(' ', first_space + 1);
-            
-            if (first_space == std::string::npos || second_space == std::string::npos) continue;
-            
-            std::string key = line.substr(first_space + 1, second_space - first_space - 1);
-            std::string data = line.substr(second_space + 1);
-            
-            std::unique_ptr<DataType> value;
-            
-            switch (type_char) {
-                case 'S': {
-                    auto string_value = std::make_unique<StringType>();
-                    string_value->deserialize(data);
-                    value = std::move(string_value);
-                    break;
-                }
-                case 'L': {
-                    auto list_value = std::make_unique<ListType>();
-                    list_value->deserialize(data);
-                    value = std::move(list_value);
-                    break;
-                }
-                case 'E': {
-                    auto set_value = std::make_unique<SetType>();
-                    set_value->deserialize(data);
-                    value = std::move(set_value);
-                    break;
-                }
-                case 'H': {
-                    auto hash_value = std::make_unique<HashType>();
-                    hash_value->deserialize(data);
-                    value = std::move(hash_value);
-                    break;
-                }
-                default:
-                    continue;
-            }
-            
-            store[key] = std::move(value);
-            cache.access(key);
-            bloom_filter.add(key);
-        }
-        
-        file.close();
-    }
-};
-
-// Protocol handler for parsing and processing Redis-like commands
-class CommandHandler {
-private:
-    BlinkDB& db;
-
-public:
-    explicit CommandHandler(BlinkDB& database) : db(database) {}
-
-    std::string process_command(const std::string& command_str) {
-        std::vector<std::string> command_parts;
-        std::istringstream iss(command_str);
-        std::string part;
-        
-        while (iss >> part) {
-            command_parts.push_back(part);
-        }
+        // Attribute keyspace lock acquisitions made by this command
+        InstrumentedSharedMutex::CommandScope command_scope(cmd);
         
-        if (command_parts.empty()) {
-            return "-ERR empty command\r\n";
-        }
-        
-        std::string cmd = command_parts[0];
-        std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::tolower);
+        BLINKDB_PROBE2(command__start, cmd.c_str(), command_parts.size());
         
         try {
             // String commands
@@ -1036,180 +1280,92 @@ public:
                 db.set(command_parts[1], command_parts[2]);
                 return "+OK\r\n";
             } else if (cmd == "get" && command_parts.size() >= 2) {
-                std::string result = db.get(command_parts[1]);
-                if (result == "NULL") {
-                    return "$-1\r\n";
-                } else if (result.substr(0, 9) == "WRONGTYPE") {
-                    return "-" + result + "\r\n";
-                } else {
-                    return "$" + std::to_string(result.size()) + "\r\n" + result + "\r\n";
-                }
+                return bulk_reply(db.get(command_parts[1]));
             } else if (cmd == "del" && command_parts.size() >= 2) {
                 db.del(command_parts[1]);
                 return ":1\r\n";
             } else if (cmd == "type" && command_parts.size() >= 2) {
-                std::string result = db.type(command_parts[1]);
-                return "+" + result + "\r\n";
+                auto type = db.type(command_parts[1]);
+                return "+" + (type ? value_type_name(*type) : "none") + "\r\n";
             }
             
             // List commands
             else if (cmd == "lpush" && command_parts.size() >= 3) {
-                std::string result = db.lpush(command_parts[1], command_parts[2]);
-                if (result.substr(0, 9) == "WRONGTYPE") {
-                    return "-" + result + "\r\n";
-                } else {
-                    return ":" + result + "\r\n";
-                }
+                return integer_reply(db.lpush(command_parts[1], command_parts[2]));
             } else if (cmd == "rpush" && command_parts.size() >= 3) {
-                std::string result = db.rpush(command_parts[1], command_parts[2]);
-                if (result.substr(0, 9) == "WRONGTYPE") {
-                    return "-" + result + "\r\n";
-                } else {
-                    return ":" + result + "\r\n";
-                }
+                return integer_reply(db.rpush(command_parts[1], command_parts[2]));
             } else if (cmd == "lpop" && command_parts.size() >= 2) {
-                std::string result = db.lpop(command_parts[1]);
-                if (result == "NULL") {
-                    return "$-1\r\n";
-                } else if (result.substr(0, 9) == "WRONGTYPE") {
-                    return "-" + result + "\r\n";
-                } else {
-                    return "$" + std::to_string(result.size()) + "\r\n" + result + "\r\n";
-                }
+                return bulk_reply(db.lpop(command_parts[1]));
             } else if (cmd == "rpop" && command_parts.size() >= 2) {
-                std::string result = db.rpop(command_parts[1]);
-                if (result == "NULL") {
-                    return "$-1\r\n";
-                } else if (result.substr(0, 9) == "WRONGTYPE") {
-                    return "-" + result + "\r\n";
-                } else {
-                    return "$" + std::to_string(result.size()) + "\r\n" + result + "\r\n";
-                }
+                return bulk_reply(db.rpop(command_parts[1]));
             } else if (cmd == "lindex" && command_parts.size() >= 3) {
                 int index = std::stoi(command_parts[2]);
-                std::string result = db.lindex(command_parts[1], index);
-                if (result == "NULL") {
-                    return "$-1\r\n";
-                } else if (result.substr(0, 9) == "WRONGTYPE") {
-                    return "-" + result + "\r\n";
-                } else {
-                    return "$" + std::to_string(result.size()) + "\r\n" + result + "\r\n";
-                }
+                return bulk_reply(db.lindex(command_parts[1], index));
             } else if (cmd == "llen" && command_parts.size() >= 2) {
-                std::string result = db.llen(command_parts[1]);
-                if (result.substr(0, 9) == "WRONGTYPE") {
-                    return "-" + result + "\r\n";
-                } else {
-                    return ":" + result + "\r\n";
-                }
+                return integer_reply(db.llen(command_parts[1]));
             } else if (cmd == "lrange" && command_parts.size() >= 4) {
                 int start = std::stoi(command_parts[2]);
                 int end = std::stoi(command_parts[3]);
-                std::string result = db.lrange(command_parts[1], start, end);
-                if (result.substr(0, 9) == "WRONGTYPE") {
-                    return "-" + result + "\r\n";
-                } else {
-                    return result;
-                }
+                return array_reply(db.lrange(command_parts[1], start, end));
+            } else if (cmd == "blpop" || cmd == "brpop") {
+                // Only reached without a scheduler: shards have nowhere to park a waiter
+                return "-ERR BLPOP and BRPOP are not supported with --shards\r\n";
             }
             
             // Set commands
             else if (cmd == "sadd" && command_parts.size() >= 3) {
-                std::string result = db.sadd(command_parts[1], command_parts[2]);
-                if (result.substr(0, 9) == "WRONGTYPE") {
-                    return "-" + result + "\r\n";
-                } else {
-                    return ":" + result + "\r\n";
-                }
+                return integer_reply(db.sadd(command_parts[1], command_parts[2]));
             } else if (cmd == "sismember" && command_parts.size() >= 3) {
-                std::string result = db.sismember(command_parts[1], command_parts[2]);
-                if (result.substr(0, 9) == "WRONGTYPE") {
-                    return "-" + result + "\r\n";
-                } else {
-                    return ":" + result + "\r\n";
-                }
+                return integer_reply(db.sismember(command_parts[1], command_parts[2]));
             } else if (cmd == "srem" && command_parts.size() >= 3) {
-                std::string result = db.srem(command_parts[1], command_parts[2]);
-                if (result.substr(0, 9) == "WRONGTYPE") {
-                    return "-" + result + "\r\n";
-                } else {
-                    return ":" + result + "\r\n";
-                }
+                return integer_reply(db.srem(command_parts[1], command_parts[2]));
             } else if (cmd == "scard" && command_parts.size() >= 2) {
-                std::string result = db.scard(command_parts[1]);
-                if (result.substr(0, 9) == "WRONGTYPE") {
-                    return "-" + result + "\r\n";
-                } else {
-                    return ":" + result + "\r\n";
-                }
+                return integer_reply(db.scard(command_parts[1]));
             } else if (cmd == "smembers" && command_parts.size() >= 2) {
-                std::string result = db.smembers(command_parts[1]);
-                if (result.substr(0, 9) == "WRONGTYPE") {
-                    return "-" + result + "\r\n";
-                } else {
-                    return result;
-                }
+                return array_reply(db.smembers(command_parts[1]));
             }
             
             // Hash commands
             else if (cmd == "hset" && command_parts.size() >= 4) {
-                std::string result = db.hset(command_parts[1], command_parts[2], command_parts[3]);
-                if (result.substr(0, 9) == "WRONGTYPE") {
-                    return "-" + result + "\r\n";
-                } else {
-                    return ":" + result + "\r\n";
-                }
+                return integer_reply(db.hset(command_parts[1], command_parts[2], command_parts[3]));
             } else if (cmd == "hget" && command_parts.size() >= 3) {
-                std::string result = db.hget(command_parts[1], command_parts[2]);
-                if (result == "NULL") {
-                    return "$-1\r\n";
-                } else if (result.substr(0, 9) == "WRONGTYPE") {
-                    return "-" + result + "\r\n";
-                } else {
-                    return "$" + std::to_string(result.size()) + "\r\n" + result + "\r\n";
-                }
+                return bulk_reply(db.hget(command_parts[1], command_parts[2]));
             } else if (cmd == "hexists" && command_parts.size() >= 3) {
-                std::string result = db.hexists(command_parts[1], command_parts[2]);
-                if (result.substr(0, 9) == "WRONGTYPE") {
-                    return "-" + result + "\r\n";
-                } else {
-                    return ":" + result + "\r\n";
-                }
+                return integer_reply(db.hexists(command_parts[1], command_parts[2]));
             } else if (cmd == "hdel" && command_parts.size() >= 3) {
-                std::string result = db.hdel(command_parts[1], command_parts[2]);
-                if (result.substr(0, 9) == "WRONGTYPE") {
-                    return "-" + result + "\r\n";
-                } else {
-                    return ":" + result + "\r\n";
-                }
+                return integer_reply(db.hdel(command_parts[1], command_parts[2]));
             } else if (cmd == "hlen" && command_parts.size() >= 2) {
-                std::string result = db.hlen(command_parts[1]);
-                if (result.substr(0, 9) == "WRONGTYPE") {
-                    return "-" + result + "\r\n";
-                } else {
-                    return ":" + result + "\r\n";
-                }
+                return integer_reply(db.hlen(command_parts[1]));
             } else if (cmd == "hkeys" && command_parts.size() >= 2) {
-                std::string result = db.hkeys(command_parts[1]);
-                if (result.substr(0, 9) == "WRONGTYPE") {
-                    return "-" + result + "\r\n";
-                } else {
-                    return result;
-                }
+                return array_reply(db.hkeys(command_parts[1]));
             } else if (cmd == "hvals" && command_parts.size() >= 2) {
-                std::string result = db.hvals(command_parts[1]);
-                if (result.substr(0, 9) == "WRONGTYPE") {
-                    return "-" + result + "\r\n";
-                } else {
-                    return result;
-                }
+                return array_reply(db.hvals(command_parts[1]));
             } else if (cmd == "hgetall" && command_parts.size() >= 2) {
-                std::string result = db.hgetall(command_parts[1]);
-                if (result.substr(0, 9) == "WRONGTYPE") {
-                    return "-" + result + "\r\n";
-                } else {
-                    return result;
+                auto fields = db.hgetall(command_parts[1]);
+                std::string response = "*" + std::to_string(fields.size() * 2) + "\r\n";
+                for (const auto& [field, value] : fields) {
+                    response += bulk_reply(field) + bulk_reply(value);
+                }
+                return response;
+            }
+            
+            // Keyspace commands
+            else if (cmd == "keys" && command_parts.size() >= 2) {
+                return array_reply(db.keys(command_parts[1]));
+            } else if (cmd == "scan" && command_parts.size() >= 2) {
+                // SCAN cursor [MATCH pattern] [COUNT count]
+                std::string pattern = "*";
+                size_t count = 10;
+                for (size_t i = 2; i + 1 < command_parts.size(); i += 2) {
+                    std::string opt = command_parts[i];
+                    std::transform(opt.begin(), opt.end(), opt.begin(), ::tolower);
+                    if (opt == "match") pattern = command_parts[i + 1];
+                    else if (opt == "count") count = std::max<size_t>(1, count_arg(command_parts[i + 1]));
+                    else return "-ERR syntax error\r\n";
                 }
+                std::vector<std::string> keys;
+                std::string next = db.scan(command_parts[1], count, pattern, keys);
+                return "*2\r\n" + bulk_reply(next) + array_reply(keys);
             }
             
             // Ping command for testing connection
@@ -1217,13 +1373,383 @@ public:
                 return "+PONG\r\n";
             }
             
+            // Server introspection commands
+            else if (cmd == "debug" && command_parts.size() >= 3) {
+                std::string sub = command_parts[1];
+                std::transform(sub.begin(), sub.end(), sub.begin(), ::tolower);
+                if (sub == "populate") {
+                    // DEBUG POPULATE count prefix size [string|list|set|hash]
+                    if (command_parts.size() < 5) return "-ERR wrong number of arguments for 'debug populate'\r\n";
+                    size_t count = count_arg(command_parts[2]);
+                    std::string prefix = command_parts[3];
+                    size_t size = count_arg(command_parts[4]);
+                    std::string type_name = command_parts.size() >= 6 ? command_parts[5] : "string";
+                    std::transform(type_name.begin(), type_name.end(), type_name.begin(), ::tolower);
+                    ValueType type;
+                    if (type_name == "string") type = ValueType::STRING;
+                    else if (type_name == "list") type = ValueType::LIST;
+                    else if (type_name == "set") type = ValueType::SET;
+                    else if (type_name == "hash") type = ValueType::HASH;
+                    else return "-ERR unknown type '" + type_name + "'\r\n";
+                    db.populate(count, prefix, size, type, key_filter);
+                    return "+OK\r\n";
+                }
+                return "-ERR unknown DEBUG subcommand '" + sub + "'\r\n";
+            } else if (cmd == "info") {
+                std::string section;
+                if (command_parts.size() >= 2) {
+                    section = command_parts[1];
+                    std::transform(section.begin(), section.end(), section.begin(), ::tolower);
+                }
+                std::string result = db.info(section);
+                if (section.empty() || section == "numa") {
+                    result += thread_placement.report(db);
+                }
+                if (section.empty() || section == "zerocopy") {
+                    result += zerocopy_stats.report();
+                }
+                return "$" + std::to_string(result.size()) + "\r\n" + result + "\r\n";
+            } else if (cmd == "hotkeys") {
+                if (command_parts.size() >= 2) {
+                    std::string arg = command_parts[1];
+                    std::transform(arg.begin(), arg.end(), arg.begin(), ::tolower);
+                    if (arg == "reset") {
+                        db.reset_hotkeys();
+                        return "+OK\r\n";
+                    }
+                    return hotkeys_reply(db.hotkeys(count_arg(command_parts[1])));
+                }
+                return hotkeys_reply(db.hotkeys(blinkdb_config::HOTKEYS_TOP_K));
+            } else if (cmd == "memory" && command_parts.size() >= 2) {
+                std::string sub = command_parts[1];
+                std::transform(sub.begin(), sub.end(), sub.begin(), ::tolower);
+                if (sub == "usage" && command_parts.size() >= 3) {
+                    size_t samples = blinkdb_config::MEMORY_USAGE_SAMPLES;
+                    if (command_parts.size() >= 5) {
+                        std::string opt = command_parts[3];
+                        std::transform(opt.begin(), opt.end(), opt.begin(), ::tolower);
+                        if (opt != "samples") {
+                            return "-ERR syntax error\r\n";
+                        }
+                        samples = count_arg(command_parts[4]);
+                    }
+                    long long usage = db.memory_usage(command_parts[2], samples);
+                    return usage < 0 ? "$-1\r\n" : ":" + std::to_string(usage) + "\r\n";
+                } else if (sub == "stats") {
+                    std::string result = db.memory_stats();
+                    return "$" + std::to_string(result.size()) + "\r\n" + result + "\r\n";
+                } else if (sub == "prefixes") {
+                    db.set_memory_prefixes(std::vector<std::string>(command_parts.begin() + 2, command_parts.end()));
+                    return "+OK\r\n";
+                }
+                return "-ERR unknown MEMORY subcommand '" + sub + "'\r\n";
+            } else if (cmd == "analyze" && command_parts.size() >= 2) {
+                std::string sub = command_parts[1];
+                std::transform(sub.begin(), sub.end(), sub.begin(), ::tolower);
+                if (sub == "start") {
+                    size_t top = command_parts.size() >= 3 ? count_arg(command_parts[2]) : ANALYZER_DEFAULT_TOP_N;
+                    int percent = command_parts.size() >= 4 ? static_cast<int>(std::min<size_t>(count_arg(command_parts[3]), 100))
+                                                            : ANALYZER_DEFAULT_CPU_PERCENT;
+                    if (!analyzer.start(top, percent)) {
+                        return "-ERR analysis already in progress\r\n";
+                    }
+                    return "+OK\r\n";
+                } else if (sub == "stop") {
+                    analyzer.stop();
+                    return "+OK\r\n";
+                } else if (sub == "status" || sub == "report") {
+                    std::string result = sub == "status" ? analyzer.status() : analyzer.report();
+                    return "$" + std::to_string(result.size()) + "\r\n" + result + "\r\n";
+                }
+                return "-ERR unknown ANALYZE subcommand '" + sub + "'\r\n";
+            } else if (cmd == "latency" && command_parts.size() >= 2) {
+                return latency_command(command_parts);
+            } else if (cmd == "index" && command_parts.size() >= 2) {
+                return index_command(command_parts);
+            } else if (cmd == "lockstats" && command_parts.size() >= 2) {
+                std::string arg = command_parts[1];
+                std::transform(arg.begin(), arg.end(), arg.begin(), ::tolower);
+                if (arg == "reset") {
+                    db.reset_lockstats();
+                    return "+OK\r\n";
+                }
+                return "-ERR unknown LOCKSTATS subcommand '" + arg + "'\r\n";
+            } else if (cmd == "capture" && command_parts.size() >= 2 && capture) {
+                std::string sub = command_parts[1];
+                std::transform(sub.begin(), sub.end(), sub.begin(), ::tolower);
+                if (sub == "start" && command_parts.size() >= 3) {
+                    if (!capture->start(command_parts[2])) {
+                        return "-ERR capture already running or file not writable\r\n";
+                    }
+                    return "+OK\r\n";
+                } else if (sub == "stop") {
+                    capture->stop();
+                    return "+OK\r\n";
+                } else if (sub == "status") {
+                    std::string result = capture->status();
+                    return "$" + std::to_string(result.size()) + "\r\n" + result + "\r\n";
+                }
+                return "-ERR unknown CAPTURE subcommand '" + sub + "'\r\n";
+            }
+            
             else {
                 return "-ERR unknown command '" + cmd + "'\r\n";
             }
+        } catch (const WrongTypeError& e) {
+            return "-" + std::string(e.what()) + "\r\n";
         } catch (const std::exception& e) {
             return "-ERR " + std::string(e.what()) + "\r\n";
         }
     }
+
+public:
+    explicit CommandHandler(BlinkDBEngine& database) : db(database), analyzer(database) {}
+
+    void set_watchdog(EventLoopWatchdog* loop_watchdog) {
+        watchdog = loop_watchdog;
+    }
+
+    void set_capture(TrafficCapture* traffic_capture) {
+        capture = traffic_capture;
+    }
+
+    // Also wakes blocked pops on every list push the engine makes
+    void set_scheduler(CommandScheduler* command_scheduler) {
+        scheduler = command_scheduler;
+        db.set_list_listener([command_scheduler](const std::string& key) { command_scheduler->notify_push(key); });
+    }
+
+    void set_key_filter(std::function<bool(const std::string&)> owns_key) {
+        key_filter = std::move(owns_key);
+    }
+
+    std::string process_command(const std::string& command_str) {
+        std::string response = execute_command(command_str);
+        BLINKDB_PROBE2(command__done, command_str.c_str(), response.size());
+        return response;
+    }
+
+    // Like process_command, but GET replies share the stored value's buffer
+    // instead of copying it, and commands that wait (blocking pops, work moved
+    // off the loop thread) come back as suspended tasks for the scheduler
+    CommandTask execute(const std::string& command_str) {
+        size_t begin = command_str.find_first_not_of(" \t");
+        std::string cmd = begin == std::string::npos ? "" : command_str.substr(begin, command_str.find_first_of(" \t", begin) - begin);
+        std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::tolower);
+        if (cmd != "get" && cmd != "blpop" && cmd != "brpop" && cmd != "memory" && cmd != "debug") {
+            return CommandTask(process_command(command_str));
+        }
+        
+        std::vector<std::string> command_parts;
+        std::istringstream iss(command_str);
+        std::string part;
+        while (iss >> part) {
+            command_parts.push_back(part);
+        }
+        if (cmd == "get" && command_parts.size() >= 2) {
+            BLINKDB_PROBE2(command__start, cmd.c_str(), command_parts.size());
+            Reply reply;
+            try {
+                // Only a reader that finds every epoch slot taken falls back to the lock
+                InstrumentedSharedMutex::CommandScope command_scope(cmd);
+                reply.bulk = db.get_shared(command_parts[1], reply.text);
+                if (!reply.bulk && reply.text.empty()) reply.text = "$-1\r\n";
+            } catch (const WrongTypeError& e) {
+                reply.text = "-" + std::string(e.what()) + "\r\n";
+            }
+            BLINKDB_PROBE2(command__done, command_str.c_str(), reply.data().size());
+            return CommandTask(std::move(reply));
+        }
+        if (scheduler && (cmd == "blpop" || cmd == "brpop") && command_parts.size() >= 3) {
+            return blocking_pop(std::move(command_parts), cmd == "blpop");
+        }
+        if (scheduler && cmd == "memory" && command_parts.size() == 2) {
+            std::string sub = command_parts[1];
+            std::transform(sub.begin(), sub.end(), sub.begin(), ::tolower);
+            if (sub == "stats") return offloaded_memory_stats();
+        }
+        if (scheduler && cmd == "debug" && command_parts.size() >= 2) {
+            std::string sub = command_parts[1];
+            std::transform(sub.begin(), sub.end(), sub.begin(), ::tolower);
+            if (sub == "populate") return offloaded_populate(command_str);
+        }
+        return CommandTask(process_command(command_str));
+    }
+};
+
+// Replies waiting to be written to one client, sent with writev. Text
+// replies are coalesced; shared value buffers are referenced rather than
+// copied and stay pinned until the kernel has taken their last byte. A short
+// write keeps the rest queued for the next EPOLLOUT.
+//
+// With a zero-copy threshold set, a reply at least that large is sent with
+// MSG_ZEROCOPY instead: the kernel transmits straight from the reply's pages,
+// so the reply is parked in `in_flight` after its last byte is queued and
+// only released once the completion for its final send has been read from
+// the socket's error queue.
+class OutputQueue {
+private:
+    struct InFlight {
+        uint32_t last_send;
+        Reply reply;
+    };
+
+    std::deque<Reply> replies;
+    size_t offset = 0;  // bytes of the front reply already written
+    bool zerocopy = false;
+    // Send ids are a 32-bit counter that wraps, so they are compared with before()
+    uint32_t next_send = 0;        // id the kernel gives the next MSG_ZEROCOPY send
+    uint32_t completed_below = 0;  // every send before this id has completed
+    std::vector<std::pair<uint32_t, uint32_t>> completed_ranges;  // completions that arrived out of order
+    std::optional<uint32_t> front_last_send;                      // last zero-copy send of the front reply
+    std::deque<InFlight> in_flight;
+
+    // Serial number order: a comes before b when it is less than 2^31 ids behind
+    static bool before(uint32_t a, uint32_t b) { return static_cast<int32_t>(a - b) < 0; }
+
+    void release_completed() {
+        // Out-of-order ranges are rare and few; fold in every one that now
+        // touches the completed prefix until none does
+        for (bool merged = true; merged;) {
+            merged = false;
+            for (auto it = completed_ranges.begin(); it != completed_ranges.end(); ++it) {
+                if (before(completed_below, it->first)) continue;
+                if (before(completed_below, it->second + 1)) completed_below = it->second + 1;
+                completed_ranges.erase(it);
+                merged = true;
+                break;
+            }
+        }
+        while (!in_flight.empty() && before(in_flight.front().last_send, completed_below)) {
+            in_flight.pop_front();
+        }
+    }
+
+    void pop_front() {
+        if (front_last_send) {
+            in_flight.push_back({*front_last_send, std::move(replies.front())});
+            front_last_send.reset();
+        }
+        replies.pop_front();
+        offset = 0;
+    }
+
+    // Sends the rest of the front reply with MSG_ZEROCOPY; returns the bytes sent, or -1 with errno
+    ssize_t send_zerocopy(int fd) {
+        std::string_view data = replies.front().data().substr(offset);
+        struct iovec iov = {const_cast<char*>(data.data()), data.size()};
+        struct msghdr msg = {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        ssize_t sent = sendmsg(fd, &msg, MSG_ZEROCOPY | MSG_NOSIGNAL);
+        if (sent >= 0) {
+            front_last_send = next_send++;
+            zerocopy_stats.sends++;
+            zerocopy_stats.bytes += sent;
+        }
+        return sent;
+    }
+
+public:
+    // Replies of at least this many bytes use MSG_ZEROCOPY (0 disables it)
+    static inline size_t zerocopy_min = 0;
+
+    // Opts the socket into MSG_ZEROCOPY when a threshold is configured
+    void enable_zerocopy(int fd) {
+        int one = 1;
+        zerocopy = zerocopy_min > 0 && setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+    }
+
+    void push(Reply reply) {
+        if (reply.data().empty()) return;
+        // Text joins the previous text reply unless it goes out with MSG_ZEROCOPY
+        // itself, or the previous one is the front reply with zero-copy sends
+        // in flight, whose buffer must not move
+        bool zerocopy_reply = zerocopy_min > 0 && reply.text.size() >= zerocopy_min;
+        bool front_pinned = replies.size() == 1 && front_last_send;
+        if (!reply.bulk && !zerocopy_reply && !replies.empty() && !replies.back().bulk && !front_pinned) {
+            replies.back().text += reply.text;
+            return;
+        }
+        replies.push_back(std::move(reply));
+    }
+
+    bool empty() const { return replies.empty(); }
+
+    // Writes as much as the socket accepts; false on a connection error
+    bool flush(int fd) {
+        while (!replies.empty()) {
+            ssize_t written;
+            if (zerocopy && replies.front().data().size() >= zerocopy_min) {
+                written = send_zerocopy(fd);
+                if (written < 0 && errno == ENOBUFS) {
+                    // Out of option memory for notifications: copy this one instead
+                    zerocopy_stats.fallbacks++;
+                    std::string_view data = replies.front().data().substr(offset);
+                    written = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+                }
+            } else {
+                struct iovec iov[OUTPUT_IOV_MAX];
+                int count = 0;
+                for (auto it = replies.begin(); it != replies.end() && count < OUTPUT_IOV_MAX; ++it, ++count) {
+                    // Stop in front of a reply that goes out with MSG_ZEROCOPY
+                    if (count > 0 && zerocopy && it->data().size() >= zerocopy_min) break;
+                    std::string_view data = it->data();
+                    if (count == 0) data.remove_prefix(offset);
+                    iov[count].iov_base = const_cast<char*>(data.data());
+                    iov[count].iov_len = data.size();
+                }
+                written = writev(fd, iov, count);
+            }
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            size_t remaining = static_cast<size_t>(written);
+            while (remaining > 0) {
+                size_t front = replies.front().data().size() - offset;
+                if (remaining < front) {
+                    offset += remaining;
+                    break;
+                }
+                remaining -= front;
+                pop_front();
+            }
+        }
+        return true;
+    }
+
+    // Reads MSG_ZEROCOPY completions from the error queue and releases the
+    // replies whose sends have all completed
+    void reap_completions(int fd) {
+        if (!zerocopy) return;
+        while (true) {
+            char control[128];
+            struct msghdr msg = {};
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            if (recvmsg(fd, &msg, MSG_ERRQUEUE) == -1) break;
+
+            for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+                if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                      || (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+                    continue;
+                }
+                auto* err = reinterpret_cast<struct sock_extended_err*>(CMSG_DATA(cm));
+                if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+                // One notification covers the inclusive range of send ids [ee_info, ee_data],
+                // which wraps past 2^32 - 1 when ee_data < ee_info
+                uint32_t first = err->ee_info;
+                uint32_t last = err->ee_data;
+                uint32_t sends = last - first + 1;
+                zerocopy_stats.completions += sends;
+                // The kernel copied after all (e.g. loopback); such sends gain nothing
+                if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) zerocopy_stats.copied += sends;
+                completed_ranges.emplace_back(first, last);
+            }
+        }
+        release_completed();
+    }
 };
 
 // Set socket to non-blocking mode
@@ -1232,7 +1758,802 @@ void set_nonblocking(int socket) {
     fcntl(socket, F_SETFL, flags | O_NONBLOCK);
 }
 
-int main() {
+// Bounded single-producer single-consumer ring between two shard threads.
+// Each side only writes its own index, and the indices sit on separate cache lines.
+template <typename T>
+class SpscQueue {
+private:
+    std::vector<T> slots;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+
+public:
+    // Capacity must be a power of two
+    explicit SpscQueue(size_t capacity) : slots(capacity), mask(capacity - 1) {}
+
+    // Moves from `item` only on success, so a full queue leaves it with the caller
+    bool push(T& item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == slots.size()) return false;
+        slots[t & mask] = std::move(item);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        item = std::move(slots[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+// A command forwarded to the shard that owns its key, or the reply coming back
+struct ShardMessage {
+    bool reply = false;
+    size_t origin = 0;        // shard holding the client connection
+    uint64_t connection = 0;  // connection id on the origin shard
+    uint64_t sequence = 0;    // position of the reply in the connection's stream
+    uint64_t gather = 0;      // broadcast the reply belongs to, 0 for single-shard commands
+    std::string payload;      // command line or RESP reply
+    std::shared_ptr<const BulkString> bulk;  // a GET reply's shared value buffer, instead of payload
+};
+
+// State shared by all shards: the queue mesh, one eventfd per shard to wake
+// its loop, and the key-to-shard mapping
+class ShardGroup {
+private:
+    size_t count;
+    std::vector<std::unique_ptr<SpscQueue<ShardMessage>>> queues;
+    std::vector<int> wakeups;
+
+public:
+    TrafficCapture capture;
+
+    explicit ShardGroup(size_t shards) : count(shards), wakeups(shards, -1) {
+        for (size_t i = 0; i < shards * shards; ++i) {
+            queues.push_back(std::make_unique<SpscQueue<ShardMessage>>(SHARD_QUEUE_CAPACITY));
+        }
+        for (auto& fd : wakeups) {
+            fd = eventfd(0, EFD_NONBLOCK);
+        }
+    }
+
+    ~ShardGroup() {
+        for (int fd : wakeups) {
+            if (fd != -1) close(fd);
+        }
+    }
+
+    size_t size() const { return count; }
+
+    SpscQueue<ShardMessage>& queue(size_t from, size_t to) { return *queues[from * count + to]; }
+
+    int wakeup_fd(size_t shard) const { return wakeups[shard]; }
+
+    void wake(size_t shard) {
+        uint64_t one = 1;
+        ssize_t written = write(wakeups[shard], &one, sizeof(one));
+        (void)written;  // EAGAIN means the counter is already nonzero
+    }
+
+    size_t owner(const std::string& key) const {
+        return std::hash<std::string>{}(key) % count;
+    }
+
+    // A SCAN walks the shards one after another. The client's cursor is the
+    // current shard's own cursor followed by the shard index in a fixed number
+    // of digits, or the bare index while that shard's walk has not started,
+    // so the first cursor is "0" and every cursor stays a decimal number.
+    size_t cursor_digits() const { return std::to_string(count - 1).size(); }
+
+    std::string join_cursor(size_t shard, const std::string& local) const {
+        if (local == "0") return std::to_string(shard);
+        std::string digits = std::to_string(shard);
+        return local + std::string(cursor_digits() - digits.size(), '0') + digits;
+    }
+
+    // Returns false for a cursor this group never handed out
+    bool split_cursor(const std::string& cursor, size_t& shard, std::string& local) const {
+        if (cursor.empty() || cursor.find_first_not_of("0123456789") != std::string::npos) return false;
+        size_t digits = cursor_digits();
+        if (cursor.size() <= digits) {
+            local = "0";
+        } else {
+            local = cursor.substr(0, cursor.size() - digits);
+            if (local[0] == '0') return false;
+        }
+        shard = std::stoul(cursor.substr(cursor.size() - std::min(digits, cursor.size())));
+        return shard < count;
+    }
+
+    // Returns the index of the key argument, or -1 for commands not bound to one key
+    static int key_position(const std::vector<std::string>& parts) {
+        static const std::unordered_set<std::string> keyed = {
+            "set", "get", "del", "type",
+            "lpush", "rpush", "lpop", "rpop", "lindex", "llen", "lrange",
+            "sadd", "sismember", "srem", "scard", "smembers",
+            "hset", "hget", "hexists", "hdel", "hlen", "hkeys", "hvals", "hgetall"};
+        if (parts.size() >= 2 && keyed.count(parts[0])) return 1;
+        if (parts.size() >= 3 && parts[0] == "memory" && parts[1] == "usage") return 2;
+        return -1;
+    }
+
+    // Commands that change every partition and run on all shards
+    static bool is_broadcast(const std::vector<std::string>& parts) {
+        if (parts.size() < 2) return false;
+        const std::string& cmd = parts[0];
+        const std::string& sub = parts[1];
+        return (cmd == "debug" && sub == "populate") || (cmd == "hotkeys" && sub == "reset")
+            || (cmd == "lockstats" && sub == "reset") || (cmd == "memory" && sub == "prefixes")
+            || (cmd == "latency" && (sub == "reset" || sub == "threshold"))
+            || (cmd == "index" && sub == "create");
+    }
+
+    // Length of the RESP element (bulk, integer, simple string or a nested
+    // array of those) starting at `pos` in a complete reply
+    static size_t element_length(const std::string& reply, size_t pos) {
+        size_t line_end = reply.find("\r\n", pos);
+        long long size = std::stoll(reply.substr(pos + 1, line_end - pos - 1));
+        size_t end = line_end + 2;
+        if (reply[pos] == '$' && size >= 0) return end + size + 2 - pos;
+        if (reply[pos] == '*') {
+            for (long long i = 0; i < size; ++i) end += element_length(reply, end);
+        }
+        return end - pos;
+    }
+
+    // Combines the per-shard replies of a broadcast: the first error wins,
+    // integers are summed, anything else (+OK) is taken from the first shard
+    static std::string merge_replies(const std::vector<std::string>& replies) {
+        long long total = 0;
+        bool integers = true;
+        for (const auto& reply : replies) {
+            if (!reply.empty() && reply[0] == '-') return reply;
+            if (reply.empty() || reply[0] != ':') {
+                integers = false;
+            } else {
+                total += std::stoll(reply.substr(1));
+            }
+        }
+        if (integers) return ":" + std::to_string(total) + "\r\n";
+        return replies.front();
+    }
+
+    // Concatenates the per-shard arrays of a keyspace-wide command such as
+    // KEYS, keeping at most `limit` elements (0 for all); the first error wins
+    static std::string merge_arrays(const std::vector<std::string>& replies, size_t limit = 0) {
+        size_t elements = 0;
+        std::string body;
+        for (const auto& reply : replies) {
+            if (reply.empty() || reply[0] != '*') return reply;
+            size_t pos = reply.find("\r\n") + 2;
+            while (pos < reply.size() && (limit == 0 || elements < limit)) {
+                size_t length = element_length(reply, pos);
+                body.append(reply, pos, length);
+                pos += length;
+                elements++;
+            }
+        }
+        return "*" + std::to_string(elements) + "\r\n" + body;
+    }
+
+    // Merges INDEX LIST replies: each shard lists the same indexes with the
+    // count of its own keys, so the entries are joined by name and counted up
+    static std::string merge_index_lists(const std::vector<std::string>& replies) {
+        std::map<std::string, std::pair<std::string, long long>> indexes;  // name -> (entry without count, keys)
+        for (const auto& reply : replies) {
+            if (reply.empty() || reply[0] != '*') return reply;
+            size_t pos = reply.find("\r\n") + 2;
+            while (pos < reply.size()) {
+                // *5 name prefix field type :keys
+                size_t end = pos + element_length(reply, pos);
+                size_t count_pos = reply.rfind(':', end - 3);
+                size_t name_start = reply.find("\r\n", reply.find("\r\n", pos) + 2) + 2;
+                std::string name = reply.substr(name_start, reply.find("\r\n", name_start) - name_start);
+                auto& entry = indexes[name];
+                entry.first = reply.substr(pos, count_pos - pos);
+                entry.second += std::stoll(reply.substr(count_pos + 1, end - 3 - count_pos));
+                pos = end;
+            }
+        }
+        std::string merged = "*" + std::to_string(indexes.size()) + "\r\n";
+        for (const auto& [name, entry] : indexes) {
+            merged += entry.first + ":" + std::to_string(entry.second) + "\r\n";
+        }
+        return merged;
+    }
+
+    // INDEX DROP on every shard: 1 when any shard had the index
+    static std::string merge_flags(const std::vector<std::string>& replies) {
+        for (const auto& reply : replies) {
+            if (!reply.empty() && reply[0] == '-') return reply;
+        }
+        for (const auto& reply : replies) {
+            if (reply == ":1\r\n") return reply;
+        }
+        return replies.front();
+    }
+};
+
+// One thread-per-core partition: its own engine, listening socket (the
+// kernel spreads connections over shards with SO_REUSEPORT) and event loop.
+// Commands on keys owned by another shard are forwarded over the SPSC mesh
+// and their replies queued in the order the client sent the commands.
+class Shard {
+private:
+    struct Connection {
+        int fd;
+        std::string input;
+        uint64_t next_sequence = 0;
+        uint64_t next_write = 0;
+        // Replies that arrived ahead of an earlier command's
+        std::map<uint64_t, Reply> pending;
+        OutputQueue output;
+    };
+
+    using Merge = std::function<std::string(const std::vector<std::string>&)>;
+
+    struct Gather {
+        uint64_t connection;
+        uint64_t sequence;
+        size_t remaining;
+        std::vector<std::string> replies;
+        Merge merge;
+    };
+
+    ShardGroup& group;
+    size_t index;
+    BlinkDBEngine db;
+    CommandHandler handler;
+    int epoll_fd = -1;
+    int listen_fd = -1;
+    std::unordered_map<uint64_t, Connection> connections;
+    std::unordered_map<int, uint64_t> fd_connections;
+    uint64_t next_connection = 1;
+    std::unordered_map<uint64_t, Gather> gathers;
+    uint64_t next_gather = 1;
+    // Connections with replies queued since their last flush
+    std::unordered_set<uint64_t> unflushed;
+    // Messages waiting for room in a full queue, per destination shard
+    std::vector<std::deque<ShardMessage>> backlog;
+    std::vector<bool> needs_wake;
+
+    static std::vector<std::string> tokenize(const std::string& command) {
+        std::vector<std::string> parts;
+        std::istringstream iss(command);
+        std::string part;
+        while (iss >> part) {
+            parts.push_back(part);
+        }
+        if (!parts.empty()) {
+            std::transform(parts[0].begin(), parts[0].end(), parts[0].begin(), ::tolower);
+        }
+        if (parts.size() >= 2 && ShardGroup::key_position(parts) != 1) {
+            std::transform(parts[1].begin(), parts[1].end(), parts[1].begin(), ::tolower);
+        }
+        return parts;
+    }
+
+    // Shards run without a scheduler, so every command completes here
+    Reply execute(const std::string& command) {
+        auto start = LatencyMonitor::Clock::now();
+        Reply response = handler.execute(command).take_reply();
+        db.latency().add_since("command", start);
+        return response;
+    }
+
+    void send(size_t to, ShardMessage message) {
+        if (backlog[to].empty() && group.queue(index, to).push(message)) {
+            needs_wake[to] = true;
+        } else {
+            backlog[to].push_back(std::move(message));
+        }
+    }
+
+    // Retries backlogged messages and wakes every shard that was sent something
+    void flush() {
+        for (size_t to = 0; to < group.size(); ++to) {
+            while (!backlog[to].empty() && group.queue(index, to).push(backlog[to].front())) {
+                backlog[to].pop_front();
+                needs_wake[to] = true;
+            }
+            if (needs_wake[to]) {
+                group.wake(to);
+                needs_wake[to] = false;
+            }
+        }
+    }
+
+    bool has_backlog() const {
+        for (const auto& pending : backlog) {
+            if (!pending.empty()) return true;
+        }
+        return false;
+    }
+
+    // Queues a reply once every earlier reply on the connection has been queued;
+    // flush_clients() writes them out
+    void deliver(uint64_t connection_id, uint64_t sequence, Reply reply) {
+        auto it = connections.find(connection_id);
+        if (it == connections.end()) return;  // client went away meanwhile
+        Connection& conn = it->second;
+        
+        if (sequence != conn.next_write) {
+            conn.pending.emplace(sequence, std::move(reply));
+            return;
+        }
+        conn.output.push(std::move(reply));
+        conn.next_write++;
+        for (auto next = conn.pending.begin(); next != conn.pending.end() && next->first == conn.next_write;
+             next = conn.pending.erase(next)) {
+            conn.output.push(std::move(next->second));
+            conn.next_write++;
+        }
+        unflushed.insert(connection_id);
+    }
+
+    // Writes what the socket accepts; the rest waits for EPOLLOUT
+    void flush_client(uint64_t connection_id) {
+        auto it = connections.find(connection_id);
+        if (it == connections.end()) return;
+        if (!it->second.output.flush(it->second.fd)) {
+            std::cerr << "Shard " << index << ": error writing to client " << it->second.fd << std::endl;
+            close_client(it->second.fd);
+        }
+    }
+
+    void flush_clients() {
+        for (uint64_t connection_id : unflushed) {
+            flush_client(connection_id);
+        }
+        unflushed.clear();
+    }
+
+    void add_gather_reply(uint64_t gather_id, std::string reply) {
+        auto it = gathers.find(gather_id);
+        if (it == gathers.end()) return;
+        Gather& gather = it->second;
+        gather.replies.push_back(std::move(reply));
+        if (--gather.remaining == 0) {
+            deliver(gather.connection, gather.sequence, {gather.merge(gather.replies), nullptr});
+            gathers.erase(it);
+        }
+    }
+
+    // Runs `command` on the given shards and delivers their replies combined by `merge`
+    void gather(uint64_t connection_id, uint64_t sequence, const std::string& command,
+                const std::vector<size_t>& targets, Merge merge) {
+        uint64_t gather_id = next_gather++;
+        gathers[gather_id] = {connection_id, sequence, targets.size(), {}, std::move(merge)};
+        bool local = false;
+        for (size_t to : targets) {
+            if (to == index) {
+                local = true;
+            } else {
+                send(to, {false, index, connection_id, sequence, gather_id, command, nullptr});
+            }
+        }
+        if (local) add_gather_reply(gather_id, std::string(execute(command).data()));
+    }
+
+    std::vector<size_t> all_shards() const {
+        std::vector<size_t> targets(group.size());
+        std::iota(targets.begin(), targets.end(), 0);
+        return targets;
+    }
+
+    // One SCAN step on the shard the cursor points into; once that shard's
+    // walk ends the returned cursor moves on to the next shard
+    void scan(uint64_t connection_id, uint64_t sequence, const std::vector<std::string>& parts) {
+        size_t shard;
+        std::string local;
+        if (!group.split_cursor(parts[1], shard, local)) {
+            deliver(connection_id, sequence, {"-ERR invalid cursor\r\n", nullptr});
+            return;
+        }
+        std::string command = "scan " + local;
+        for (size_t i = 2; i < parts.size(); ++i) command += " " + parts[i];
+        gather(connection_id, sequence, command, {shard}, [this, shard](const std::vector<std::string>& replies) {
+            // *2 $<len> <cursor> followed by the keys array
+            const std::string& reply = replies.front();
+            if (reply.rfind("*2\r\n$", 0) != 0) return reply;
+            size_t length_end = reply.find("\r\n", 4);
+            size_t length = std::stoull(reply.substr(5, length_end - 5));
+            std::string next = reply.substr(length_end + 2, length);
+            if (next == "0") {
+                next = shard + 1 < group.size() ? group.join_cursor(shard + 1, "0") : "0";
+            } else {
+                next = group.join_cursor(shard, next);
+            }
+            return "*2\r\n$" + std::to_string(next.size()) + "\r\n" + next + "\r\n"
+                   + reply.substr(length_end + 2 + length + 2);
+        });
+    }
+
+    // INDEX DROP, LIST and QUERY over the per-shard indexes (CREATE is a
+    // plain broadcast); anything else, such as a malformed query, runs here
+    void gather_index(uint64_t connection_id, uint64_t sequence, const std::string& command,
+                      const std::vector<std::string>& parts) {
+        if (parts[1] == "drop") {
+            gather(connection_id, sequence, command, all_shards(), ShardGroup::merge_flags);
+            return;
+        }
+        if (parts[1] == "list") {
+            gather(connection_id, sequence, command, all_shards(), ShardGroup::merge_index_lists);
+            return;
+        }
+        std::vector<FieldPredicate> predicates;
+        size_t limit = 0;
+        bool valid = false;
+        try {
+            valid = parts[1] == "query" && parts.size() >= 5
+                 && CommandHandler::parse_index_query(parts, predicates, limit);
+        } catch (const std::exception&) {
+        }
+        if (!valid) {
+            deliver(connection_id, sequence, execute(command));
+            return;
+        }
+        gather(connection_id, sequence, command, all_shards(), [limit](const std::vector<std::string>& replies) {
+            return ShardGroup::merge_arrays(replies, limit);
+        });
+    }
+
+    void dispatch(uint64_t connection_id, Connection& conn, const std::string& command) {
+        uint64_t sequence = conn.next_sequence++;
+        std::vector<std::string> parts = tokenize(command);
+        int key = ShardGroup::key_position(parts);
+        
+        if (key >= 0) {
+            size_t owner = group.owner(parts[key]);
+            if (owner == index) {
+                deliver(connection_id, sequence, execute(command));
+            } else {
+                send(owner, {false, index, connection_id, sequence, 0, command, nullptr});
+            }
+        } else if (group.size() > 1 && parts[0] == "keys") {
+            gather(connection_id, sequence, command, all_shards(),
+                   [](const std::vector<std::string>& replies) { return ShardGroup::merge_arrays(replies); });
+        } else if (group.size() > 1 && parts[0] == "index" && parts.size() >= 2 && parts[1] != "create") {
+            gather_index(connection_id, sequence, command, parts);
+        } else if (group.size() > 1 && parts[0] == "scan" && parts.size() >= 2) {
+            scan(connection_id, sequence, parts);
+        } else if (group.size() > 1 && ShardGroup::is_broadcast(parts)) {
+            gather(connection_id, sequence, command, all_shards(), ShardGroup::merge_replies);
+        } else {
+            // Introspection and other keyless commands report on this shard only
+            deliver(connection_id, sequence, execute(command));
+        }
+    }
+
+    // Runs commands forwarded by other shards and routes replies back to their connections
+    void drain_queues() {
+        uint64_t wakeups;
+        ssize_t drained = read(group.wakeup_fd(index), &wakeups, sizeof(wakeups));
+        (void)drained;
+        
+        ShardMessage message;
+        for (size_t from = 0; from < group.size(); ++from) {
+            if (from == index) continue;
+            while (group.queue(from, index).pop(message)) {
+                if (!message.reply) {
+                    Reply reply = execute(message.payload);
+                    send(message.origin, {true, index, message.connection, message.sequence, message.gather,
+                                          std::move(reply.text), std::move(reply.bulk)});
+                } else if (message.gather != 0) {
+                    add_gather_reply(message.gather, std::move(message.payload));
+                } else {
+                    deliver(message.connection, message.sequence, {std::move(message.payload), std::move(message.bulk)});
+                }
+            }
+        }
+    }
+
+    void accept_clients() {
+        while (true) {
+            int client_socket = accept(listen_fd, nullptr, nullptr);
+            if (client_socket == -1) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    std::cerr << "Shard " << index << ": failed to accept connection" << std::endl;
+                }
+                return;
+            }
+            
+            set_nonblocking(client_socket);
+            int nodelay = 1;
+            setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+            
+            // EPOLLOUT resumes replies that did not fit in the socket buffer
+            struct epoll_event ev;
+            ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+            ev.data.fd = client_socket;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_socket, &ev) == -1) {
+                close(client_socket);
+                continue;
+            }
+            
+            uint64_t connection_id = next_connection++;
+            connections[connection_id].fd = client_socket;
+            connections[connection_id].output.enable_zerocopy(client_socket);
+            fd_connections[client_socket] = connection_id;
+            BLINKDB_PROBE1(conn__accept, client_socket);
+        }
+    }
+
+    void close_client(int fd) {
+        BLINKDB_PROBE1(conn__close, fd);
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        auto it = fd_connections.find(fd);
+        if (it != fd_connections.end()) {
+            connections.erase(it->second);
+            fd_connections.erase(it);
+        }
+    }
+
+    void read_client(int fd) {
+        auto it = fd_connections.find(fd);
+        if (it == fd_connections.end()) return;
+        uint64_t connection_id = it->second;
+        Connection& conn = connections[connection_id];
+        
+        char buffer[BUFFER_SIZE];
+        ssize_t bytes_read;
+        while ((bytes_read = read(fd, buffer, BUFFER_SIZE)) > 0) {
+            conn.input.append(buffer, bytes_read);
+        }
+        if (bytes_read == 0 || (bytes_read == -1 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            close_client(fd);
+            return;
+        }
+        
+        size_t pos;
+        bool pipelined = false;
+        while ((pos = conn.input.find("\r\n")) != std::string::npos) {
+            std::string command = conn.input.substr(0, pos);
+            conn.input.erase(0, pos + 2);
+            if (!command.empty()) {
+                group.capture.record(fd, command, pipelined);
+                pipelined = true;
+                dispatch(connection_id, conn, command);
+            }
+        }
+    }
+
+public:
+    Shard(ShardGroup& shard_group, size_t shard_index)
+        : group(shard_group), index(shard_index),
+          db(snapshot_file(shard_index)),
+          handler(db), backlog(shard_group.size()), needs_wake(shard_group.size(), false) {
+        handler.set_capture(&group.capture);
+        handler.set_key_filter([this](const std::string& key) { return group.owner(key) == index; });
+    }
+
+    BlinkDBEngine& engine() { return db; }
+
+    static std::string snapshot_file(size_t shard) {
+        return "blinkdb_data.shard" + std::to_string(shard) + ".txt";
+    }
+
+    ~Shard() {
+        if (listen_fd != -1) close(listen_fd);
+        if (epoll_fd != -1) close(epoll_fd);
+    }
+
+    // Opens this shard's listening socket on the shared port and its epoll set
+    bool open(int port) {
+        listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (listen_fd == -1) return false;
+        
+        int opt = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        if (setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) == -1) {
+            return false;
+        }
+        
+        struct sockaddr_in server_addr{};
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_addr.s_addr = INADDR_ANY;
+        server_addr.sin_port = htons(port);
+        if (bind(listen_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) == -1
+            || listen(listen_fd, 128) == -1) {
+            return false;
+        }
+        set_nonblocking(listen_fd);
+        
+        epoll_fd = epoll_create1(0);
+        if (epoll_fd == -1) return false;
+        
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = listen_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+        ev.data.fd = group.wakeup_fd(index);
+        return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, group.wakeup_fd(index), &ev) == 0;
+    }
+
+    void run() {
+        struct epoll_event events[MAX_EVENTS];
+        LatencyMonitor& latency = db.latency();
+        
+        while (true) {
+            // Poll while messages wait for queue space so they are retried promptly
+            int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, has_backlog() ? 1 : -1);
+            auto iteration_start = LatencyMonitor::Clock::now();
+            
+            for (int i = 0; i < num_events; ++i) {
+                int fd = events[i].data.fd;
+                if (fd == listen_fd) {
+                    accept_clients();
+                } else if (fd == group.wakeup_fd(index)) {
+                    drain_queues();
+                } else if (auto it = fd_connections.find(fd); it != fd_connections.end()) {
+                    uint64_t connection_id = it->second;
+                    if (events[i].events & EPOLLERR) {
+                        connections[connection_id].output.reap_completions(fd);
+                    }
+                    if (events[i].events & EPOLLIN) {
+                        read_client(fd);
+                    }
+                    unflushed.insert(connection_id);
+                }
+            }
+            flush_clients();
+            flush();
+            
+            latency.add_since("event-loop", iteration_start);
+        }
+    }
+};
+
+// Hands every loaded key to the shard that owns it under the current shard
+// count. Snapshots written with a different count hold keys of other shards,
+// and the single-loop snapshot (blinkdb_data.txt) and those of shards that no
+// longer exist are loaded by no shard at all: their keys are imported, taking
+// precedence over the shard snapshots, and the files removed once every
+// shard has saved its share.
+static void rebalance_snapshots(ShardGroup& group, std::vector<std::unique_ptr<Shard>>& shards) {
+    auto owner_engine = [&](const std::string& key) { return &shards[group.owner(key)]->engine(); };
+    size_t moved = 0;
+    for (auto& shard : shards) {
+        moved += shard->engine().move_keys(owner_engine);
+    }
+    
+    std::vector<std::string> orphans;
+    if (access("blinkdb_data.txt", F_OK) == 0) orphans.push_back("blinkdb_data.txt");
+    for (size_t i = shards.size(); i < SHARD_MAX; ++i) {
+        if (access(Shard::snapshot_file(i).c_str(), F_OK) == 0) orphans.push_back(Shard::snapshot_file(i));
+    }
+    for (const auto& file : orphans) {
+        BlinkDBEngine orphan(file);
+        moved += orphan.move_keys(owner_engine);
+    }
+    if (moved == 0 && orphans.empty()) return;
+    
+    // The old files still hold the moved keys until every shard has saved
+    bool saved = true;
+    for (auto& shard : shards) {
+        saved = shard->engine().save_to_disk() && saved;
+    }
+    if (!saved) {
+        std::cerr << "Keeping the previous snapshot files until every shard has saved" << std::endl;
+        return;
+    }
+    for (const auto& file : orphans) {
+        std::remove(file.c_str());
+    }
+    std::cout << "Moved " << moved << " keys to their owning shards" << std::endl;
+}
+
+// Runs `count` shards, one thread each (the calling thread runs shard 0)
+int run_shards(size_t count, bool key_index) {
+    ShardGroup group(count);
+    std::vector<std::unique_ptr<Shard>> shards;
+    for (size_t i = 0; i < count; ++i) {
+        if (group.wakeup_fd(i) == -1) {
+            std::cerr << "Failed to create shard wakeup eventfd" << std::endl;
+            return 1;
+        }
+        // Build each shard's engine while pinned to that shard's CPU so loaded data starts out node-local
+        thread_placement.pin(ThreadPlacement::Role::LOOP, i);
+        shards.push_back(std::make_unique<Shard>(group, i));
+        if (key_index) shards.back()->engine().enable_key_index();
+        if (!shards.back()->open(PORT)) {
+            std::cerr << "Failed to open listening socket for shard " << i << std::endl;
+            return 1;
+        }
+    }
+    
+    rebalance_snapshots(group, shards);
+    
+    std::cout << "BlinkDB server started on port " << PORT << " with " << count << " shards" << std::endl;
+    
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < count; ++i) {
+        threads.emplace_back([&shards, i] {
+            thread_placement.pin(ThreadPlacement::Role::LOOP, i);
+            shards[i]->run();
+        });
+    }
+    thread_placement.pin(ThreadPlacement::Role::LOOP, 0);
+    shards[0]->run();
+    for (auto& thread : threads) thread.join();
+    return 0;
+}
+
+// Parses a numeric option value; false unless it is a whole number in [min, max]
+static bool option_count(const std::string& text, size_t min, size_t max, size_t& value) {
+    if (text.empty() || text[0] == '-') return false;
+    try {
+        size_t used = 0;
+        value = std::stoull(text, &used);
+        return used == text.size() && value >= min && value <= max;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+int main(int argc, char** argv) {
+    // --shards N runs N shared-nothing event loops ("auto" = one per hardware thread)
+    size_t shards = 0;
+    bool key_index = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--shards" && i + 1 < argc) {
+            std::string value = argv[++i];
+            if (value == "auto") {
+                shards = std::max(1u, std::thread::hardware_concurrency());
+            } else if (!option_count(value, 1, SHARD_MAX, shards)) {
+                std::cerr << "Invalid --shards: " << value << " (1 to " << SHARD_MAX << ", or auto)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--huge-pages" && i + 1 < argc) {
+            // Must be chosen before the first engine allocates
+            std::string value = argv[++i];
+            if (value == "off") HugePageArena::set_mode(HugePageArena::Mode::OFF);
+            else if (value == "thp") HugePageArena::set_mode(HugePageArena::Mode::THP);
+            else if (value == "hugetlb") HugePageArena::set_mode(HugePageArena::Mode::HUGETLB);
+            else {
+                std::cerr << "Invalid --huge-pages mode: " << value << " (off, thp or hugetlb)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--key-index") {
+            key_index = true;
+        } else if (arg == "--lru-read-sample" && i + 1 < argc) {
+            std::string value = argv[++i];
+            size_t rate = 0;
+            if (!option_count(value, 1, SIZE_MAX, rate)) {
+                std::cerr << "Invalid --lru-read-sample: " << value << std::endl;
+                return 1;
+            }
+            BlinkDBEngine::set_lru_read_sampling(rate);
+        } else if (arg == "--zerocopy-min" && i + 1 < argc) {
+            std::string value = argv[++i];
+            if (!option_count(value, 0, SIZE_MAX, OutputQueue::zerocopy_min)) {
+                std::cerr << "Invalid --zerocopy-min: " << value << std::endl;
+                return 1;
+            }
+        } else if ((arg == "--loop-cpus" || arg == "--background-cpus") && i + 1 < argc) {
+            auto role = arg == "--loop-cpus" ? ThreadPlacement::Role::LOOP : ThreadPlacement::Role::BACKGROUND;
+            if (!thread_placement.configure(role, argv[++i])) {
+                std::cerr << "Invalid CPU list for " << arg << ": " << argv[i] << std::endl;
+                return 1;
+            }
+        } else {
+            std::cerr << "Usage: blinkdb [--shards N|auto] [--loop-cpus LIST] [--background-cpus LIST]"
+                      << " [--huge-pages off|thp|hugetlb] [--zerocopy-min BYTES]"
+                      << " [--key-index] [--lru-read-sample N]" << std::endl;
+            return 1;
+        }
+    }
+    if (shards > 0) {
+        return run_shards(std::min<size_t>(shards, SHARD_MAX), key_index);
+    }
+    thread_placement.pin(ThreadPlacement::Role::LOOP);
+    
     // Create socket
     int server_socket = socket(AF_INET, SOCK_STREAM, 0);
     if (server_socket == -1) {
@@ -1290,17 +2611,86 @@ int main() {
     }
     
     // Initialize database and command handler
-    BlinkDB db;
+    BlinkDBEngine db;
+    if (key_index) db.enable_key_index();
     CommandHandler handler(db);
+    EventLoopWatchdog watchdog;
+    handler.set_watchdog(&watchdog);
+    TrafficCapture capture;
+    handler.set_capture(&capture);
+    CommandScheduler scheduler;
+    handler.set_scheduler(&scheduler);
+    LatencyMonitor& latency = db.latency();
+    
+    ev.events = EPOLLIN;
+    ev.data.fd = scheduler.wakeup_fd();
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, scheduler.wakeup_fd(), &ev);
     
     std::cout << "BlinkDB server started on port " << PORT << std::endl;
     
     // Event loop
     struct epoll_event events[MAX_EVENTS];
-    std::unordered_map<int, std::string> client_buffers;
+    struct Client {
+        std::string input;
+        OutputQueue output;
+    };
+    std::unordered_map<int, Client> clients;
+    // Clients whose last command is suspended; their later commands wait in the buffer
+    std::unordered_set<int> blocked;
+    
+    auto close_client = [&](int fd) {
+        BLINKDB_PROBE1(conn__close, fd);
+        scheduler.cancel(fd);
+        blocked.erase(fd);
+        close(fd);
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        clients.erase(fd);
+    };
+    
+    auto flush_client = [&](int fd) {
+        if (!clients[fd].output.flush(fd)) {
+            std::cerr << "Error writing to client: " << fd << std::endl;
+            close_client(fd);
+        }
+    };
+    
+    // Runs the complete commands buffered for a client, stopping at one that
+    // suspends, and queues their replies; the caller flushes them
+    std::function<void(int)> process_buffer = [&](int fd) {
+        Client& client = clients[fd];
+        size_t consumed = 0;
+        size_t pos = 0;
+        bool pipelined = false;
+        while (!blocked.count(fd) && (pos = client.input.find("\r\n", consumed)) != std::string::npos) {
+            std::string command = client.input.substr(consumed, pos - consumed);
+            consumed = pos + 2;
+            
+            if (!command.empty()) {
+                // File descriptors identify connections; a reused fd continues an old stream
+                capture.record(fd, command, pipelined);
+                pipelined = true;
+                auto command_start = LatencyMonitor::Clock::now();
+                auto response = scheduler.start(fd, handler.execute(command), [&, fd](Reply reply) {
+                    clients[fd].output.push(std::move(reply));
+                    blocked.erase(fd);
+                    process_buffer(fd);
+                    flush_client(fd);
+                });
+                if (!response) {
+                    blocked.insert(fd);
+                    continue;
+                }
+                latency.add_since("command", command_start);
+                client.output.push(std::move(*response));
+            }
+        }
+        client.input.erase(0, consumed);
+    };
     
     while (true) {
-        int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, scheduler.timeout_ms());
+        auto iteration_start = LatencyMonitor::Clock::now();
+        watchdog.begin_iteration();
         
         for (int i = 0; i < num_events; ++i) {
             int fd = events[i].data.fd;
@@ -1320,7 +2710,12 @@ int main() {
                 
                 set_nonblocking(client_socket);
                 
-                ev.events = EPOLLIN | EPOLLET;
+                // Replies are small and written once per read batch; don't let Nagle hold them back
+                int nodelay = 1;
+                setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+                
+                // EPOLLOUT resumes replies that did not fit in the socket buffer
+                ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
                 ev.data.fd = client_socket;
                 if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_socket, &ev) == -1) {
                     std::cerr << "Failed to add client socket to epoll" << std::endl;
@@ -1328,50 +2723,55 @@ int main() {
                     continue;
                 }
                 
-                client_buffers[client_socket] = "";
+                clients[client_socket] = Client();
+                clients[client_socket].output.enable_zerocopy(client_socket);
+                BLINKDB_PROBE1(conn__accept, client_socket);
                 std::cout << "New client connected: " << client_socket << std::endl;
             }
+            // Background work finished or a list was pushed elsewhere; run_ready() below picks it up
+            else if (fd == scheduler.wakeup_fd()) {
+                scheduler.drain_wakeup();
+                continue;
+            }
             // Client data
             else {
+                if (!clients.count(fd)) continue;
+                if (events[i].events & EPOLLERR) {
+                    clients[fd].output.reap_completions(fd);
+                }
                 if (events[i].events & EPOLLIN) {
                     char buffer[BUFFER_SIZE];
                     ssize_t bytes_read;
                     
                     while ((bytes_read = read(fd, buffer, BUFFER_SIZE)) > 0) {
-                        client_buffers[fd].append(buffer, bytes_read);
+                        clients[fd].input.append(buffer, bytes_read);
                     }
                     
                     if (bytes_read == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
                         std::cerr << "Error reading from client: " << fd << std::endl;
-                        close(fd);
-                        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
-                        client_buffers.erase(fd);
+                        close_client(fd);
+                        continue;
                     } else if (bytes_read == 0) {
                         // Client disconnected
                         std::cout << "Client disconnected: " << fd << std::endl;
-                        close(fd);
-                        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
-                        client_buffers.erase(fd);
-                    } else {
-                        // Process commands in buffer
-                        size_t pos = 0;
-                        while ((pos = client_buffers[fd].find("\r\n")) != std::string::npos) {
-                            std::string command = client_buffers[fd].substr(0, pos);
-                            client_buffers[fd].erase(0, pos + 2);
-                            
-                            if (!command.empty()) {
-                                std::string response = handler.process_command(command);
-                                write(fd, response.c_str(), response.size());
-                            }
-                        }
+                        close_client(fd);
+                        continue;
                     }
+                    process_buffer(fd);
                 }
+                flush_client(fd);
             }
         }
+        
+        // Resume commands woken by pushes, timeouts or finished background work
+        scheduler.run_ready();
+        
+        watchdog.end_iteration();
+        latency.add_since("event-loop", iteration_start);
     }
     
     close(server_socket);
     close(epoll_fd);
     
     return 0;
-}
\ No newline at end of file
+}
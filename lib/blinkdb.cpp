@@ -0,0 +1,1395 @@
+// BlinkDB engine: keyspace operations, introspection and snapshot persistence.
+#include "blinkdb_internal.h"
+
+#include <malloc.h>
+#include <sys/mman.h>
+#include <cstdio>
+#include <fnmatch.h>
+#include <condition_variable>
+
+const char* huge_page_mode_name(HugePageArena::Mode mode) {
+    switch (mode) {
+        case HugePageArena::Mode::THP: return "thp";
+        case HugePageArena::Mode::HUGETLB: return "hugetlb";
+        default: return "off";
+    }
+}
+
+bool HugePageArena::set_mode(Mode mode) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (started.load(std::memory_order_relaxed)) return false;
+    current.store(mode, std::memory_order_relaxed);
+    return true;
+}
+
+// Maps `size` bytes (a multiple of HUGEPAGE_SIZE) aligned to HUGEPAGE_SIZE so
+// THP can back every extent; the caller holds the lock
+char* HugePageArena::map_region(size_t size) {
+    if (current.load(std::memory_order_relaxed) == Mode::HUGETLB) {
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            regions.push_back({static_cast<char*>(p), size, true});
+            return static_cast<char*>(p);
+        }
+    }
+    
+    void* p = mmap(nullptr, size + blinkdb_config::HUGEPAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) throw std::bad_alloc();
+    char* raw = static_cast<char*>(p);
+    char* base = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(raw) + blinkdb_config::HUGEPAGE_SIZE - 1) & ~uintptr_t(blinkdb_config::HUGEPAGE_SIZE - 1));
+    if (base > raw) munmap(raw, base - raw);
+    size_t tail = (raw + size + blinkdb_config::HUGEPAGE_SIZE) - (base + size);
+    if (tail > 0) munmap(base + size, tail);
+    madvise(base, size, MADV_HUGEPAGE);
+    regions.push_back({base, size, false});
+    return base;
+}
+
+HugePageArena::ThreadCache& HugePageArena::thread_cache() {
+    if (!cache.registered) {
+        // Constructed on the thread's first small block; its destructor runs at thread exit
+        struct Retire {
+            ~Retire() {
+                for (size_t size_class = 0; size_class < SIZE_CLASSES; ++size_class) {
+                    spill(size_class, cache.counts[size_class]);
+                }
+                cache.retired = true;
+            }
+        };
+        static thread_local Retire retire;
+        (void)retire;
+        cache.registered = true;
+    }
+    return cache;
+}
+
+void HugePageArena::refill(size_t size_class) {
+    void*& shared = free_lists[size_class];
+    void*& own = cache.free_lists[size_class];
+    size_t moved = 0;
+    while (shared && moved < blinkdb_config::HUGEPAGE_ARENA_THREAD_BATCH) {
+        void* block = shared;
+        shared = *static_cast<void**>(block);
+        *static_cast<void**>(block) = own;
+        own = block;
+        moved++;
+    }
+    size_t block_size = (size_class + 1) * SIZE_CLASS;
+    for (; moved < blinkdb_config::HUGEPAGE_ARENA_THREAD_BATCH; ++moved) {
+        if (carve_next == nullptr || carve_next + block_size > carve_end) {
+            if (moved > 0) break;
+            carve_next = map_region(blinkdb_config::HUGEPAGE_SIZE);
+            carve_end = carve_next + blinkdb_config::HUGEPAGE_SIZE;
+            small_bytes += blinkdb_config::HUGEPAGE_SIZE;
+        }
+        void* block = carve_next;
+        carve_next += block_size;
+        *static_cast<void**>(block) = own;
+        own = block;
+    }
+    cache.counts[size_class] += moved;
+}
+
+void HugePageArena::spill(size_t size_class, size_t count) {
+    void*& own = cache.free_lists[size_class];
+    std::lock_guard<std::mutex> guard(lock);
+    for (size_t i = 0; i < count && own; ++i) {
+        void* block = own;
+        own = *static_cast<void**>(block);
+        *static_cast<void**>(block) = free_lists[size_class];
+        free_lists[size_class] = block;
+        cache.counts[size_class]--;
+    }
+}
+
+void* HugePageArena::allocate(size_t bytes) {
+    if (!started.load(std::memory_order_relaxed)) started.store(true, std::memory_order_relaxed);
+    if (mode() == Mode::OFF || (bytes > blinkdb_config::HUGEPAGE_ARENA_MAX_SMALL && bytes < blinkdb_config::HUGEPAGE_SIZE)) {
+        return ::operator new(bytes);
+    }
+    
+    if (bytes >= blinkdb_config::HUGEPAGE_SIZE) {
+        std::lock_guard<std::mutex> guard(lock);
+        size_t size = (bytes + blinkdb_config::HUGEPAGE_SIZE - 1) & ~size_t(blinkdb_config::HUGEPAGE_SIZE - 1);
+        large_bytes += size;
+        return map_region(size);
+    }
+    
+    ThreadCache& own = thread_cache();
+    size_t size_class = (std::max<size_t>(bytes, 1) + SIZE_CLASS - 1) / SIZE_CLASS - 1;
+    void*& head = own.free_lists[size_class];
+    if (!head) {
+        std::lock_guard<std::mutex> guard(lock);
+        refill(size_class);
+    }
+    void* block = head;
+    head = *static_cast<void**>(block);
+    size_t& count = own.counts[size_class];
+    count--;
+    // A thread that is exiting keeps nothing cached
+    if (own.retired && count > 0) spill(size_class, count);
+    return block;
+}
+
+void HugePageArena::deallocate(void* p, size_t bytes) {
+    if (!p) return;
+    if (mode() == Mode::OFF || (bytes > blinkdb_config::HUGEPAGE_ARENA_MAX_SMALL && bytes < blinkdb_config::HUGEPAGE_SIZE)) {
+        ::operator delete(p);
+        return;
+    }
+    
+    if (bytes >= blinkdb_config::HUGEPAGE_SIZE) {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = std::find_if(regions.begin(), regions.end(), [p](const Region& r) { return r.base == p; });
+        if (it != regions.end()) {
+            munmap(it->base, it->size);
+            large_bytes -= it->size;
+            regions.erase(it);
+        }
+        return;
+    }
+    
+    // Small blocks go back on the thread's list for their size, which hands
+    // a batch to the shared list once it holds two; the regions are kept for reuse
+    ThreadCache& own = thread_cache();
+    size_t size_class = (std::max<size_t>(bytes, 1) + SIZE_CLASS - 1) / SIZE_CLASS - 1;
+    void*& head = own.free_lists[size_class];
+    *static_cast<void**>(p) = head;
+    head = p;
+    size_t& count = own.counts[size_class];
+    count++;
+    if (own.retired) {
+        spill(size_class, count);
+    } else if (count >= 2 * blinkdb_config::HUGEPAGE_ARENA_THREAD_BATCH) {
+        spill(size_class, blinkdb_config::HUGEPAGE_ARENA_THREAD_BATCH);
+    }
+}
+
+std::string HugePageArena::stats() {
+    std::vector<Region> mapped;
+    size_t small, large;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        mapped = regions;
+        small = small_bytes;
+        large = large_bytes;
+    }
+    std::sort(mapped.begin(), mapped.end(), [](const Region& a, const Region& b) { return a.base < b.base; });
+    
+    // hugetlb regions are huge pages by construction; THP regions count the
+    // AnonHugePages of every smaps mapping that overlaps them
+    size_t huge_bytes = 0;
+    for (const auto& region : mapped) {
+        if (region.hugetlb) huge_bytes += region.size;
+    }
+    size_t process_huge_bytes = 0;
+    std::ifstream smaps("/proc/self/smaps");
+    std::string line;
+    bool in_arena = false;
+    while (std::getline(smaps, line)) {
+        uintptr_t start, end;
+        if (std::sscanf(line.c_str(), "%lx-%lx ", &start, &end) == 2 && line.find(':') > line.find(' ')) {
+            auto it = std::upper_bound(mapped.begin(), mapped.end(), end, [](uintptr_t address, const Region& r) {
+                return address <= reinterpret_cast<uintptr_t>(r.base);
+            });
+            in_arena = it != mapped.begin() && !std::prev(it)->hugetlb
+                    && reinterpret_cast<uintptr_t>(std::prev(it)->base) + std::prev(it)->size > start;
+        } else if (line.compare(0, 14, "AnonHugePages:") == 0) {
+            size_t kb = std::stoull(line.substr(14));
+            process_huge_bytes += kb * 1024;
+            if (in_arena) huge_bytes += kb * 1024;
+        }
+    }
+    
+    size_t mapped_bytes = small + large;
+    double coverage = mapped_bytes > 0 ? static_cast<double>(huge_bytes) / mapped_bytes : 0.0;
+    std::string result;
+    result += "hugepages_mode:" + std::string(huge_page_mode_name(mode())) + "\r\n";
+    result += "hugepages_arena_bytes:" + std::to_string(mapped_bytes) + "\r\n";
+    result += "hugepages_arena_small_bytes:" + std::to_string(small) + "\r\n";
+    result += "hugepages_arena_large_bytes:" + std::to_string(large) + "\r\n";
+    result += "hugepages_backed_bytes:" + std::to_string(huge_bytes) + "\r\n";
+    result += "hugepages_coverage:" + std::to_string(coverage) + "\r\n";
+    result += "anon_huge_pages_bytes:" + std::to_string(process_huge_bytes) + "\r\n";
+    return result;
+}
+
+void BlinkDBEngine::touch(const std::string& key) {
+    {
+        std::lock_guard<std::mutex> guard(cache_lock);
+        cache.access(key);
+    }
+    hot_keys.record(key);
+}
+
+void BlinkDBEngine::set_lru_read_sampling(size_t rate) {
+    lru_read_sample_rate = std::max<size_t>(rate, 1);
+}
+
+void BlinkDBEngine::touch_unlocked(const std::string& key) {
+    hot_keys.record(key);
+    
+    // Only keys still tracked are refreshed, which keeps a key deleted during
+    // the read from coming back into the LRU
+    size_t rate = lru_read_sample_rate.load(std::memory_order_relaxed);
+    if (rate == 1) {
+        std::lock_guard<std::mutex> guard(cache_lock);
+        if (cache.contains(key)) cache.access(key);
+        return;
+    }
+    // Sampled and skipped under contention so readers do not serialize on cache_lock
+    static thread_local uint64_t reads = 0;
+    if (reads++ % rate != 0) return;
+    std::unique_lock<std::mutex> guard(cache_lock, std::try_to_lock);
+    if (guard.owns_lock() && cache.contains(key)) {
+        cache.access(key);
+    }
+}
+
+void BlinkDBEngine::evict_if_needed() {
+    std::string oldest_key;
+    {
+        std::lock_guard<std::mutex> guard(cache_lock);
+        if (cache.size() <= blinkdb_config::CACHE_SIZE) return;
+        oldest_key = cache.get_oldest();
+        BLINKDB_PROBE2(evict, oldest_key.c_str(), cache.size());
+    }
+    auto start = LatencyMonitor::Clock::now();
+    remove_key(oldest_key);
+    latency_monitor.add_since("eviction", start);
+}
+
+DataType* BlinkDBEngine::lookup(const std::string& key) {
+    auto it = store.find(key);
+    DataType* entry = it == store.end() ? nullptr : it->second.get();
+    BLINKDB_PROBE2(keyspace__lookup, key.c_str(), entry != nullptr);
+    return entry;
+}
+
+void BlinkDBEngine::store_value(const std::string& key, std::unique_ptr<DataType> value) {
+    size_t buckets = store.bucket_count();
+    auto start = LatencyMonitor::Clock::now();
+    auto [it, inserted] = store.try_emplace(key);
+    if (!inserted) {
+        // Lock-free readers may still hold the old value
+        reclaimer.retire(it->second.release());
+    }
+    it->second = std::move(value);
+    read_index.put(it->first, it->second.get());
+    if (inserted && key_index) key_index->insert(it->first);
+    if (!field_indexes.empty()) index_fields(it->first, *it->second);
+    if (store.bucket_count() != buckets) {
+        latency_monitor.add_since("rehash", start);
+    }
+}
+
+bool BlinkDBEngine::remove_key(const std::string& key) {
+    {
+        std::lock_guard<std::mutex> guard(cache_lock);
+        cache.remove(key);
+    }
+    auto node = store.extract(key);
+    if (node.empty()) {
+        return false;
+    }
+    // Unlink from the index first; the map node holds the key and value readers may still see
+    read_index.erase(key);
+    if (key_index) key_index->erase(key);
+    for (auto& [name, index] : field_indexes) {
+        if (index->covers(key)) index->remove(key);
+    }
+    reclaimer.retire(new Store::node_type(std::move(node)));
+    return true;
+}
+
+void BlinkDBEngine::index_fields(const std::string& key, const DataType& value) {
+    const auto* hash = value.get_type() == ValueType::HASH ? static_cast<const HashType*>(&value) : nullptr;
+    for (auto& [name, index] : field_indexes) {
+        if (!index->covers(key)) continue;
+        if (hash && hash->hexists(index->field())) {
+            index->update(key, hash->hget(index->field()));
+        } else {
+            index->remove(key);
+        }
+    }
+}
+
+template <typename T>
+T* BlinkDBEngine::lookup_as(const std::string& key, ValueType type) {
+    DataType* entry = lookup(key);
+    if (!entry) {
+        return nullptr;
+    }
+    if (entry->get_type() != type) {
+        throw WrongTypeError();
+    }
+    return static_cast<T*>(entry);
+}
+
+template <typename T>
+T* BlinkDBEngine::lookup_or_create(const std::string& key, ValueType type) {
+    if (T* existing = lookup_as<T>(key, type)) {
+        return existing;
+    }
+    auto value = std::make_unique<T>();
+    T* created = value.get();
+    store_value(key, std::move(value));
+    bloom_filter.add(key);
+    return created;
+}
+
+BlinkDBEngine::BlinkDBEngine(const std::string& file) : cache(blinkdb_config::CACHE_SIZE), persistence_file(file) {
+    if (!persistence_file.empty()) load_from_disk();
+}
+
+BlinkDBEngine::~BlinkDBEngine() {
+    if (!persistence_file.empty()) save_to_disk();
+}
+
+void BlinkDBEngine::set(const std::string& key, const std::string& value) {
+    std::unique_lock lock(rw_lock);
+    auto string_value = std::make_unique<StringType>(value);
+    store_value(key, std::move(string_value));
+    touch(key);
+    evict_if_needed();
+    bloom_filter.add(key);
+}
+
+template <typename Read>
+bool BlinkDBEngine::read_string(const std::string& key, Read read) {
+    {
+        EpochReclaimer::Guard guard = EpochReclaimer::pin();
+        if (!guard) {
+            // Every reader slot is taken: read under the keyspace lock instead
+            std::shared_lock lock(rw_lock);
+            auto* string_value = lookup_as<StringType>(key, ValueType::STRING);
+            if (!string_value) {
+                return false;
+            }
+            touch(key);
+            read(*string_value);
+            return true;
+        }
+        
+        const DataType* entry = read_index.find(key);
+        BLINKDB_PROBE2(keyspace__lookup, key.c_str(), entry != nullptr);
+        if (!entry) {
+            return false;
+        }
+        if (entry->get_type() != ValueType::STRING) {
+            throw WrongTypeError();
+        }
+        // String values are never modified once published, only replaced
+        read(*static_cast<const StringType*>(entry));
+    }
+    
+    touch_unlocked(key);
+    return true;
+}
+
+std::optional<std::string> BlinkDBEngine::get(const std::string& key) {
+    std::optional<std::string> result;
+    read_string(key, [&](const StringType& value) { result.emplace(value.view()); });
+    return result;
+}
+
+std::shared_ptr<const BulkString> BlinkDBEngine::get_shared(const std::string& key, std::string& encoded) {
+    std::shared_ptr<const BulkString> result;
+    read_string(key, [&](const StringType& value) { result = value.shared(encoded); });
+    return result;
+}
+
+bool BlinkDBEngine::del(const std::string& key) {
+    std::unique_lock lock(rw_lock);
+    return remove_key(key);
+}
+
+std::optional<ValueType> BlinkDBEngine::type(const std::string& key) {
+    std::shared_lock lock(rw_lock);
+    DataType* entry = bloom_filter.contains(key) ? lookup(key) : nullptr;
+    if (!entry) {
+        return std::nullopt;
+    }
+    
+    return entry->get_type();
+}
+
+size_t BlinkDBEngine::lpush(const std::string& key, const std::string& value) {
+    size_t length;
+    {
+        std::unique_lock lock(rw_lock);
+        auto* list = lookup_or_create<ListType>(key, ValueType::LIST);
+        list->lpush(value);
+        touch(key);
+        evict_if_needed();
+        length = list->llen();
+    }
+    if (list_listener) list_listener(key);
+    return length;
+}
+
+size_t BlinkDBEngine::rpush(const std::string& key, const std::string& value) {
+    size_t length;
+    {
+        std::unique_lock lock(rw_lock);
+        auto* list = lookup_or_create<ListType>(key, ValueType::LIST);
+        list->rpush(value);
+        touch(key);
+        evict_if_needed();
+        length = list->llen();
+    }
+    if (list_listener) list_listener(key);
+    return length;
+}
+
+std::optional<std::string> BlinkDBEngine::lpop(const std::string& key) {
+    std::unique_lock lock(rw_lock);
+    auto* list = lookup_as<ListType>(key, ValueType::LIST);
+    if (!list) {
+        return std::nullopt;
+    }
+    
+    std::string result = list->lpop();
+    touch(key);
+    
+    if (list->llen() == 0) {
+        remove_key(key);
+    }
+    
+    return result;
+}
+
+std::optional<std::string> BlinkDBEngine::rpop(const std::string& key) {
+    std::unique_lock lock(rw_lock);
+    auto* list = lookup_as<ListType>(key, ValueType::LIST);
+    if (!list) {
+        return std::nullopt;
+    }
+    
+    std::string result = list->rpop();
+    touch(key);
+    
+    if (list->llen() == 0) {
+        remove_key(key);
+    }
+    
+    return result;
+}
+
+std::optional<std::string> BlinkDBEngine::lindex(const std::string& key, int index) {
+    std::shared_lock lock(rw_lock);
+    auto* list = lookup_as<ListType>(key, ValueType::LIST);
+    if (!list) {
+        return std::nullopt;
+    }
+    
+    touch(key);
+    
+    int length = list->llen();
+    if (index < -length || index >= length) {
+        return std::nullopt;
+    }
+    return list->lindex(index);
+}
+
+size_t BlinkDBEngine::llen(const std::string& key) {
+    std::shared_lock lock(rw_lock);
+    auto* list = lookup_as<ListType>(key, ValueType::LIST);
+    if (!list) {
+        return 0;
+    }
+    
+    touch(key);
+    return list->llen();
+}
+
+std::vector<std::string> BlinkDBEngine::lrange(const std::string& key, int start, int end) {
+    std::shared_lock lock(rw_lock);
+    auto* list = lookup_as<ListType>(key, ValueType::LIST);
+    if (!list) {
+        return {};
+    }
+    
+    touch(key);
+    return list->lrange(start, end);
+}
+
+bool BlinkDBEngine::sadd(const std::string& key, const std::string& value) {
+    std::unique_lock lock(rw_lock);
+    auto* set = lookup_or_create<SetType>(key, ValueType::SET);
+    bool added = set->sadd(value);
+    touch(key);
+    evict_if_needed();
+    
+    return added;
+}
+
+bool BlinkDBEngine::sismember(const std::string& key, const std::string& value) {
+    std::shared_lock lock(rw_lock);
+    auto* set = lookup_as<SetType>(key, ValueType::SET);
+    if (!set) {
+        return false;
+    }
+    
+    touch(key);
+    return set->sismember(value);
+}
+
+bool BlinkDBEngine::srem(const std::string& key, const std::string& value) {
+    std::unique_lock lock(rw_lock);
+    auto* set = lookup_as<SetType>(key, ValueType::SET);
+    if (!set) {
+        return false;
+    }
+    
+    bool removed = set->srem(value);
+    touch(key);
+    
+    if (set->scard() == 0) {
+        remove_key(key);
+    }
+    
+    return removed;
+}
+
+size_t BlinkDBEngine::scard(const std::string& key) {
+    std::shared_lock lock(rw_lock);
+    auto* set = lookup_as<SetType>(key, ValueType::SET);
+    if (!set) {
+        return 0;
+    }
+    
+    touch(key);
+    return set->scard();
+}
+
+std::vector<std::string> BlinkDBEngine::smembers(const std::string& key) {
+    std::shared_lock lock(rw_lock);
+    auto* set = lookup_as<SetType>(key, ValueType::SET);
+    if (!set) {
+        return {};
+    }
+    
+    touch(key);
+    return set->smembers();
+}
+
+bool BlinkDBEngine::hset(const std::string& key, const std::string& field, const std::string& value) {
+    std::unique_lock lock(rw_lock);
+    auto* hash = lookup_or_create<HashType>(key, ValueType::HASH);
+    bool added = hash->hset(field, value);
+    for (auto& [name, index] : field_indexes) {
+        if (index->field() == field && index->covers(key)) index->update(key, value);
+    }
+    touch(key);
+    evict_if_needed();
+    
+    return added;
+}
+
+std::optional<std::string> BlinkDBEngine::hget(const std::string& key, const std::string& field) {
+    std::shared_lock lock(rw_lock);
+    auto* hash = lookup_as<HashType>(key, ValueType::HASH);
+    if (!hash) {
+        return std::nullopt;
+    }
+    
+    touch(key);
+    if (!hash->hexists(field)) {
+        return std::nullopt;
+    }
+    return hash->hget(field);
+}
+
+bool BlinkDBEngine::hexists(const std::string& key, const std::string& field) {
+    std::shared_lock lock(rw_lock);
+    auto* hash = lookup_as<HashType>(key, ValueType::HASH);
+    if (!hash) {
+        return false;
+    }
+    
+    touch(key);
+    return hash->hexists(field);
+}
+
+bool BlinkDBEngine::hdel(const std::string& key, const std::string& field) {
+    std::unique_lock lock(rw_lock);
+    auto* hash = lookup_as<HashType>(key, ValueType::HASH);
+    if (!hash) {
+        return false;
+    }
+    
+    bool removed = hash->hdel(field);
+    if (removed) {
+        for (auto& [name, index] : field_indexes) {
+            if (index->field() == field && index->covers(key)) index->remove(key);
+        }
+    }
+    touch(key);
+    
+    if (hash->hlen() == 0) {
+        remove_key(key);
+    }
+    
+    return removed;
+}
+
+size_t BlinkDBEngine::hlen(const std::string& key) {
+    std::shared_lock lock(rw_lock);
+    auto* hash = lookup_as<HashType>(key, ValueType::HASH);
+    if (!hash) {
+        return 0;
+    }
+    
+    touch(key);
+    return hash->hlen();
+}
+
+std::vector<std::string> BlinkDBEngine::hkeys(const std::string& key) {
+    std::shared_lock lock(rw_lock);
+    auto* hash = lookup_as<HashType>(key, ValueType::HASH);
+    if (!hash) {
+        return {};
+    }
+    
+    touch(key);
+    return hash->hkeys();
+}
+
+std::vector<std::string> BlinkDBEngine::hvals(const std::string& key) {
+    std::shared_lock lock(rw_lock);
+    auto* hash = lookup_as<HashType>(key, ValueType::HASH);
+    if (!hash) {
+        return {};
+    }
+    
+    touch(key);
+    return hash->hvals();
+}
+
+std::unordered_map<std::string, std::string> BlinkDBEngine::hgetall(const std::string& key) {
+    std::shared_lock lock(rw_lock);
+    auto* hash = lookup_as<HashType>(key, ValueType::HASH);
+    if (!hash) {
+        return {};
+    }
+    
+    touch(key);
+    return hash->hgetall();
+}
+
+size_t BlinkDBEngine::populate(size_t count, const std::string& prefix, size_t size, ValueType type,
+                         const std::function<bool(const std::string&)>& include) {
+    auto start = LatencyMonitor::Clock::now();
+    size_t workers = count >= blinkdb_config::POPULATE_PARALLEL_MIN ? std::max(1u, std::thread::hardware_concurrency()) : 1;
+    size_t added = 0;
+    std::vector<std::pair<std::string, std::unique_ptr<DataType>>> batch;
+    size_t batch_start = 0;
+    
+    auto generate = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            std::string id = std::to_string(batch_start + i);
+            std::string key = prefix + ":" + id;
+            if (include && !include(key)) continue;
+            std::string value = "value:" + id;
+            if (size) value.resize(size, '0');
+            std::unique_ptr<DataType> entry;
+            switch (type) {
+                case ValueType::STRING:
+                    entry = std::make_unique<StringType>(value);
+                    break;
+                case ValueType::LIST: {
+                    auto list = std::make_unique<ListType>();
+                    list->rpush(value);
+                    entry = std::move(list);
+                    break;
+                }
+                case ValueType::SET: {
+                    auto set = std::make_unique<SetType>();
+                    set->sadd(value);
+                    entry = std::move(set);
+                    break;
+                }
+                case ValueType::HASH: {
+                    auto hash = std::make_unique<HashType>();
+                    hash->hset("field", value);
+                    entry = std::move(hash);
+                    break;
+                }
+            }
+            batch[i] = {std::move(key), std::move(entry)};
+        }
+    };
+    auto share = [&](size_t worker) {
+        size_t chunk = (batch.size() + workers - 1) / workers;
+        return std::make_pair(std::min(batch.size(), worker * chunk), std::min(batch.size(), (worker + 1) * chunk));
+    };
+    
+    // Helper threads are started once and build their share of every batch:
+    // `generation` counts the batches handed out, `pending` the shares of
+    // the current one still being built
+    std::mutex batch_lock;
+    std::condition_variable batch_cv;
+    size_t generation = 0;
+    size_t pending = 0;
+    bool finished = false;
+    std::vector<std::thread> helpers;
+    for (size_t worker = 1; worker < workers; ++worker) {
+        helpers.emplace_back([&, worker] {
+            for (size_t seen = 0;; ) {
+                std::pair<size_t, size_t> range;
+                {
+                    std::unique_lock<std::mutex> guard(batch_lock);
+                    batch_cv.wait(guard, [&] { return finished || generation != seen; });
+                    if (finished) return;
+                    seen = generation;
+                    range = share(worker);
+                }
+                generate(range.first, range.second);
+                std::lock_guard<std::mutex> guard(batch_lock);
+                if (--pending == 0) batch_cv.notify_all();
+            }
+        });
+    }
+    
+    std::vector<const std::string*> fresh;
+    std::vector<std::string> pushed;
+    for (; batch_start < count; batch_start += blinkdb_config::POPULATE_BATCH) {
+        {
+            std::lock_guard<std::mutex> guard(batch_lock);
+            batch.clear();
+            batch.resize(std::min<size_t>(blinkdb_config::POPULATE_BATCH, count - batch_start));
+            pending = helpers.size();
+            generation++;
+        }
+        batch_cv.notify_all();
+        auto own = share(0);
+        generate(own.first, own.second);
+        {
+            std::unique_lock<std::mutex> guard(batch_lock);
+            batch_cv.wait(guard, [&] { return pending == 0; });
+        }
+        
+        // One batch per exclusive lock, so other clients get in between batches
+        std::unique_lock lock(rw_lock);
+        pushed.clear();
+        store.reserve(store.size() + batch.size());
+        fresh.clear();
+        for (auto& [key, entry] : batch) {
+            if (!entry) continue;
+            auto [it, inserted] = store.emplace(key, std::move(entry));
+            if (inserted) {
+                read_index.put(it->first, it->second.get());
+                if (key_index) key_index->insert(it->first);
+                if (!field_indexes.empty()) index_fields(it->first, *it->second);
+                bloom_filter.add(key);
+                fresh.push_back(&it->first);
+                if (type == ValueType::LIST && list_listener) pushed.push_back(it->first);
+                added++;
+            }
+        }
+        // The new keys enter the LRU in insertion order; only the last
+        // CACHE_SIZE of them can still be tracked afterwards
+        {
+            std::lock_guard<std::mutex> guard(cache_lock);
+            for (size_t i = fresh.size() > blinkdb_config::CACHE_SIZE ? fresh.size() - blinkdb_config::CACHE_SIZE : 0; i < fresh.size(); ++i) {
+                cache.access(*fresh[i]);
+            }
+        }
+        evict_if_needed();
+        lock.unlock();
+        for (const auto& key : pushed) list_listener(key);
+    }
+    
+    {
+        std::lock_guard<std::mutex> guard(batch_lock);
+        finished = true;
+    }
+    batch_cv.notify_all();
+    for (auto& helper : helpers) helper.join();
+    
+    latency_monitor.add_since("populate", start);
+    return added;
+}
+
+void BlinkDBEngine::set_list_listener(std::function<void(const std::string&)> listener) {
+    list_listener = std::move(listener);
+}
+
+size_t BlinkDBEngine::move_keys(const std::function<BlinkDBEngine*(const std::string&)>& destination) {
+    std::unique_lock lock(rw_lock);
+    std::vector<std::pair<std::string, BlinkDBEngine*>> moving;
+    for (const auto& entry : store) {
+        BlinkDBEngine* target = destination(entry.first);
+        if (target && target != this) moving.emplace_back(entry.first, target);
+    }
+    for (auto& [key, target] : moving) {
+        std::unique_ptr<DataType> value = std::move(store.find(key)->second);
+        remove_key(key);
+        std::unique_lock target_lock(target->rw_lock);
+        target->store_value(key, std::move(value));
+        {
+            std::lock_guard<std::mutex> guard(target->cache_lock);
+            target->cache.access(key);
+        }
+        target->bloom_filter.add(key);
+    }
+    return moving.size();
+}
+
+size_t BlinkDBEngine::scan_buckets(size_t cursor, size_t count,
+                             const std::function<void(const std::string&, const DataType&)>& visit) {
+    std::shared_lock lock(rw_lock);
+    size_t bucket_count = store.bucket_count();
+    size_t end = std::min(bucket_count, cursor + count);
+    
+    for (size_t bucket = cursor; bucket < end; ++bucket) {
+        for (auto it = store.begin(bucket); it != store.end(bucket); ++it) {
+            visit(it->first, *it->second);
+        }
+    }
+    
+    return end >= bucket_count ? 0 : end;
+}
+
+// The part of a glob pattern before its first special character
+static std::string literal_prefix(const std::string& pattern) {
+    return pattern.substr(0, pattern.find_first_of("*?[\\"));
+}
+
+void BlinkDBEngine::enable_key_index() {
+    std::unique_lock lock(rw_lock);
+    if (key_index) return;
+    auto start = LatencyMonitor::Clock::now();
+    key_index = std::make_unique<KeyIndex>();
+    for (const auto& entry : store) {
+        key_index->insert(entry.first);
+    }
+    latency_monitor.add_since("key-index-build", start);
+}
+
+bool BlinkDBEngine::lru_tracks(const std::string& key) {
+    std::lock_guard<std::mutex> guard(cache_lock);
+    return cache.contains(key);
+}
+
+bool BlinkDBEngine::has_key_index() {
+    std::shared_lock lock(rw_lock);
+    return key_index != nullptr;
+}
+
+std::vector<std::string> BlinkDBEngine::keys(const std::string& pattern) {
+    std::vector<std::string> result;
+    std::shared_lock lock(rw_lock);
+    if (key_index) {
+        std::string prefix = literal_prefix(pattern);
+        bool prefix_only = pattern.size() == prefix.size() + 1 && pattern.back() == '*';
+        key_index->visit_prefix(prefix, 0, [&](const std::string& key) {
+            if (prefix_only || fnmatch(pattern.c_str(), key.c_str(), 0) == 0) result.push_back(key);
+            return true;
+        });
+        return result;
+    }
+    for (const auto& entry : store) {
+        if (fnmatch(pattern.c_str(), entry.first.c_str(), 0) == 0) result.push_back(entry.first);
+    }
+    return result;
+}
+
+// A key index SCAN cursor: "1" and then every byte of the last key visited
+// as three decimal digits, so clients that parse cursors as numbers keep working
+static std::string encode_key_cursor(const std::string& key) {
+    std::string cursor = "1";
+    char digits[4];
+    for (unsigned char byte : key) {
+        std::snprintf(digits, sizeof(digits), "%03u", byte);
+        cursor += digits;
+    }
+    return cursor;
+}
+
+static std::string decode_key_cursor(const std::string& cursor) {
+    if (cursor.size() % 3 != 1 || cursor[0] != '1') throw std::invalid_argument("invalid cursor");
+    std::string key;
+    for (size_t i = 1; i < cursor.size(); i += 3) {
+        unsigned value = 0;
+        for (size_t j = i; j < i + 3; ++j) {
+            if (!std::isdigit(static_cast<unsigned char>(cursor[j]))) throw std::invalid_argument("invalid cursor");
+            value = value * 10 + (cursor[j] - '0');
+        }
+        if (value > 255) throw std::invalid_argument("invalid cursor");
+        key.push_back(static_cast<char>(value));
+    }
+    return key;
+}
+
+std::string BlinkDBEngine::scan(const std::string& cursor, size_t count, const std::string& pattern,
+                          std::vector<std::string>& out) {
+    bool match_all = pattern == "*";
+    {
+        std::shared_lock lock(rw_lock);
+        if (key_index) {
+            std::string prefix = literal_prefix(pattern);
+            std::string last;
+            size_t visited = 0;
+            bool more = false;
+            auto step = [&](const std::string& key) {
+                // One key past the batch only tells whether the walk is done
+                if (visited == count) {
+                    more = true;
+                    return false;
+                }
+                if (match_all || fnmatch(pattern.c_str(), key.c_str(), 0) == 0) out.push_back(key);
+                last = key;
+                ++visited;
+                return true;
+            };
+            if (cursor == "0") {
+                key_index->visit_prefix(prefix, 0, step);
+            } else {
+                key_index->visit_prefix_after(prefix, decode_key_cursor(cursor), step);
+            }
+            return more ? encode_key_cursor(last) : "0";
+        }
+    }
+    if (cursor.empty() || cursor.size() > 19 || cursor.find_first_not_of("0123456789") != std::string::npos) {
+        throw std::invalid_argument("invalid cursor");
+    }
+    size_t next = scan_buckets(std::stoull(cursor), count, [&](const std::string& key, const DataType&) {
+        if (match_all || fnmatch(pattern.c_str(), key.c_str(), 0) == 0) out.push_back(key);
+    });
+    return std::to_string(next);
+}
+
+bool BlinkDBEngine::create_index(const std::string& name, const std::string& prefix, const std::string& field,
+                           FieldIndexType type) {
+    std::unique_lock lock(rw_lock);
+    if (field_indexes.count(name)) return false;
+    auto start = LatencyMonitor::Clock::now();
+    auto index = std::make_unique<FieldIndex>(prefix, field, type);
+    auto backfill = [&](const std::string& key, const DataType& value) {
+        if (value.get_type() != ValueType::HASH) return;
+        const auto& hash = static_cast<const HashType&>(value);
+        if (hash.hexists(field)) index->update(key, hash.hget(field));
+    };
+    if (key_index) {
+        key_index->visit_prefix(prefix, 0, [&](const std::string& key) {
+            backfill(key, *store.find(key)->second);
+            return true;
+        });
+    } else {
+        for (const auto& [key, value] : store) {
+            if (index->covers(key)) backfill(key, *value);
+        }
+    }
+    field_indexes.emplace(name, std::move(index));
+    latency_monitor.add_since("field-index-build", start);
+    return true;
+}
+
+bool BlinkDBEngine::drop_index(const std::string& name) {
+    std::unique_lock lock(rw_lock);
+    return field_indexes.erase(name) > 0;
+}
+
+std::vector<FieldIndexInfo> BlinkDBEngine::list_indexes() {
+    std::shared_lock lock(rw_lock);
+    std::vector<FieldIndexInfo> result;
+    for (const auto& [name, index] : field_indexes) {
+        result.push_back({name, index->prefix(), index->field(), index->type(), index->size()});
+    }
+    return result;
+}
+
+std::vector<std::string> BlinkDBEngine::query_index(const std::vector<FieldPredicate>& predicates, size_t limit) {
+    std::shared_lock lock(rw_lock);
+    std::vector<const FieldIndex*> indexes;
+    for (const auto& predicate : predicates) {
+        auto it = field_indexes.find(predicate.index);
+        if (it == field_indexes.end()) {
+            throw std::invalid_argument("no such index '" + predicate.index + "'");
+        }
+        if (predicate.range && it->second->type() != FieldIndexType::NUMERIC) {
+            throw std::invalid_argument("index '" + predicate.index + "' is not numeric");
+        }
+        indexes.push_back(it->second.get());
+    }
+    std::vector<std::string> result;
+    if (predicates.empty()) return result;
+
+    // Enumerate the predicate with the fewest matches. Equality counts are
+    // free, so they go first and cap how far the numeric ranges are counted.
+    std::vector<size_t> order(predicates.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::stable_partition(order.begin(), order.end(),
+                          [&](size_t i) { return indexes[i]->type() == FieldIndexType::EQUALITY; });
+    size_t driver = order[0];
+    size_t fewest = SIZE_MAX;
+    for (size_t i : order) {
+        size_t matches = indexes[i]->count(predicates[i], fewest);
+        if (matches < fewest) {
+            fewest = matches;
+            driver = i;
+        }
+        if (fewest == 0) return result;
+    }
+    indexes[driver]->visit(predicates[driver], [&](const std::string& key) {
+        for (size_t i = 0; i < predicates.size(); ++i) {
+            if (i != driver && !indexes[i]->matches(key, predicates[i])) return true;
+        }
+        result.push_back(key);
+        return limit == 0 || result.size() < limit;
+    });
+    return result;
+}
+
+size_t BlinkDBEngine::dbsize() {
+    std::shared_lock lock(rw_lock);
+    return store.size();
+}
+
+LatencyMonitor& BlinkDBEngine::latency() {
+    return latency_monitor;
+}
+
+size_t BlinkDBEngine::keyspace_buckets() {
+    std::shared_lock lock(rw_lock);
+    return store.bucket_count();
+}
+
+size_t BlinkDBEngine::key_overhead(const std::string& key) {
+    return HASH_NODE_OVERHEAD + sizeof(std::pair<const std::string, std::unique_ptr<DataType>>)
+         + string_heap_bytes(key);
+}
+
+long long BlinkDBEngine::memory_usage(const std::string& key, size_t samples) {
+    std::shared_lock lock(rw_lock);
+    auto it = store.find(key);
+    if (it == store.end()) {
+        return -1;
+    }
+    return static_cast<long long>(key_overhead(key) + it->second->memory_usage(samples));
+}
+
+void BlinkDBEngine::set_memory_prefixes(const std::vector<std::string>& prefixes) {
+    std::lock_guard<std::mutex> guard(memory_prefixes_lock);
+    memory_prefixes = prefixes;
+}
+
+std::string BlinkDBEngine::allocator_stats() {
+    struct mallinfo2 mi = mallinfo2();
+    size_t allocated = mi.uordblks + mi.hblkhd;
+    size_t resident = mi.arena + mi.hblkhd;
+    double fragmentation = allocated > 0 ? static_cast<double>(resident) / allocated : 0.0;
+    
+    std::string result;
+    result += "allocator_allocated:" + std::to_string(allocated) + "\r\n";
+    result += "allocator_reserved:" + std::to_string(resident) + "\r\n";
+    result += "allocator_free:" + std::to_string(mi.fordblks) + "\r\n";
+    result += "allocator_mmapped:" + std::to_string(mi.hblkhd) + "\r\n";
+    result += "allocator_fragmentation_ratio:" + std::to_string(fragmentation) + "\r\n";
+    return result;
+}
+
+std::string BlinkDBEngine::memory_stats() {
+    struct Usage {
+        size_t keys = 0;
+        size_t key_bytes = 0;
+        size_t value_bytes = 0;
+    };
+    
+    std::vector<std::string> prefixes;
+    {
+        std::lock_guard<std::mutex> guard(memory_prefixes_lock);
+        prefixes = memory_prefixes;
+    }
+    
+    std::vector<Usage> by_type(4);
+    std::vector<Usage> by_prefix(prefixes.size());
+    Usage other;
+    
+    size_t cursor = 0;
+    do {
+        cursor = scan_buckets(cursor, blinkdb_config::MEMORY_STATS_BATCH, [&](const std::string& key, const DataType& value) {
+            size_t key_bytes = key_overhead(key);
+            size_t value_bytes = value.memory_usage(blinkdb_config::MEMORY_USAGE_SAMPLES);
+            
+            Usage& type_usage = by_type[static_cast<size_t>(value.get_type())];
+            type_usage.keys++;
+            type_usage.key_bytes += key_bytes;
+            type_usage.value_bytes += value_bytes;
+            
+            Usage* prefix_usage = &other;
+            for (size_t i = 0; i < prefixes.size(); ++i) {
+                if (key.compare(0, prefixes[i].size(), prefixes[i]) == 0) {
+                    prefix_usage = &by_prefix[i];
+                    break;
+                }
+            }
+            prefix_usage->keys++;
+            prefix_usage->key_bytes += key_bytes;
+            prefix_usage->value_bytes += value_bytes;
+        });
+    } while (cursor != 0);
+    
+    size_t dataset_bytes = 0;
+    size_t total_keys = 0;
+    for (const auto& usage : by_type) {
+        dataset_bytes += usage.key_bytes + usage.value_bytes;
+        total_keys += usage.keys;
+    }
+    
+    // LRU bookkeeping: one list node and one map node per tracked key, each holding a key copy
+    size_t lru_tracked;
+    size_t table_bytes;
+    size_t read_index_bytes;
+    size_t key_index_bytes;
+    size_t field_index_bytes = 0;
+    {
+        std::shared_lock lock(rw_lock);
+        key_index_bytes = key_index ? key_index->memory_bytes() : 0;
+        for (const auto& [name, index] : field_indexes) field_index_bytes += index->memory_bytes();
+        std::lock_guard<std::mutex> guard(cache_lock);
+        lru_tracked = cache.size();
+        table_bytes = store.bucket_count() * sizeof(void*);
+        read_index_bytes = read_index.memory_bytes();
+    }
+    size_t lru_bytes = lru_tracked * (2 * sizeof(void*) + sizeof(std::string)
+                                      + HASH_NODE_OVERHEAD + sizeof(std::string)
+                                      + sizeof(std::list<std::string>::iterator));
+    
+    std::string result = "# Allocator\r\n" + allocator_stats();
+    result += "# Overhead\r\n";
+    result += "keyspace_table_bytes:" + std::to_string(table_bytes) + "\r\n";
+    result += "lru_bytes:" + std::to_string(lru_bytes) + "\r\n";
+    result += "bloom_filter_bytes:" + std::to_string(sizeof(BloomFilter)) + "\r\n";
+    result += "read_index_bytes:" + std::to_string(read_index_bytes) + "\r\n";
+    result += "key_index_bytes:" + std::to_string(key_index_bytes) + "\r\n";
+    result += "field_index_bytes:" + std::to_string(field_index_bytes) + "\r\n";
+    result += "reclaim_pending_objects:" + std::to_string(reclaimer.pending()) + "\r\n";
+    result += "# Hugepages\r\n" + HugePageArena::stats();
+    result += "# Dataset\r\n";
+    result += "dataset_keys:" + std::to_string(total_keys) + "\r\n";
+    result += "dataset_bytes:" + std::to_string(dataset_bytes) + "\r\n";
+    
+    auto format_usage = [](const Usage& usage) {
+        size_t average = usage.keys > 0 ? (usage.key_bytes + usage.value_bytes) / usage.keys : 0;
+        return "keys=" + std::to_string(usage.keys)
+             + ",key_overhead_bytes=" + std::to_string(usage.key_bytes)
+             + ",value_bytes=" + std::to_string(usage.value_bytes)
+             + ",avg_bytes_per_key=" + std::to_string(average);
+    };
+    
+    result += "# Types\r\n";
+    for (ValueType type : {ValueType::STRING, ValueType::LIST, ValueType::SET, ValueType::HASH}) {
+        result += "type_" + value_type_name(type) + ":"
+                + format_usage(by_type[static_cast<size_t>(type)]) + "\r\n";
+    }
+    
+    result += "# Prefixes\r\n";
+    for (size_t i = 0; i < prefixes.size(); ++i) {
+        result += "prefix_" + prefixes[i] + ":" + format_usage(by_prefix[i]) + "\r\n";
+    }
+    result += "prefix_other:" + format_usage(other) + "\r\n";
+    
+    return result;
+}
+
+std::vector<std::pair<std::string, uint64_t>> BlinkDBEngine::hotkeys(size_t count) {
+    return hot_keys.top(count);
+}
+
+void BlinkDBEngine::reset_hotkeys() {
+    hot_keys.reset();
+}
+
+void BlinkDBEngine::reset_lockstats() {
+    rw_lock.reset_stats();
+}
+
+const LockModeStats& BlinkDBEngine::lock_stats(InstrumentedSharedMutex::Mode mode) const {
+    return rw_lock.stats(mode);
+}
+
+std::string BlinkDBEngine::info(const std::string& section) {
+    std::string result;
+    
+    if (section.empty() || section == "keyspace") {
+        std::shared_lock lock(rw_lock);
+        result += "# Keyspace\r\n";
+        result += "keys:" + std::to_string(store.size()) + "\r\n";
+        if (key_index) {
+            result += "key_index_keys:" + std::to_string(key_index->size()) + "\r\n";
+        }
+        result += "field_indexes:" + std::to_string(field_indexes.size()) + "\r\n";
+        std::lock_guard<std::mutex> guard(cache_lock);
+        result += "lru_tracked_keys:" + std::to_string(cache.size()) + "\r\n";
+    }
+    
+    if (section.empty() || section == "memory") {
+        result += "# Memory\r\n";
+        result += allocator_stats();
+    }
+    
+    if (section.empty() || section == "hotkeys") {
+        auto top = hot_keys.top(blinkdb_config::HOTKEYS_TOP_K);
+        result += "# Hotkeys\r\n";
+        result += "hotkeys_sample_rate:" + std::to_string(blinkdb_config::HOTKEYS_SAMPLE_RATE) + "\r\n";
+        result += "hotkeys_samples:" + std::to_string(hot_keys.total_samples()) + "\r\n";
+        for (size_t i = 0; i < top.size(); ++i) {
+            result += "hotkey_" + std::to_string(i) + ":key=" + top[i].first
+                    + ",hits=" + std::to_string(top[i].second) + "\r\n";
+        }
+    }
+    
+    if (section.empty() || section == "lockstats") {
+        result += "# Lockstats\r\n";
+        result += rw_lock.report();
+    }
+    
+    return result;
+}
+
+bool BlinkDBEngine::save_to_disk() {
+    std::shared_lock lock(rw_lock);
+    auto start = LatencyMonitor::Clock::now();
+    BLINKDB_PROBE2(snapshot__save__begin, persistence_file.c_str(), store.size());
+    std::ofstream file(persistence_file);
+    
+    if (!file) {
+        std::cerr << "Failed to open file for writing: " << persistence_file << std::endl;
+        return false;
+    }
+    
+    for (const auto& [key, value] : store) {
+        char type_char;
+        switch (value->get_type()) {
+            case ValueType::STRING: type_char = 'S'; break;
+            case ValueType::LIST: type_char = 'L'; break;
+            case ValueType::SET: type_char = 'E'; break;
+            case ValueType::HASH: type_char = 'H'; break;
+            default: continue;
+        }
+        
+        file << type_char << " " << key << " " << value->serialize() << std::endl;
+    }
+    
+    file.close();
+    if (!file) {
+        std::cerr << "Failed to write snapshot: " << persistence_file << std::endl;
+        return false;
+    }
+    latency_monitor.add_since("snapshot-save", start);
+    BLINKDB_PROBE2(snapshot__save__end, persistence_file.c_str(), store.size());
+    return true;
+}
+
+void BlinkDBEngine::load_from_disk() {
+    std::unique_lock lock(rw_lock);
+    auto start = LatencyMonitor::Clock::now();
+    BLINKDB_PROBE1(snapshot__load__begin, persistence_file.c_str());
+    std::ifstream file(persistence_file);
+    
+    if (!file) {
+        std::cerr << "No persistence file found or unable to open: " << persistence_file << std::endl;
+        return;
+    }
+    
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line.size() < 3) continue;
+        
+        char type_char = line[0];
+        size_t first_space = line.find(' ');
+        size_t second_space = line.find(' ', first_space + 1);
+        
+        if (first_space == std::string::npos || second_space == std::string::npos) continue;
+        
+        std::string key = line.substr(first_space + 1, second_space - first_space - 1);
+        std::string data = line.substr(second_space + 1);
+        
+        std::unique_ptr<DataType> value;
+        
+        switch (type_char) {
+            case 'S': {
+                auto string_value = std::make_unique<StringType>();
+                string_value->deserialize(data);
+                value = std::move(string_value);
+                break;
+            }
+            case 'L': {
+                auto list_value = std::make_unique<ListType>();
+                list_value->deserialize(data);
+                value = std::move(list_value);
+                break;
+            }
+            case 'E': {
+                auto set_value = std::make_unique<SetType>();
+                set_value->deserialize(data);
+                value = std::move(set_value);
+                break;
+            }
+            case 'H': {
+                auto hash_value = std::make_unique<HashType>();
+                hash_value->deserialize(data);
+                value = std::move(hash_value);
+                break;
+            }
+            default:
+                continue;
+        }
+        
+        store_value(key, std::move(value));
+        {
+            std::lock_guard<std::mutex> guard(cache_lock);
+            cache.access(key);
+        }
+        bloom_filter.add(key);
+    }
+    
+    file.close();
+    latency_monitor.add_since("snapshot-load", start);
+    BLINKDB_PROBE2(snapshot__load__end, persistence_file.c_str(), store.size());
+}
+
+// Public API: BlinkDB forwards to the engine
+BlinkDB::BlinkDB(const std::string& file) : engine(std::make_unique<BlinkDBEngine>(file)) {}
+BlinkDB::~BlinkDB() = default;
+
+void BlinkDB::set(const std::string& key, const std::string& value) { engine->set(key, value); }
+std::optional<std::string> BlinkDB::get(const std::string& key) { return engine->get(key); }
+bool BlinkDB::del(const std::string& key) { return engine->del(key); }
+std::optional<ValueType> BlinkDB::type(const std::string& key) { return engine->type(key); }
+
+size_t BlinkDB::lpush(const std::string& key, const std::string& value) { return engine->lpush(key, value); }
+size_t BlinkDB::rpush(const std::string& key, const std::string& value) { return engine->rpush(key, value); }
+std::optional<std::string> BlinkDB::lpop(const std::string& key) { return engine->lpop(key); }
+std::optional<std::string> BlinkDB::rpop(const std::string& key) { return engine->rpop(key); }
+std::optional<std::string> BlinkDB::lindex(const std::string& key, int index) { return engine->lindex(key, index); }
+size_t BlinkDB::llen(const std::string& key) { return engine->llen(key); }
+std::vector<std::string> BlinkDB::lrange(const std::string& key, int start, int end) {
+    return engine->lrange(key, start, end);
+}
+
+bool BlinkDB::sadd(const std::string& key, const std::string& value) { return engine->sadd(key, value); }
+bool BlinkDB::sismember(const std::string& key, const std::string& value) { return engine->sismember(key, value); }
+bool BlinkDB::srem(const std::string& key, const std::string& value) { return engine->srem(key, value); }
+size_t BlinkDB::scard(const std::string& key) { return engine->scard(key); }
+std::vector<std::string> BlinkDB::smembers(const std::string& key) { return engine->smembers(key); }
+
+bool BlinkDB::hset(const std::string& key, const std::string& field, const std::string& value) {
+    return engine->hset(key, field, value);
+}
+std::optional<std::string> BlinkDB::hget(const std::string& key, const std::string& field) {
+    return engine->hget(key, field);
+}
+bool BlinkDB::hexists(const std::string& key, const std::string& field) { return engine->hexists(key, field); }
+bool BlinkDB::hdel(const std::string& key, const std::string& field) { return engine->hdel(key, field); }
+size_t BlinkDB::hlen(const std::string& key) { return engine->hlen(key); }
+std::vector<std::string> BlinkDB::hkeys(const std::string& key) { return engine->hkeys(key); }
+std::vector<std::string> BlinkDB::hvals(const std::string& key) { return engine->hvals(key); }
+std::unordered_map<std::string, std::string> BlinkDB::hgetall(const std::string& key) { return engine->hgetall(key); }
+
+std::vector<std::string> BlinkDB::keys(const std::string& pattern) { return engine->keys(pattern); }
+size_t BlinkDB::dbsize() { return engine->dbsize(); }
+bool BlinkDB::save_to_disk() { return engine->save_to_disk(); }
@@ -0,0 +1,87 @@
+// libblinkdb: the embeddable BlinkDB engine. This is the installed C++ API,
+// the BlinkDB class with its typed operations; lib/blinkdb_c.h wraps it for C
+// callers. The engine itself lives in lib/blinkdb_internal.h, which the
+// server and the in-process benchmarks build against.
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class BlinkDBEngine;
+
+// Value types enum
+enum class ValueType {
+    STRING,
+    LIST,
+    SET,
+    HASH
+};
+
+// Thrown by typed operations on a key that holds a different value type
+class WrongTypeError : public std::runtime_error {
+public:
+    WrongTypeError() : std::runtime_error("WRONGTYPE Operation against a key holding the wrong kind of value") {}
+};
+
+// An engine instance. Safe to use from several threads at once.
+class BlinkDB {
+private:
+    std::unique_ptr<BlinkDBEngine> engine;
+
+public:
+    // An empty persistence file disables loading and saving; otherwise the
+    // snapshot is loaded now and written back on destruction
+    explicit BlinkDB(const std::string& file = "blinkdb_data.txt");
+    ~BlinkDB();
+
+    BlinkDB(const BlinkDB&) = delete;
+    BlinkDB& operator=(const BlinkDB&) = delete;
+
+    // Typed operations: missing keys map to std::nullopt, zero or an empty
+    // container, and commands against a key of another type throw WrongTypeError
+
+    // Basic operations
+    void set(const std::string& key, const std::string& value);
+    std::optional<std::string> get(const std::string& key);
+    // Returns whether the key existed
+    bool del(const std::string& key);
+    std::optional<ValueType> type(const std::string& key);
+
+    // List operations; push returns the new length
+    size_t lpush(const std::string& key, const std::string& value);
+    size_t rpush(const std::string& key, const std::string& value);
+    std::optional<std::string> lpop(const std::string& key);
+    std::optional<std::string> rpop(const std::string& key);
+    std::optional<std::string> lindex(const std::string& key, int index);
+    size_t llen(const std::string& key);
+    std::vector<std::string> lrange(const std::string& key, int start, int end);
+
+    // Set operations; add and remove return whether the set changed
+    bool sadd(const std::string& key, const std::string& value);
+    bool sismember(const std::string& key, const std::string& value);
+    bool srem(const std::string& key, const std::string& value);
+    size_t scard(const std::string& key);
+    std::vector<std::string> smembers(const std::string& key);
+
+    // Hash operations; hset returns whether the field is new
+    bool hset(const std::string& key, const std::string& field, const std::string& value);
+    std::optional<std::string> hget(const std::string& key, const std::string& field);
+    bool hexists(const std::string& key, const std::string& field);
+    bool hdel(const std::string& key, const std::string& field);
+    size_t hlen(const std::string& key);
+    std::vector<std::string> hkeys(const std::string& key);
+    std::vector<std::string> hvals(const std::string& key);
+    std::unordered_map<std::string, std::string> hgetall(const std::string& key);
+
+    // Keys matching a glob pattern (as in Redis KEYS)
+    std::vector<std::string> keys(const std::string& pattern);
+    size_t dbsize();
+
+    // Writes the snapshot now; false when it could not be written
+    bool save_to_disk();
+};
@@ -0,0 +1,233 @@
+// C interface to libblinkdb: thin wrappers that translate typed results and
+// exceptions into blinkdb_status codes.
+#include "blinkdb_c.h"
+#include "blinkdb.h"
+
+#include <cstdlib>
+#include <cstring>
+
+struct blinkdb {
+    BlinkDB engine;
+    bool persistent;
+
+    explicit blinkdb(const std::string& path) : engine(path), persistent(!path.empty()) {}
+};
+
+namespace {
+
+// Runs one engine call, mapping its exceptions to status codes
+template <typename Fn>
+blinkdb_status guarded(blinkdb_t* db, Fn fn) {
+    if (!db) return BLINKDB_ERROR;
+    try {
+        return fn(db->engine);
+    } catch (const WrongTypeError&) {
+        return BLINKDB_WRONGTYPE;
+    } catch (...) {
+        return BLINKDB_ERROR;
+    }
+}
+
+// Hands a value to the caller as a malloc'd copy (NUL-terminated for convenience)
+blinkdb_status copy_out(const std::optional<std::string>& result, char** value, size_t* value_len) {
+    if (!result) return BLINKDB_NOT_FOUND;
+    if (value) {
+        *value = static_cast<char*>(std::malloc(result->size() + 1));
+        if (!*value) return BLINKDB_ERROR;
+        std::memcpy(*value, result->data(), result->size());
+        (*value)[result->size()] = '\0';
+    }
+    if (value_len) *value_len = result->size();
+    return BLINKDB_OK;
+}
+
+blinkdb_status visit_all(const std::vector<std::string>& items, blinkdb_visit_fn visit, void* ctx) {
+    for (const auto& item : items) {
+        if (visit(ctx, item.data(), item.size()) != 0) break;
+    }
+    return BLINKDB_OK;
+}
+
+}  // namespace
+
+extern "C" {
+
+blinkdb_t* blinkdb_open(const char* path) {
+    try {
+        return new blinkdb(path ? path : "");
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void blinkdb_close(blinkdb_t* db) {
+    try {
+        delete db;
+    } catch (...) {
+    }
+}
+
+void blinkdb_free(void* ptr) {
+    std::free(ptr);
+}
+
+blinkdb_status blinkdb_set(blinkdb_t* db, const char* key, size_t key_len, const char* value, size_t value_len) {
+    return guarded(db, [&](BlinkDB& engine) {
+        engine.set(std::string(key, key_len), std::string(value, value_len));
+        return BLINKDB_OK;
+    });
+}
+
+blinkdb_status blinkdb_get(blinkdb_t* db, const char* key, size_t key_len, char** value, size_t* value_len) {
+    return guarded(db, [&](BlinkDB& engine) {
+        return copy_out(engine.get(std::string(key, key_len)), value, value_len);
+    });
+}
+
+blinkdb_status blinkdb_del(blinkdb_t* db, const char* key, size_t key_len) {
+    return guarded(db, [&](BlinkDB& engine) {
+        return engine.del(std::string(key, key_len)) ? BLINKDB_OK : BLINKDB_NOT_FOUND;
+    });
+}
+
+blinkdb_status blinkdb_lpush(blinkdb_t* db, const char* key, size_t key_len, const char* value, size_t value_len,
+                             size_t* length) {
+    return guarded(db, [&](BlinkDB& engine) {
+        size_t result = engine.lpush(std::string(key, key_len), std::string(value, value_len));
+        if (length) *length = result;
+        return BLINKDB_OK;
+    });
+}
+
+blinkdb_status blinkdb_rpush(blinkdb_t* db, const char* key, size_t key_len, const char* value, size_t value_len,
+                             size_t* length) {
+    return guarded(db, [&](BlinkDB& engine) {
+        size_t result = engine.rpush(std::string(key, key_len), std::string(value, value_len));
+        if (length) *length = result;
+        return BLINKDB_OK;
+    });
+}
+
+blinkdb_status blinkdb_lpop(blinkdb_t* db, const char* key, size_t key_len, char** value, size_t* value_len) {
+    return guarded(db, [&](BlinkDB& engine) {
+        return copy_out(engine.lpop(std::string(key, key_len)), value, value_len);
+    });
+}
+
+blinkdb_status blinkdb_rpop(blinkdb_t* db, const char* key, size_t key_len, char** value, size_t* value_len) {
+    return guarded(db, [&](BlinkDB& engine) {
+        return copy_out(engine.rpop(std::string(key, key_len)), value, value_len);
+    });
+}
+
+blinkdb_status blinkdb_llen(blinkdb_t* db, const char* key, size_t key_len, size_t* length) {
+    return guarded(db, [&](BlinkDB& engine) {
+        size_t result = engine.llen(std::string(key, key_len));
+        if (length) *length = result;
+        return BLINKDB_OK;
+    });
+}
+
+blinkdb_status blinkdb_lrange(blinkdb_t* db, const char* key, size_t key_len, int start, int end,
+                              blinkdb_visit_fn visit, void* ctx) {
+    return guarded(db, [&](BlinkDB& engine) {
+        return visit_all(engine.lrange(std::string(key, key_len), start, end), visit, ctx);
+    });
+}
+
+blinkdb_status blinkdb_sadd(blinkdb_t* db, const char* key, size_t key_len, const char* value, size_t value_len,
+                            int* changed) {
+    return guarded(db, [&](BlinkDB& engine) {
+        bool result = engine.sadd(std::string(key, key_len), std::string(value, value_len));
+        if (changed) *changed = result;
+        return BLINKDB_OK;
+    });
+}
+
+blinkdb_status blinkdb_srem(blinkdb_t* db, const char* key, size_t key_len, const char* value, size_t value_len,
+                            int* changed) {
+    return guarded(db, [&](BlinkDB& engine) {
+        bool result = engine.srem(std::string(key, key_len), std::string(value, value_len));
+        if (changed) *changed = result;
+        return BLINKDB_OK;
+    });
+}
+
+blinkdb_status blinkdb_sismember(blinkdb_t* db, const char* key, size_t key_len, const char* value, size_t value_len,
+                                 int* member) {
+    return guarded(db, [&](BlinkDB& engine) {
+        bool result = engine.sismember(std::string(key, key_len), std::string(value, value_len));
+        if (member) *member = result;
+        return BLINKDB_OK;
+    });
+}
+
+blinkdb_status blinkdb_scard(blinkdb_t* db, const char* key, size_t key_len, size_t* count) {
+    return guarded(db, [&](BlinkDB& engine) {
+        size_t result = engine.scard(std::string(key, key_len));
+        if (count) *count = result;
+        return BLINKDB_OK;
+    });
+}
+
+blinkdb_status blinkdb_smembers(blinkdb_t* db, const char* key, size_t key_len, blinkdb_visit_fn visit, void* ctx) {
+    return guarded(db, [&](BlinkDB& engine) {
+        return visit_all(engine.smembers(std::string(key, key_len)), visit, ctx);
+    });
+}
+
+blinkdb_status blinkdb_hset(blinkdb_t* db, const char* key, size_t key_len, const char* field, size_t field_len,
+                            const char* value, size_t value_len, int* created) {
+    return guarded(db, [&](BlinkDB& engine) {
+        bool result = engine.hset(std::string(key, key_len), std::string(field, field_len),
+                                  std::string(value, value_len));
+        if (created) *created = result;
+        return BLINKDB_OK;
+    });
+}
+
+blinkdb_status blinkdb_hget(blinkdb_t* db, const char* key, size_t key_len, const char* field, size_t field_len,
+                            char** value, size_t* value_len) {
+    return guarded(db, [&](BlinkDB& engine) {
+        return copy_out(engine.hget(std::string(key, key_len), std::string(field, field_len)), value, value_len);
+    });
+}
+
+blinkdb_status blinkdb_hdel(blinkdb_t* db, const char* key, size_t key_len, const char* field, size_t field_len,
+                            int* removed) {
+    return guarded(db, [&](BlinkDB& engine) {
+        bool result = engine.hdel(std::string(key, key_len), std::string(field, field_len));
+        if (removed) *removed = result;
+        return BLINKDB_OK;
+    });
+}
+
+blinkdb_status blinkdb_hlen(blinkdb_t* db, const char* key, size_t key_len, size_t* count) {
+    return guarded(db, [&](BlinkDB& engine) {
+        size_t result = engine.hlen(std::string(key, key_len));
+        if (count) *count = result;
+        return BLINKDB_OK;
+    });
+}
+
+blinkdb_status blinkdb_hgetall(blinkdb_t* db, const char* key, size_t key_len, blinkdb_visit_pair_fn visit, void* ctx) {
+    return guarded(db, [&](BlinkDB& engine) {
+        for (const auto& [field, value] : engine.hgetall(std::string(key, key_len))) {
+            if (visit(ctx, field.data(), field.size(), value.data(), value.size()) != 0) break;
+        }
+        return BLINKDB_OK;
+    });
+}
+
+size_t blinkdb_dbsize(blinkdb_t* db) {
+    return db ? db->engine.dbsize() : 0;
+}
+
+blinkdb_status blinkdb_save(blinkdb_t* db) {
+    if (db && !db->persistent) return BLINKDB_ERROR;
+    return guarded(db, [&](BlinkDB& engine) {
+        return engine.save_to_disk() ? BLINKDB_OK : BLINKDB_ERROR;
+    });
+}
+
+}  // extern "C"
@@ -0,0 +1,77 @@
+// C interface to libblinkdb. Keys and values are (pointer, length) byte
+// strings; values returned through `char**` are malloc'd and released with
+// blinkdb_free. No C++ exception crosses this boundary: failures come back as
+// a blinkdb_status.
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct blinkdb blinkdb_t;
+
+typedef enum {
+    BLINKDB_OK = 0,
+    BLINKDB_NOT_FOUND,
+    BLINKDB_WRONGTYPE,
+    BLINKDB_ERROR
+} blinkdb_status;
+
+// Called once per element of a list or set; returning non-zero stops the walk
+typedef int (*blinkdb_visit_fn)(void* ctx, const char* value, size_t value_len);
+// Called once per field of a hash; returning non-zero stops the walk
+typedef int (*blinkdb_visit_pair_fn)(void* ctx, const char* field, size_t field_len,
+                                     const char* value, size_t value_len);
+
+// Opens an engine; a NULL or empty path keeps it in memory only, otherwise
+// the snapshot is loaded now and written back by blinkdb_close
+blinkdb_t* blinkdb_open(const char* path);
+void blinkdb_close(blinkdb_t* db);
+void blinkdb_free(void* ptr);
+
+// Strings
+blinkdb_status blinkdb_set(blinkdb_t* db, const char* key, size_t key_len, const char* value, size_t value_len);
+blinkdb_status blinkdb_get(blinkdb_t* db, const char* key, size_t key_len, char** value, size_t* value_len);
+blinkdb_status blinkdb_del(blinkdb_t* db, const char* key, size_t key_len);
+
+// Lists; push reports the new length through `length` when it is non-NULL
+blinkdb_status blinkdb_lpush(blinkdb_t* db, const char* key, size_t key_len, const char* value, size_t value_len,
+                             size_t* length);
+blinkdb_status blinkdb_rpush(blinkdb_t* db, const char* key, size_t key_len, const char* value, size_t value_len,
+                             size_t* length);
+blinkdb_status blinkdb_lpop(blinkdb_t* db, const char* key, size_t key_len, char** value, size_t* value_len);
+blinkdb_status blinkdb_rpop(blinkdb_t* db, const char* key, size_t key_len, char** value, size_t* value_len);
+blinkdb_status blinkdb_llen(blinkdb_t* db, const char* key, size_t key_len, size_t* length);
+blinkdb_status blinkdb_lrange(blinkdb_t* db, const char* key, size_t key_len, int start, int end,
+                              blinkdb_visit_fn visit, void* ctx);
+
+// Sets; `changed` and `member` are set to 0 or 1
+blinkdb_status blinkdb_sadd(blinkdb_t* db, const char* key, size_t key_len, const char* value, size_t value_len,
+                            int* changed);
+blinkdb_status blinkdb_srem(blinkdb_t* db, const char* key, size_t key_len, const char* value, size_t value_len,
+                            int* changed);
+blinkdb_status blinkdb_sismember(blinkdb_t* db, const char* key, size_t key_len, const char* value, size_t value_len,
+                                 int* member);
+blinkdb_status blinkdb_scard(blinkdb_t* db, const char* key, size_t key_len, size_t* count);
+blinkdb_status blinkdb_smembers(blinkdb_t* db, const char* key, size_t key_len, blinkdb_visit_fn visit, void* ctx);
+
+// Hashes
+blinkdb_status blinkdb_hset(blinkdb_t* db, const char* key, size_t key_len, const char* field, size_t field_len,
+                            const char* value, size_t value_len, int* created);
+blinkdb_status blinkdb_hget(blinkdb_t* db, const char* key, size_t key_len, const char* field, size_t field_len,
+                            char** value, size_t* value_len);
+blinkdb_status blinkdb_hdel(blinkdb_t* db, const char* key, size_t key_len, const char* field, size_t field_len,
+                            int* removed);
+blinkdb_status blinkdb_hlen(blinkdb_t* db, const char* key, size_t key_len, size_t* count);
+blinkdb_status blinkdb_hgetall(blinkdb_t* db, const char* key, size_t key_len, blinkdb_visit_pair_fn visit, void* ctx);
+
+// Keyspace; save fails with BLINKDB_ERROR for an in-memory database or a
+// snapshot that could not be written
+size_t blinkdb_dbsize(blinkdb_t* db);
+blinkdb_status blinkdb_save(blinkdb_t* db);
+
+#ifdef __cplusplus
+}
+#endif
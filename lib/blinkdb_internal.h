@@ -0,0 +1,2104 @@
+// libblinkdb internals: tunables, value types, keyspace bookkeeping and
+// BlinkDBEngine, the engine behind the public BlinkDB class. Shared by the
+// library, the server in blinkDB.cpp (a RESP layer over BlinkDBEngine) and
+// the in-process benchmarks; embedders only see lib/blinkdb.h.
+#pragma once
+
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <set>
+#include <vector>
+#include <list>
+#include <sstream>
+#include <fstream>
+#include <bitset>
+#include <shared_mutex>
+#include <mutex>
+#include <algorithm>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <ctime>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <array>
+#include <cmath>
+#include <cctype>
+#include <cstdlib>
+
+#include "blinkdb.h"
+
+// Static tracepoints (USDT) for perf/bpftrace under the "blinkdb" provider.
+// With <sys/sdt.h> each probe is a single nop until a tracer attaches; without
+// it (or with BLINKDB_DISABLE_USDT) the probes and their arguments compile away.
+#if defined(__has_include) && !defined(BLINKDB_DISABLE_USDT)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define BLINKDB_PROBE1(name, a) DTRACE_PROBE1(blinkdb, name, a)
+#define BLINKDB_PROBE2(name, a, b) DTRACE_PROBE2(blinkdb, name, a, b)
+#define BLINKDB_PROBE3(name, a, b, c) DTRACE_PROBE3(blinkdb, name, a, b, c)
+#endif
+#endif
+#ifndef BLINKDB_PROBE1
+#define BLINKDB_PROBE1(name, a) do {} while (0)
+#define BLINKDB_PROBE2(name, a, b) do {} while (0)
+#define BLINKDB_PROBE3(name, a, b, c) do {} while (0)
+#endif
+
+// Engine tunables
+namespace blinkdb_config {
+inline constexpr size_t CACHE_SIZE = 1000;
+inline constexpr size_t BLOOM_FILTER_SIZE = 10000;
+inline constexpr size_t HOTKEYS_TOP_K = 16;
+inline constexpr size_t HOTKEYS_SAMPLE_RATE = 8;
+inline constexpr size_t HOTKEYS_SKETCH_WIDTH = 2048;
+inline constexpr size_t HOTKEYS_DECAY_INTERVAL = 100000;
+inline constexpr size_t LOCK_STATS_MAX_COMMANDS = 64;
+inline constexpr size_t LOCK_WAIT_BUCKETS = 16;
+inline constexpr size_t MEMORY_USAGE_SAMPLES = 5;
+inline constexpr size_t MEMORY_STATS_BATCH = 1024;
+inline constexpr size_t LATENCY_THRESHOLD_MS = 100;
+inline constexpr size_t LATENCY_HISTORY_LEN = 160;
+inline constexpr size_t POPULATE_BATCH = 16384;
+inline constexpr size_t POPULATE_PARALLEL_MIN = 10000;
+inline constexpr size_t EPOCH_MAX_THREADS = 256;
+inline constexpr size_t EPOCH_RECLAIM_BATCH = 64;
+inline constexpr size_t READ_INDEX_INITIAL_BUCKETS = 1024;
+inline constexpr size_t READ_INDEX_MIGRATE_STEP = 4;
+inline constexpr size_t HUGEPAGE_SIZE = 2 * 1024 * 1024;
+inline constexpr size_t HUGEPAGE_ARENA_MAX_SMALL = 256;
+inline constexpr size_t HUGEPAGE_ARENA_THREAD_BATCH = 64;
+inline constexpr size_t STRING_SHARED_MIN = 1024;
+inline constexpr size_t KEY_INDEX_SMALL_FANOUT = 16;
+}  // namespace blinkdb_config
+
+// Forward declarations
+class DataType;
+class StringType;
+class ListType;
+class SetType;
+class HashType;
+
+// Huge-page backed memory for the keyspace: the store's map nodes and bucket
+// array, the read index and the value objects allocate from here so lookups
+// walk memory covered by a few TLB entries. Small blocks come from per-size
+// free lists carved out of HUGEPAGE_SIZE regions; blocks of a region or more
+// get mappings of their own, and everything in between goes to operator new.
+// Each thread caches free small blocks per size and only takes the arena's
+// lock to move HUGEPAGE_ARENA_THREAD_BATCH of them to or from the shared
+// lists, so writers on different threads do not serialize on every node.
+// THP regions are madvise(MADV_HUGEPAGE)d, which also keeps them separate
+// from ordinary mappings; HUGETLB maps from the hugetlbfs pool and falls back
+// to THP when the pool is empty. Mappings stay private and copy-on-write, so
+// a forked child shares them like the rest of the heap. The mode is
+// process-wide and fixed by the first allocation; OFF forwards everything to
+// operator new.
+class HugePageArena {
+public:
+    enum class Mode { OFF, THP, HUGETLB };
+
+private:
+    struct Region {
+        char* base;
+        size_t size;
+        bool hugetlb;
+    };
+
+    static constexpr size_t SIZE_CLASS = 16;
+    static constexpr size_t SIZE_CLASSES = blinkdb_config::HUGEPAGE_ARENA_MAX_SMALL / SIZE_CLASS;
+
+    // Free small blocks owned by one thread. Trivially destructible, so a
+    // block freed while the thread exits can still find it; by then it is
+    // marked retired and such blocks go straight to the shared lists.
+    struct ThreadCache {
+        void* free_lists[SIZE_CLASSES];
+        size_t counts[SIZE_CLASSES];
+        bool registered;
+        bool retired;
+    };
+    static inline thread_local ThreadCache cache{};
+
+    static inline std::atomic<Mode> current{Mode::OFF};
+    static inline std::atomic<bool> started{false};
+    static inline std::mutex lock;
+    static inline std::vector<Region> regions;
+    static inline void* free_lists[SIZE_CLASSES];
+    static inline char* carve_next = nullptr;
+    static inline char* carve_end = nullptr;
+    static inline size_t small_bytes = 0;
+    static inline size_t large_bytes = 0;
+
+    static char* map_region(size_t size);
+    // Fills the calling thread's list for `size_class` from the shared list,
+    // carving new blocks when it is empty; the caller holds the lock
+    static void refill(size_t size_class);
+    // Moves `count` blocks of the calling thread's list back to the shared one
+    static void spill(size_t size_class, size_t count);
+    // The calling thread's cache, set up to hand its blocks back when the thread exits
+    static ThreadCache& thread_cache();
+
+public:
+    // Returns false once the first block has been allocated
+    static bool set_mode(Mode mode);
+    static Mode mode() { return current.load(std::memory_order_relaxed); }
+    static void* allocate(size_t bytes);
+    static void deallocate(void* p, size_t bytes);
+    // Mapped bytes and how much of them the kernel backs with huge pages (from /proc/self/smaps)
+    static std::string stats();
+};
+
+const char* huge_page_mode_name(HugePageArena::Mode mode);
+
+// Standard allocator over HugePageArena, for the keyspace containers
+template <typename T>
+struct HugePageAllocator {
+    using value_type = T;
+
+    HugePageAllocator() = default;
+    template <typename U>
+    HugePageAllocator(const HugePageAllocator<U>&) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(HugePageArena::allocate(n * sizeof(T))); }
+    void deallocate(T* p, size_t n) { HugePageArena::deallocate(p, n * sizeof(T)); }
+
+    template <typename U>
+    bool operator==(const HugePageAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const HugePageAllocator<U>&) const { return false; }
+};
+
+// Base abstract class for all data types
+class DataType {
+public:
+    virtual ~DataType() = default;
+    virtual ValueType get_type() const = 0;
+    virtual std::string serialize() const = 0;
+    virtual void deserialize(const std::string& data) = 0;
+    virtual std::string to_string() const = 0;
+    virtual size_t element_count() const = 0;
+    // Estimated bytes used by the value, including container overhead.
+    // Collections larger than `samples` elements are extrapolated from a sample.
+    virtual size_t memory_usage(size_t samples) const = 0;
+
+    // Value objects live in the huge-page arena; the virtual destructor passes the dynamic size
+    static void* operator new(size_t size) { return HugePageArena::allocate(size); }
+    static void operator delete(void* p, size_t size) { HugePageArena::deallocate(p, size); }
+};
+
+// Heap bytes owned by a string beyond its inline (small string) buffer
+inline size_t string_heap_bytes(const std::string& str) {
+    static const size_t inline_capacity = std::string().capacity();
+    return str.capacity() > inline_capacity ? str.capacity() + 1 : 0;
+}
+
+// Sums per-element heap usage, extrapolating from the first `samples`
+// elements of large containers (samples == 0 visits every element)
+template <typename Container, typename SizeFn>
+size_t sampled_heap_bytes(const Container& container, size_t samples, SizeFn element_bytes) {
+    size_t total = 0;
+    size_t visited = 0;
+    for (const auto& element : container) {
+        if (samples != 0 && visited == samples) break;
+        total += element_bytes(element);
+        ++visited;
+    }
+    if (visited == 0 || visited == container.size()) return total;
+    return total * container.size() / visited;
+}
+
+// Per-node overhead of unordered containers: next pointer and cached hash
+constexpr size_t HASH_NODE_OVERHEAD = sizeof(void*) + sizeof(size_t);
+
+inline std::string value_type_name(ValueType type) {
+    switch (type) {
+        case ValueType::STRING: return "string";
+        case ValueType::LIST: return "list";
+        case ValueType::SET: return "set";
+        case ValueType::HASH: return "hash";
+        default: return "unknown";
+    }
+}
+
+// Immutable string value stored pre-encoded as a RESP bulk reply
+// ("$<len>\r\n<bytes>\r\n"), so a GET reply is this buffer as is. Shared by
+// reference: a reader holding one keeps it alive after the key is
+// overwritten or deleted.
+class BulkString {
+private:
+    std::string encoded;
+    size_t header;
+
+public:
+    explicit BulkString(std::string_view value) {
+        std::string prefix = "$" + std::to_string(value.size()) + "\r\n";
+        header = prefix.size();
+        encoded.reserve(header + value.size() + 2);
+        encoded.append(prefix).append(value).append("\r\n");
+    }
+
+    std::string_view value() const { return std::string_view(encoded).substr(header, encoded.size() - header - 2); }
+    std::string_view resp() const { return encoded; }
+
+    size_t memory_usage() const { return sizeof(*this) + string_heap_bytes(encoded); }
+};
+
+// String data type. Values of STRING_SHARED_MIN bytes or more are kept in a
+// shared BulkString so reads can hand out the buffer instead of copying it;
+// smaller ones stay inline, where sharing would cost more than the copy.
+class StringType : public DataType {
+private:
+    std::variant<std::string, std::shared_ptr<const BulkString>> value;
+
+    void assign(std::string_view val) {
+        if (val.size() >= blinkdb_config::STRING_SHARED_MIN) {
+            value = std::make_shared<const BulkString>(val);
+        } else {
+            value = std::string(val);
+        }
+    }
+
+public:
+    explicit StringType(std::string_view val = "") { assign(val); }
+
+    ValueType get_type() const override {
+        return ValueType::STRING;
+    }
+
+    std::string serialize() const override {
+        return get();
+    }
+
+    void deserialize(const std::string& data) override {
+        assign(data);
+    }
+
+    std::string to_string() const override {
+        return get();
+    }
+
+    size_t element_count() const override {
+        return 1;
+    }
+
+    // make_shared puts the count block and the BulkString in one allocation
+    size_t memory_usage(size_t) const override {
+        if (auto* shared = std::get_if<std::shared_ptr<const BulkString>>(&value)) {
+            return sizeof(*this) + 2 * sizeof(long) + (*shared)->memory_usage();
+        }
+        return sizeof(*this) + string_heap_bytes(std::get<std::string>(value));
+    }
+
+    void set(std::string_view val) {
+        assign(val);
+    }
+
+    std::string get() const {
+        return std::string(view());
+    }
+
+    std::string_view view() const {
+        if (auto* shared = std::get_if<std::shared_ptr<const BulkString>>(&value)) {
+            return (*shared)->value();
+        }
+        return std::get<std::string>(value);
+    }
+
+    // The stored buffer for shared values. Inline values are RESP-encoded
+    // into `encoded` instead and null is returned: a fresh shared buffer per
+    // read would cost more than the copy.
+    std::shared_ptr<const BulkString> shared(std::string& encoded) const {
+        if (auto* shared = std::get_if<std::shared_ptr<const BulkString>>(&value)) {
+            return *shared;
+        }
+        const std::string& inline_value = std::get<std::string>(value);
+        encoded = "$" + std::to_string(inline_value.size()) + "\r\n";
+        encoded.append(inline_value).append("\r\n");
+        return nullptr;
+    }
+};
+
+// List data type
+class ListType : public DataType {
+private:
+    std::vector<std::string> elements;
+
+public:
+    ValueType get_type() const override {
+        return ValueType::LIST;
+    }
+
+    // Serializes list to string format for storage
+    std::string serialize() const override {
+        std::string result = "L";
+        for (const auto& element : elements) {
+            result += std::to_string(element.size()) + ":" + element + ",";
+        }
+        return result;
+    }
+
+    // Deserializes string to list
+    void deserialize(const std::string& data) override {
+        elements.clear();
+        if (data.empty() || data[0] != 'L') return;
+        
+        size_t pos = 1;
+        while (pos < data.size()) {
+            size_t colon_pos = data.find(':', pos);
+            if (colon_pos == std::string::npos) break;
+            
+            int len = std::stoi(data.substr(pos, colon_pos - pos));
+            std::string element = data.substr(colon_pos + 1, len);
+            elements.push_back(element);
+            
+            pos = colon_pos + len + 2; // Skip past element and comma
+        }
+    }
+
+    std::string to_string() const override {
+        std::string result = "[";
+        for (size_t i = 0; i < elements.size(); ++i) {
+            if (i > 0) result += ", ";
+            result += elements[i];
+        }
+        result += "]";
+        return result;
+    }
+
+    size_t element_count() const override {
+        return elements.size();
+    }
+
+    size_t memory_usage(size_t samples) const override {
+        return sizeof(*this) + elements.capacity() * sizeof(std::string)
+             + sampled_heap_bytes(elements, samples, string_heap_bytes);
+    }
+
+    // List operations
+    void lpush(const std::string& value) {
+        elements.insert(elements.begin(), value);
+    }
+
+    void rpush(const std::string& value) {
+        elements.push_back(value);
+    }
+
+    std::string lpop() {
+        if (elements.empty()) return "";
+        std::string value = elements.front();
+        elements.erase(elements.begin());
+        return value;
+    }
+
+    std::string rpop() {
+        if (elements.empty()) return "";
+        std::string value = elements.back();
+        elements.pop_back();
+        return value;
+    }
+
+    std::string lindex(int index) const {
+        if (index < 0) index = elements.size() + index;
+        if (index < 0 || index >= static_cast<int>(elements.size())) return "";
+        return elements[index];
+    }
+
+    int llen() const {
+        return static_cast<int>(elements.size());
+    }
+
+    std::vector<std::string> lrange(int start, int end) const {
+        if (elements.empty()) return {};
+        
+        if (start < 0) start = elements.size() + start;
+        if (end < 0) end = elements.size() + end;
+        
+        start = std::max(0, start);
+        end = std::min(static_cast<int>(elements.size()) - 1, end);
+        
+        if (start > end) return {};
+        
+        return std::vector<std::string>(elements.begin() + start, elements.begin() + end + 1);
+    }
+};
+
+// Set data type
+class SetType : public DataType {
+private:
+    std::unordered_set<std::string> elements;
+
+public:
+    ValueType get_type() const override {
+        return ValueType::SET;
+    }
+
+    std::string serialize() const override {
+        std::string result = "S";
+        for (const auto& element : elements) {
+            result += std::to_string(element.size()) + ":" + element + ",";
+        }
+        return result;
+    }
+
+    void deserialize(const std::string& data) override {
+        elements.clear();
+        if (data.empty() || data[0] != 'S') return;
+        
+        size_t pos = 1;
+        while (pos < data.size()) {
+            size_t colon_pos = data.find(':', pos);
+            if (colon_pos == std::string::npos) break;
+            
+            int len = std::stoi(data.substr(pos, colon_pos - pos));
+            std::string element = data.substr(colon_pos + 1, len);
+            elements.insert(element);
+            
+            pos = colon_pos + len + 2; // Skip past element and comma
+        }
+    }
+
+    std::string to_string() const override {
+        std::string result = "{";
+        bool first = true;
+        for (const auto& element : elements) {
+            if (!first) result += ", ";
+            result += element;
+            first = false;
+        }
+        result += "}";
+        return result;
+    }
+
+    size_t element_count() const override {
+        return elements.size();
+    }
+
+    size_t memory_usage(size_t samples) const override {
+        return sizeof(*this) + elements.bucket_count() * sizeof(void*)
+             + elements.size() * (HASH_NODE_OVERHEAD + sizeof(std::string))
+             + sampled_heap_bytes(elements, samples, string_heap_bytes);
+    }
+
+    // Set operations
+    bool sadd(const std::string& value) {
+        auto [_, inserted] = elements.insert(value);
+        return inserted;
+    }
+
+    bool sismember(const std::string& value) const {
+        return elements.find(value) != elements.end();
+    }
+
+    bool srem(const std::string& value) {
+        return elements.erase(value) > 0;
+    }
+
+    int scard() const {
+        return static_cast<int>(elements.size());
+    }
+
+    std::vector<std::string> smembers() const {
+        return std::vector<std::string>(elements.begin(), elements.end());
+    }
+};
+
+// Hash data type (similar to Redis hashes)
+class HashType : public DataType {
+private:
+    std::unordered_map<std::string, std::string> fields;
+
+public:
+    ValueType get_type() const override {
+        return ValueType::HASH;
+    }
+
+    std::string serialize() const override {
+        std::string result = "H";
+        for (const auto& [field, value] : fields) {
+            result += std::to_string(field.size()) + ":" + field + ":" + 
+                      std::to_string(value.size()) + ":" + value + ",";
+        }
+        return result;
+    }
+
+    void deserialize(const std::string& data) override {
+        fields.clear();
+        if (data.empty() || data[0] != 'H') return;
+        
+        size_t pos = 1;
+        while (pos < data.size()) {
+            // Parse field
+            size_t colon_pos1 = data.find(':', pos);
+            if (colon_pos1 == std::string::npos) break;
+            
+            int field_len = std::stoi(data.substr(pos, colon_pos1 - pos));
+            std::string field = data.substr(colon_pos1 + 1, field_len);
+            
+            // Parse value (its length starts after the field and the ':' that follows it)
+            size_t value_start = colon_pos1 + field_len + 2;
+            size_t colon_pos2 = data.find(':', value_start);
+            if (colon_pos2 == std::string::npos) break;
+            
+            int value_len = std::stoi(data.substr(value_start, colon_pos2 - value_start));
+            std::string value = data.substr(colon_pos2 + 1, value_len);
+            
+            fields[field] = value;
+            pos = colon_pos2 + value_len + 2; // Skip past value and comma
+        }
+    }
+
+    std::string to_string() const override {
+        std::string result = "{";
+        bool first = true;
+        for (const auto& [field, value] : fields) {
+            if (!first) result += ", ";
+            result += field + ": " + value;
+            first = false;
+        }
+        result += "}";
+        return result;
+    }
+
+    size_t element_count() const override {
+        return fields.size();
+    }
+
+    size_t memory_usage(size_t samples) const override {
+        return sizeof(*this) + fields.bucket_count() * sizeof(void*)
+             + fields.size() * (HASH_NODE_OVERHEAD + sizeof(std::pair<const std::string, std::string>))
+             + sampled_heap_bytes(fields, samples, [](const auto& entry) {
+                   return string_heap_bytes(entry.first) + string_heap_bytes(entry.second);
+               });
+    }
+
+    // Hash operations
+    bool hset(const std::string& field, const std::string& value) {
+        bool is_new = fields.find(field) == fields.end();
+        fields[field] = value;
+        return is_new;
+    }
+
+    std::string hget(const std::string& field) const {
+        auto it = fields.find(field);
+        return (it != fields.end()) ? it->second : "";
+    }
+
+    bool hexists(const std::string& field) const {
+        return fields.find(field) != fields.end();
+    }
+
+    bool hdel(const std::string& field) {
+        return fields.erase(field) > 0;
+    }
+
+    int hlen() const {
+        return static_cast<int>(fields.size());
+    }
+
+    std::vector<std::string> hkeys() const {
+        std::vector<std::string> keys;
+        keys.reserve(fields.size());
+        for (const auto& [field, _] : fields) {
+            keys.push_back(field);
+        }
+        return keys;
+    }
+
+    std::vector<std::string> hvals() const {
+        std::vector<std::string> values;
+        values.reserve(fields.size());
+        for (const auto& [_, value] : fields) {
+            values.push_back(value);
+        }
+        return values;
+    }
+
+    std::unordered_map<std::string, std::string> hgetall() const {
+        return fields;
+    }
+};
+
+// LRU Cache for key management
+class LRUCache {
+private:
+    std::list<std::string> cache;
+    std::unordered_map<std::string, std::list<std::string>::iterator> map;
+    size_t max_size;
+
+public:
+    explicit LRUCache(size_t size) : max_size(size) {}
+
+    void access(const std::string& key) {
+        if (map.find(key) != map.end()) {
+            cache.erase(map[key]);
+        }
+        cache.push_front(key);
+        map[key] = cache.begin();
+
+        if (cache.size() > max_size) {
+            auto oldest = cache.back();
+            map.erase(oldest);
+            cache.pop_back();
+        }
+    }
+
+    bool contains(const std::string& key) const {
+        return map.find(key) != map.end();
+    }
+
+    void remove(const std::string& key) {
+        if (map.find(key) != map.end()) {
+            cache.erase(map[key]);
+            map.erase(key);
+        }
+    }
+
+    std::string get_oldest() const {
+        if (cache.empty()) {
+            throw std::runtime_error("Cache is empty");
+        }
+        return cache.back();
+    }
+
+    size_t size() const {
+        return cache.size();
+    }
+};
+
+// Bloom Filter for probabilistic key existence checking
+class BloomFilter {
+private:
+    std::bitset<blinkdb_config::BLOOM_FILTER_SIZE> filter;
+    
+    size_t hash(const std::string& key) const {
+        std::hash<std::string> hasher;
+        return hasher(key) % blinkdb_config::BLOOM_FILTER_SIZE;
+    }
+
+public:
+    void add(const std::string& key) {
+        filter.set(hash(key));
+    }
+
+    bool contains(const std::string& key) const {
+        return filter.test(hash(key));
+    }
+};
+
+// Heavy-hitters tracker for hot key detection.
+// A count-min sketch estimates per-key frequencies and a min-heap keeps the
+// current top-K keys. Only one in HOTKEYS_SAMPLE_RATE accesses is recorded,
+// and counters are halved every HOTKEYS_DECAY_INTERVAL samples so the view
+// follows the recent workload instead of the whole server lifetime.
+class HotKeyTracker {
+private:
+    static constexpr size_t DEPTH = 4;
+    static constexpr size_t WIDTH = blinkdb_config::HOTKEYS_SKETCH_WIDTH;
+
+    std::vector<uint32_t> sketch;
+    std::vector<std::pair<uint64_t, std::string>> heap;
+    size_t top_k;
+    // Per-thread so the sampling decision adds no shared cache line to reads
+    static inline thread_local uint64_t access_counter = 0;
+    uint64_t samples = 0;
+    std::mutex lock;
+
+    static bool heap_compare(const std::pair<uint64_t, std::string>& a,
+                             const std::pair<uint64_t, std::string>& b) {
+        return a.first > b.first;
+    }
+
+    void decay() {
+        for (auto& counter : sketch) {
+            counter >>= 1;
+        }
+        for (auto& entry : heap) {
+            entry.first >>= 1;
+        }
+    }
+
+public:
+    explicit HotKeyTracker(size_t k = blinkdb_config::HOTKEYS_TOP_K) : sketch(DEPTH * WIDTH, 0), top_k(k) {}
+
+    void record(const std::string& key) {
+        // Sampling keeps the access path down to one thread-local increment
+        if (access_counter++ % blinkdb_config::HOTKEYS_SAMPLE_RATE != 0) {
+            return;
+        }
+
+        size_t h = std::hash<std::string>{}(key);
+        size_t h1 = h & 0xffffffff;
+        size_t h2 = (h >> 32) | 1;
+
+        std::lock_guard<std::mutex> guard(lock);
+        uint64_t estimate = UINT64_MAX;
+        for (size_t i = 0; i < DEPTH; ++i) {
+            uint32_t& counter = sketch[i * WIDTH + (h1 + i * h2) % WIDTH];
+            if (counter != UINT32_MAX) ++counter;
+            estimate = std::min<uint64_t>(estimate, counter);
+        }
+
+        auto it = std::find_if(heap.begin(), heap.end(),
+                               [&key](const auto& entry) { return entry.second == key; });
+        if (it != heap.end()) {
+            it->first = estimate;
+            std::make_heap(heap.begin(), heap.end(), heap_compare);
+        } else if (heap.size() < top_k) {
+            heap.emplace_back(estimate, key);
+            std::push_heap(heap.begin(), heap.end(), heap_compare);
+        } else if (estimate > heap.front().first) {
+            std::pop_heap(heap.begin(), heap.end(), heap_compare);
+            heap.back() = {estimate, key};
+            std::push_heap(heap.begin(), heap.end(), heap_compare);
+        }
+
+        if (++samples % blinkdb_config::HOTKEYS_DECAY_INTERVAL == 0) {
+            decay();
+        }
+    }
+
+    // Returns the tracked keys ordered by estimated access count (scaled by the sample rate)
+    std::vector<std::pair<std::string, uint64_t>> top(size_t count) {
+        std::lock_guard<std::mutex> guard(lock);
+        std::vector<std::pair<uint64_t, std::string>> sorted(heap);
+        std::sort(sorted.begin(), sorted.end(), heap_compare);
+
+        std::vector<std::pair<std::string, uint64_t>> result;
+        for (size_t i = 0; i < sorted.size() && i < count; ++i) {
+            result.emplace_back(sorted[i].second, sorted[i].first * blinkdb_config::HOTKEYS_SAMPLE_RATE);
+        }
+        return result;
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> guard(lock);
+        std::fill(sketch.begin(), sketch.end(), 0);
+        heap.clear();
+        samples = 0;
+    }
+
+    uint64_t total_samples() {
+        std::lock_guard<std::mutex> guard(lock);
+        return samples;
+    }
+};
+
+// Lock statistics for one lock mode (shared or exclusive)
+struct LockModeStats {
+    std::atomic<uint64_t> acquisitions{0};
+    std::atomic<uint64_t> contended{0};
+    std::atomic<uint64_t> wait_ns{0};
+    std::atomic<uint64_t> hold_ns{0};
+    // Bucket i counts waits below 2^i microseconds; the last bucket is open ended
+    std::atomic<uint64_t> wait_histogram[blinkdb_config::LOCK_WAIT_BUCKETS]{};
+
+    void reset() {
+        acquisitions = 0;
+        contended = 0;
+        wait_ns = 0;
+        hold_ns = 0;
+        for (auto& bucket : wait_histogram) bucket = 0;
+    }
+};
+
+// Drop-in replacement for std::shared_mutex that records acquisition counts,
+// wait time histograms and hold times for both modes, broken down by the
+// command running on the acquiring thread. The uncontended path costs one
+// try_lock and two clock reads, so it is cheap enough to leave enabled.
+class InstrumentedSharedMutex {
+public:
+    enum Mode { SHARED = 0, EXCLUSIVE = 1 };
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::shared_mutex mutex;
+    LockModeStats totals[2];
+    LockModeStats per_command[blinkdb_config::LOCK_STATS_MAX_COMMANDS][2];
+
+    // Slot 0 collects acquisitions made outside of any command (load, save, INFO)
+    static inline std::mutex registry_lock;
+    static inline std::vector<std::string> command_names{"internal"};
+    static inline thread_local int current_slot = 0;
+    static inline thread_local int held_slot[2] = {0, 0};
+    static inline thread_local Clock::time_point acquired_at[2];
+
+    static size_t wait_bucket(uint64_t wait_ns) {
+        uint64_t micros = wait_ns / 1000;
+        size_t bucket = 0;
+        while (micros > 0 && bucket < blinkdb_config::LOCK_WAIT_BUCKETS - 1) {
+            micros >>= 1;
+            ++bucket;
+        }
+        return bucket;
+    }
+
+    void record_acquire(Mode mode, bool was_contended, Clock::time_point start) {
+        Clock::time_point now = Clock::now();
+        uint64_t wait = std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count();
+        acquired_at[mode] = now;
+        held_slot[mode] = current_slot;
+
+        for (LockModeStats* stats : {&totals[mode], &per_command[current_slot][mode]}) {
+            stats->acquisitions.fetch_add(1, std::memory_order_relaxed);
+            if (was_contended) stats->contended.fetch_add(1, std::memory_order_relaxed);
+            stats->wait_ns.fetch_add(wait, std::memory_order_relaxed);
+            stats->wait_histogram[wait_bucket(wait)].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void record_release(Mode mode) {
+        uint64_t hold = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now() - acquired_at[mode]).count();
+        totals[mode].hold_ns.fetch_add(hold, std::memory_order_relaxed);
+        per_command[held_slot[mode]][mode].hold_ns.fetch_add(hold, std::memory_order_relaxed);
+    }
+
+    static std::string format_stats(const LockModeStats& stats) {
+        std::string result = "acquisitions=" + std::to_string(stats.acquisitions.load())
+                           + ",contended=" + std::to_string(stats.contended.load())
+                           + ",wait_us=" + std::to_string(stats.wait_ns.load() / 1000)
+                           + ",hold_us=" + std::to_string(stats.hold_ns.load() / 1000);
+        for (size_t i = 0; i < blinkdb_config::LOCK_WAIT_BUCKETS; ++i) {
+            uint64_t count = stats.wait_histogram[i].load();
+            if (count == 0) continue;
+            std::string bound = (i == blinkdb_config::LOCK_WAIT_BUCKETS - 1) ? "inf" : std::to_string(1ULL << i) + "us";
+            result += ",wait_lt_" + bound + "=" + std::to_string(count);
+        }
+        return result;
+    }
+
+public:
+    // Attributes subsequent acquisitions on this thread to the given command
+    static void set_command(const std::string& name) {
+        static thread_local std::unordered_map<std::string, int> slot_cache;
+        auto it = slot_cache.find(name);
+        if (it != slot_cache.end()) {
+            current_slot = it->second;
+            return;
+        }
+
+        std::lock_guard<std::mutex> guard(registry_lock);
+        int slot = 0;
+        auto pos = std::find(command_names.begin(), command_names.end(), name);
+        if (pos != command_names.end()) {
+            slot = static_cast<int>(pos - command_names.begin());
+        } else if (command_names.size() < blinkdb_config::LOCK_STATS_MAX_COMMANDS) {
+            slot = static_cast<int>(command_names.size());
+            command_names.push_back(name);
+        }
+        slot_cache[name] = slot;
+        current_slot = slot;
+    }
+
+    static void clear_command() {
+        current_slot = 0;
+    }
+
+    // Attributes acquisitions to a command until the end of the scope
+    struct CommandScope {
+        explicit CommandScope(const std::string& name) { set_command(name); }
+        ~CommandScope() { clear_command(); }
+        CommandScope(const CommandScope&) = delete;
+        CommandScope& operator=(const CommandScope&) = delete;
+    };
+
+    void lock() {
+        Clock::time_point start = Clock::now();
+        bool was_contended = !mutex.try_lock();
+        if (was_contended) mutex.lock();
+        record_acquire(EXCLUSIVE, was_contended, start);
+    }
+
+    bool try_lock() {
+        Clock::time_point start = Clock::now();
+        if (!mutex.try_lock()) return false;
+        record_acquire(EXCLUSIVE, false, start);
+        return true;
+    }
+
+    void unlock() {
+        record_release(EXCLUSIVE);
+        mutex.unlock();
+    }
+
+    void lock_shared() {
+        Clock::time_point start = Clock::now();
+        bool was_contended = !mutex.try_lock_shared();
+        if (was_contended) mutex.lock_shared();
+        record_acquire(SHARED, was_contended, start);
+    }
+
+    bool try_lock_shared() {
+        Clock::time_point start = Clock::now();
+        if (!mutex.try_lock_shared()) return false;
+        record_acquire(SHARED, false, start);
+        return true;
+    }
+
+    void unlock_shared() {
+        record_release(SHARED);
+        mutex.unlock_shared();
+    }
+
+    const LockModeStats& stats(Mode mode) const {
+        return totals[mode];
+    }
+
+    void reset_stats() {
+        for (auto& stats : totals) stats.reset();
+        for (auto& command : per_command) {
+            for (auto& stats : command) stats.reset();
+        }
+    }
+
+    // INFO lines for the lock; per-command lines are omitted for unused commands
+    std::string report() {
+        std::string result;
+        result += "lock_shared:" + format_stats(totals[SHARED]) + "\r\n";
+        result += "lock_exclusive:" + format_stats(totals[EXCLUSIVE]) + "\r\n";
+
+        std::vector<std::string> names;
+        {
+            std::lock_guard<std::mutex> guard(registry_lock);
+            names = command_names;
+        }
+        for (size_t slot = 0; slot < names.size(); ++slot) {
+            for (Mode mode : {SHARED, EXCLUSIVE}) {
+                const LockModeStats& stats = per_command[slot][mode];
+                if (stats.acquisitions.load() == 0) continue;
+                result += "lock_cmd_" + names[slot] + (mode == SHARED ? "_shared:" : "_exclusive:")
+                        + format_stats(stats) + "\r\n";
+            }
+        }
+        return result;
+    }
+};
+
+// Records loop iterations and named internal events (snapshot, eviction,
+// rehash, ...) whose duration reaches the configured threshold, keeping the
+// latest and maximum value plus a bounded history per event.
+class LatencyMonitor {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Sample {
+        std::time_t time;
+        uint64_t latency_ms;
+    };
+
+    struct Event {
+        std::vector<Sample> history; // ring buffer of LATENCY_HISTORY_LEN samples
+        size_t next = 0;
+        Sample latest{0, 0};
+        uint64_t max_ms = 0;
+    };
+
+private:
+    std::unordered_map<std::string, Event> events;
+    std::atomic<uint64_t> threshold_ms{blinkdb_config::LATENCY_THRESHOLD_MS};
+    std::mutex lock;
+
+public:
+    static uint64_t elapsed_ms(Clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+    }
+
+    // A threshold of 0 disables the monitor
+    void set_threshold(uint64_t ms) {
+        threshold_ms = ms;
+    }
+
+    uint64_t threshold() const {
+        return threshold_ms;
+    }
+
+    void add_sample(const std::string& event, uint64_t latency_ms) {
+        uint64_t threshold = threshold_ms.load(std::memory_order_relaxed);
+        if (threshold == 0 || latency_ms < threshold) return;
+        
+        Sample sample{std::time(nullptr), latency_ms};
+        std::lock_guard<std::mutex> guard(lock);
+        Event& entry = events[event];
+        if (entry.history.size() < blinkdb_config::LATENCY_HISTORY_LEN) {
+            entry.history.push_back(sample);
+        } else {
+            entry.history[entry.next] = sample;
+        }
+        entry.next = (entry.next + 1) % blinkdb_config::LATENCY_HISTORY_LEN;
+        entry.latest = sample;
+        entry.max_ms = std::max(entry.max_ms, latency_ms);
+    }
+
+    // Records the time elapsed since `start` under the given event name
+    void add_since(const std::string& event, Clock::time_point start) {
+        add_sample(event, elapsed_ms(start));
+    }
+
+    std::vector<std::pair<std::string, Event>> latest() {
+        std::lock_guard<std::mutex> guard(lock);
+        std::vector<std::pair<std::string, Event>> result(events.begin(), events.end());
+        std::sort(result.begin(), result.end(),
+                  [](const auto& a, const auto& b) { return a.first < b.first; });
+        return result;
+    }
+
+    // Returns the history of an event, oldest sample first
+    std::vector<Sample> history(const std::string& event) {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = events.find(event);
+        if (it == events.end()) return {};
+        
+        const Event& entry = it->second;
+        std::vector<Sample> result;
+        size_t start = entry.history.size() < blinkdb_config::LATENCY_HISTORY_LEN ? 0 : entry.next;
+        for (size_t i = 0; i < entry.history.size(); ++i) {
+            result.push_back(entry.history[(start + i) % entry.history.size()]);
+        }
+        return result;
+    }
+
+    // Resets the given events, or every event when the list is empty; returns the number reset
+    size_t reset(const std::vector<std::string>& names) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (names.empty()) {
+            size_t count = events.size();
+            events.clear();
+            return count;
+        }
+        size_t count = 0;
+        for (const auto& name : names) {
+            count += events.erase(name);
+        }
+        return count;
+    }
+};
+
+// Epoch-based reclamation for lock-free readers.
+// A reader pins the current global epoch in a per-thread slot while it
+// dereferences shared objects; writers unlink objects first and then retire
+// them tagged with the epoch. The global epoch only advances once every
+// pinned reader has observed it, so objects retired two epochs back are
+// unreachable and can be freed. Slots and the epoch are process-wide, while
+// each reclaimer owns its retired list.
+class EpochReclaimer {
+private:
+    static constexpr uint64_t IDLE = 0;
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch;
+        std::atomic<bool> claimed;
+
+        Slot() : epoch(IDLE), claimed(false) {}
+    };
+
+    // Gives the thread's slot back when the thread exits
+    struct Registration {
+        Slot* slot;
+
+        Registration() : slot(nullptr) {}
+        ~Registration() {
+            if (slot) {
+                slot->epoch.store(IDLE, std::memory_order_release);
+                slot->claimed.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    struct Retired {
+        uint64_t epoch;
+        void* object;
+        void (*destroy)(void*);
+    };
+
+    static inline std::atomic<uint64_t> global_epoch{1};
+    static inline Slot slots[blinkdb_config::EPOCH_MAX_THREADS];
+    static inline std::atomic<size_t> slots_used{0};
+    static inline thread_local Registration registration;
+
+    std::vector<Retired> retired;
+    size_t next_collect = blinkdb_config::EPOCH_RECLAIM_BATCH;
+    std::mutex lock;
+
+    static Slot* local_slot() {
+        if (registration.slot) return registration.slot;
+        for (size_t i = 0; i < blinkdb_config::EPOCH_MAX_THREADS; ++i) {
+            if (!slots[i].claimed.exchange(true, std::memory_order_acq_rel)) {
+                size_t used = slots_used.load();
+                while (used < i + 1 && !slots_used.compare_exchange_weak(used, i + 1)) {}
+                registration.slot = &slots[i];
+                break;
+            }
+        }
+        return registration.slot;
+    }
+
+    // Moves the global epoch forward if no reader is pinned in an older one
+    static void try_advance() {
+        uint64_t epoch = global_epoch.load();
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        size_t used = slots_used.load();
+        for (size_t i = 0; i < used; ++i) {
+            uint64_t pinned = slots[i].epoch.load(std::memory_order_acquire);
+            if (pinned != IDLE && pinned != epoch) return;
+        }
+        global_epoch.compare_exchange_strong(epoch, epoch + 1);
+    }
+
+    void collect() {
+        try_advance();
+        uint64_t epoch = global_epoch.load();
+        auto reclaimable = std::partition(retired.begin(), retired.end(),
+                                          [epoch](const Retired& r) { return r.epoch + 2 > epoch; });
+        for (auto it = reclaimable; it != retired.end(); ++it) {
+            it->destroy(it->object);
+        }
+        retired.erase(reclaimable, retired.end());
+        // Back off while readers hold the epoch so a stalled advance stays amortized
+        next_collect = std::max<size_t>(blinkdb_config::EPOCH_RECLAIM_BATCH, retired.size() * 2);
+    }
+
+public:
+    // Keeps everything reachable at pin time alive until destroyed. Not
+    // reentrant: a thread holds at most one guard at a time.
+    class Guard {
+    private:
+        Slot* slot;
+
+    public:
+        explicit Guard(Slot* s) : slot(s) {}
+        Guard(Guard&& other) noexcept : slot(other.slot) { other.slot = nullptr; }
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+        ~Guard() {
+            if (slot) slot->epoch.store(IDLE, std::memory_order_release);
+        }
+
+        // False when every slot is taken; the caller must fall back to locking
+        explicit operator bool() const { return slot != nullptr; }
+    };
+
+    EpochReclaimer() = default;
+    EpochReclaimer(const EpochReclaimer&) = delete;
+    EpochReclaimer& operator=(const EpochReclaimer&) = delete;
+
+    // The owner guarantees no reader is still pinned on its objects
+    ~EpochReclaimer() {
+        for (const auto& r : retired) {
+            r.destroy(r.object);
+        }
+    }
+
+    static Guard pin() {
+        Slot* slot = local_slot();
+        if (slot) {
+            slot->epoch.store(global_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+        return Guard(slot);
+    }
+
+    // Frees `object` once no reader can still hold it; it must already be unreachable
+    template <typename T>
+    void retire(T* object) {
+        std::lock_guard<std::mutex> guard(lock);
+        retired.push_back({global_epoch.load(), object, [](void* p) { delete static_cast<T*>(p); }});
+        if (retired.size() >= next_collect) {
+            collect();
+        }
+    }
+
+    size_t pending() {
+        std::lock_guard<std::mutex> guard(lock);
+        return retired.size();
+    }
+};
+
+// Keyspace index for lock-free readers, kept beside the store map. Each entry
+// is a node with the key's hash, a pointer to the key inside the store's map
+// node and an atomic pointer to the value. Writers are serialized by the
+// keyspace lock: they publish with release stores and retire unlinked nodes
+// and outgrown tables through the EpochReclaimer, while readers walk the
+// chains under an epoch guard without taking any lock.
+//
+// Growing is incremental. A new table twice the size is linked from the old
+// one, and every write afterwards copies READ_INDEX_MIGRATE_STEP old buckets
+// into it (plus the bucket of the key it touches) and leaves a forwarding
+// marker behind. Readers start at the oldest table and follow a marker to the
+// next table, so a key is always found in exactly one place; the old table is
+// retired once its last bucket has moved.
+class ReadIndex {
+private:
+    struct Node {
+        size_t hash;
+        const std::string* key;
+        std::atomic<const DataType*> value;
+        std::atomic<Node*> next;
+
+        Node(size_t h, const std::string* k, const DataType* v, Node* n) : hash(h), key(k), value(v), next(n) {}
+
+        static void* operator new(size_t size) { return HugePageArena::allocate(size); }
+        static void operator delete(void* p, size_t size) { HugePageArena::deallocate(p, size); }
+    };
+
+    // Bucket head left in an old table once the bucket has been copied forward
+    static inline Node forwarded{0, nullptr, nullptr, nullptr};
+
+    // A bucket array; it owns the nodes still linked into it
+    struct Table {
+        size_t mask;
+        std::atomic<Node*>* buckets;
+        std::atomic<Table*> next{nullptr};  // the table this one is migrating into
+
+        explicit Table(size_t size)
+            : mask(size - 1), buckets(static_cast<std::atomic<Node*>*>(HugePageArena::allocate(size * sizeof(std::atomic<Node*>)))) {
+            for (size_t i = 0; i < size; ++i) new (&buckets[i]) std::atomic<Node*>(nullptr);
+        }
+        Table(const Table&) = delete;
+        Table& operator=(const Table&) = delete;
+
+        ~Table() {
+            for (size_t i = 0; i <= mask; ++i) {
+                Node* node = buckets[i].load(std::memory_order_relaxed);
+                if (node == &forwarded) continue;
+                while (node) {
+                    Node* next = node->next.load(std::memory_order_relaxed);
+                    delete node;
+                    node = next;
+                }
+            }
+            HugePageArena::deallocate(buckets, (mask + 1) * sizeof(std::atomic<Node*>));
+        }
+    };
+
+    EpochReclaimer& reclaimer;
+    // Where readers start: the table being migrated while a resize is in progress
+    std::atomic<Table*> table;
+    // Writer side: the table writes go to, and the next old bucket to migrate
+    Table* newest;
+    size_t migrate_cursor = 0;
+    size_t count = 0;
+
+    // Finds the link that points at `key`'s node (or the chain's null tail)
+    std::atomic<Node*>* find_link(Table* t, size_t hash, const std::string& key) const {
+        std::atomic<Node*>* link = &t->buckets[hash & t->mask];
+        for (Node* node = link->load(std::memory_order_relaxed); node; node = link->load(std::memory_order_relaxed)) {
+            if (node->hash == hash && *node->key == key) break;
+            link = &node->next;
+        }
+        return link;
+    }
+
+    // Copies one old bucket into the newest table, then forwards readers to it
+    void migrate_bucket(Table* old_table, size_t bucket) {
+        Node* node = old_table->buckets[bucket].load(std::memory_order_relaxed);
+        if (node == &forwarded) return;
+        for (Node* n = node; n; n = n->next.load(std::memory_order_relaxed)) {
+            std::atomic<Node*>& target = newest->buckets[n->hash & newest->mask];
+            target.store(new Node(n->hash, n->key, n->value.load(std::memory_order_relaxed),
+                                  target.load(std::memory_order_relaxed)),
+                         std::memory_order_release);
+        }
+        old_table->buckets[bucket].store(&forwarded, std::memory_order_release);
+        // Readers already on the old chain keep walking it until they leave their epoch
+        while (node) {
+            Node* next = node->next.load(std::memory_order_relaxed);
+            reclaimer.retire(node);
+            node = next;
+        }
+    }
+
+    // Moves the bucket `hash` maps to plus a few more while a resize is in
+    // progress, so the key's entry lives in the newest table afterwards
+    void migrate(size_t hash) {
+        Table* old_table = table.load(std::memory_order_relaxed);
+        if (old_table == newest) return;
+        migrate_bucket(old_table, hash & old_table->mask);
+        for (size_t step = 0; step < blinkdb_config::READ_INDEX_MIGRATE_STEP && migrate_cursor <= old_table->mask; ++step) {
+            migrate_bucket(old_table, migrate_cursor++);
+        }
+        while (migrate_cursor <= old_table->mask
+               && old_table->buckets[migrate_cursor].load(std::memory_order_relaxed) == &forwarded) {
+            ++migrate_cursor;
+        }
+        if (migrate_cursor > old_table->mask) {
+            table.store(newest, std::memory_order_release);
+            reclaimer.retire(old_table);
+        }
+    }
+
+    // Starts migrating into twice the buckets
+    void grow() {
+        auto* grown = new Table((newest->mask + 1) * 2);
+        newest->next.store(grown, std::memory_order_release);
+        newest = grown;
+        migrate_cursor = 0;
+    }
+
+public:
+    explicit ReadIndex(EpochReclaimer& r) : reclaimer(r), table(new Table(blinkdb_config::READ_INDEX_INITIAL_BUCKETS)) {
+        newest = table.load(std::memory_order_relaxed);
+    }
+    ReadIndex(const ReadIndex&) = delete;
+    ReadIndex& operator=(const ReadIndex&) = delete;
+
+    ~ReadIndex() {
+        Table* t = table.load(std::memory_order_relaxed);
+        if (t != newest) delete newest;
+        delete t;
+    }
+
+    // Reader side; the caller holds an epoch guard for as long as it uses the result
+    const DataType* find(const std::string& key) const {
+        size_t hash = std::hash<std::string>{}(key);
+        Table* t = table.load(std::memory_order_acquire);
+        Node* node = t->buckets[hash & t->mask].load(std::memory_order_acquire);
+        while (node == &forwarded) {
+            t = t->next.load(std::memory_order_acquire);
+            node = t->buckets[hash & t->mask].load(std::memory_order_acquire);
+        }
+        for (; node; node = node->next.load(std::memory_order_acquire)) {
+            if (node->hash == hash && *node->key == key) {
+                return node->value.load(std::memory_order_acquire);
+            }
+        }
+        return nullptr;
+    }
+
+    // Writer side: `stored_key` lives in the store's map node, which must
+    // outlive the entry (retire it rather than destroying it)
+    void put(const std::string& stored_key, const DataType* value) {
+        size_t hash = std::hash<std::string>{}(stored_key);
+        migrate(hash);
+        std::atomic<Node*>* link = find_link(newest, hash, stored_key);
+        if (Node* node = link->load(std::memory_order_relaxed)) {
+            node->value.store(value, std::memory_order_release);
+            return;
+        }
+        std::atomic<Node*>& bucket = newest->buckets[hash & newest->mask];
+        bucket.store(new Node(hash, &stored_key, value, bucket.load(std::memory_order_relaxed)),
+                     std::memory_order_release);
+        // A resize finishes long before the count doubles again
+        if (++count > newest->mask + 1 && table.load(std::memory_order_relaxed) == newest) {
+            grow();
+        }
+    }
+
+    void erase(const std::string& key) {
+        size_t hash = std::hash<std::string>{}(key);
+        migrate(hash);
+        std::atomic<Node*>* link = find_link(newest, hash, key);
+        Node* node = link->load(std::memory_order_relaxed);
+        if (!node) return;
+        link->store(node->next.load(std::memory_order_relaxed), std::memory_order_release);
+        reclaimer.retire(node);
+        --count;
+    }
+
+    // Writer side (or under the keyspace lock)
+    size_t memory_bytes() const {
+        Table* t = table.load(std::memory_order_relaxed);
+        size_t buckets = newest->mask + 1 + (t != newest ? t->mask + 1 : 0);
+        return buckets * sizeof(std::atomic<Node*>) + count * sizeof(Node);
+    }
+};
+
+// Ordered index over the keyspace for prefix enumeration: an adaptive radix
+// tree with path compression. A node stores the bytes that every key below
+// it shares after its parent's edge, so a namespace such as "user:" is kept
+// once. Children sit in a sorted array while there are at most
+// KEY_INDEX_SMALL_FANOUT of them and move to a 256-slot table beyond that.
+// Every node counts the keys in its subtree, so an ordered walk can start at
+// any rank without visiting the keys before it, or seek past a given key
+// along that key's path. Writers hold the keyspace lock exclusively, readers
+// shared.
+class KeyIndex {
+private:
+    struct Node {
+        std::string prefix;
+        bool terminal;  // a key ends at this node
+        size_t keys;    // keys ending in this subtree
+        std::vector<std::pair<unsigned char, std::unique_ptr<Node>>> small;  // sorted by edge byte
+        std::unique_ptr<std::array<std::unique_ptr<Node>, 256>> wide;
+        size_t fanout;
+
+        Node() : terminal(false), keys(0), fanout(0) {}
+
+        std::unique_ptr<Node>* find_slot(unsigned char byte) {
+            if (wide) {
+                std::unique_ptr<Node>& slot = (*wide)[byte];
+                return slot ? &slot : nullptr;
+            }
+            auto it = std::lower_bound(small.begin(), small.end(), byte,
+                                       [](const auto& entry, unsigned char b) { return entry.first < b; });
+            return it != small.end() && it->first == byte ? &it->second : nullptr;
+        }
+
+        Node* child(unsigned char byte) const {
+            if (wide) return (*wide)[byte].get();
+            auto it = std::lower_bound(small.begin(), small.end(), byte,
+                                       [](const auto& entry, unsigned char b) { return entry.first < b; });
+            return it != small.end() && it->first == byte ? it->second.get() : nullptr;
+        }
+
+        void add_child(unsigned char byte, std::unique_ptr<Node> node) {
+            ++fanout;
+            if (!wide && small.size() == blinkdb_config::KEY_INDEX_SMALL_FANOUT) {
+                wide = std::make_unique<std::array<std::unique_ptr<Node>, 256>>();
+                for (auto& [edge, grandchild] : small) (*wide)[edge] = std::move(grandchild);
+                small.clear();
+                small.shrink_to_fit();
+            }
+            if (wide) {
+                (*wide)[byte] = std::move(node);
+                return;
+            }
+            auto it = std::lower_bound(small.begin(), small.end(), byte,
+                                       [](const auto& entry, unsigned char b) { return entry.first < b; });
+            small.emplace(it, byte, std::move(node));
+        }
+
+        std::unique_ptr<Node> remove_child(unsigned char byte) {
+            std::unique_ptr<Node> removed;
+            --fanout;
+            if (wide) {
+                removed = std::move((*wide)[byte]);
+                // Back to the sorted array once it is well below the switch-over point
+                if (fanout <= blinkdb_config::KEY_INDEX_SMALL_FANOUT / 2) {
+                    for (size_t b = 0; b < 256; ++b) {
+                        if ((*wide)[b]) small.emplace_back(static_cast<unsigned char>(b), std::move((*wide)[b]));
+                    }
+                    wide.reset();
+                }
+                return removed;
+            }
+            auto it = std::lower_bound(small.begin(), small.end(), byte,
+                                       [](const auto& entry, unsigned char b) { return entry.first < b; });
+            removed = std::move(it->second);
+            small.erase(it);
+            return removed;
+        }
+
+        // Visits children in byte order until `visit` returns false
+        template <typename Visit>
+        bool for_each_child(Visit visit) const {
+            if (wide) {
+                for (size_t b = 0; b < 256; ++b) {
+                    if ((*wide)[b] && !visit(static_cast<unsigned char>(b), *(*wide)[b])) return false;
+                }
+                return true;
+            }
+            for (const auto& [edge, node] : small) {
+                if (!visit(edge, *node)) return false;
+            }
+            return true;
+        }
+    };
+
+    Node root;
+
+    // Folds a non-terminal node's only child into it, restoring path compression
+    static void merge_only_child(Node& node) {
+        unsigned char edge = 0;
+        node.for_each_child([&](unsigned char b, const Node&) {
+            edge = b;
+            return false;
+        });
+        std::unique_ptr<Node> child = node.remove_child(edge);
+        node.prefix.push_back(static_cast<char>(edge));
+        node.prefix += child->prefix;
+        node.terminal = child->terminal;
+        node.small = std::move(child->small);
+        node.wide = std::move(child->wide);
+        node.fanout = child->fanout;
+    }
+
+    // Ranked in-order walk; `skip` keys are passed over before `visit` sees any
+    template <typename Visit>
+    static bool walk(const Node& node, std::string& path, size_t& skip, Visit& visit) {
+        if (skip >= node.keys) {
+            skip -= node.keys;
+            return true;
+        }
+        if (node.terminal) {
+            if (skip > 0) {
+                --skip;
+            } else if (!visit(static_cast<const std::string&>(path))) {
+                return false;
+            }
+        }
+        return node.for_each_child([&](unsigned char edge, const Node& child) {
+            size_t length = path.size();
+            path.push_back(static_cast<char>(edge));
+            path += child.prefix;
+            bool more = walk(child, path, skip, visit);
+            path.resize(length);
+            return more;
+        });
+    }
+
+    // In-order walk of the keys below `node` that sort after `after`, where
+    // `path` (the node's own key) is a prefix of `after` and so never follows it.
+    // Subtrees wholly before `after` are skipped, those wholly after it walked
+    // in full, and only the one on its path is descended into.
+    template <typename Visit>
+    static bool walk_after(const Node& node, std::string& path, const std::string& after, Visit& visit) {
+        return node.for_each_child([&](unsigned char edge, const Node& child) {
+            size_t length = path.size();
+            path.push_back(static_cast<char>(edge));
+            path += child.prefix;
+            bool more = true;
+            size_t common = std::min(path.size(), after.size());
+            int order = path.compare(0, common, after, 0, common);
+            if (order > 0 || (order == 0 && path.size() > after.size())) {
+                size_t skip = 0;
+                more = walk(child, path, skip, visit);
+            } else if (order == 0) {
+                more = walk_after(child, path, after, visit);
+            }
+            path.resize(length);
+            return more;
+        });
+    }
+
+    // Finds the subtree holding every key that starts with `prefix`, and the key bytes leading to it
+    const Node* find_prefix(const std::string& prefix, std::string& path) const {
+        const Node* node = &root;
+        size_t depth = 0;
+        while (depth < prefix.size()) {
+            const Node* next = node->child(static_cast<unsigned char>(prefix[depth]));
+            if (!next) return nullptr;
+            ++depth;
+            size_t common = std::min(next->prefix.size(), prefix.size() - depth);
+            if (next->prefix.compare(0, common, prefix, depth, common) != 0) return nullptr;
+            path.push_back(prefix[depth - 1]);
+            path += next->prefix;
+            depth += next->prefix.size();
+            node = next;
+        }
+        return node;
+    }
+
+    static size_t node_bytes(const Node& node) {
+        size_t bytes = sizeof(Node) + string_heap_bytes(node.prefix)
+                     + node.small.capacity() * sizeof(node.small.front())
+                     + (node.wide ? sizeof(*node.wide) : 0);
+        node.for_each_child([&](unsigned char, const Node& child) {
+            bytes += node_bytes(child);
+            return true;
+        });
+        return bytes;
+    }
+
+public:
+    KeyIndex() = default;
+    KeyIndex(const KeyIndex&) = delete;
+    KeyIndex& operator=(const KeyIndex&) = delete;
+
+    size_t size() const { return root.keys; }
+
+    bool contains(const std::string& key) const {
+        std::string path;
+        const Node* node = find_prefix(key, path);
+        return node && node->terminal && path.size() == key.size();
+    }
+
+    // Returns false when the key was already indexed
+    bool insert(const std::string& key) {
+        if (contains(key)) return false;
+        Node* node = &root;
+        size_t depth = 0;
+        while (true) {
+            ++node->keys;
+            if (depth == key.size()) {
+                node->terminal = true;
+                return true;
+            }
+            unsigned char byte = static_cast<unsigned char>(key[depth]);
+            std::unique_ptr<Node>* slot = node->find_slot(byte);
+            if (!slot) {
+                auto leaf = std::make_unique<Node>();
+                leaf->prefix = key.substr(depth + 1);
+                leaf->terminal = true;
+                leaf->keys = 1;
+                node->add_child(byte, std::move(leaf));
+                return true;
+            }
+            ++depth;
+            Node* next = slot->get();
+            size_t common = 0;
+            while (common < next->prefix.size() && depth + common < key.size()
+                   && next->prefix[common] == key[depth + common]) {
+                ++common;
+            }
+            if (common < next->prefix.size()) {
+                // The key leaves the compressed path part way: split it at the divergence
+                auto split = std::make_unique<Node>();
+                split->prefix = next->prefix.substr(0, common);
+                split->keys = next->keys;
+                unsigned char edge = static_cast<unsigned char>(next->prefix[common]);
+                next->prefix.erase(0, common + 1);
+                split->add_child(edge, std::move(*slot));
+                *slot = std::move(split);
+                next = slot->get();
+            }
+            depth += common;
+            node = next;
+        }
+    }
+
+    // Returns false when the key was not indexed
+    bool erase(const std::string& key) {
+        if (!contains(key)) return false;
+        std::vector<std::pair<Node*, unsigned char>> path;  // each node with the edge taken out of it
+        Node* node = &root;
+        size_t depth = 0;
+        while (true) {
+            --node->keys;
+            if (depth == key.size()) break;
+            unsigned char byte = static_cast<unsigned char>(key[depth]);
+            path.emplace_back(node, byte);
+            node = node->child(byte);
+            depth += 1 + node->prefix.size();
+        }
+        node->terminal = false;
+
+        if (node != &root && node->fanout == 0) {
+            auto [parent, edge] = path.back();
+            parent->remove_child(edge);
+            node = parent;
+        }
+        if (node != &root && !node->terminal && node->fanout == 1) {
+            merge_only_child(*node);
+        }
+        return true;
+    }
+
+    void clear() {
+        root = Node();
+    }
+
+    // Number of keys starting with `prefix`
+    size_t count_prefix(const std::string& prefix) const {
+        std::string path;
+        const Node* node = find_prefix(prefix, path);
+        return node ? node->keys : 0;
+    }
+
+    // Visits the keys starting with `prefix` in byte order, beginning after
+    // the first `skip` of them, until `visit` returns false
+    template <typename Visit>
+    void visit_prefix(const std::string& prefix, size_t skip, Visit visit) const {
+        std::string path;
+        const Node* node = find_prefix(prefix, path);
+        if (node) walk(*node, path, skip, visit);
+    }
+
+    // Visits the keys starting with `prefix` that sort after `after`, in byte
+    // order, until `visit` returns false. `after` need not be indexed any
+    // more, so a walk can resume behind a key that was removed meanwhile.
+    template <typename Visit>
+    void visit_prefix_after(const std::string& prefix, const std::string& after, Visit visit) const {
+        std::string path;
+        const Node* node = find_prefix(prefix, path);
+        if (!node) return;
+        size_t common = std::min(path.size(), after.size());
+        int order = path.compare(0, common, after, 0, common);
+        if (order > 0 || (order == 0 && path.size() > after.size())) {
+            size_t skip = 0;
+            walk(*node, path, skip, visit);
+        } else if (order == 0) {
+            walk_after(*node, path, after, visit);
+        }
+    }
+
+    size_t memory_bytes() const {
+        return node_bytes(root) - sizeof(Node);
+    }
+};
+
+enum class FieldIndexType { EQUALITY, NUMERIC };
+
+// One condition of an index query: the indexed field equals `value`, or,
+// with `range`, holds a number within [min, max]. Equality on a numeric
+// index compares numbers, so "5" matches "5.0".
+struct FieldPredicate {
+    std::string index;
+    bool range = false;
+    std::string value;
+    double min = 0;
+    double max = 0;
+};
+
+struct FieldIndexInfo {
+    std::string name;
+    std::string prefix;
+    std::string field;
+    FieldIndexType type;
+    size_t keys;
+};
+
+// Secondary index over one hash field of the keys starting with a prefix.
+// An equality index groups keys by the field's exact value; a numeric index
+// keeps (number, key) pairs ordered for range lookups and leaves out values
+// that do not parse as numbers. Each key's indexed value is kept as well, so
+// updates and removals find the old entry and intersections can test a key
+// without a keyspace lookup. Guarded by the keyspace lock like KeyIndex.
+class FieldIndex {
+private:
+    std::string key_prefix;
+    std::string field_name;
+    FieldIndexType index_type;
+    std::unordered_map<std::string, std::string> current;
+    std::unordered_map<std::string, std::unordered_set<std::string>> by_value;
+    std::set<std::pair<double, std::string>> by_number;
+
+    static std::optional<double> parse_number(const std::string& value) {
+        if (value.empty() || std::isspace(static_cast<unsigned char>(value[0]))) return std::nullopt;
+        char* end = nullptr;
+        double number = std::strtod(value.c_str(), &end);
+        if (end != value.c_str() + value.size() || std::isnan(number)) return std::nullopt;
+        return number;
+    }
+
+    // The numeric bounds a predicate selects; empty when nothing can match
+    static std::optional<std::pair<double, double>> bounds(const FieldPredicate& predicate) {
+        if (predicate.range) return std::make_pair(predicate.min, predicate.max);
+        auto number = parse_number(predicate.value);
+        if (!number) return std::nullopt;
+        return std::make_pair(*number, *number);
+    }
+
+    void unlink(const std::string& key, const std::string& value) {
+        if (index_type == FieldIndexType::EQUALITY) {
+            auto it = by_value.find(value);
+            it->second.erase(key);
+            if (it->second.empty()) by_value.erase(it);
+        } else if (auto number = parse_number(value)) {
+            by_number.erase({*number, key});
+        }
+    }
+
+public:
+    FieldIndex(const std::string& prefix, const std::string& field, FieldIndexType type)
+        : key_prefix(prefix), field_name(field), index_type(type) {}
+
+    const std::string& prefix() const { return key_prefix; }
+    const std::string& field() const { return field_name; }
+    FieldIndexType type() const { return index_type; }
+    // Keys actually indexed; a numeric index leaves out values that are not numbers
+    size_t size() const { return index_type == FieldIndexType::NUMERIC ? by_number.size() : current.size(); }
+
+    bool covers(const std::string& key) const {
+        return key.compare(0, key_prefix.size(), key_prefix) == 0;
+    }
+
+    // Indexes `value` as the key's field, replacing any earlier value
+    void update(const std::string& key, const std::string& value) {
+        auto [it, inserted] = current.try_emplace(key, value);
+        if (!inserted) {
+            if (it->second == value) return;
+            unlink(key, it->second);
+            it->second = value;
+        }
+        if (index_type == FieldIndexType::EQUALITY) {
+            by_value[value].insert(key);
+        } else if (auto number = parse_number(value)) {
+            by_number.emplace(*number, key);
+        }
+    }
+
+    void remove(const std::string& key) {
+        auto it = current.find(key);
+        if (it == current.end()) return;
+        unlink(key, it->second);
+        current.erase(it);
+    }
+
+    bool matches(const std::string& key, const FieldPredicate& predicate) const {
+        auto it = current.find(key);
+        if (it == current.end()) return false;
+        if (index_type == FieldIndexType::EQUALITY) return it->second == predicate.value;
+        auto number = parse_number(it->second);
+        auto range = bounds(predicate);
+        return number && range && *number >= range->first && *number <= range->second;
+    }
+
+    // Number of keys matching `predicate`, counting no further than `limit`
+    size_t count(const FieldPredicate& predicate, size_t limit) const {
+        if (index_type == FieldIndexType::EQUALITY) {
+            auto it = by_value.find(predicate.value);
+            return it == by_value.end() ? 0 : std::min(limit, it->second.size());
+        }
+        size_t matched = 0;
+        visit(predicate, [&](const std::string&) { return ++matched < limit; });
+        return matched;
+    }
+
+    // Visits the keys matching `predicate` (in value order for a numeric
+    // index) until `visit` returns false
+    template <typename Visit>
+    void visit(const FieldPredicate& predicate, Visit visit) const {
+        if (index_type == FieldIndexType::EQUALITY) {
+            auto it = by_value.find(predicate.value);
+            if (it == by_value.end()) return;
+            for (const auto& key : it->second) {
+                if (!visit(key)) return;
+            }
+            return;
+        }
+        auto range = bounds(predicate);
+        if (!range) return;
+        for (auto it = by_number.lower_bound({range->first, std::string()});
+             it != by_number.end() && it->first <= range->second; ++it) {
+            if (!visit(it->second)) return;
+        }
+    }
+
+    size_t memory_bytes() const {
+        // Ordered set nodes carry a color word and three links
+        constexpr size_t tree_node_overhead = 4 * sizeof(void*);
+        size_t bytes = sizeof(*this) + current.bucket_count() * sizeof(void*)
+                     + by_value.bucket_count() * sizeof(void*);
+        for (const auto& [key, value] : current) {
+            bytes += HASH_NODE_OVERHEAD + sizeof(std::pair<const std::string, std::string>)
+                   + string_heap_bytes(key) + string_heap_bytes(value);
+        }
+        for (const auto& [value, keys] : by_value) {
+            bytes += HASH_NODE_OVERHEAD + sizeof(std::pair<const std::string, std::unordered_set<std::string>>)
+                   + string_heap_bytes(value) + keys.bucket_count() * sizeof(void*);
+            for (const auto& key : keys) bytes += HASH_NODE_OVERHEAD + sizeof(std::string) + string_heap_bytes(key);
+        }
+        for (const auto& [number, key] : by_number) {
+            bytes += tree_node_overhead + sizeof(std::pair<double, std::string>) + string_heap_bytes(key);
+        }
+        return bytes;
+    }
+};
+
+// Main database class supporting multiple data types. BlinkDB forwards its
+// typed API here; the server and the benchmarks use the rest directly.
+class BlinkDBEngine {
+private:
+    using Store = std::unordered_map<std::string, std::unique_ptr<DataType>, std::hash<std::string>,
+                                     std::equal_to<std::string>,
+                                     HugePageAllocator<std::pair<const std::string, std::unique_ptr<DataType>>>>;
+
+    Store store;
+    // Lock-free view of the store for GET; removed map nodes and replaced
+    // values are retired through `reclaimer` instead of being freed in place
+    EpochReclaimer reclaimer;
+    ReadIndex read_index{reclaimer};
+    // Ordered key index for prefix scans, when enabled
+    std::unique_ptr<KeyIndex> key_index;
+    // Secondary indexes over hash fields, by name
+    std::map<std::string, std::unique_ptr<FieldIndex>> field_indexes;
+    LRUCache cache;
+    BloomFilter bloom_filter;
+    HotKeyTracker hot_keys;
+    LatencyMonitor latency_monitor;
+    InstrumentedSharedMutex rw_lock;
+    std::string persistence_file;
+    std::vector<std::string> memory_prefixes;
+    std::mutex memory_prefixes_lock;
+    // Readers touch the LRU list under a shared rw_lock or none at all, so it
+    // needs its own lock
+    std::mutex cache_lock;
+    std::function<void(const std::string&)> list_listener;
+    
+    // Records a key access for LRU ordering and hot key sampling
+    void touch(const std::string& key);
+
+    void evict_if_needed();
+
+    // Finds the value stored under a key, firing the keyspace lookup probe
+    DataType* lookup(const std::string& key);
+
+    // Inserts or replaces a value and publishes it to the read index,
+    // recording hash table growth as a rehash event
+    void store_value(const std::string& key, std::unique_ptr<DataType> value);
+
+    // Refreshes the LRU position of a key read without the keyspace lock
+    void touch_unlocked(const std::string& key);
+
+    // 1 in this many lock-free reads refreshes the LRU; see set_lru_read_sampling
+    static inline std::atomic<size_t> lru_read_sample_rate{1};
+
+    // Removes a key from the store and the read index; the caller holds rw_lock exclusively
+    bool remove_key(const std::string& key);
+
+    // Re-indexes a key's hash fields after its value was replaced or loaded
+    void index_fields(const std::string& key, const DataType& value);
+
+    // Returns the value under a key as T, nullptr when missing; throws WrongTypeError on a type mismatch
+    template <typename T>
+    T* lookup_as(const std::string& key, ValueType type);
+
+    // As lookup_as, but creates an empty value when the key is missing
+    template <typename T>
+    T* lookup_or_create(const std::string& key, ValueType type);
+
+    // Lock-free string read: passes the value to `read` while an epoch guard
+    // keeps it alive; returns false when the key is missing
+    template <typename Read>
+    bool read_string(const std::string& key, Read read);
+
+public:
+    // An empty persistence file disables loading and saving (embedded use, benchmarks)
+    explicit BlinkDBEngine(const std::string& file = "blinkdb_data.txt");
+    ~BlinkDBEngine();
+
+    BlinkDBEngine(const BlinkDBEngine&) = delete;
+    BlinkDBEngine& operator=(const BlinkDBEngine&) = delete;
+
+    // Typed operations: missing keys map to std::nullopt, zero or an empty
+    // container, and commands against a key of another type throw WrongTypeError
+
+    // Basic operations
+    void set(const std::string& key, const std::string& value);
+    // Lock-free: reads the read index under an epoch guard instead of rw_lock
+    std::optional<std::string> get(const std::string& key);
+    // Same lookup, returning the value RESP-encoded: values of STRING_SHARED_MIN
+    // bytes or more share the stored buffer instead of being copied, smaller
+    // ones are encoded into `encoded` (null is returned for both a small value
+    // and a missing key, which leaves `encoded` empty)
+    std::shared_ptr<const BulkString> get_shared(const std::string& key, std::string& encoded);
+    // Returns whether the key existed
+    bool del(const std::string& key);
+    std::optional<ValueType> type(const std::string& key);
+
+    // List operations; push returns the new length
+    size_t lpush(const std::string& key, const std::string& value);
+    size_t rpush(const std::string& key, const std::string& value);
+    std::optional<std::string> lpop(const std::string& key);
+    std::optional<std::string> rpop(const std::string& key);
+    std::optional<std::string> lindex(const std::string& key, int index);
+    size_t llen(const std::string& key);
+    std::vector<std::string> lrange(const std::string& key, int start, int end);
+
+    // Set operations; add and remove return whether the set changed
+    bool sadd(const std::string& key, const std::string& value);
+    bool sismember(const std::string& key, const std::string& value);
+    bool srem(const std::string& key, const std::string& value);
+    size_t scard(const std::string& key);
+    std::vector<std::string> smembers(const std::string& key);
+
+    // Hash operations; hset returns whether the field is new
+    bool hset(const std::string& key, const std::string& field, const std::string& value);
+    std::optional<std::string> hget(const std::string& key, const std::string& field);
+    bool hexists(const std::string& key, const std::string& field);
+    bool hdel(const std::string& key, const std::string& field);
+    size_t hlen(const std::string& key);
+    std::vector<std::string> hkeys(const std::string& key);
+    std::vector<std::string> hvals(const std::string& key);
+    std::unordered_map<std::string, std::string> hgetall(const std::string& key);
+
+    // Bulk-loads `count` synthetic keys named prefix:0 .. prefix:count-1, each
+    // holding a `size` byte value (or one element of that size for list, set
+    // and hash). Values are built outside the lock by a set of threads that
+    // is reused for every POPULATE_BATCH keys; each batch is then inserted
+    // under one exclusive lock, released before the next, and its new keys
+    // are appended to the LRU. Existing keys are left untouched, as in
+    // Redis, and keys rejected by `include` are skipped. Returns the number
+    // of keys added.
+    size_t populate(size_t count, const std::string& prefix, size_t size, ValueType type,
+                    const std::function<bool(const std::string&)>& include = nullptr);
+
+    // Called with every key that LPUSH, RPUSH or POPULATE added list elements
+    // to, after the keyspace lock is released, on the thread that wrote them.
+    // Set before the engine is shared; snapshots load in the constructor,
+    // before anyone can listen.
+    void set_list_listener(std::function<void(const std::string&)> listener);
+
+    // Moves every key for which `destination` names another engine into that
+    // engine, replacing any value it holds there, and returns how many moved.
+    // Used to repartition keys after the partitioning changed; neither engine
+    // may be in use by another thread meanwhile.
+    size_t move_keys(const std::function<BlinkDBEngine*(const std::string&)>& destination);
+
+    // Visits the entries of up to `count` hash buckets starting at `cursor`
+    // under a shared lock and returns the cursor to resume from (0 once the
+    // walk is complete). The lock is released between calls so long walks do
+    // not block writers; a rehash in between may skip or repeat some keys.
+    size_t scan_buckets(size_t cursor, size_t count,
+                        const std::function<void(const std::string&, const DataType&)>& visit);
+
+    // Builds the ordered key index from the current keyspace and keeps it
+    // up to date from then on; KEYS and SCAN then walk only matching keys
+    void enable_key_index();
+    bool has_key_index();
+
+    // Process-wide. By default (rate 1) every GET moves its key to the front
+    // of the LRU list, so eviction is exact LRU. A rate N > 1 refreshes only
+    // 1 in N lock-free reads per thread and skips the refresh when cache_lock
+    // is contended: readers stop serializing on that lock, but a key read
+    // only while others hold it can age out as if it were never read.
+    static void set_lru_read_sampling(size_t rate);
+
+    // Whether the LRU list tracks the key, i.e. it is a candidate for eviction
+    bool lru_tracks(const std::string& key);
+
+    // Keys matching a glob pattern (as in Redis KEYS). With the key index, a
+    // pattern whose only wildcard is a trailing '*' visits just the keys under
+    // its prefix, in key order.
+    std::vector<std::string> keys(const std::string& pattern);
+
+    // One SCAN step over up to `count` keys, appending those matching
+    // `pattern` to `out`; returns the cursor for the next step, "0" when done.
+    // Cursors are decimal strings, "0" to start. With the key index the walk
+    // is ordered and limited to the pattern's literal prefix, and the cursor
+    // encodes the last key visited ("1" followed by each byte as three
+    // digits), so keys removed between steps never shift the walk. Without
+    // it, the cursor is a hash bucket position. Throws std::invalid_argument
+    // for a malformed cursor.
+    std::string scan(const std::string& cursor, size_t count, const std::string& pattern,
+                     std::vector<std::string>& out);
+
+    // Secondary indexes over the hash field `field` of keys starting with
+    // `prefix`. Creating one backfills it from the matching keys (walking
+    // only that prefix when the key index is enabled); from then on HSET,
+    // HDEL and key removal keep it current. Returns false when the name is taken.
+    bool create_index(const std::string& name, const std::string& prefix, const std::string& field,
+                      FieldIndexType type);
+    bool drop_index(const std::string& name);
+    std::vector<FieldIndexInfo> list_indexes();
+    // Keys satisfying every predicate, at most `limit` of them (0 for all).
+    // The most selective predicate is enumerated and the others are checked
+    // per key. Throws std::invalid_argument for an unknown index or a range
+    // over an equality index.
+    std::vector<std::string> query_index(const std::vector<FieldPredicate>& predicates, size_t limit = 0);
+
+    size_t dbsize();
+    LatencyMonitor& latency();
+    size_t keyspace_buckets();
+
+    // Memory introspection
+    static size_t key_overhead(const std::string& key);
+    // Returns -1 when the key does not exist
+    long long memory_usage(const std::string& key, size_t samples);
+    void set_memory_prefixes(const std::vector<std::string>& prefixes);
+    // Allocator-level totals reported by glibc malloc
+    static std::string allocator_stats();
+    // Walks the keyspace in MEMORY_STATS_BATCH bucket steps and reports
+    // dataset usage per type and per configured key prefix
+    std::string memory_stats();
+
+    // Server introspection
+    std::vector<std::pair<std::string, uint64_t>> hotkeys(size_t count);
+    void reset_hotkeys();
+    void reset_lockstats();
+    const LockModeStats& lock_stats(InstrumentedSharedMutex::Mode mode) const;
+    // Builds the INFO text; an empty section selects every section
+    std::string info(const std::string& section);
+
+    // Persistence operations; save returns false when the snapshot could not be written
+    bool save_to_disk();
+    void load_from_disk();
+};
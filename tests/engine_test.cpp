@@ -0,0 +1,272 @@
+// Behavior tests for the embeddable engine (lib/blinkdb.h, the C API in
+// lib/blinkdb_c.h and the engine internals behind them), run in process,
+// mostly against engines without a persistence file.
+#include "../lib/blinkdb.h"
+#include "../lib/blinkdb_c.h"
+#include "../lib/blinkdb_internal.h"
+
+#include "test_common.h"
+
+TEST(typed_api_maps_missing_keys_and_wrong_types) {
+    BlinkDB db("");
+    CHECK(!db.get("missing"));
+    CHECK_EQ(db.llen("missing"), size_t(0));
+    CHECK(db.smembers("missing").empty());
+    CHECK(!db.type("missing"));
+
+    db.set("name", "blink");
+    CHECK_EQ(db.get("name").value_or(""), std::string("blink"));
+    CHECK_EQ(db.rpush("list", "b"), size_t(1));
+    CHECK_EQ(db.lpush("list", "a"), size_t(2));
+    CHECK(db.lrange("list", 0, -1) == (std::vector<std::string>{"a", "b"}));
+    CHECK(db.sadd("set", "x"));
+    CHECK(!db.sadd("set", "x"));
+    CHECK(db.hset("hash", "f", "v"));
+    CHECK_EQ(db.hget("hash", "f").value_or(""), std::string("v"));
+    CHECK(db.type("hash") == ValueType::HASH);
+    CHECK_EQ(db.dbsize(), size_t(4));
+
+    bool threw = false;
+    try {
+        db.lpush("name", "x");
+    } catch (const WrongTypeError&) {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK_EQ(db.get("name").value_or(""), std::string("blink"));
+    CHECK(db.del("name"));
+    CHECK(!db.del("name"));
+}
+
+static int collect_value(void* ctx, const char* value, size_t value_len) {
+    static_cast<std::vector<std::string>*>(ctx)->emplace_back(value, value_len);
+    return 0;
+}
+
+TEST(c_api_reports_status_codes_and_persists_on_close) {
+    char scratch[] = "/tmp/blinkdb-test-XXXXXX";
+    REQUIRE(mkdtemp(scratch));
+    std::string path = std::string(scratch) + "/data.txt";
+
+    blinkdb_t* db = blinkdb_open(path.c_str());
+    REQUIRE(db);
+    // Embedded NULs survive the (pointer, length) interface
+    std::string value("a\0b", 3);
+    CHECK_EQ(blinkdb_set(db, "k", 1, value.data(), value.size()), BLINKDB_OK);
+    char* out = nullptr;
+    size_t out_len = 0;
+    REQUIRE(blinkdb_get(db, "k", 1, &out, &out_len) == BLINKDB_OK);
+    CHECK_EQ(std::string(out, out_len), value);
+    blinkdb_free(out);
+    CHECK_EQ(blinkdb_get(db, "none", 4, &out, &out_len), BLINKDB_NOT_FOUND);
+    CHECK_EQ(blinkdb_llen(db, "k", 1, &out_len), BLINKDB_WRONGTYPE);
+
+    size_t length = 0;
+    blinkdb_rpush(db, "list", 4, "one", 3, &length);
+    blinkdb_rpush(db, "list", 4, "two", 3, &length);
+    CHECK_EQ(length, size_t(2));
+    std::vector<std::string> elements;
+    CHECK_EQ(blinkdb_lrange(db, "list", 4, 0, -1, collect_value, &elements), BLINKDB_OK);
+    CHECK(elements == (std::vector<std::string>{"one", "two"}));
+    int changed = 0;
+    CHECK_EQ(blinkdb_sadd(db, "set", 3, "m", 1, &changed), BLINKDB_OK);
+    CHECK_EQ(changed, 1);
+    CHECK_EQ(blinkdb_dbsize(db), size_t(3));
+    CHECK_EQ(blinkdb_save(db), BLINKDB_OK);
+    blinkdb_close(db);
+
+    db = blinkdb_open(path.c_str());
+    REQUIRE(db);
+    CHECK_EQ(blinkdb_dbsize(db), size_t(3));
+    int member = 0;
+    CHECK_EQ(blinkdb_sismember(db, "set", 3, "m", 1, &member), BLINKDB_OK);
+    CHECK_EQ(member, 1);
+    blinkdb_close(db);
+
+    // In-memory engines have nothing to save to
+    db = blinkdb_open(nullptr);
+    CHECK_EQ(blinkdb_save(db), BLINKDB_ERROR);
+    blinkdb_close(db);
+
+    // A snapshot that cannot be written is reported, not only logged
+    db = blinkdb_open((std::string(scratch) + "/missing/data.txt").c_str());
+    REQUIRE(db);
+    CHECK_EQ(blinkdb_set(db, "k", 1, "v", 1), BLINKDB_OK);
+    CHECK_EQ(blinkdb_save(db), BLINKDB_ERROR);
+    blinkdb_close(db);
+    std::system(("rm -rf " + std::string(scratch)).c_str());
+}
+
+TEST(hotkeys_ranks_most_accessed_key_first) {
+    BlinkDBEngine db("");
+    db.set("hot", "1");
+    for (int i = 0; i < 200; ++i) db.set("cold:" + std::to_string(i), "1");
+    for (int i = 0; i < 5000; ++i) db.get("hot");
+    auto top = db.hotkeys(3);
+    REQUIRE(!top.empty());
+    CHECK_EQ(top[0].first, std::string("hot"));
+    CHECK(top[0].second > 1000);
+
+    db.reset_hotkeys();
+    CHECK(db.hotkeys(3).empty());
+}
+
+TEST(lock_free_get_never_misses_a_key_while_the_index_grows) {
+    BlinkDBEngine db("");
+    for (int i = 0; i < 1000; ++i) db.set("stable:" + std::to_string(i), std::to_string(i));
+
+    std::atomic<bool> done{false};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> reads{0};
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 2; ++r) {
+        readers.emplace_back([&, r] {
+            for (uint64_t i = r; !done.load(); i += 7) {
+                std::string id = std::to_string(i % 1000);
+                auto value = db.get("stable:" + id);
+                if (!value || *value != id) misses++;
+                reads++;
+            }
+        });
+    }
+    // Several doublings of the read index, each migrated while readers run.
+    // Dropping a key from the LRU list does not evict it; deletes in between
+    // touch partially moved tables.
+    for (int round = 0; round < 30; ++round) {
+        std::string prefix = "grow" + std::to_string(round);
+        db.populate(10000, prefix, 4, ValueType::STRING);
+        for (int i = 0; i < 10000; i += 3) db.del(prefix + ":" + std::to_string(i));
+    }
+    done = true;
+    for (auto& reader : readers) reader.join();
+    CHECK_EQ(misses.load(), 0u);
+    CHECK(reads.load() > 0);
+    for (int round = 0; round < 30; round += 7) {
+        for (int i = 0; i < 10000; i += 97) {
+            CHECK_EQ(db.get("grow" + std::to_string(round) + ":" + std::to_string(i)).has_value(), i % 3 != 0);
+        }
+    }
+    CHECK_EQ(db.dbsize(), 1000u + 30u * 6666u);
+}
+
+TEST(lock_free_get_keeps_exact_lru_order_by_default) {
+    BlinkDBEngine db("");
+    for (size_t i = 0; i < blinkdb_config::CACHE_SIZE; ++i) db.set("k:" + std::to_string(i), "v");
+    // Reading the oldest key makes k:1 the next one evicted
+    REQUIRE(db.get("k:0"));
+    db.set("new", "v");
+    CHECK(db.lru_tracks("k:0"));
+    CHECK(!db.lru_tracks("k:1"));
+    CHECK(db.lru_tracks("new"));
+}
+
+// Runs a SCAN to completion with `count` keys per step, calling `between`
+// after every step; returns the keys seen and how often each came back
+static std::map<std::string, int> scan_all(BlinkDBEngine& db, const std::string& pattern, size_t count,
+                                           const std::function<void()>& between) {
+    std::map<std::string, int> seen;
+    std::string cursor = "0";
+    int steps = 0;
+    do {
+        std::vector<std::string> batch;
+        cursor = db.scan(cursor, count, pattern, batch);
+        for (const auto& key : batch) seen[key]++;
+        between();
+        REQUIRE(++steps < 100000);
+    } while (cursor != "0");
+    return seen;
+}
+
+TEST(key_index_scan_returns_each_surviving_key_once_under_deletes) {
+    BlinkDBEngine db("");
+    db.enable_key_index();
+    db.populate(500, "user", 4, ValueType::STRING);
+    db.populate(100, "other", 4, ValueType::STRING);
+
+    // Every step deletes the next three keys in order, and now and then a key
+    // already returned, so the keys behind the cursor keep shrinking
+    std::vector<std::string> ordered = db.keys("user:*");
+    REQUIRE(ordered.size() == 500);
+    std::set<std::string> deleted;
+    size_t next_delete = 0;
+    auto seen = scan_all(db, "user:*", 7, [&] {
+        for (int i = 0; i < 3 && next_delete < ordered.size(); ++i, next_delete += 5) {
+            db.del(ordered[next_delete]);
+            deleted.insert(ordered[next_delete]);
+        }
+    });
+    for (const auto& key : ordered) {
+        if (!deleted.count(key)) CHECK_EQ(seen[key], 1);
+    }
+    for (const auto& [key, times] : seen) {
+        CHECK(key.rfind("user:", 0) == 0);
+        CHECK_EQ(times, 1);
+    }
+
+    // Deleting exactly the key a cursor points at still resumes behind it
+    std::vector<std::string> batch;
+    std::string cursor = db.scan("0", 1, "other:*", batch);
+    REQUIRE(batch.size() == 1 && cursor != "0");
+    db.del(batch[0]);
+    std::vector<std::string> next;
+    db.scan(cursor, 1, "other:*", next);
+    REQUIRE(next.size() == 1);
+    CHECK(next[0] > batch[0]);
+
+    bool rejected = false;
+    try {
+        db.scan("12", 1, "*", batch);
+    } catch (const std::invalid_argument&) {
+        rejected = true;
+    }
+    CHECK(rejected);
+}
+
+TEST(hash_table_scan_returns_each_key_once) {
+    BlinkDBEngine db("");
+    db.populate(300, "k", 4, ValueType::STRING);
+    auto seen = scan_all(db, "*", 5, [] {});
+    CHECK_EQ(seen.size(), size_t(300));
+    for (const auto& [key, times] : seen) CHECK_EQ(times, 1);
+}
+
+TEST(field_index_queries_and_counts_only_indexed_values) {
+    BlinkDBEngine db("");
+    for (int i = 0; i < 30; ++i) {
+        std::string key = "user:" + std::to_string(i);
+        db.hset(key, "city", i % 3 == 0 ? "paris" : "rome");
+        db.hset(key, "age", i < 20 ? std::to_string(i) : "unknown");
+    }
+    db.hset("other:0", "city", "paris");
+    REQUIRE(db.create_index("by_city", "user:", "city", FieldIndexType::EQUALITY));
+    REQUIRE(db.create_index("by_age", "user:", "age", FieldIndexType::NUMERIC));
+    CHECK(!db.create_index("by_age", "user:", "age", FieldIndexType::NUMERIC));
+
+    std::map<std::string, size_t> counts;
+    for (const auto& info : db.list_indexes()) counts[info.name] = info.keys;
+    CHECK_EQ(counts["by_city"], size_t(30));
+    CHECK_EQ(counts["by_age"], size_t(20));
+
+    FieldPredicate paris{"by_city", false, "paris", 0, 0};
+    FieldPredicate teens{"by_age", true, "", 10, 19};
+    auto keys = db.query_index({paris, teens}, 0);
+    std::set<std::string> found(keys.begin(), keys.end());
+    CHECK(found == (std::set<std::string>{"user:12", "user:15", "user:18"}));
+    CHECK_EQ(db.query_index({paris}, 4).size(), size_t(4));
+
+    // Updates and removals move keys between values
+    db.hset("user:12", "city", "rome");
+    db.hset("user:25", "age", "16");
+    db.del("user:18");
+    keys = db.query_index({paris, teens}, 0);
+    CHECK(std::set<std::string>(keys.begin(), keys.end()) == std::set<std::string>{"user:15"});
+    for (const auto& info : db.list_indexes()) counts[info.name] = info.keys;
+    CHECK_EQ(counts["by_age"], size_t(20));
+
+    CHECK(db.drop_index("by_age"));
+    CHECK(!db.drop_index("by_age"));
+}
+
+int main(int argc, char** argv) {
+    return run_tests(argc, argv);
+}
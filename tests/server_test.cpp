@@ -0,0 +1,763 @@
+// Behavior tests for the server: each test starts ./blinkdb (or
+// $BLINKDB_SERVER) in a scratch directory and talks RESP to it on port 9001.
+#include "test_common.h"
+
+TEST(hotkeys_command_and_info) {
+    TestServer server;
+    TestClient client;
+    client.command("SET hot 1");
+    client.command("SET cold 1");
+    for (int i = 0; i < 2000; ++i) client.send("GET hot");
+    for (int i = 0; i < 2000; ++i) client.read_reply();
+
+    auto top = resp_values(client.command("HOTKEYS 1"));
+    REQUIRE(top.size() == 2);
+    CHECK_EQ(top[0], std::string("hot"));
+    CHECK(std::stoll(top[1]) > 100);
+
+    std::string info = resp_values(client.command("INFO hotkeys"))[0];
+    CHECK(info_field(info, "hotkey_0").find("key=hot,") == 0);
+
+    CHECK_EQ(client.command("HOTKEYS abc"), std::string("-ERR value is not an integer\r\n"));
+    CHECK_EQ(client.command("HOTKEYS -1"), std::string("-ERR value is not an integer\r\n"));
+    CHECK_EQ(client.command("HOTKEYS RESET"), std::string("+OK\r\n"));
+    CHECK_EQ(client.command("HOTKEYS"), std::string("*0\r\n"));
+}
+
+TEST(memory_usage_and_stats_break_down_the_dataset) {
+    TestServer server;
+    TestClient client;
+    client.command("SET plain " + std::string(200, 'v'));
+    client.command("HSET user:1 name ann");
+    client.command("HSET user:2 name bob");
+    client.command("RPUSH user:list a");
+
+    auto usage = client.command("MEMORY USAGE plain");
+    REQUIRE(usage[0] == ':');
+    CHECK(std::stoll(usage.substr(1)) > 200);
+    CHECK(client.command("MEMORY USAGE user:1 SAMPLES 0")[0] == ':');
+    CHECK_EQ(client.command("MEMORY USAGE missing"), std::string("$-1\r\n"));
+    CHECK_EQ(client.command("MEMORY USAGE plain SAMPLES many"), std::string("-ERR value is not an integer\r\n"));
+    CHECK_EQ(client.command("MEMORY USAGE plain COUNT 1"), std::string("-ERR syntax error\r\n"));
+
+    CHECK_EQ(client.command("MEMORY PREFIXES user:"), std::string("+OK\r\n"));
+    std::string stats = resp_values(client.command("MEMORY STATS"))[0];
+    CHECK_EQ(info_field(stats, "dataset_keys"), std::string("4"));
+    CHECK(info_field(stats, "type_hash").find("keys=2,") == 0);
+    CHECK(info_field(stats, "type_string").find("keys=1,") == 0);
+    CHECK(info_field(stats, "prefix_user:").find("keys=3,") == 0);
+    CHECK(info_field(stats, "prefix_other").find("keys=1,") == 0);
+    CHECK_EQ(client.command("MEMORY DOCTOR"), std::string("-ERR unknown MEMORY subcommand 'doctor'\r\n"));
+}
+
+TEST(analyze_reports_largest_keys_per_type) {
+    TestServer server;
+    TestClient client;
+    for (int i = 0; i < 300; ++i) client.send("SET item:" + std::to_string(i) + " value");
+    for (int i = 0; i < 300; ++i) client.read_reply();
+    client.command("SET huge " + std::string(5000, 'h'));
+    for (int i = 0; i < 50; ++i) client.command("RPUSH long " + std::to_string(i));
+    client.command("RPUSH short x");
+
+    CHECK_EQ(client.command("ANALYZE START 1 x"), std::string("-ERR value is not an integer\r\n"));
+    CHECK_EQ(client.command("ANALYZE START 2 100"), std::string("+OK\r\n"));
+    std::string status;
+    bool finished = wait_until([&] {
+        status = resp_values(client.command("ANALYZE STATUS"))[0];
+        return info_field(status, "analyzer_running") == "0";
+    });
+    REQUIRE(finished);
+    CHECK_EQ(info_field(status, "analyzer_keys_scanned"), std::string("303"));
+
+    std::string report = resp_values(client.command("ANALYZE REPORT"))[0];
+    CHECK_EQ(info_field(report, "string_keys"), std::string("301"));
+    CHECK_EQ(info_field(report, "list_keys"), std::string("2"));
+    CHECK_EQ(info_field(report, "list_elements"), std::string("51"));
+    CHECK(info_field(report, "string_largest_0").find("key=huge,") == 0);
+    CHECK(info_field(report, "list_largest_0").find("key=long,") == 0);
+    CHECK(info_field(report, "list_largest_1").find("key=short,") == 0);
+    CHECK(info_field(report, "list_largest_2").empty());
+    CHECK_EQ(info_field(report, "ttl_distribution"), std::string("no_expiry=303"));
+    CHECK_EQ(client.command("ANALYZE STOP"), std::string("+OK\r\n"));
+}
+
+// Pushes `count` elements onto `key`, pipelined in batches
+static void fill_list(TestClient& client, const std::string& key, int count) {
+    for (int done = 0; done < count; done += 1000) {
+        for (int i = done; i < done + 1000 && i < count; ++i) client.send("RPUSH " + key + " " + std::to_string(i));
+        for (int i = done; i < done + 1000 && i < count; ++i) client.read_reply();
+    }
+}
+
+TEST(latency_monitor_records_slow_events_and_watchdog_stacks) {
+    TestServer server;
+    TestClient client;
+    fill_list(client, "big", 200000);
+    CHECK_EQ(client.command("LATENCY THRESHOLD soon"), std::string("-ERR value is not an integer\r\n"));
+    CHECK_EQ(client.command("LATENCY THRESHOLD 1"), std::string("+OK\r\n"));
+    CHECK_EQ(client.command("LATENCY WATCHDOG 1"), std::string("+OK\r\n"));
+    CHECK_EQ(client.command("LATENCY STACK"), std::string("$-1\r\n"));
+
+    // Long enough to pass both the 1 ms threshold and the 1 ms watchdog period
+    CHECK_EQ(resp_values(client.command("LRANGE big 0 -1", 30000)).size(), size_t(200000));
+    auto latest = resp_values(client.command("LATENCY LATEST"));
+    CHECK(std::find(latest.begin(), latest.end(), "command") != latest.end());
+    CHECK(std::find(latest.begin(), latest.end(), "event-loop") != latest.end());
+    auto history = resp_values(client.command("LATENCY HISTORY command"));
+    REQUIRE(history.size() >= 2);
+    CHECK(std::stoll(history[1]) >= 1);
+    // The watchdog samples the loop from another thread, so give it a few more stalls to catch
+    CHECK(wait_until([&] {
+        if (client.command("LATENCY STACK").find("WATCHDOG") != std::string::npos) return true;
+        client.command("LRANGE big 0 -1", 30000);
+        return false;
+    }, 20000));
+
+    CHECK_EQ(client.command("LATENCY RESET command"), std::string(":1\r\n"));
+    CHECK_EQ(client.command("LATENCY HISTORY command"), std::string("*0\r\n"));
+    CHECK_EQ(client.command("LATENCY THRESHOLD 0"), std::string("+OK\r\n"));
+    client.command("LATENCY RESET");
+    client.command("LRANGE big 0 -1", 30000);
+    CHECK_EQ(client.command("LATENCY LATEST"), std::string("*0\r\n"));
+}
+
+TEST(usdt_probes_are_registered_when_built_with_sdt) {
+    std::string notes;
+    FILE* pipe = popen("readelf -n ./blinkdb 2>/dev/null", "r");
+    REQUIRE(pipe);
+    char chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), pipe)) > 0) notes.append(chunk, n);
+    pclose(pipe);
+    // Without <sys/sdt.h> the probes compile away and leave no notes
+    if (notes.find("stapsdt") == std::string::npos) return;
+    for (const char* probe : {"command__start", "command__done", "keyspace__lookup", "evict", "conn__accept",
+                              "conn__close", "snapshot__save__begin", "snapshot__save__end",
+                              "snapshot__load__begin", "snapshot__load__end"}) {
+        if (notes.find(std::string("Name: ") + probe + "\n") == std::string::npos) {
+            test_fail(__FILE__, __LINE__, std::string("missing probe ") + probe);
+        }
+    }
+}
+
+// Number after the first "key": in a tool's JSON output (NaN when missing)
+static double json_number(const std::string& json, const std::string& key, size_t from = 0) {
+    size_t pos = json.find("\"" + key + "\":", from);
+    if (pos == std::string::npos) return std::nan("");
+    return std::strtod(json.c_str() + pos + key.size() + 3, nullptr);
+}
+
+TEST(benchmark_reports_throughput_and_percentiles) {
+    TestServer server;
+    std::string output;
+    CHECK_EQ(run_tool("blinkdb-benchmark", {"--connections", "4", "--threads", "2", "--requests", "2000",
+                                            "--keyspace", "100", "--pipeline", "4", "--json"}, &output), 0);
+    CHECK_EQ(json_number(output, "requests"), 2000.0);
+    CHECK_EQ(json_number(output, "errors"), 0.0);
+    CHECK(json_number(output, "ops_per_sec") > 0);
+    double p50 = json_number(output, "p50");
+    CHECK(p50 > 0 && p50 <= json_number(output, "p99") && json_number(output, "p99") <= json_number(output, "max"));
+    CHECK(output.find("\"set\":{") != std::string::npos && output.find("\"get\":{") != std::string::npos);
+
+    output.clear();
+    CHECK_EQ(run_tool("blinkdb-benchmark", {"--connections", "2", "--threads", "1", "--requests", "500",
+                                            "--mix", "rpush:1,lrange:1", "--distribution", "zipfian",
+                                            "--keyspace", "10", "--json"}, &output), 0);
+    CHECK_EQ(json_number(output, "errors"), 0.0);
+    CHECK(output.find("\"lrange\":{") != std::string::npos);
+    TestClient client;
+    long pushed = 0;
+    for (int i = 0; i < 10; i++) {
+        pushed += std::stol(client.command("LLEN bench:list:" + std::to_string(i)).substr(1));
+    }
+    CHECK(pushed > 0);
+}
+
+TEST(microbench_filters_and_reports_per_op_costs) {
+    std::string output;
+    CHECK_EQ(run_tool("blinkdb-microbench", {"--filter", "lru/", "--min-time", "1", "--max-size", "100", "--json"}, &output), 0);
+    std::istringstream lines(output);
+    std::string line;
+    std::set<std::string> names;
+    while (std::getline(lines, line)) {
+        size_t start = line.find("\"benchmark\":\"");
+        REQUIRE(start != std::string::npos);
+        start += 13;
+        names.insert(line.substr(start, line.find('"', start) - start));
+        if (line.find("ns_per_op") != std::string::npos) CHECK(json_number(line, "ns_per_op") > 0);
+    }
+    CHECK(names.count("lru/access_hit") && names.count("lru/access_evict"));
+    for (const auto& name : names) CHECK(name.rfind("lru/", 0) == 0);
+
+    // A Bloom filter sized for its load keeps false positives near 1%
+    output.clear();
+    CHECK_EQ(run_tool("blinkdb-microbench", {"--filter", "bloom/fpr", "--max-size", "100", "--json"}, &output), 0);
+    double rate = json_number(output, "false_positive_rate");
+    CHECK(rate >= 0 && rate < 0.05);
+}
+
+TEST(persistence_bench_round_trips_every_key) {
+    char scratch[] = "/tmp/blinkdb-test-XXXXXX";
+    REQUIRE(mkdtemp(scratch));
+    std::string output;
+    CHECK_EQ(run_tool("blinkdb-persistence-bench", {"--keys", "2000", "--mix", "string:1,hash:1,list:1,set:1",
+                                                    "--file", std::string(scratch) + "/bench.txt", "--json"}, &output), 0);
+    CHECK_EQ(json_number(output, "keys"), 2000.0);
+    CHECK_EQ(json_number(output, "loaded_keys"), 2000.0);
+    CHECK(json_number(output, "file_mb") > 0);
+    CHECK(json_number(output, "save_keys_per_sec") > 0 && json_number(output, "load_keys_per_sec") > 0);
+    std::system(("rm -rf " + std::string(scratch)).c_str());
+}
+
+TEST(scaling_bench_reports_one_row_per_thread_count) {
+    std::string output;
+    CHECK_EQ(run_tool("blinkdb-scaling-bench", {"--max-threads", "2", "--keys", "1000", "--seconds", "0.2", "--json"}, &output), 0);
+    size_t second = output.find("\"threads\":2");
+    REQUIRE(output.find("\"threads\":1") != std::string::npos && second != std::string::npos);
+    CHECK_EQ(json_number(output, "speedup"), 1.0);
+    CHECK(json_number(output, "ops_per_sec") > 0 && json_number(output, "ops_per_sec", second) > 0);
+    double contended = json_number(output, "contended_percent", second);
+    CHECK(contended >= 0 && contended <= 100);
+}
+
+// Sum of the "[OP], Return=OK, N" lines of YCSB output; errors land in `errors`
+static long ycsb_ok(const std::string& output, long& errors) {
+    long ok = 0;
+    errors = 0;
+    std::istringstream lines(output);
+    std::string line;
+    while (std::getline(lines, line)) {
+        size_t pos = line.find("Return=OK, ");
+        if (pos != std::string::npos) ok += std::stol(line.substr(pos + 11));
+        pos = line.find("Return=ERROR, ");
+        if (pos != std::string::npos) errors += std::stol(line.substr(pos + 14));
+    }
+    return ok;
+}
+
+TEST(ycsb_loads_and_runs_workloads) {
+    TestServer server;
+    std::vector<std::string> common{"--threads", "2", "--recordcount", "200", "--operationcount", "500",
+                                    "--fieldcount", "3", "--fieldlength", "8"};
+    std::string output;
+    std::vector<std::string> args{"both", "--workload", "a"};
+    args.insert(args.end(), common.begin(), common.end());
+    CHECK_EQ(run_tool("blinkdb-ycsb", args, &output), 0);
+    long errors = 0;
+    // Load inserts every record, then the run phase performs every operation
+    CHECK_EQ(ycsb_ok(output, errors), 700L);
+    CHECK_EQ(errors, 0L);
+    TestClient client;
+    for (uint64_t id = 0; id < 200; id++) {
+        CHECK_EQ(client.command("HLEN user" + std::to_string(fnv1a_64(id))), std::string(":3\r\n"));
+    }
+
+    for (const std::string workload : {"b", "c", "d", "e", "f"}) {
+        output.clear();
+        args = {"run", "--workload", workload};
+        args.insert(args.end(), common.begin(), common.end());
+        CHECK_EQ(run_tool("blinkdb-ycsb", args, &output), 0);
+        CHECK_EQ(ycsb_ok(output, errors), 500L);
+        CHECK_EQ(errors, 0L);
+    }
+}
+
+TEST(memory_bench_reports_overhead_per_key_and_element) {
+    std::string output;
+    CHECK_EQ(run_tool("blinkdb-memory-bench", {"--keys", "500", "--type", "list", "--json"}, &output), 0);
+    std::istringstream lines(output);
+    std::string line;
+    std::vector<double> per_element;
+    while (std::getline(lines, line)) {
+        CHECK(line.find("\"type\":\"list\"") != std::string::npos);
+        CHECK_EQ(json_number(line, "keys"), 500.0);
+        // Every byte stored costs at least its payload
+        CHECK(json_number(line, "bytes_per_key") >= json_number(line, "payload_per_key"));
+        CHECK(json_number(line, "overhead_ratio") >= 1);
+        per_element.push_back(json_number(line, "bytes_per_element"));
+    }
+    // Larger lists amortize the per-key cost over more elements
+    REQUIRE(per_element.size() >= 2);
+    CHECK(per_element.back() < per_element.front());
+}
+
+TEST(capture_and_replay_reproduce_the_traffic) {
+    std::string file;
+    std::unique_ptr<TestServer> recorded = std::make_unique<TestServer>();
+    {
+        TestClient client;
+        file = recorded->directory() + "/traffic.cap";
+        CHECK_EQ(client.command("CAPTURE START " + file), std::string("+OK\r\n"));
+        CHECK(client.command("CAPTURE START " + file).rfind("-ERR", 0) == 0);
+        client.command("SET greeting hello");
+        // One pipelined write, replayed as one
+        client.send("RPUSH list a\r\nRPUSH list b\r\nHSET hash f v");
+        for (int i = 0; i < 3; ++i) client.read_reply();
+        TestClient other;
+        other.command("SADD set m");
+        CHECK_EQ(client.command("CAPTURE STOP"), std::string("+OK\r\n"));
+        std::string status = resp_values(client.command("CAPTURE STATUS"))[0];
+        CHECK_EQ(info_field(status, "capturing"), std::string("0"));
+        // CAPTURE STOP itself is the last record
+        CHECK_EQ(info_field(status, "records"), std::string("7"));
+    }
+    recorded->stop();
+
+    TestServer fresh;
+    std::string output;
+    CHECK_EQ(run_tool("blinkdb-replay", {file, "--speed", "0"}, &output), 0);
+    CHECK(output.find("7 captured commands on 2 connections") != std::string::npos);
+    TestClient client;
+    CHECK_EQ(client.command("GET greeting"), std::string("$5\r\nhello\r\n"));
+    CHECK(resp_values(client.command("LRANGE list 0 -1")) == (std::vector<std::string>{"a", "b"}));
+    CHECK_EQ(client.command("HGET hash f"), std::string("$1\r\nv\r\n"));
+    CHECK_EQ(client.command("SISMEMBER set m"), std::string(":1\r\n"));
+}
+
+static void check_populate(const std::vector<std::string>& args) {
+    TestServer server(args);
+    TestClient client;
+    CHECK_EQ(client.command("SET p:7 mine"), std::string("+OK\r\n"));
+    CHECK_EQ(client.command("DEBUG POPULATE 2000 p 10"), std::string("+OK\r\n"));
+    CHECK_EQ(client.command("DEBUG POPULATE 10 l 0 list"), std::string("+OK\r\n"));
+    CHECK_EQ(client.command("DEBUG POPULATE 10 h 0 hash"), std::string("+OK\r\n"));
+    CHECK_EQ(client.command("DEBUG POPULATE 10 s 0 set"), std::string("+OK\r\n"));
+
+    size_t strings = 0;
+    for (int i = 0; i <= 2000; i++) {
+        if (client.command("TYPE p:" + std::to_string(i)) == "+string\r\n") strings++;
+    }
+    CHECK_EQ(strings, size_t(2000));
+    CHECK_EQ(client.command("GET p:5"), std::string("$10\r\nvalue:5000\r\n"));
+    CHECK_EQ(client.command("GET p:1999"), std::string("$10\r\nvalue:1999\r\n"));
+    // Existing keys are left alone
+    CHECK_EQ(client.command("GET p:7"), std::string("$4\r\nmine\r\n"));
+    CHECK_EQ(client.command("LRANGE l:3 0 -1"), std::string("*1\r\n$7\r\nvalue:3\r\n"));
+    CHECK_EQ(client.command("HGET h:3 field"), std::string("$7\r\nvalue:3\r\n"));
+    CHECK_EQ(client.command("SISMEMBER s:3 value:3"), std::string(":1\r\n"));
+
+    CHECK_EQ(client.command("DEBUG POPULATE lots p 0"), std::string("-ERR value is not an integer\r\n"));
+    CHECK_EQ(client.command("DEBUG POPULATE 10 p"), std::string("-ERR wrong number of arguments for 'debug populate'\r\n"));
+    CHECK_EQ(client.command("DEBUG POPULATE 1 z 0 zset"), std::string("-ERR unknown type 'zset'\r\n"));
+}
+
+TEST(debug_populate_creates_synthetic_keys) {
+    check_populate({});
+}
+
+TEST(debug_populate_creates_synthetic_keys_across_shards) {
+    check_populate({"--shards", "4"});
+}
+
+// Writes one bench-compare result file with a single lower-is-better metric
+static void write_bench_results(const std::string& path, const std::string& revision,
+                                const std::vector<double>& samples) {
+    std::ofstream file(path);
+    file << "{\"revision\":\"" << revision << "\",\"metric\":\"get_p99_us\",\"higher_is_better\":false,\"samples\":[";
+    for (size_t i = 0; i < samples.size(); ++i) file << (i ? "," : "") << samples[i];
+    file << "]}\n";
+}
+
+TEST(bench_compare_flags_only_significant_regressions) {
+    char scratch[] = "/tmp/blinkdb-test-XXXXXX";
+    REQUIRE(mkdtemp(scratch));
+    std::string dir = scratch;
+    write_bench_results(dir + "/base.jsonl", "base", {100, 101, 99, 100, 100});
+    write_bench_results(dir + "/same.jsonl", "same", {100, 99, 101, 100, 100});
+    write_bench_results(dir + "/noisy.jsonl", "noisy", {80, 140, 90, 130, 100});
+    write_bench_results(dir + "/slow.jsonl", "slow", {120, 121, 119, 120, 120});
+
+    std::string output;
+    CHECK_EQ(run_tool("blinkdb-bench-compare", {"compare", dir + "/base.jsonl", dir + "/same.jsonl", "--threshold", "5"}, &output), 0);
+    CHECK(output.find("no regressions") != std::string::npos);
+    // A higher mean whose confidence interval still spans zero is not a regression
+    CHECK_EQ(run_tool("blinkdb-bench-compare", {"compare", dir + "/base.jsonl", dir + "/noisy.jsonl", "--threshold", "5"}), 0);
+    output.clear();
+    CHECK_EQ(run_tool("blinkdb-bench-compare", {"compare", dir + "/base.jsonl", dir + "/slow.jsonl", "--threshold", "5"}, &output), 1);
+    CHECK(output.find("REGRESSION") != std::string::npos);
+    // Under the threshold the same slowdown passes
+    CHECK_EQ(run_tool("blinkdb-bench-compare", {"compare", dir + "/base.jsonl", dir + "/slow.jsonl", "--threshold", "25"}), 0);
+    CHECK_EQ(run_tool("blinkdb-bench-compare", {"compare", dir + "/missing.jsonl", dir + "/slow.jsonl"}), 2);
+    std::system(("rm -rf " + dir).c_str());
+}
+
+TEST(blocking_pops_wait_for_pushes_without_stalling_the_loop) {
+    TestServer server;
+    TestClient waiter;
+    TestClient other;
+
+    auto start = std::chrono::steady_clock::now();
+    CHECK_EQ(waiter.command("BLPOP empty 0.2"), std::string("*-1\r\n"));
+    CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(150));
+    CHECK_EQ(waiter.command("BLPOP empty soon"), std::string("-ERR timeout is not a float or out of range\r\n"));
+    CHECK_EQ(waiter.command("BLPOP empty -1"), std::string("-ERR timeout is negative\r\n"));
+
+    // A suspended pop holds back only its own connection's later commands
+    waiter.send("BLPOP queue 0\r\nPING");
+    CHECK_EQ(waiter.read_reply(200), std::string(""));
+    CHECK_EQ(other.command("PING"), std::string("+PONG\r\n"));
+    TestClient later;
+    later.send("BRPOP queue 0");
+    CHECK_EQ(other.command("RPUSH queue first"), std::string(":1\r\n"));
+    CHECK_EQ(waiter.read_reply(), std::string("*2\r\n$5\r\nqueue\r\n$5\r\nfirst\r\n"));
+    CHECK_EQ(waiter.read_reply(), std::string("+PONG\r\n"));
+    // The longest waiting client is served first, the next one on the next push
+    CHECK_EQ(later.read_reply(200), std::string(""));
+    other.command("RPUSH queue second");
+    CHECK_EQ(later.read_reply(), std::string("*2\r\n$5\r\nqueue\r\n$6\r\nsecond\r\n"));
+    CHECK_EQ(other.command("LLEN queue"), std::string(":0\r\n"));
+
+    // A client that loses the pushed element to another keeps its place in line
+    waiter.send("BLPOP line 0");
+    CHECK_EQ(waiter.read_reply(100), std::string(""));
+    later.send("BLPOP line 0");
+    CHECK_EQ(later.read_reply(100), std::string(""));
+    other.send("RPUSH line taken\r\nLPOP line");
+    CHECK_EQ(other.read_reply(), std::string(":1\r\n"));
+    CHECK_EQ(other.read_reply(), std::string("$5\r\ntaken\r\n"));
+    other.command("RPUSH line mine");
+    CHECK_EQ(waiter.read_reply(), std::string("*2\r\n$4\r\nline\r\n$4\r\nmine\r\n"));
+    other.command("RPUSH line next");
+    CHECK_EQ(later.read_reply(), std::string("*2\r\n$4\r\nline\r\n$4\r\nnext\r\n"));
+
+    // Pushes the engine makes on other threads wake waiters too
+    waiter.send("BLPOP gen:3 0");
+    CHECK_EQ(waiter.read_reply(100), std::string(""));
+    CHECK_EQ(other.command("DEBUG POPULATE 5 gen 0 list"), std::string("+OK\r\n"));
+    CHECK_EQ(waiter.read_reply(), std::string("*2\r\n$5\r\ngen:3\r\n$7\r\nvalue:3\r\n"));
+
+    // A client that disconnects while blocked does not swallow later pushes
+    {
+        TestClient gone;
+        gone.send("BLPOP abandoned 0");
+        CHECK_EQ(other.command("PING"), std::string("+PONG\r\n"));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    other.command("RPUSH abandoned kept");
+    CHECK_EQ(other.command("LLEN abandoned"), std::string(":1\r\n"));
+    CHECK(server.alive());
+}
+
+// CPUs the main thread of a process may run on, as a kernel CPU list
+static std::string allowed_cpus(pid_t pid) {
+    std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("Cpus_allowed_list:", 0) == 0) return line.substr(line.find_first_not_of(" \t", 18));
+    }
+    return "";
+}
+
+TEST(cpu_pinning_and_numa_info) {
+    {
+        TestServer server;
+        TestClient client;
+        std::string info = resp_values(client.command("INFO numa"))[0];
+        CHECK_EQ(info_field(info, "loop_cpus"), std::string("any"));
+        CHECK_EQ(info_field(info, "numa_policy"), std::string("default"));
+    }
+    {
+        TestServer server({"--loop-cpus", "0", "--background-cpus", "0"});
+        CHECK_EQ(allowed_cpus(server.process()), std::string("0"));
+        TestClient client;
+        client.command("DEBUG POPULATE 1000 numa 4096");
+        std::string info = resp_values(client.command("INFO numa"))[0];
+        CHECK(info.rfind("# Numa\r\n", 0) == 0);
+        CHECK(std::stoi(info_field(info, "numa_nodes")) >= 1);
+        CHECK_EQ(info_field(info, "loop_cpus"), std::string("0"));
+        CHECK_EQ(info_field(info, "background_cpus"), std::string("0"));
+        CHECK(std::stoul(info_field(info, "numa_sampled_pages")) > 0);
+        double ratio = std::stod(info_field(info, "numa_cross_node_ratio"));
+        CHECK(ratio >= 0 && ratio <= 1);
+        // Pinned background work (MEMORY STATS runs on the scheduler's worker) still completes
+        CHECK(client.command("MEMORY STATS").rfind("$", 0) == 0);
+    }
+    {
+        // Each shard takes one CPU of the list
+        TestServer server({"--shards", "2", "--loop-cpus", "0"});
+        TestClient client;
+        CHECK_EQ(client.command("SET k v"), std::string("+OK\r\n"));
+        CHECK_EQ(info_field(resp_values(client.command("INFO numa"))[0], "loop_cpus"), std::string("0"));
+    }
+    CHECK_EQ(run_tool("blinkdb", {"--loop-cpus", "2-1"}), 1);
+    CHECK_EQ(run_tool("blinkdb", {"--background-cpus", "x"}), 1);
+}
+
+TEST(huge_page_arena_reports_coverage) {
+    for (const std::string mode : {"off", "thp", "hugetlb"}) {
+        TestServer server({"--huge-pages", mode});
+        TestClient client;
+        CHECK_EQ(client.command("DEBUG POPULATE 20000 huge 64"), std::string("+OK\r\n"));
+        CHECK_EQ(client.command("GET huge:19999"), std::string("$64\r\nvalue:19999" + std::string(53, '0') + "\r\n"));
+        std::string stats = resp_values(client.command("MEMORY STATS"))[0];
+        REQUIRE(stats.find("# Hugepages\r\n") != std::string::npos);
+        CHECK_EQ(info_field(stats, "hugepages_mode"), mode);
+        size_t arena = std::stoull(info_field(stats, "hugepages_arena_bytes"));
+        size_t backed = std::stoull(info_field(stats, "hugepages_backed_bytes"));
+        double coverage = std::stod(info_field(stats, "hugepages_coverage"));
+        // Whether THP actually backs the arena is up to the kernel's settings,
+        // and hugetlb falls back to THP once the reserved pool runs out
+        CHECK(backed <= arena);
+        CHECK(coverage >= 0 && coverage <= 1);
+        if (mode == "off") {
+            CHECK_EQ(arena, size_t(0));
+        } else {
+            CHECK(arena >= 20000 * 64);
+        }
+    }
+    CHECK_EQ(run_tool("blinkdb", {"--huge-pages", "always"}), 1);
+}
+
+TEST(lockstats_attribute_acquisitions_to_commands) {
+    TestServer server;
+    TestClient client;
+    client.command("SET a 1");
+    client.command("HSET h f v");
+    std::string info = resp_values(client.command("INFO lockstats"))[0];
+    CHECK(info_field(info, "lock_cmd_set_exclusive").find("acquisitions=1,") == 0);
+    CHECK(info_field(info, "lock_cmd_hset_exclusive").find("acquisitions=1,") == 0);
+    CHECK(!info_field(info, "lock_exclusive").empty());
+
+    // MEMORY STATS runs on the scheduler's worker thread but is still the MEMORY command's
+    client.command("MEMORY STATS");
+    info = resp_values(client.command("INFO lockstats"))[0];
+    CHECK(!info_field(info, "lock_cmd_memory_shared").empty());
+    CHECK(info_field(info, "lock_cmd_internal_shared").empty());
+
+    CHECK_EQ(client.command("LOCKSTATS RESET"), std::string("+OK\r\n"));
+    info = resp_values(client.command("INFO lockstats"))[0];
+    CHECK(info_field(info, "lock_cmd_set_exclusive").empty());
+}
+
+TEST(shards_queue_large_replies_for_slow_readers) {
+    TestServer server({"--shards", "2"});
+    TestClient client;
+    std::string value(8 << 20, 'x');
+    CHECK_EQ(client.command("SET big " + value), std::string("+OK\r\n"));
+
+    // Neither 8 MB reply fits in the socket buffer while the client is not reading
+    client.send("GET big");
+    client.send("GET big");
+    client.send("PING");
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    std::string expected = "$" + std::to_string(value.size()) + "\r\n" + value + "\r\n";
+    CHECK(client.read_reply() == expected);
+    CHECK(client.read_reply() == expected);
+    CHECK_EQ(client.read_reply(), std::string("+PONG\r\n"));
+}
+
+// Small values are encoded per read, large ones share the stored buffer;
+// in thread-per-core mode some of the keys live on the other shards
+static void check_get_replies(const std::vector<std::string>& args) {
+    TestServer server(args);
+    TestClient client;
+    // Either side of STRING_SHARED_MIN (1024)
+    std::vector<std::string> values = {"v", std::string(1023, 'a'), std::string(1024, 'b'), std::string(100000, 'c')};
+    for (size_t i = 0; i < values.size(); ++i) {
+        CHECK_EQ(client.command("SET key" + std::to_string(i) + " " + values[i]), std::string("+OK\r\n"));
+    }
+    for (int round = 0; round < 3; ++round) {
+        for (size_t i = 0; i < values.size(); ++i) client.send("GET key" + std::to_string(i));
+        client.send("GET missing");
+        for (const auto& value : values) {
+            CHECK(client.read_reply() == "$" + std::to_string(value.size()) + "\r\n" + value + "\r\n");
+        }
+        CHECK_EQ(client.read_reply(), std::string("$-1\r\n"));
+    }
+    // An overwritten value is not served from the old buffer
+    client.command("SET key3 short");
+    CHECK_EQ(client.command("GET key3"), std::string("$5\r\nshort\r\n"));
+    client.command("HSET hash f v");
+    CHECK(client.command("GET hash").rfind("-WRONGTYPE", 0) == 0);
+}
+
+TEST(get_replies_small_and_large_values) {
+    check_get_replies({});
+}
+
+TEST(get_replies_small_and_large_values_across_shards) {
+    check_get_replies({"--shards", "4"});
+}
+
+// A full SCAN over `pattern` deleting `deletes` each step, as a client would
+static std::map<std::string, int> scan_with_deletes(TestClient& client, const std::string& pattern,
+                                                    std::vector<std::string>& deletes) {
+    std::map<std::string, int> seen;
+    std::string cursor = "0";
+    int steps = 0;
+    do {
+        auto values = resp_values(client.command("SCAN " + cursor + " MATCH " + pattern + " COUNT 4"));
+        REQUIRE(!values.empty());
+        cursor = values[0];
+        for (size_t i = 1; i < values.size(); ++i) seen[values[i]]++;
+        for (int i = 0; i < 2 && !deletes.empty(); ++i) {
+            client.command("DEL " + deletes.back());
+            deletes.pop_back();
+        }
+        REQUIRE(++steps < 10000);
+    } while (cursor != "0");
+    return seen;
+}
+
+TEST(scan_with_key_index_survives_deletes) {
+    TestServer server({"--key-index"});
+    TestClient client;
+    CHECK_EQ(client.command("DEBUG POPULATE 200 item 0"), std::string("+OK\r\n"));
+    CHECK_EQ(client.command("DEBUG POPULATE 50 skip 0"), std::string("+OK\r\n"));
+
+    // Delete from the start of the order, i.e. keys the cursor has already passed
+    auto ordered = resp_values(client.command("KEYS item:*"));
+    REQUIRE(ordered.size() == 200);
+    std::vector<std::string> survivors(ordered.begin() + 100, ordered.end());
+    std::vector<std::string> deletes(ordered.begin(), ordered.begin() + 100);
+    std::reverse(deletes.begin(), deletes.end());
+    auto seen = scan_with_deletes(client, "item:*", deletes);
+    for (const auto& key : survivors) CHECK_EQ(seen[key], 1);
+    for (const auto& [key, times] : seen) CHECK_EQ(times, 1);
+
+    CHECK_EQ(client.command("SCAN abc"), std::string("-ERR invalid cursor\r\n"));
+    CHECK_EQ(client.command("SCAN 0 COUNT x"), std::string("-ERR value is not an integer\r\n"));
+}
+
+// The shard a --shards 4 server assigns `key` to
+static size_t shard_of(const std::string& key, size_t shards = 4) {
+    return std::hash<std::string>{}(key) % shards;
+}
+
+TEST(shards_keys_and_scan_cover_every_shard) {
+    TestServer server({"--shards", "4", "--key-index"});
+    TestClient client;
+    std::set<std::string> expected;
+    for (int i = 0; i < 40; ++i) {
+        std::string key = "key:" + std::to_string(i);
+        client.command("SET " + key + " v");
+        expected.insert(key);
+    }
+    client.command("SET other v");
+
+    auto keys = resp_values(client.command("KEYS key:*"));
+    CHECK(std::set<std::string>(keys.begin(), keys.end()) == expected);
+    CHECK_EQ(keys.size(), expected.size());
+
+    // Half the keys go away while the walk moves from shard to shard
+    std::vector<std::string> deletes;
+    for (int i = 0; i < 40; i += 2) deletes.push_back("key:" + std::to_string(i));
+    std::set<std::string> survivors;
+    for (int i = 1; i < 40; i += 2) survivors.insert("key:" + std::to_string(i));
+    auto seen = scan_with_deletes(client, "key:*", deletes);
+    for (const auto& key : survivors) CHECK_EQ(seen[key], 1);
+    for (const auto& [key, times] : seen) CHECK_EQ(times, 1);
+    CHECK_EQ(client.command("SCAN 7"), std::string("-ERR invalid cursor\r\n"));
+    for (const std::string count : {"0", "65", "-1", "4x", ""}) {
+        CHECK_EQ(run_tool("blinkdb", {"--shards", count}), 1);
+    }
+}
+
+TEST(shards_reject_blocking_pops) {
+    TestServer server({"--shards", "4"});
+    TestClient client;
+    client.command("RPUSH list x");
+    // Rejected whether or not there is something to pop
+    for (const std::string command : {"BLPOP list 0", "BRPOP list 1", "BLPOP empty other 0"}) {
+        CHECK_EQ(client.command(command), std::string("-ERR BLPOP and BRPOP are not supported with --shards\r\n"));
+    }
+    CHECK_EQ(client.command("LLEN list"), std::string(":1\r\n"));
+}
+
+TEST(shards_move_loaded_keys_to_their_owners) {
+    // A single-loop snapshot, a one-shard snapshot and one from a shard that no longer exists
+    std::string legacy, shard0, stale;
+    for (int i = 0; i < 20; ++i) {
+        legacy += "S legacy:" + std::to_string(i) + " l" + std::to_string(i) + "\n";
+        shard0 += "S moved:" + std::to_string(i) + " m" + std::to_string(i) + "\n";
+        stale += "S stale:" + std::to_string(i) + " s" + std::to_string(i) + "\n";
+    }
+    TestServer server({"--shards", "4"}, {{"blinkdb_data.txt", legacy},
+                                          {"blinkdb_data.shard0.txt", shard0},
+                                          {"blinkdb_data.shard5.txt", stale}});
+    TestClient client;
+    for (const char* name : {"legacy", "moved", "stale"}) {
+        for (int i = 0; i < 20; ++i) {
+            std::string value = std::string(1, name[0]) + std::to_string(i);
+            CHECK_EQ(client.command("GET " + std::string(name) + ":" + std::to_string(i)),
+                     "$" + std::to_string(value.size()) + "\r\n" + value + "\r\n");
+        }
+    }
+    CHECK_EQ(resp_values(client.command("KEYS *")).size(), size_t(60));
+
+    // Every shard saved its own keys, and the imported files are gone
+    for (size_t shard = 0; shard < 4; ++shard) {
+        std::ifstream file(server.directory() + "/blinkdb_data.shard" + std::to_string(shard) + ".txt");
+        std::string type, key;
+        while (file >> type >> key) {
+            CHECK_EQ(shard_of(key), shard);
+            file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        }
+    }
+    CHECK(access((server.directory() + "/blinkdb_data.txt").c_str(), F_OK) != 0);
+    CHECK(access((server.directory() + "/blinkdb_data.shard5.txt").c_str(), F_OK) != 0);
+}
+
+TEST(zerocopy_sends_complete_and_replies_stay_in_order) {
+    TestServer server({"--zerocopy-min", "4096"});
+    TestClient client;
+    std::string big(100000, 'z');
+    client.command("SET big " + big);
+    client.command("SET small s");
+    // Small replies around the large ones are coalesced, the large ones sent zero-copy
+    for (int i = 0; i < 20; ++i) {
+        client.send("GET small");
+        client.send("GET big");
+        client.send("GET small");
+    }
+    for (int i = 0; i < 20; ++i) {
+        CHECK_EQ(client.read_reply(), std::string("$1\r\ns\r\n"));
+        CHECK(client.read_reply() == "$100000\r\n" + big + "\r\n");
+        CHECK_EQ(client.read_reply(), std::string("$1\r\ns\r\n"));
+    }
+
+    // Every send is eventually reported complete (as copied, over loopback)
+    std::string info;
+    bool completed = wait_until([&] {
+        info = resp_values(client.command("INFO zerocopy"))[0];
+        return info_field(info, "zerocopy_completions") == info_field(info, "zerocopy_sends");
+    });
+    CHECK(completed);
+    CHECK(std::stoull(info_field(info, "zerocopy_sends")) >= 20);
+    CHECK_EQ(run_tool("blinkdb", {"--zerocopy-min", "-1"}), 1);
+    CHECK_EQ(run_tool("blinkdb", {"--zerocopy-min", "64k"}), 1);
+}
+
+// INDEX commands against hashes spread over the shards of a --shards 4 server
+TEST(shards_index_queries_cover_every_shard) {
+    TestServer server({"--shards", "4"});
+    TestClient client;
+    for (int i = 0; i < 40; ++i) {
+        std::string key = "user:" + std::to_string(i);
+        client.command("HSET " + key + " city " + (i % 4 == 0 ? "paris" : "rome"));
+        client.command("HSET " + key + " age " + (i < 30 ? std::to_string(i) : "unknown"));
+    }
+    CHECK_EQ(client.command("INDEX CREATE by_city user: city"), std::string("+OK\r\n"));
+    CHECK_EQ(client.command("INDEX CREATE by_age user: age NUMERIC"), std::string("+OK\r\n"));
+    CHECK(client.command("INDEX CREATE by_age user: age").rfind("-ERR", 0) == 0);
+
+    CHECK_EQ(client.command("INDEX LIST"),
+             std::string("*2\r\n*5\r\n$6\r\nby_age\r\n$5\r\nuser:\r\n$3\r\nage\r\n$7\r\nnumeric\r\n:30\r\n"
+                         "*5\r\n$7\r\nby_city\r\n$5\r\nuser:\r\n$4\r\ncity\r\n$8\r\nequality\r\n:40\r\n"));
+
+    auto paris = resp_values(client.command("INDEX QUERY by_city EQ paris"));
+    CHECK_EQ(paris.size(), size_t(10));
+    auto young = resp_values(client.command("INDEX QUERY by_city EQ paris by_age RANGE -inf (20"));
+    CHECK(std::set<std::string>(young.begin(), young.end())
+          == (std::set<std::string>{"user:0", "user:4", "user:8", "user:12", "user:16"}));
+    CHECK_EQ(resp_values(client.command("INDEX QUERY by_city EQ rome LIMIT 7")).size(), size_t(7));
+    CHECK_EQ(client.command("INDEX QUERY by_city NEAR paris"), std::string("-ERR syntax error\r\n"));
+
+    CHECK_EQ(client.command("INDEX DROP by_age"), std::string(":1\r\n"));
+    CHECK_EQ(client.command("INDEX DROP by_age"), std::string(":0\r\n"));
+    CHECK_EQ(resp_values(client.command("INDEX LIST")).size(), size_t(5));
+}
+
+int main(int argc, char** argv) {
+    return run_tests(argc, argv);
+}
@@ -0,0 +1,315 @@
+// Shared helpers for the BlinkDB behavior tests: a small test registry with
+// CHECK macros, a RESP client, and a server process started in a scratch
+// directory on port 9001.
+#pragma once
+
+#include "../bench/bench_common.h"
+
+#include <csignal>
+#include <fcntl.h>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <poll.h>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <sys/wait.h>
+#include <thread>
+
+struct TestCase {
+    std::string name;
+    std::function<void()> run;
+};
+
+inline std::vector<TestCase>& test_registry() {
+    static std::vector<TestCase> tests;
+    return tests;
+}
+
+struct TestRegistration {
+    TestRegistration(const char* name, std::function<void()> run) { test_registry().push_back({name, std::move(run)}); }
+};
+
+#define TEST(name)                                                        \
+    static void test_##name();                                            \
+    static TestRegistration register_##name(#name, test_##name);          \
+    static void test_##name()
+
+inline int& test_failures() {
+    static int failures = 0;
+    return failures;
+}
+
+// Thrown by REQUIRE to abandon the current test
+struct TestAbort : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+template <typename T>
+std::string test_describe(const T& value) {
+    std::ostringstream out;
+    if constexpr (std::is_convertible_v<T, std::string>) {
+        // Show CR/LF so RESP replies read on one line
+        for (char c : std::string(value)) {
+            if (c == '\r') out << "\\r";
+            else if (c == '\n') out << "\\n";
+            else out << c;
+        }
+    } else {
+        out << value;
+    }
+    return out.str();
+}
+
+inline void test_fail(const char* file, int line, const std::string& message) {
+    std::cerr << "  " << file << ":" << line << ": " << message << std::endl;
+    test_failures()++;
+}
+
+#define CHECK(cond)                                                                  \
+    do {                                                                             \
+        if (!(cond)) test_fail(__FILE__, __LINE__, "CHECK(" #cond ") failed");       \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                                   \
+    do {                                                                             \
+        const auto& check_actual = (actual);                                         \
+        const auto& check_expected = (expected);                                     \
+        if (!(check_actual == check_expected)) {                                     \
+            test_fail(__FILE__, __LINE__, #actual " == " #expected ": got '"         \
+                      + test_describe(check_actual) + "', expected '"                \
+                      + test_describe(check_expected) + "'");                        \
+        }                                                                            \
+    } while (0)
+
+#define REQUIRE(cond)                                                                \
+    do {                                                                             \
+        if (!(cond)) {                                                               \
+            test_fail(__FILE__, __LINE__, "REQUIRE(" #cond ") failed");              \
+            throw TestAbort(#cond);                                                  \
+        }                                                                            \
+    } while (0)
+
+// Runs every registered test whose name contains one of the arguments (all
+// of them without arguments); returns the process exit code
+inline int run_tests(int argc, char** argv) {
+    int failed = 0;
+    int ran = 0;
+    for (const auto& test : test_registry()) {
+        bool selected = argc <= 1;
+        for (int i = 1; i < argc && !selected; ++i) {
+            selected = test.name.find(argv[i]) != std::string::npos;
+        }
+        if (!selected) continue;
+
+        std::cout << "[ RUN  ] " << test.name << std::endl;
+        int before = test_failures();
+        try {
+            test.run();
+        } catch (const TestAbort&) {
+        } catch (const std::exception& e) {
+            test_fail(__FILE__, __LINE__, std::string("uncaught exception: ") + e.what());
+        }
+        ++ran;
+        bool ok = test_failures() == before;
+        if (!ok) ++failed;
+        std::cout << (ok ? "[  OK  ] " : "[ FAIL ] ") << test.name << std::endl;
+    }
+    std::cout << ran - failed << "/" << ran << " tests passed" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
+
+// Polls `condition` every 10 ms for up to `timeout_ms`
+inline bool wait_until(const std::function<bool()>& condition, int timeout_ms = 5000) {
+    for (int waited = 0; waited < timeout_ms; waited += 10) {
+        if (condition()) return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return condition();
+}
+
+// A blocking RESP connection to the server under test
+class TestClient {
+private:
+    int fd;
+    std::string buffer;
+
+public:
+    TestClient() : fd(connect_to("127.0.0.1", 9001)) {
+        if (fd == -1) throw TestAbort("cannot connect to 127.0.0.1:9001");
+    }
+    ~TestClient() {
+        if (fd != -1) close(fd);
+    }
+    TestClient(const TestClient&) = delete;
+    TestClient& operator=(const TestClient&) = delete;
+
+    int socket() const { return fd; }
+
+    void send(const std::string& command) {
+        std::string line = command + "\r\n";
+        if (!write_all(fd, line.data(), line.size())) throw TestAbort("write failed");
+    }
+
+    // The next complete reply, or "" when none arrives within `timeout_ms`
+    std::string read_reply(int timeout_ms = 5000) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (true) {
+            bool is_error = false;
+            size_t length = resp_reply_length(buffer, 0, is_error);
+            if (length > 0) {
+                std::string reply = buffer.substr(0, length);
+                buffer.erase(0, length);
+                return reply;
+            }
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            if (left.count() <= 0) return "";
+            struct pollfd pfd = {fd, POLLIN, 0};
+            if (poll(&pfd, 1, static_cast<int>(left.count())) <= 0) return "";
+            char chunk[65536];
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            if (n <= 0) return "";
+            buffer.append(chunk, n);
+        }
+    }
+
+    std::string command(const std::string& command, int timeout_ms = 5000) {
+        send(command);
+        return read_reply(timeout_ms);
+    }
+};
+
+// Elements of a RESP reply: the payload of a simple, integer or bulk reply,
+// or the flattened elements of a (possibly nested) array
+inline std::vector<std::string> resp_values(const std::string& reply) {
+    std::vector<std::string> values;
+    size_t pos = 0;
+    while (pos < reply.size()) {
+        size_t line_end = reply.find("\r\n", pos);
+        if (line_end == std::string::npos) break;
+        char type = reply[pos];
+        std::string header = reply.substr(pos + 1, line_end - pos - 1);
+        pos = line_end + 2;
+        if (type == '$') {
+            long long length = std::atoll(header.c_str());
+            if (length < 0) continue;
+            values.push_back(reply.substr(pos, length));
+            pos += length + 2;
+        } else if (type != '*') {
+            values.push_back(header);
+        }
+    }
+    return values;
+}
+
+// Value of a "name:value" line in INFO-style text ("" when missing)
+inline std::string info_field(const std::string& text, const std::string& name) {
+    std::string needle = name + ":";
+    size_t pos = 0;
+    while ((pos = text.find(needle, pos)) != std::string::npos) {
+        if (pos == 0 || text[pos - 1] == '\n') {
+            size_t end = text.find("\r\n", pos);
+            return text.substr(pos + needle.size(), end == std::string::npos ? std::string::npos : end - pos - needle.size());
+        }
+        pos += needle.size();
+    }
+    return "";
+}
+
+// Runs a tool built alongside the server (./blinkdb-benchmark, ...) and returns
+// its exit status, with its standard output in `output` when given
+inline int run_tool(const std::string& name, const std::vector<std::string>& args, std::string* output = nullptr) {
+    char cwd[4096];
+    std::string command = "'" + std::string(getcwd(cwd, sizeof(cwd)) ? cwd : ".") + "/" + name + "'";
+    for (const auto& arg : args) command += " '" + arg + "'";
+    FILE* pipe = popen((command + " 2>/dev/null").c_str(), "r");
+    if (!pipe) throw TestAbort("cannot run " + name);
+    char chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), pipe)) > 0) {
+        if (output) output->append(chunk, n);
+    }
+    int status = pclose(pipe);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// A blinkdb process in its own scratch directory. `files` are written into
+// the directory before the server starts (e.g. snapshots to load).
+class TestServer {
+private:
+    pid_t pid = -1;
+    std::string dir;
+
+public:
+    explicit TestServer(const std::vector<std::string>& args = {},
+                        const std::map<std::string, std::string>& files = {}) {
+        int probe = connect_to("127.0.0.1", 9001);
+        if (probe != -1) {
+            close(probe);
+            throw TestAbort("port 9001 is already in use");
+        }
+        char scratch[] = "/tmp/blinkdb-test-XXXXXX";
+        if (!mkdtemp(scratch)) throw TestAbort("mkdtemp failed");
+        dir = scratch;
+        for (const auto& [name, content] : files) {
+            std::ofstream(dir + "/" + name) << content;
+        }
+
+        const char* env = std::getenv("BLINKDB_SERVER");
+        char cwd[4096];
+        std::string server = env ? env : std::string(getcwd(cwd, sizeof(cwd)) ? cwd : ".") + "/blinkdb";
+        pid = fork();
+        if (pid == 0) {
+            int null_fd = open("/dev/null", O_WRONLY);
+            if (chdir(dir.c_str()) != 0 || null_fd == -1) _exit(1);
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+            std::vector<char*> argv{const_cast<char*>("blinkdb")};
+            for (const auto& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+            argv.push_back(nullptr);
+            execv(server.c_str(), argv.data());
+            _exit(1);
+        }
+        bool ready = wait_until([] {
+            int fd = connect_to("127.0.0.1", 9001);
+            if (fd == -1) return false;
+            close(fd);
+            return true;
+        });
+        if (!ready) {
+            stop();
+            throw TestAbort("server did not start");
+        }
+    }
+
+    ~TestServer() {
+        stop();
+        std::system(("rm -rf " + dir).c_str());
+    }
+
+    TestServer(const TestServer&) = delete;
+    TestServer& operator=(const TestServer&) = delete;
+
+    const std::string& directory() const { return dir; }
+    pid_t process() const { return pid; }
+
+    // True while the process has not exited
+    bool alive() {
+        return pid != -1 && waitpid(pid, nullptr, WNOHANG) == 0;
+    }
+
+    void stop() {
+        if (pid == -1) return;
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        pid = -1;
+        // Let the port go before the next server binds it
+        wait_until([] {
+            int fd = connect_to("127.0.0.1", 9001);
+            if (fd != -1) close(fd);
+            return fd == -1;
+        });
+    }
+};